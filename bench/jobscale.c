@@ -0,0 +1,204 @@
+/*
+ * Copyright (C) 2026 Vincent Sallaberry
+ * vlib <https://github.com/vsallaberry/vlib>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/* ------------------------------------------------------------------------
+ * Scaling of the work-stealing job pool, with 1, 2, 4, ... max_workers workers:
+ *   for:     vjob_parallel_for() on n elements of equal cost
+ *   skewed:  vjob_parallel_for() on n elements, the cost of element i growing with i
+ *   static:  the skewed loop split in one vjob_run() thread per worker, as before the pool
+ *   reduce:  vjob_parallel_reduce() summing n elements of equal cost
+ *   fib:     fork/join fib(30), one pooled job per call over a sequential cutoff
+ * Each figure is the best of 3 runs, in milliseconds, with the speedup over 1 worker.
+ *
+ * Build, from the vlib directory:
+ *   make OPTI=-O2
+ *   gcc -O2 -Iinclude -o jobscale bench/jobscale.c libvlib.a -lpthread -lz -lncurses -lrt -lm
+ * Usage: jobscale [max_workers [n]], default vjob_cpu_nb() workers and n = 2000000.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "vlib/job.h"
+
+#define JOBSCALE_RUNS       3
+#define JOBSCALE_FIB        30
+#define JOBSCALE_CUTOFF     18
+
+typedef struct {
+    vjob_pool_t *   pool;
+    double *        tab;
+    size_t          begin;
+    size_t          end;
+    long            n;
+} jobscale_t;
+
+static double jobscale_elt(size_t i, unsigned int cost) {
+    double x = (double) i;
+
+    for (unsigned int k = 0; k < cost; ++k)
+        x = sqrt(x + k);
+    return x;
+}
+
+static unsigned int jobscale_skew(size_t i, size_t n) {
+    return (unsigned int) (1 + (64 * i) / n);
+}
+
+static void jobscale_for(size_t b, size_t e, void * vctx) {
+    jobscale_t * ctx = (jobscale_t *) vctx;
+
+    for (size_t i = b; i < e; ++i)
+        ctx->tab[i] = jobscale_elt(i, 16);
+}
+
+static void jobscale_skewed(size_t b, size_t e, void * vctx) {
+    jobscale_t * ctx = (jobscale_t *) vctx;
+
+    for (size_t i = b; i < e; ++i)
+        ctx->tab[i] = jobscale_elt(i, jobscale_skew(i, ctx->end));
+}
+
+static void * jobscale_static(void * vctx) {
+    jobscale_t * ctx = (jobscale_t *) vctx;
+
+    for (size_t i = ctx->begin; i < ctx->end; ++i)
+        ctx->tab[i] = jobscale_elt(i, jobscale_skew(i, (size_t) ctx->n));
+    return NULL;
+}
+
+static void jobscale_sum(size_t b, size_t e, void * acc, void * vctx) {
+    (void) vctx;
+    for (size_t i = b; i < e; ++i)
+        *((double *) acc) += jobscale_elt(i, 16);
+}
+
+static void jobscale_join(void * result, const void * acc, void * vctx) {
+    (void) vctx;
+    *((double *) result) += *((const double *) acc);
+}
+
+static long jobscale_fib_seq(long n) {
+    return n < 2 ? n : jobscale_fib_seq(n - 1) + jobscale_fib_seq(n - 2);
+}
+
+static void * jobscale_fib(void * vctx) {
+    jobscale_t *    ctx = (jobscale_t *) vctx;
+    jobscale_t      sub = { .pool = ctx->pool, .n = ctx->n - 1 };
+    vjob_t *        job;
+    long            r;
+
+    if (ctx->n < JOBSCALE_CUTOFF)
+        return (void *) jobscale_fib_seq(ctx->n);
+    /* fork n-1, compute n-2 here, then join: the waiting worker runs other jobs */
+    if ((job = vjob_pool_run(ctx->pool, jobscale_fib, &sub)) == NULL)
+        return (void *) -1L;
+    r = (long) jobscale_fib(&(jobscale_t) { .pool = ctx->pool, .n = ctx->n - 2 });
+    return (void *) (r + (long) vjob_waitandfree(job));
+}
+
+static double jobscale_ms(struct timespec * t0) {
+    struct timespec t1;
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return (t1.tv_sec - t0->tv_sec) * 1e3 + (t1.tv_nsec - t0->tv_nsec) / 1e6;
+}
+
+/** run case on workers, @return the best time in ms, or -1 on error */
+static double jobscale_run(const char * name, unsigned int workers, size_t n, double * tab) {
+    double best = -1;
+
+    for (unsigned int run = 0; run < JOBSCALE_RUNS; ++run) {
+        vjob_pool_t *   pool = vjob_pool_create(workers);
+        jobscale_t      ctx = { .pool = pool, .tab = tab, .begin = 0, .end = n, .n = (long) n };
+        struct timespec t0;
+        double          ms, sum = 0;
+        int             ret = 0;
+
+        if (pool == NULL)
+            return -1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        if (strcmp(name, "for") == 0) {
+            ret = vjob_parallel_for(pool, 0, n, 0, jobscale_for, &ctx);
+        } else if (strcmp(name, "skewed") == 0) {
+            ret = vjob_parallel_for(pool, 0, n, 0, jobscale_skewed, &ctx);
+        } else if (strcmp(name, "static") == 0) {
+            jobscale_t  parts[workers];
+            vjob_t *    jobs[workers];
+
+            for (unsigned int i = 0; i < workers; ++i) {
+                parts[i] = ctx;
+                parts[i].begin = n * i / workers;
+                parts[i].end = n * (i + 1) / workers;
+                jobs[i] = vjob_run(jobscale_static, &parts[i]);
+            }
+            for (unsigned int i = 0; i < workers; ++i) {
+                if (jobs[i] == NULL)
+                    ret = -1;
+                else
+                    vjob_waitandfree(jobs[i]);
+            }
+        } else if (strcmp(name, "reduce") == 0) {
+            ret = vjob_parallel_reduce(pool, 0, n, 0, jobscale_sum, jobscale_join,
+                                       &sum, sizeof(sum), &ctx);
+        } else {
+            ctx.n = JOBSCALE_FIB;
+            ret = (long) jobscale_fib(&ctx) == jobscale_fib_seq(JOBSCALE_FIB) ? 0 : -1;
+        }
+        ms = jobscale_ms(&t0);
+        vjob_pool_free(pool);
+        if (ret != 0)
+            return -1;
+        if (best < 0 || ms < best)
+            best = ms;
+    }
+    return best;
+}
+
+int main(int argc, char ** argv) {
+    static const char * const cases[] = { "for", "skewed", "static", "reduce", "fib" };
+    unsigned int    max_workers = argc > 1 ? (unsigned int) atoi(argv[1]) : vjob_cpu_nb();
+    size_t          n = argc > 2 ? (size_t) atol(argv[2]) : 2000000;
+    double *        tab = malloc(n * sizeof(*tab));
+
+    if (tab == NULL || max_workers == 0 || n == 0) {
+        fprintf(stderr, "usage: %s [max_workers [n]]\n", argv[0]);
+        return 1;
+    }
+    printf("%-8s %8s %10s %8s\n", "case", "workers", "ms", "speedup");
+    for (unsigned int c = 0; c < sizeof(cases) / sizeof(*cases); ++c) {
+        double one = -1;
+
+        for (unsigned int workers = 1; workers <= max_workers;
+             workers = workers < max_workers && workers * 2 > max_workers ? max_workers : workers * 2) {
+            double ms = jobscale_run(cases[c], workers, n, tab);
+
+            if (ms < 0) {
+                fprintf(stderr, "%s, %u workers: error\n", cases[c], workers);
+                return 1;
+            }
+            if (one < 0)
+                one = ms;
+            printf("%-8s %8u %10.1f %8.2f\n", cases[c], workers, ms, one / ms);
+        }
+    }
+    free(tab);
+    return 0;
+}
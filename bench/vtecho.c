@@ -0,0 +1,220 @@
+/*
+ * Copyright (C) 2026 Vincent Sallaberry
+ * vlib <https://github.com/vsallaberry/vlib>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/* ------------------------------------------------------------------------
+ * Loopback TCP echo served by a vthread, for each backend and two ways of
+ * serving connections accepted with vthread_io_accept():
+ *   fd: a VTE_FD_READ callback read()s up to 64 bytes and write()s them back
+ *   io: a multishot vthread_io_read() callback sends data back with vthread_io_write()
+ * The main thread opens nconn connections, with TCP_NODELAY as the server ones,
+ * and waits until they are accepted. Then on each round it writes a 64 bytes
+ * message on every connection, and reads the replies of every connection.
+ * A figure is the median of 3 runs, in microseconds per message.
+ *
+ * Build, from the vlib directory:
+ *   make OPTI=-O2
+ *   gcc -O2 -Iinclude -o vtecho bench/vtecho.c libvlib.a -lpthread -lz -lncurses -lrt
+ * Usage: vtecho [nconn [rounds]], default 500 connections and 200 rounds.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+
+#include "vlib/thread.h"
+#include "vlib/util.h"
+
+#define VTECHO_RUNS     3
+#define VTECHO_MSG_SZ   64
+#define VTECHO_MAX_FD   65536
+
+static char             s_vtecho_out[VTECHO_MAX_FD][VTECHO_MSG_SZ];
+static unsigned int     s_vtecho_accepted;
+
+static int vtecho_written(vthread_t * vthread, vthread_event_t event, void * event_data, void * data) {
+    (void) vthread; (void) event; (void) event_data; (void) data;
+    return 0;
+}
+
+static int vtecho_io_read(vthread_t * vthread, vthread_event_t event, void * event_data, void * data) {
+    vthread_io_t * io = (vthread_io_t *) event_data;
+    (void) event; (void) data;
+
+    if (io->res <= 0) {
+        /* end of file or error: this is the last completion of the read */
+        close(io->fd);
+        return 0;
+    }
+    memcpy(s_vtecho_out[io->fd], io->buf, io->res);
+    vthread_io_write(vthread, io->fd, s_vtecho_out[io->fd], io->res, vtecho_written, NULL);
+    return 0;
+}
+
+static int vtecho_fd_read(vthread_t * vthread, vthread_event_t event, void * event_data, void * data) {
+    int     fd = VTE_FD_DATA(event_data);
+    ssize_t n;
+    (void) event; (void) data;
+
+    if ((n = read(fd, s_vtecho_out[fd], VTECHO_MSG_SZ)) > 0) {
+        return write(fd, s_vtecho_out[fd], n) == n ? 0 : -1;
+    }
+    /* fd events are level-triggered: stop watching a connection at end of file */
+    vthread_unregister_event(vthread, VTE_FD_READ, event_data);
+    close(fd);
+    return 0;
+}
+
+static int vtecho_accept(vthread_t * vthread, vthread_event_t event, void * event_data, void * data) {
+    vthread_io_t *  io = (vthread_io_t *) event_data;
+    int             one = 1, ret;
+    (void) event;
+
+    if (io->res < 0)
+        return 0;
+    if (io->res >= VTECHO_MAX_FD) {
+        close(io->res);
+        return 0;
+    }
+    setsockopt(io->res, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (data != NULL)
+        ret = vthread_io_read(vthread, io->res, NULL, 0, vtecho_io_read, NULL);
+    else
+        ret = vthread_register_event(vthread, VTE_FD_READ, VTE_DATA_FD(io->res), vtecho_fd_read, NULL);
+    VLIB_ATOMIC_ADD(&s_vtecho_accepted, 1);
+    return ret;
+}
+
+/** @return the microseconds per message, or -1 on error */
+static double vtecho_run(vthread_backend_t backend, int use_io, long nconn, long rounds) {
+    struct sockaddr_in  addr;
+    socklen_t           len = sizeof(addr);
+    vthread_t *         vthread = NULL;
+    int *               fds = calloc(nconn, sizeof(*fds));
+    int                 lfd = -1, one = 1;
+    long                i, r, n = 0;
+    double              us = -1;
+    char                msg[VTECHO_MSG_SZ], buf[VTECHO_MSG_SZ];
+    struct timespec     t0, t1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (fds == NULL || (lfd = socket(AF_INET, SOCK_STREAM, 0)) < 0
+    ||  bind(lfd, (struct sockaddr *) &addr, sizeof(addr)) != 0 || listen(lfd, 1024) != 0
+    ||  getsockname(lfd, (struct sockaddr *) &addr, &len) != 0) {
+        goto end;
+    }
+    fcntl(lfd, F_SETFL, O_NONBLOCK);
+    VLIB_ATOMIC_STORE(&s_vtecho_accepted, 0);
+    if ((vthread = vthread_create(0, NULL)) == NULL || vthread_set_backend(vthread, backend) != 0
+    ||  vthread_start(vthread) != 0
+    ||  vthread_io_accept(vthread, lfd, vtecho_accept, use_io ? (void *) 1 : NULL) != 0) {
+        goto end;
+    }
+    for (n = 0; n < nconn; ++n) {
+        if ((fds[n] = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+            goto end;
+        setsockopt(fds[n], IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if (connect(fds[n], (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+            close(fds[n]);
+            goto end;
+        }
+    }
+    while (VLIB_ATOMIC_LOAD(&s_vtecho_accepted) < nconn)
+        usleep(1000);
+
+    memset(msg, 'm', sizeof(msg));
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (r = 0; r < rounds; ++r) {
+        for (i = 0; i < nconn; ++i) {
+            if (write(fds[i], msg, sizeof(msg)) != sizeof(msg))
+                goto end;
+        }
+        for (i = 0; i < nconn; ++i) {
+            ssize_t got = 0, ret;
+
+            while (got < VTECHO_MSG_SZ && (ret = read(fds[i], buf + got, VTECHO_MSG_SZ - got)) > 0)
+                got += ret;
+            if (got != VTECHO_MSG_SZ)
+                goto end;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    us = ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / (nconn * rounds) / 1e3;
+end:
+    while (n > 0)
+        close(fds[--n]);
+    if (vthread != NULL)
+        vthread_stop(vthread);
+    if (lfd >= 0)
+        close(lfd);
+    free(fds);
+    return us;
+}
+
+static int vtecho_cmp(const void * a, const void * b) {
+    double da = *(const double *) a, db = *(const double *) b;
+
+    return (da > db) - (da < db);
+}
+
+int main(int argc, char ** argv) {
+    static const struct { vthread_backend_t backend; const char * name; } backends[] = {
+        { VTB_SELECT, "select" }, { VTB_EPOLL, "epoll" }, { VTB_URING, "uring" }
+    };
+    long                        nconn = argc > 1 ? atol(argv[1]) : 500;
+    long                        rounds = argc > 2 ? atol(argv[2]) : 200;
+    struct rlimit               rl;
+
+    if (nconn <= 0 || rounds <= 0) {
+        fprintf(stderr, "usage: %s [nconn [rounds]]\n", argv[0]);
+        return 1;
+    }
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+    printf("%-8s %8s %8s\n", "backend", "fd", "io");
+    for (unsigned int b = 0; b < sizeof(backends) / sizeof(*backends); ++b) {
+        printf("%-8s", backends[b].name);
+        for (int use_io = 0; use_io <= 1; ++use_io) {
+            double runs[VTECHO_RUNS];
+            int    r;
+
+            for (r = 0; r < VTECHO_RUNS
+                        && (runs[r] = vtecho_run(backends[b].backend, use_io, nconn, rounds)) >= 0; ++r)
+                ;
+            if (r < VTECHO_RUNS) {
+                printf(" %8s", "-");
+            } else {
+                qsort(runs, VTECHO_RUNS, sizeof(*runs), vtecho_cmp);
+                printf(" %8.1f", runs[VTECHO_RUNS / 2]);
+            }
+            fflush(stdout);
+        }
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2026 Vincent Sallaberry
+ * vlib <https://github.com/vsallaberry/vlib>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/* ------------------------------------------------------------------------
+ * Cost of one wakeup of a vthread loop watching N fds, for each backend:
+ * N eventfds, never written, are registered with VTE_FD_READ, and one end of
+ * a socketpair with a callback writing back each byte read. The main thread
+ * writes one byte to the other end and reads the reply, 1000 times to warm up,
+ * then 'rounds' times. A figure is the median of 3 runs, in microseconds
+ * per round trip, or '-' when the N fds cannot be registered (FD_SETSIZE for
+ * select, RLIMIT_NOFILE, raised to its hard limit, for all backends).
+ *
+ * Build, from the vlib directory:
+ *   make OPTI=-O2
+ *   gcc -O2 -Iinclude -o vtwake bench/vtwake.c libvlib.a -lpthread -lz -lncurses -lrt
+ * Usage: vtwake [rounds [N ...]], default 20000 rounds and N = 10 1000 50000.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+
+#include "vlib/thread.h"
+
+#define VTWAKE_RUNS     3
+#define VTWAKE_WARMUP   1000
+
+static int vtwake_idle(vthread_t * vthread, vthread_event_t event, void * event_data, void * data) {
+    (void) vthread; (void) event; (void) event_data; (void) data;
+    return 0;
+}
+
+static int vtwake_pong(vthread_t * vthread, vthread_event_t event, void * event_data, void * data) {
+    int     fd = VTE_FD_DATA(event_data);
+    char    c;
+    (void) vthread; (void) event; (void) data;
+
+    if (read(fd, &c, 1) == 1 && write(fd, &c, 1) != 1)
+        return -1;
+    return 0;
+}
+
+/** @return the microseconds per round trip, -1 if the fds cannot be registered */
+static double vtwake_run(vthread_backend_t backend, long nidle, long rounds) {
+    vthread_t *     vthread = vthread_create(0, NULL);
+    int *           fds = calloc(nidle > 0 ? nidle : 1, sizeof(*fds));
+    int             sv[2] = { -1, -1 };
+    double          us = -1;
+    long            i, n = 0;
+    struct timespec t0, t1;
+    char            c = 'x';
+
+    if (vthread == NULL || fds == NULL || vthread_set_backend(vthread, backend) != 0
+    ||  socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+        goto end;
+    }
+    for (n = 0; n < nidle; ++n) {
+        if ((fds[n] = eventfd(0, EFD_NONBLOCK)) < 0
+        ||  vthread_register_event(vthread, VTE_FD_READ, VTE_DATA_FD(fds[n]), vtwake_idle, NULL) != 0) {
+            if (fds[n] >= 0)
+                close(fds[n]);
+            goto end;
+        }
+    }
+    if (vthread_register_event(vthread, VTE_FD_READ, VTE_DATA_FD(sv[1]), vtwake_pong, NULL) != 0
+    ||  vthread_start(vthread) != 0) {
+        goto end;
+    }
+    for (i = -VTWAKE_WARMUP; i < rounds; ++i) {
+        if (i == 0)
+            clock_gettime(CLOCK_MONOTONIC, &t0);
+        if (write(sv[0], &c, 1) != 1 || read(sv[0], &c, 1) != 1)
+            goto end;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    us = ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / rounds / 1e3;
+end:
+    if (vthread != NULL)
+        vthread_stop(vthread);
+    while (n > 0)
+        close(fds[--n]);
+    if (sv[0] >= 0) {
+        close(sv[0]);
+        close(sv[1]);
+    }
+    free(fds);
+    return us;
+}
+
+static int vtwake_cmp(const void * a, const void * b) {
+    double da = *(const double *) a, db = *(const double *) b;
+
+    return (da > db) - (da < db);
+}
+
+int main(int argc, char ** argv) {
+    static const long           defaults[] = { 10, 1000, 50000 };
+    static const struct { vthread_backend_t backend; const char * name; } backends[] = {
+        { VTB_SELECT, "select" }, { VTB_EPOLL, "epoll" }, { VTB_URING, "uring" }
+    };
+    long                        rounds = argc > 1 ? atol(argv[1]) : 20000;
+    int                         nsizes = argc > 2 ? argc - 2 : (int) (sizeof(defaults) / sizeof(*defaults));
+    struct rlimit               rl;
+
+    if (rounds <= 0) {
+        fprintf(stderr, "usage: %s [rounds [N ...]]\n", argv[0]);
+        return 1;
+    }
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+    printf("%-8s", "N");
+    for (unsigned int b = 0; b < sizeof(backends) / sizeof(*backends); ++b)
+        printf(" %8s", backends[b].name);
+    printf("\n");
+    for (int s = 0; s < nsizes; ++s) {
+        long nidle = argc > 2 ? atol(argv[s + 2]) : defaults[s];
+
+        printf("%-8ld", nidle);
+        for (unsigned int b = 0; b < sizeof(backends) / sizeof(*backends); ++b) {
+            double runs[VTWAKE_RUNS];
+            int    r;
+
+            for (r = 0; r < VTWAKE_RUNS && (runs[r] = vtwake_run(backends[b].backend, nidle, rounds)) >= 0; ++r)
+                ;
+            if (r < VTWAKE_RUNS) {
+                printf(" %8s", "-");
+            } else {
+                qsort(runs, VTWAKE_RUNS, sizeof(*runs), vtwake_cmp);
+                printf(" %8.1f", runs[VTWAKE_RUNS / 2]);
+            }
+            fflush(stdout);
+        }
+        printf("\n");
+    }
+    return 0;
+}
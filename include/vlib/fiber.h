@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2026 Vincent Sallaberry
+ * vlib <https://github.com/vsallaberry/vlib>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/* ------------------------------------------------------------------------
+ * Fibers: stackful coroutines run by a vthread event loop, allowing
+ * blocking-style code without a thread per task. A fiber doing I/O on a
+ * non-blocking fd which would block is suspended until the vthread loop
+ * sees the fd ready.
+ *   vthread_t * vthread = vthread_create(0, NULL);
+ *   vfiber_sched_t * sched = vfiber_sched_create(vthread, 0);
+ *   vthread_start(vthread);
+ *   vfiber_spawn(sched, serve_client, client);
+ *   ... in serve_client(): while ((n = vfiber_read(fd, buf, sizeof(buf))) > 0) {
+ *                              vfiber_write(fd, buf, n); }
+ *   vthread_stop(vthread);
+ *   vfiber_sched_free(sched);
+ */
+#ifndef VLIB_FIBER_H
+#define VLIB_FIBER_H
+
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include "vlib/thread.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*****************************************************************************/
+#define VLIB_FIBER_STACK_SZ     (64 * 1024) /* default fiber stack size */
+#define VLIB_FIBER_STACK_CACHE  256         /* max number of unused stacks kept */
+
+/** opaque fiber and fiber scheduler */
+typedef struct vfiber_s         vfiber_t;
+typedef struct vfiber_sched_s   vfiber_sched_t;
+
+/** fiber function */
+typedef void    (*vfiber_fun_t)(void * data);
+
+/*****************************************************************************/
+
+/** create a fiber scheduler running fibers in the vthread loop.
+ * Must not be called from the vthread callbacks.
+ * @param vthread the vthread running fibers, see vthread_create()
+ * @param stack_size the fiber stack size, 0 for VLIB_FIBER_STACK_SZ.
+ *        Stacks are pooled and have a guard page.
+ * @return the scheduler or NULL on error */
+vfiber_sched_t *    vfiber_sched_create(
+                        vthread_t *         vthread,
+                        size_t              stack_size);
+
+/** free the scheduler, after the vthread is stopped: fibers not
+ * finished are discarded without returning from their function. */
+void                vfiber_sched_free(
+                        vfiber_sched_t *    sched);
+
+/** @return number of fibers not finished */
+size_t              vfiber_sched_count(
+                        vfiber_sched_t *    sched);
+
+/** create a fiber running fun(data), started on next loop of the vthread.
+ * Can be called from any thread.
+ * @return 0 on success, -1 on error */
+int                 vfiber_spawn(
+                        vfiber_sched_t *    sched,
+                        vfiber_fun_t        fun,
+                        void *              data);
+
+/** @return the running fiber, or NULL if not called from a fiber */
+vfiber_t *          vfiber_current();
+
+/** give the vthread loop to other fibers and events: the fiber is resumed
+ * on next loop.
+ * @return 0 on success, -1 if not called from a fiber */
+int                 vfiber_yield();
+
+/** suspend the fiber until fd is ready.
+ * @param events combination of VTE_FD_READ, VTE_FD_WRITE, VTE_FD_ERR
+ * @return the ready event, or -1 on error */
+int                 vfiber_wait_fd(
+                        int                 fd,
+                        unsigned int        events);
+
+/** I/O on non-blocking fds, suspending the fiber instead of failing
+ * with EAGAIN. Outside a fiber they are the same as read(), write(),
+ * accept(), connect().
+ * vfiber_write() writes all bytes unless an error occurs. */
+ssize_t             vfiber_read(
+                        int                 fd,
+                        void *              buf,
+                        size_t              size);
+
+ssize_t             vfiber_write(
+                        int                 fd,
+                        const void *        buf,
+                        size_t              size);
+
+int                 vfiber_accept(
+                        int                 fd,
+                        struct sockaddr *   addr,
+                        socklen_t *         addrlen);
+
+int                 vfiber_connect(
+                        int                     fd,
+                        const struct sockaddr * addr,
+                        socklen_t               addrlen);
+
+/*****************************************************************************/
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ! ifndef *_H */
+
@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2026 Vincent Sallaberry
+ * vlib <https://github.com/vsallaberry/vlib>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/* ------------------------------------------------------------------------
+ * Simple d-ary heap (priority queue) in a contiguous array.
+ * The element with the smallest value according to cmpfun is on top.
+ *   vheap_t * heap = vheap_create(4, 64, deadline_cmp);
+ *   vheap_handle_t h = vheap_push(heap, timer);
+ *   timer->deadline -= 10;
+ *   vheap_decrease_key(heap, h);
+ *   while (vheap_size(heap) != 0) run(vheap_pop(heap));
+ *   vheap_free(heap);
+ */
+#ifndef VLIB_HEAP_H
+#define VLIB_HEAP_H
+
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*****************************************************************************/
+#define VLIB_HEAP_SZ            64
+#define VHEAP_ARITY_BINARY      2
+#define VHEAP_ARITY_QUATERNARY  4
+
+/** handle of an element, valid until the element is popped or removed */
+typedef size_t                  vheap_handle_t;
+#define VHEAP_INVALID_HANDLE    ((vheap_handle_t) -1)
+
+/** compare function: < 0 if first element must be popped before the second one */
+typedef int     (*vheap_cmpfun_t)(const void *, const void *);
+
+/** opaque struct vheap_t/vheap_s */
+typedef struct vheap_s  vheap_t;
+
+/*****************************************************************************/
+
+/* As for rbuf, NULL data can be inserted in the heap: when a get function
+ * returns NULL, errno is set to 0 on success, and is not 0 on error. */
+
+/** create a heap
+ * @param arity the number of children per node (>= 2): binary heap (2),
+ *        or 4-ary heap for better cache behavior on large heaps.
+ * @param init_size the initial capacity, doubled when needed
+ * @param cmpfun the compare function
+ * @return the new heap or NULL on error */
+vheap_t *       vheap_create(
+                    unsigned int    arity,
+                    size_t          init_size,
+                    vheap_cmpfun_t  cmpfun);
+
+/** release heap memory (not the elements) */
+void            vheap_free(
+                    vheap_t *       heap);
+
+/** remove all elements of the heap, handles are invalidated.
+ * @return 0 on success, -1 on error */
+int             vheap_clear(
+                    vheap_t *       heap);
+
+/** number of elements in the heap
+ * @return number of elements (errno is only set to 0 if number is 0),
+ *         or 0 on error with errno set. */
+size_t          vheap_size(
+                    const vheap_t * heap);
+
+/** estimation of memory used by the heap
+ * @return memory size or 0 on error with errno set */
+size_t          vheap_memorysize(
+                    const vheap_t * heap);
+
+/** insert an element, O(log n)
+ * @return the element handle, or VHEAP_INVALID_HANDLE on error */
+vheap_handle_t  vheap_push(
+                    vheap_t *       heap,
+                    void *          data);
+
+/** top element, which would be returned by vheap_pop(), O(1)
+ * @return the element (errno is only set to 0 if element is NULL),
+ *         or NULL on error with errno set. */
+void *          vheap_peek(
+                    const vheap_t * heap);
+
+/** remove and return the top element, O(log n)
+ * @return the element (errno is only set to 0 if element is NULL),
+ *         or NULL on error with errno set. */
+void *          vheap_pop(
+                    vheap_t *       heap);
+
+/** get the element of a handle
+ * @return the element (errno is only set to 0 if element is NULL),
+ *         or NULL on error with errno set. */
+void *          vheap_get(
+                    const vheap_t * heap,
+                    vheap_handle_t  handle);
+
+/** restore heap order after the key of element <handle> has been decreased
+ * (moved towards top), O(log n).
+ * @return 0 on success, -1 on error */
+int             vheap_decrease_key(
+                    vheap_t *       heap,
+                    vheap_handle_t  handle);
+
+/** restore heap order after the key of element <handle> has changed
+ * in any direction, O(log n).
+ * @return 0 on success, -1 on error */
+int             vheap_update(
+                    vheap_t *       heap,
+                    vheap_handle_t  handle);
+
+/** remove element <handle> from the heap, O(log n).
+ * @return the element (errno is only set to 0 if element is NULL),
+ *         or NULL on error with errno set. */
+void *          vheap_remove(
+                    vheap_t *       heap,
+                    vheap_handle_t  handle);
+
+/** add <n> elements and restore heap order at once, O(size + n).
+ * @param heap the heap
+ * @param data the elements to add
+ * @param n number of elements in data
+ * @param handles if not NULL, the handles of added elements are stored here
+ * @return 0 on success, -1 on error */
+int             vheap_heapify(
+                    vheap_t *       heap,
+                    void * const *  data,
+                    size_t          n,
+                    vheap_handle_t *handles);
+
+/*****************************************************************************/
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ! ifndef *_H */
+
@@ -27,6 +27,8 @@
 #else
 # include <stdlib.h>
 #endif
+
+#include "vlib/log.h"
 /* ************************************************************************ */
 
 /** vjob_fun_t : fun ptr executing job */
@@ -34,10 +36,30 @@
 #define VJOB_ERR_RESULT     ((void *) -1)
 typedef void *              (*vjob_fun_t)(void *);
 
+/** vjob_then_fun_t : fun ptr of continuation, receiving the result of previous job */
+typedef void *              (*vjob_then_fun_t)(void * result, void * user_data);
+
+/** vjob_range_fun_t : fun ptr processing elements [begin,end[ of a parallel loop */
+typedef void                (*vjob_range_fun_t)(size_t begin, size_t end, void * ctx);
+
+/** vjob_reduce_fun_t : fun ptr accumulating elements [begin,end[ into acc */
+typedef void                (*vjob_reduce_fun_t)(size_t begin, size_t end, void * acc, void * ctx);
+
+/** vjob_join_fun_t : fun ptr accumulating other partial result into acc */
+typedef void                (*vjob_join_fun_t)(void * acc, const void * other, void * ctx);
+
 /** external opaque job_t */
 struct vjob_s;
 typedef struct vjob_s vjob_t;
 
+/** external opaque vjob_cancel_t */
+struct vjob_cancel_s;
+typedef struct vjob_cancel_s vjob_cancel_t;
+
+/** external opaque vjob_pool_t */
+struct vjob_pool_s;
+typedef struct vjob_pool_s vjob_pool_t;
+
 /** vjob states */
 typedef enum {
     VJS_NONE            = 0,
@@ -48,6 +70,7 @@ typedef enum {
     VJS_EXIT_REQUESTED  = 1 << 4,
     VJS_INTERRUPTED     = 1 << 5,
     VJS_LOGPOOL_DISABLED= 1 << 6,
+    VJS_POOLED          = 1 << 7,
 } vjob_state_t;
 
 #ifdef __cplusplus
@@ -59,7 +82,10 @@ extern "C" {
  * @return job result or VJOB_ERR_RESULT or VJOB_NO_RESULT */
 void *          vjob_free(vjob_t * job);
 
-/** run a job in a new thread
+/** run a job in a new thread.
+ * Unlike vjob_pool_run(), the job does not hold a worker of a pool: it can block
+ * or run as long as the program, and vjob_kill() cancels its thread, see
+ * vjob_killmode(). Short jobs should use vjob_pool_run().
  * @param fun the function to execute
  * @param user_data the data to give to function
  * @return job handle or NULL on error */
@@ -79,7 +105,17 @@ int             vjob_done(vjob_t * job);
  *          VJOB_NO_RESULT if job not done */
 void *          vjob_wait(vjob_t * job);
 
-/** kill job with waiting
+/** wait for job completion at most timeout_ms milliseconds, see vjob_wait().
+ * @param timeout_ms the timeout, 0 to wait forever
+ * @return result of vjob_wait(), or VJOB_NO_RESULT with errno ETIMEDOUT
+ *         if job is not done after timeout_ms, or VJOB_ERR_RESULT with
+ *         errno EINVAL if job is detached (or waited by vjob_wait()) and
+ *         not done. */
+void *          vjob_wait_timeout(vjob_t * job, unsigned long timeout_ms);
+
+/** kill job with waiting: the job cancellation token is cancelled
+ * (see vjob_cancel_current()) and the job thread is canceled if
+ * it is not a pooled job.
  * @return VJOB_ERR_RESULT on error, VJOB_NO_RESULT if job not done, or job result
  * @notes: Warning, if the kill mode is enabled, the job could let locked
  *   mutexes locked depending on pthread implementation.
@@ -135,14 +171,362 @@ int             vjob_detachme(vjob_t * job);
  * @return 0 on success, < 0 on error */
 int             vjob_detach(vjob_t * job);
 
+/* ************************************************************************ */
+/* Cancellation tokens: cooperative cancellation, the job polling its token
+ * with vjob_cancelled(), which is cheap enough for tight loops (an atomic
+ * read, plus a coarse clock read if a deadline is set).
+ * Cancelling a token cancels its children, so that a group of jobs can be
+ * cancelled at once. Each job has its own token, cancelled by vjob_kill(),
+ * child of the token given to vjob_pool_run_cancel().
+ *   vjob_cancel_t * group = vjob_cancel_create(NULL);
+ *   vjob_cancel_deadline(group, 5000);
+ *   job = vjob_pool_run_cancel(NULL, compute, data, group);
+ *   ... in compute(): while (!vjob_cancelled(vjob_cancel_current())) { ... }
+ *   vjob_cancel(group); vjob_waitandfree(job); vjob_cancel_free(group); */
+
+/** create a cancellation token
+ * @param parent if not NULL, the token is cancelled when parent is cancelled,
+ *        and inherits its deadline.
+ * @return the token, or NULL on error */
+vjob_cancel_t * vjob_cancel_create(vjob_cancel_t * parent);
+
+/** free a token created with vjob_cancel_create(), its children are
+ * then detached from it. */
+void            vjob_cancel_free(vjob_cancel_t * token);
+
+/** cancel a token and its children */
+void            vjob_cancel(vjob_cancel_t * token);
+
+/** set the deadline of token (and of its children if earlier than theirs)
+ * @param timeout_ms the token is cancelled in timeout_ms milliseconds
+ * @return 0 on success, -1 on error */
+int             vjob_cancel_deadline(vjob_cancel_t * token, unsigned long timeout_ms);
+
+/** @return non-zero if token is cancelled or its deadline is reached,
+ *          0 otherwise or if token is NULL */
+int             vjob_cancelled(vjob_cancel_t * token);
+
+/** @return the token of the job run by current thread, or NULL if current
+ *          thread does not run a job */
+vjob_cancel_t * vjob_cancel_current();
+
 /** @return number of available CPUs */
 unsigned int    vjob_cpu_nb();
 
+/** @return number of NUMA nodes having CPUs available to the process,
+ *          read from /sys/devices/system/node on linux, 1 if unknown */
+unsigned int    vjob_numa_nb();
+
 /** run job and forget it (let it run)
  * @param see vjob_run()
  * @return 0 on success */
 int             vjob_runandfree(vjob_fun_t fun, void * data);
 
+/* ************************************************************************ */
+/* Pool of persistent worker threads, avoiding the thread creation of vjob_run()
+ * for short jobs: pooled jobs are given to workers through a lock-free queue
+ * and vjob_t objects are recycled. Each worker has its own deque of jobs it
+ * submitted, where idle workers steal jobs.
+ * vjob_state(), vjob_done(), vjob_wait(), vjob_free(), vjob_detach(),
+ * vjob_detachme() and vjob_*andfree() work on pooled jobs.
+ * A running pooled job cannot be killed: vjob_kill() prevents a queued job from
+ * running (state VJS_INTERRUPTED) or waits for a running one, and
+ * vjob_testkill()/vjob_killmode() have no effect in pooled jobs.
+ * A worker waiting for a pooled job (vjob_wait()) or a parallel loop runs other
+ * jobs of its pool meanwhile, allowing nested fork/join.
+ * Jobs have a priority class, and jobs with a deadline are run before other ones,
+ * earliest deadline first. A pool can have workers reserved to high priority and
+ * deadline jobs, and background workers running low priority jobs with a lower
+ * OS priority:
+ *   vjob_pool_attr_t pattr = { .nworkers = 0, .nreserved = 1, .nbackground = 1,
+ *                              .background_nice = 10 };
+ *   vjob_attr_t attr = { .prio = VJOB_PRIO_LOW };
+ *   pool = vjob_pool_create_attr(&pattr);
+ *   vjob_pool_runandfree(pool, serve_request, req);
+ *   job = vjob_pool_run_attr(pool, compress_logs, logs, &attr);
+ * Workers can be pinned to cpus and spread over NUMA nodes, a worker preferring
+ * jobs of its node, and jobs can be given a node hint, for instance the node of
+ * the worker which allocated the data:
+ *   vjob_attr_t attr = { .flags = VJOB_ATTR_NODE, .node = vjob_current_node() };
+ * Telemetry of a pool (counts, histograms of waits and run times, utilization
+ * and steals of workers) is collected when enabled, at runtime with
+ * VJOB_POOL_TELEMETRY or vjob_pool_telemetry_enable(). It is not compiled
+ * if vlib is built with -DVJOB_TELEMETRY=0:
+ *   vjob_pool_telemetry_log(pool, g_vlib_log, 60000); */
+
+/** pool flags */
+#define VJOB_POOL_PIN_CPU       (1 << 0)    /* pin each worker to one cpu */
+#define VJOB_POOL_PIN_NODE      (1 << 1)    /* pin each worker to the cpus of a NUMA node */
+#define VJOB_POOL_TELEMETRY     (1 << 2)    /* enable telemetry, see vjob_pool_telemetry() */
+
+/** job attribute flags */
+#define VJOB_ATTR_NODE          (1 << 0)    /* run job preferably on NUMA node attr.node */
+
+/** priority classes of pooled jobs */
+typedef enum {
+    VJOB_PRIO_NORMAL = 0,
+    VJOB_PRIO_HIGH,                 /* run before normal jobs, also by reserved workers */
+    VJOB_PRIO_LOW,                  /* run when no other job is waiting, or by background workers */
+    VJOB_PRIO_NB
+} vjob_prio_t;
+
+/** pool attributes, zero-initialized fields are defaults */
+typedef struct {
+    unsigned int    nworkers;       /* normal workers, 0 for vjob_cpu_nb() */
+    unsigned int    nreserved;      /* additional workers running only high priority and deadline jobs */
+    unsigned int    nbackground;    /* additional workers running only low priority jobs */
+    int             background_nice;/* nice increment of background workers (linux only) */
+    unsigned int    flags;          /* VJOB_POOL_PIN_*: workers spread over NUMA nodes (linux only) */
+} vjob_pool_attr_t;
+
+/** job attributes, zero-initialized fields are defaults */
+typedef struct {
+    unsigned int    prio;           /* vjob_prio_t */
+    unsigned long   deadline_ms;    /* if not 0, job is run earliest deadline first, before jobs without deadline */
+    vjob_cancel_t * token;          /* parent of job token, see vjob_pool_run_cancel() */
+    unsigned int    flags;          /* VJOB_ATTR_* */
+    unsigned int    node;           /* NUMA node hint with VJOB_ATTR_NODE, ignored if invalid */
+} vjob_attr_t;
+
+/** statistics of a priority class, see vjob_pool_stats() */
+typedef struct {
+    size_t          queued;         /* jobs waiting to be started */
+    size_t          started;        /* jobs taken from queues since pool creation */
+    unsigned long   wait_avg_us;    /* time between submission and start */
+    unsigned long   wait_max_us;
+} vjob_pool_stats_t;
+
+/** number of buckets of telemetry histograms: bucket 0 counts durations
+ * under 1us, bucket i counts durations in [2^(i-1),2^i[ us, the last one
+ * counts longer durations */
+#define VJOB_TELEMETRY_BUCKETS  24
+
+/** telemetry of a pool worker, see vjob_pool_telemetry() */
+typedef struct {
+    size_t          jobs;           /* jobs run */
+    size_t          steals;         /* jobs stolen from other workers */
+    unsigned long   busy_us;        /* time spent running jobs */
+    unsigned int    utilization;    /* busy time per thousand of elapsed time */
+} vjob_worker_telemetry_t;
+
+/** telemetry of a pool since it was enabled, see vjob_pool_telemetry() */
+typedef struct {
+    unsigned long   elapsed_us;     /* time since telemetry was enabled */
+    size_t          submitted;
+    size_t          running;
+    size_t          completed;
+    size_t          steals;
+    size_t          wait_hist[VJOB_TELEMETRY_BUCKETS];  /* time between submission and start */
+    size_t          run_hist[VJOB_TELEMETRY_BUCKETS];   /* duration of jobs */
+} vjob_telemetry_t;
+
+/** create a pool of worker threads
+ * @param nworkers the number of workers, 0 for vjob_cpu_nb()
+ * @return the pool or NULL on error */
+vjob_pool_t *   vjob_pool_create(unsigned int nworkers);
+
+/** create a pool of worker threads with attributes, see vjob_pool_create()
+ * @param attr the pool attributes, NULL for defaults
+ * @return the pool or NULL on error */
+vjob_pool_t *   vjob_pool_create_attr(const vjob_pool_attr_t * attr);
+
+/** stop workers after they have run the queued jobs, and free the pool.
+ * Pooled jobs must have been freed or detached. If pool is the default one,
+ * next vjob_pool_default() creates a new default pool.
+ * @return 0 on success, -1 with errno EDEADLK if called from a worker of pool */
+int             vjob_pool_free(vjob_pool_t * pool);
+
+/** @return the process default pool, created on first call, or after
+ *          it was freed, with vjob_cpu_nb() workers, or NULL on error */
+vjob_pool_t *   vjob_pool_default();
+
+/** @return number of workers of pool, including reserved and background ones */
+unsigned int    vjob_pool_workers(vjob_pool_t * pool);
+
+/** @return the NUMA node of the current worker of a pool created with
+ * VJOB_POOL_PIN_* flags, in range [0,vjob_numa_nb()[, or -1 */
+int             vjob_current_node();
+
+/** get the statistics of each priority class of pool
+ * @param pool the pool, or NULL for vjob_pool_default()
+ * @param stats an array of VJOB_PRIO_NB elements, indexed by vjob_prio_t
+ * @return 0 on success, -1 on error */
+int             vjob_pool_stats(vjob_pool_t * pool, vjob_pool_stats_t * stats);
+
+/** enable or disable the telemetry of pool, counters being reset when enabled.
+ * @param pool the pool, or NULL for vjob_pool_default()
+ * @return 0 on success, -1 on error (errno ENOTSUP if telemetry is not compiled) */
+int             vjob_pool_telemetry_enable(vjob_pool_t * pool, int enable);
+
+/** get a snapshot of pool telemetry
+ * @param pool the pool, or NULL for vjob_pool_default()
+ * @param tm receives the pool telemetry, can be NULL
+ * @param workers if not NULL, receives the telemetry of the first nworkers workers,
+ *        see vjob_pool_workers()
+ * @return 0 on success, -1 on error (errno ENOTSUP if telemetry is not compiled,
+ *         EAGAIN if it is not enabled) */
+int             vjob_pool_telemetry(
+                    vjob_pool_t *               pool,
+                    vjob_telemetry_t *          tm,
+                    vjob_worker_telemetry_t *   workers,
+                    unsigned int                nworkers);
+
+/** log a snapshot of pool telemetry with LOG_INFO
+ * @return 0 on success, -1 on error */
+int             vjob_pool_telemetry_dump(vjob_pool_t * pool, log_t * log);
+
+/** enable pool telemetry and log it every period_ms, in a thread of the pool
+ * @param period_ms the period, 0 to stop logging
+ * @return 0 on success, -1 on error */
+int             vjob_pool_telemetry_log(vjob_pool_t * pool, log_t * log, unsigned long period_ms);
+
+/** run a job on a pool worker, see vjob_run().
+ * If the pool queue is full, the job is run by the calling thread.
+ * @param pool the pool, or NULL for vjob_pool_default()
+ * @return job handle or NULL on error */
+vjob_t *        vjob_pool_run(vjob_pool_t * pool, vjob_fun_t fun, void * user_data);
+
+/** run a job on a pool worker, see vjob_pool_run(), with a job token child
+ * of token: the job is not started if token is cancelled before.
+ * @param token the parent of job token, can be NULL
+ * @return job handle or NULL on error */
+vjob_t *        vjob_pool_run_cancel(
+                    vjob_pool_t *       pool,
+                    vjob_fun_t          fun,
+                    void *              user_data,
+                    vjob_cancel_t *     token);
+
+/** run a job on a pool worker, see vjob_pool_run(), with attributes
+ * @param attr the job priority, deadline and token, NULL for defaults
+ * @return job handle or NULL on error */
+vjob_t *        vjob_pool_run_attr(
+                    vjob_pool_t *       pool,
+                    vjob_fun_t          fun,
+                    void *              user_data,
+                    const vjob_attr_t * attr);
+
+/** run job on pool and forget it, see vjob_runandfree(), vjob_pool_run().
+ * @return 0 on success */
+int             vjob_pool_runandfree(vjob_pool_t * pool, vjob_fun_t fun, void * data);
+
+/* ************************************************************************ */
+/* Futures: continuations of pooled jobs, queued on the pool as soon as the
+ * jobs they depend on are finished, without any thread blocked meanwhile.
+ * A continuation is a pooled job which must be freed or detached as other ones.
+ * The jobs it depends on can be freed independently.
+ *   vjob_t * jobs[2] = { vjob_pool_run(NULL, rotate, log1), vjob_pool_run(NULL, rotate, log2) };
+ *   vjob_t * all = vjob_when_all(jobs, 2);
+ *   vjob_t * end = vjob_then(all, compress, NULL);
+ *   vjob_detach(jobs[0]); vjob_detach(jobs[1]); vjob_detach(all);
+ *   ... vjob_waitandfree(end); */
+
+/** run fun(result_of_job, user_data) on the pool of job when job is finished.
+ * If job was interrupted (vjob_kill()), the continuation is interrupted too.
+ * @param job a pooled job
+ * @return the continuation job, or NULL on error */
+vjob_t *        vjob_then(vjob_t * job, vjob_then_fun_t fun, void * user_data);
+
+/** @return a job finished when all pooled jobs of array jobs are finished,
+ *          with result NULL, or NULL on error */
+vjob_t *        vjob_when_all(vjob_t * const * jobs, size_t n);
+
+/** @return a job finished when the first of the pooled jobs of array jobs
+ *          is finished, with the index in jobs of this job as result
+ *          ((size_t) vjob_wait(any)), or NULL on error.
+ * The result is an index and not the job, which can have been freed and
+ * recycled when the result is read. A vjob_then() continuation of it gets
+ * the same index as result_of_job. */
+vjob_t *        vjob_when_any(vjob_t * const * jobs, size_t n);
+
+/** parallel loop: run fun(b, e, ctx) on the pool for ranges [b,e[ covering
+ * [begin,end[, the calling thread taking part, and wait for completion.
+ * @param pool the pool, or NULL for vjob_pool_default()
+ * @param grain the maximum number of elements of a range,
+ *        0 for about 8 ranges per worker
+ * @return 0 on success, -1 on error */
+int             vjob_parallel_for(
+                    vjob_pool_t *       pool,
+                    size_t              begin,
+                    size_t              end,
+                    size_t              grain,
+                    vjob_range_fun_t    fun,
+                    void *              ctx);
+
+/** parallel reduction: each range [b,e[ (see vjob_parallel_for()) is accumulated
+ * by fun(b, e, acc, ctx) in its own acc of result_size bytes, initialized with
+ * a copy of *result, then the accs are joined in order by join(result, acc, ctx).
+ * Eg: long sum = 0;
+ *     vjob_parallel_reduce(NULL, 0, n, 0, sum_range, sum_join, &sum, sizeof(sum), tab);
+ * @param result the result, holding on call the identity value of join (0 for a sum)
+ * @return 0 on success, -1 on error */
+int             vjob_parallel_reduce(
+                    vjob_pool_t *       pool,
+                    size_t              begin,
+                    size_t              end,
+                    size_t              grain,
+                    vjob_reduce_fun_t   fun,
+                    vjob_join_fun_t     join,
+                    void *              result,
+                    size_t              result_size,
+                    void *              ctx);
+
+/* ************************************************************************ */
+/* Task graphs: nodes are jobs run on a pool as soon as the nodes they depend
+ * on are finished. A graph can be run several times, without allocation once
+ * it has been run unmodified. The duration of each node in last run is kept,
+ * giving the critical path of the graph.
+ *   vjob_graph_t * graph = vjob_graph_create(NULL);
+ *   int load = vjob_graph_add_node(graph, load_fun, data);
+ *   int parse = vjob_graph_add_node(graph, parse_fun, data);
+ *   int index = vjob_graph_add_node(graph, index_fun, data);
+ *   vjob_graph_add_edge(graph, load, parse); vjob_graph_add_edge(graph, load, index);
+ *   while (batch(data)) { vjob_graph_run(graph); }
+ *   vjob_graph_free(graph); */
+
+/** opaque task graph */
+typedef struct vjob_graph_s vjob_graph_t;
+
+/** timing of a graph node in last vjob_graph_run() */
+typedef struct {
+    unsigned long   start_us;       /* start time, relative to the graph start */
+    unsigned long   run_us;         /* duration of the node function */
+    unsigned long   path_us;        /* longest path of node durations ending with this node */
+    int             critical;       /* node is on the critical path of the graph */
+} vjob_graph_timing_t;
+
+/** create an empty task graph
+ * @param pool the pool running nodes, or NULL for vjob_pool_default()
+ * @return the graph or NULL on error */
+vjob_graph_t *  vjob_graph_create(vjob_pool_t * pool);
+
+/** free the graph, which must not be running */
+void            vjob_graph_free(vjob_graph_t * graph);
+
+/** add a node running fun(user_data)
+ * @return the node id, or -1 on error */
+int             vjob_graph_add_node(vjob_graph_t * graph, vjob_fun_t fun, void * user_data);
+
+/** add a dependency: node to is started after node from is finished
+ * @return 0 on success, -1 on error */
+int             vjob_graph_add_edge(vjob_graph_t * graph, int from, int to);
+
+/** run all nodes of graph and wait for them. The graph must not be modified
+ * nor run by other threads meanwhile.
+ * @return 0 on success, -1 on error (errno EDEADLK if the graph has a cycle) */
+int             vjob_graph_run(vjob_graph_t * graph);
+
+/** @return the result of node function in last run, or VJOB_NO_RESULT */
+void *          vjob_graph_result(vjob_graph_t * graph, int node);
+
+/** get the timing of a node in last run
+ * @return 0 on success, -1 on error */
+int             vjob_graph_timing(vjob_graph_t * graph, int node, vjob_graph_timing_t * timing);
+
+/** get the critical path of last run: the path with the longest sum of node durations
+ * @param nodes if not NULL, receives the first max node ids of the path, in order
+ * @return the number of nodes in the path */
+size_t          vjob_graph_critical_path(vjob_graph_t * graph, int * nodes, size_t max);
+
 /* ************************************************************************ */
 
 #ifdef __cplusplus
@@ -288,6 +288,57 @@ FILE *      log_getfile_locked(log_t * log);
  */
 log_t *     log_set_vlib_instance(log_t * log);
 
+/*****************************************************************************/
+/* Asynchronous logs: lines written to a file are formatted by the logging
+ * thread in a thread buffer, queued without lock in a ring buffer, and
+ * written by a background thread in large writes.
+ * The mode is set on the file of a log: all logs sharing this file, as the
+ * ones of a logpool using the same path, become asynchronous.
+ *   log_async_start(log, 0, LOG_ASYNC_DROP_COUNT);
+ *   LOG_INFO(log, "hello");
+ *   log_close(log); -> queued lines are written before closing
+ */
+
+/** what to do with a line when the ring buffer is full */
+typedef enum {
+    LOG_ASYNC_BLOCK     = 0,        /* wait for room */
+    LOG_ASYNC_DROP,                 /* drop the line */
+    LOG_ASYNC_DROP_COUNT,           /* drop the line, and write the number of dropped lines
+                                       when there is room again */
+} log_async_policy_t;
+
+/** default size of the ring buffer of an asynchronous file */
+#define LOG_ASYNC_SIZE_DEFAULT      (256 * 1024)
+/** maximum number of asynchronous files */
+#define LOG_ASYNC_MAX               16
+
+/** make the file of log asynchronous.
+ * Queued lines are written before log_close() closes the file, at exit(),
+ * and on fatal signals (SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT) when
+ * the program does not handle them.
+ * Writes done on the file without the vlog() functions are not ordered with
+ * queued lines, log_async_flush() can be called before.
+ * fork() waits for the queued lines to be written, and the files are
+ * synchronous in the child.
+ * @param log the log whose file (stderr if log->out is NULL) becomes asynchronous
+ * @param size the size of the ring buffer, 0 for LOG_ASYNC_SIZE_DEFAULT
+ * @param policy the overflow policy
+ * @return 0 on success, -1 on error (errno EEXIST if file is already asynchronous,
+ *         ENOSPC if there are LOG_ASYNC_MAX asynchronous files). */
+int         log_async_start(log_t * log, size_t size, log_async_policy_t policy);
+
+/** write the queued lines of the file of log, and make it synchronous again.
+ * @return 0 on success, -1 on error (errno ENOENT if file is not asynchronous) */
+int         log_async_stop(log_t * log);
+
+/** wait until lines queued before this call on the file of log are written.
+ * @return 0 on success, -1 on error (errno ENOENT if file is not asynchronous) */
+int         log_async_flush(log_t * log);
+
+/** @return the number of lines dropped on the file of log because
+ *          the ring buffer was full */
+unsigned long log_async_dropped(log_t * log);
+
 
 #ifdef __cplusplus
 }
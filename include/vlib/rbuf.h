@@ -28,6 +28,9 @@
  *   while (rbuf_size(rbuf) != 0) printf(">%ld\n", (long)rbuf_dequeue(rbuf));
  *     // fifo: prints 1, 2
  *   rbuf_free(rbuf);
+ * Bulk operations (rbuf_push_n, rbuf_pop_n, rbuf_dequeue_n) and rbuf_peek_spans()
+ * avoid one call per element. When max_size is a power of 2, index wrapping
+ * uses a mask instead of a modulo.
  */
 #ifndef VLIB_RBUF_H
 #define VLIB_RBUF_H
@@ -51,6 +54,12 @@ typedef enum {
 /** opaque struct rbuf_t/rbuf_s */
 typedef struct rbuf_s   rbuf_t;
 
+/** contiguous slice of the buffer, as returned by rbuf_peek_spans() */
+typedef struct {
+    void * const *  tab;
+    size_t          count;
+} rbuf_span_t;
+
 /*****************************************************************************/
 
 /* General information about inserted data and functions returned values:
@@ -150,6 +159,55 @@ int             rbuf_set(
                     size_t          index,
                     void *          data);
 
+/** push <n> elements at end of the buffer, as <n> calls of rbuf_push() would do,
+ * the buffer being increased at most once.
+ * If RBF_OVERWRITE is ON, and there is not enough room, the bottom elements are lost,
+ * and only the last max_size elements of <data> are kept if n > max_size.
+ * @param rbuf the buffer
+ * @param data the array of elements to be pushed
+ * @param n the number of elements in <data>
+ * @return 0 on success, -1 if elements cannot be pushed (bad parameters, out of memory). */
+int             rbuf_push_n(
+                    rbuf_t *        rbuf,
+                    void * const *  data,
+                    size_t          n);
+
+/** remove at most <n> last elements of the buffer : LIFO(stack) mode.
+ * @param rbuf the buffer
+ * @param out if not NULL, where to store removed elements, in the order
+ *        rbuf_pop() would have returned them.
+ * @param n the maximum number of elements to remove.
+ * @return number of removed elements (errno is only set to 0 if number is 0),
+ *         or 0 on error with errno set. */
+size_t          rbuf_pop_n(
+                    rbuf_t *        rbuf,
+                    void **         out,
+                    size_t          n);
+
+/** remove at most <n> first elements of the buffer : FIFO(queue) mode.
+ * @param rbuf the buffer
+ * @param out if not NULL, where to store removed elements, in the order
+ *        rbuf_dequeue() would have returned them. It can be NULL to consume
+ *        elements previously processed with rbuf_peek_spans().
+ * @param n the maximum number of elements to remove.
+ * @return number of removed elements (errno is only set to 0 if number is 0),
+ *         or 0 on error with errno set. */
+size_t          rbuf_dequeue_n(
+                    rbuf_t *        rbuf,
+                    void **         out,
+                    size_t          n);
+
+/** get the buffer content without copy, as at most two contiguous slices,
+ * spans[0] starting with the element which would be returned by rbuf_dequeue().
+ * The spans are valid until next modification of the buffer.
+ * @param rbuf the buffer
+ * @param spans the slices to be filled, span.count is 0 for unused ones.
+ * @return number of elements in the spans (errno is only set to 0 if number is 0),
+ *         or 0 on error with errno set. */
+size_t          rbuf_peek_spans(
+                    const rbuf_t *  rbuf,
+                    rbuf_span_t     spans[2]);
+
 /*****************************************************************************/
 
 #ifdef __cplusplus
@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2026 Vincent Sallaberry
+ * vlib <https://github.com/vsallaberry/vlib>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/* ------------------------------------------------------------------------
+ * Shared memory ring buffer of records, for inter-process streaming.
+ * The buffer is placed in a shm_open()/mmap() region, with a layout using
+ * only offsets so that it can be mapped at any address by each process.
+ * Many producers (MPSC) or a single one (SPSC) push records without lock,
+ * one consumer reads them, and is woken up with a futex on linux.
+ *   -- collector --
+ *   shmrbuf_t * shm = shmrbuf_open("/mylog", 1024, 512, SRF_CREATE | SRF_CONSUMER);
+ *   while ((n = shmrbuf_read(shm, buf, sizeof(buf), -1)) >= 0) process(buf, n);
+ *   -- worker --
+ *   shmrbuf_t * shm = shmrbuf_open("/mylog", 0, 0, SRF_DEFAULT);
+ *   shmrbuf_write(shm, "hello", 5);
+ *   shmrbuf_close(shm);
+ */
+#ifndef VLIB_SHMRBUF_H
+#define VLIB_SHMRBUF_H
+
+#include <sys/types.h>
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*****************************************************************************/
+
+typedef enum {
+    SRF_NONE            = 0,
+    SRF_CREATE          = 1 << 0, /* create the region if it does not exist */
+    SRF_CONSUMER        = 1 << 1, /* this process reads records: recovery done at open */
+    SRF_SINGLE_PRODUCER = 1 << 2, /* creation: only one producer, no CAS on write position */
+    SRF_DEFAULT         = SRF_NONE,
+} shmrbuf_flags_t;
+
+/** opaque struct shmrbuf_t/shmrbuf_s */
+typedef struct shmrbuf_s    shmrbuf_t;
+
+/*****************************************************************************/
+
+/** open or create a shared memory ring buffer.
+ * When the region is created, the process creating it initializes it, and the
+ * other ones wait for the end of initialization.
+ * @param name the shm_open() name ('/name'), or NULL with SRF_CREATE for
+ *        a buffer private to the process, between its threads.
+ * @param slot_count the number of records the buffer can hold (rounded to
+ *        a power of 2), only used at creation.
+ * @param record_maxsize the maximum size of a record, only used at creation.
+ * @param flags @see shmrbuf_flags_t
+ * @return the buffer or NULL on error, with errno set */
+shmrbuf_t *     shmrbuf_open(
+                    const char *    name,
+                    size_t          slot_count,
+                    size_t          record_maxsize,
+                    shmrbuf_flags_t flags);
+
+/** unmap the buffer and release local resources, the shared memory is kept.
+ * @return 0 on success, -1 on error */
+int             shmrbuf_close(
+                    shmrbuf_t *     shm);
+
+/** remove the shared memory name, see shm_unlink().
+ * @return 0 on success, -1 on error */
+int             shmrbuf_unlink(
+                    const char *    name);
+
+/** push a record in the buffer, and wake up the consumer if it is waiting.
+ * @return 0 on success,
+ *         -1 on error with errno EAGAIN if the buffer is full,
+ *         EMSGSIZE if size > shmrbuf_record_maxsize(), or ECANCELED if
+ *         the record was dropped because shmrbuf_recover() took the
+ *         producer for dead (stalled after reserving the slot). */
+int             shmrbuf_write(
+                    shmrbuf_t *     shm,
+                    const void *    data,
+                    size_t          size);
+
+/** read the next record of the buffer (consumer only).
+ * @param shm the buffer
+ * @param buf where to copy the record
+ * @param size the capacity of buf
+ * @param timeout_ms maximum time to wait for a record:
+ *        -1 is infinite, 0 does not wait.
+ * @return the record size, or -1 with errno EAGAIN if there is no record,
+ *         or EMSGSIZE if buf is too small (the record is not consumed). */
+ssize_t         shmrbuf_read(
+                    shmrbuf_t *     shm,
+                    void *          buf,
+                    size_t          size,
+                    int             timeout_ms);
+
+/** number of records written and not yet read (including ones being written).
+ * @return the number of records (errno is only set to 0 if number is 0),
+ *         or 0 on error with errno set. */
+size_t          shmrbuf_size(
+                    const shmrbuf_t * shm);
+
+/** maximum size of a record in this buffer
+ * @return maximum size, or 0 on error */
+size_t          shmrbuf_record_maxsize(
+                    const shmrbuf_t * shm);
+
+/** recover positions after a crash (consumer only). It is done by shmrbuf_open()
+ * with SRF_CONSUMER, and can be done later if a producer is suspected to be dead.
+ *  + a read interrupted by the consumer crash is completed,
+ *  + records reserved by a dead producer but never completed are skipped,
+ *    waiting a short delay if a producer died before storing its pid.
+ * @param shm the buffer
+ * @param force if not 0, all uncompleted records are skipped, to be used when
+ *        the caller knows no producer is running.
+ * @return number of recovered records or -1 on error */
+int             shmrbuf_recover(
+                    shmrbuf_t *     shm,
+                    int             force);
+
+/*****************************************************************************/
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ! ifndef *_H */
+
@@ -23,6 +23,7 @@
 #define VLIB_SLIST_H
 
 #include <stdlib.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -34,13 +35,23 @@ typedef struct slist_s {
     void *              data; /* must be last for the  slist_*_sized() functions */
 } slist_t;
 
-/** struct with slist head and slist tail */
-#define SHLIST_INITIALIZER()    ((shlist_t) { .head = NULL, .tail = NULL })
+/** struct with slist head, slist tail and number of elements,
+ * allowing O(1) append and length with the shlist_*() functions */
+#define SHLIST_INITIALIZER()    ((shlist_t) { .head = NULL, .tail = NULL, .count = 0 })
 typedef struct {
     slist_t *           head;
     slist_t *           tail;
+    size_t              count;
 } shlist_t;
 
+/** lock-free stack (Treiber) of slist_t elements, the tag protecting against ABA
+ * is updated with the head in a double-word compare-and-swap. */
+#define SLIST_ATOMIC_INITIALIZER() ((slist_atomic_t) { .head = NULL, .tag = 0 })
+typedef struct {
+    slist_t *           head;
+    uintptr_t           tag;
+} __attribute__((aligned(2 * sizeof(void *)))) slist_atomic_t;
+
 typedef void    (*slist_free_fun_t)(void *);
 typedef int     (*slist_cmp_fun_t)(const void *, const void *);
 
@@ -55,6 +66,18 @@ slist_t *       slist_insert_sorted(slist_t * list, void * data, slist_cmp_fun_t
 
 slist_t *       slist_concat(slist_t * list1, slist_t * list2);
 
+/* stable in-place merge sort, O(n log n), without allocation
+ * @return the new list head */
+slist_t *       slist_sort(slist_t * list, slist_cmp_fun_t cmpfun);
+
+/* merge two sorted lists into one sorted list, without allocation (stable:
+ * list1 elements come first on equality). @return the new list head */
+slist_t *       slist_merge_sorted(slist_t * list1, slist_t * list2, slist_cmp_fun_t cmpfun);
+
+/* remove consecutive duplicates (all duplicates if list is sorted),
+ * keeping the first one. @return the list head */
+slist_t *       slist_unique(slist_t * list, slist_cmp_fun_t cmpfun, slist_free_fun_t freefun);
+
 const slist_t * slist_find(const slist_t * list, const void * data, slist_cmp_fun_t cmpfun);
 const slist_t * slist_find_ptr(const slist_t * list, const void * data);
 
@@ -64,6 +87,8 @@ slist_t *       slist_remove_ptr(slist_t * list, const void * data);
 
 unsigned int    slist_length(const slist_t * list);
 
+/* free nodes allocated by slist functions, nodes of pool size being kept for
+ * next allocations (see slist_pool_flush()) */
 void            slist_free_1(slist_t * list, slist_free_fun_t freefun);
 void            slist_free(slist_t * list, slist_free_fun_t freefun);
 
@@ -76,9 +101,50 @@ slist_t *       slist_insert_sorted_sized(slist_t * list, const void * data, siz
 const slist_t * slist_find_sized(const slist_t * list, const void * data, slist_cmp_fun_t cmpfun);
 slist_t *       slist_remove_sized(slist_t * list, const void * data,
                                    slist_cmp_fun_t cmpfun, slist_free_fun_t freefun);
+slist_t *       slist_sort_sized(slist_t * list, slist_cmp_fun_t cmpfun);
+slist_t *       slist_merge_sorted_sized(slist_t * list1, slist_t * list2, slist_cmp_fun_t cmpfun);
+slist_t *       slist_unique_sized(slist_t * list, slist_cmp_fun_t cmpfun, slist_free_fun_t freefun);
 void            slist_free_1_sized(slist_t * list, slist_free_fun_t freefun);
 void            slist_free_sized(slist_t * list, slist_free_fun_t freefun);
 
+/* list header functions: head, tail and count of shlist_t are kept up to date.
+ * shlist_init() attaches an existing list to the header (O(n)), or empties it.
+ * add functions return 0 on success, -1 on error.
+ * shlist_pop() removes the head element and returns its data, with the errno
+ * conventions of rbuf_pop(). shlist_concat() moves hlist2 elements to hlist1 tail (O(1)). */
+shlist_t *      shlist_init(shlist_t * hlist, slist_t * list);
+int             shlist_prepend(shlist_t * hlist, void * data);
+int             shlist_append(shlist_t * hlist, void * data);
+int             shlist_prepend_sized(shlist_t * hlist, const void * data, size_t data_sz);
+int             shlist_append_sized(shlist_t * hlist, const void * data, size_t data_sz);
+void *          shlist_pop(shlist_t * hlist);
+shlist_t *      shlist_concat(shlist_t * hlist1, shlist_t * hlist2);
+size_t          shlist_length(const shlist_t * hlist);
+void            shlist_free(shlist_t * hlist, slist_free_fun_t freefun);
+void            shlist_free_sized(shlist_t * hlist, slist_free_fun_t freefun);
+
+/* slist_t nodes (not the _sized ones) are recycled in a per-thread cache, itself
+ * refilled by batches from a global pool. Nodes remain compatible with free().
+ * slist_pool_flush() releases the nodes of the current thread cache and of the
+ * global pool to the system (eg: before a memory leak check). */
+void            slist_pool_flush();
+
+/* lock-free stack functions, working on elements and not on data: an object
+ * embedding a slist_t can be recycled between threads without allocation.
+ * slist_atomic_push_list() pushes the chain [head,tail] at once.
+ * slist_atomic_pop_all() detaches the whole stack (last pushed first).
+ * A popped element can be read by a concurrent slist_atomic_pop(): it must be
+ * reused (eg: pushed again) rather than released to the system while other
+ * threads pop, otherwise only slist_atomic_pop_all() can be used.
+ * slist_atomic_lockfree() returns 0 if the system has no double-word CAS,
+ * in which case a spinlock is used. */
+void            slist_atomic_init(slist_atomic_t * stack);
+void            slist_atomic_push(slist_atomic_t * stack, slist_t * elt);
+void            slist_atomic_push_list(slist_atomic_t * stack, slist_t * head, slist_t * tail);
+slist_t *       slist_atomic_pop(slist_atomic_t * stack);
+slist_t *       slist_atomic_pop_all(slist_atomic_t * stack);
+int             slist_atomic_lockfree();
+
 /**
  * for loop iterating on each 'slist_t *' element of the list
  * Can be folowed by { } block.
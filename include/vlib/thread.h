@@ -23,8 +23,11 @@
 #define VLIB_THREAD_H
 
 #include <stdlib.h>
+#include <sys/types.h>
 #include <signal.h>
+#include <stdint.h>
 #include <pthread.h>
+#include <sys/socket.h>
 
 #include "vlib/log.h"
 
@@ -74,9 +77,39 @@ typedef enum {
     VTE_FD_WRITE        = 1 << 6, /* action_data is fd */
     VTE_FD_ERR          = 1 << 7, /* action_data is fd */
     VTE_FD_CLOSE        = 1 << 8, /* action_data is fd, can be combined with READ,WRITE,ERR */
+    VTE_ONESHOT         = 1 << 9, /* combined with FD_* or SIG: unregistered after first callback */
+    VTE_TIMER           = 1 << 10,/* action_data points to the vthread_timer_id_t, see vthread_timer_add() */
+    VTE_MSG             = 1 << 11,/* action_data is the message, see vthread_post() */
+    VTE_IO_READ         = 1 << 12,/* action_data is vthread_io_t *, see vthread_io_read() */
+    VTE_IO_WRITE        = 1 << 13,/* action_data is vthread_io_t *, see vthread_io_write() */
+    VTE_IO_ACCEPT       = 1 << 14,/* action_data is vthread_io_t *, see vthread_io_accept() */
     VTE_RESERVED        = 1 << 16 /* LAST. Reserved for internal use */
 } vthread_event_t;
 
+/** vthread event loop backends, see vthread_set_backend() */
+typedef enum {
+    VTB_DEFAULT         = 0,      /* epoll if available, select otherwise */
+    VTB_SELECT,                   /* portable, limited to FD_SETSIZE fds */
+    VTB_EPOLL,                    /* linux: interest kept in kernel, only ready fds dispatched */
+    VTB_URING                     /* linux: io_uring, fd polls and VTE_IO_* done by the kernel */
+} vthread_backend_t;
+
+/** size of the buffers given to multishot vthread_io_read() callbacks */
+#define VLIB_THREAD_IO_BUFSZ    16384
+
+/** completion of an asynchronous I/O, action_data of VTE_IO_* callbacks */
+typedef struct {
+    int                         fd;
+    ssize_t                     res;    /* bytes read or written, accepted fd,
+                                           0 on end of file, -errno on error */
+    void *                      buf;    /* the buffer read or written */
+    int                         more;   /* not 0 if the request gives more completions */
+} vthread_io_t;
+
+/** timer identifier, see vthread_timer_add(), 0 is not a timer. Identifiers
+ * carry a generation: the one of a timer expired or cancelled is not valid anymore. */
+typedef uint64_t                vthread_timer_id_t;
+
 /** cast macros for the event_data parameter of vthread_(un)register_event() */
 #define VTE_DATA_FD(fd)         ((void *)((ssize_t)(fd)))
 #define VTE_DATA_SIG(sig)       ((void *)((ssize_t)(sig)))
@@ -106,6 +139,16 @@ vthread_t *         vthread_create(
                             unsigned long           timeout,
                             log_t *                 log);
 
+/** choose the event loop backend, before vthread_start().
+ * The epoll backend is not compiled if vlib is built with -DVLIB_THREAD_NO_EPOLL,
+ * and the io_uring one with -DVLIB_THREAD_NO_URING. If io_uring cannot be
+ * initialized when the thread starts, the default backend is used.
+ * @return 0 on success, -1 on error (errno ENOTSUP if backend is not available,
+ *         EBUSY if the thread is started) */
+int                 vthread_set_backend(
+                            vthread_t *             vthread,
+                            vthread_backend_t       backend);
+
 /** start the thread */
 int                 vthread_start(
                             vthread_t *             vthread);
@@ -129,11 +172,17 @@ void *              vthread_wait_and_free(
  *   VTE_{INIT,CLEAN,PROCESS*}: event_data is ignored. This flags can be combined together.
  *   VTE_FD_{READ,WRITE,ERR}: event_data is fd. This flags can be combined together.
  *   VTE_SIG: event_data is signal value. This flag cannot be combined.
+ *   On linux, signals are read with a signalfd and stay blocked in the vthread.
+ *   VTE_ONESHOT: can be added to VTE_FD_* or VTE_SIG to unregister the event
+ *   after its callback is called.
+ *   VTE_TIMER: not accepted, see vthread_timer_add().
  * @param event_data see parameter 'event'
  * @param callback the callback to be called on this event.
  *        thread will exit if callback returns negative value.
  * @param callback_user_data the pointer to be passed to callback
  * @return 0 on SUCCESS, other value on error
+ * @notes: this function and vthread_unregister_event() can be called from
+ *         the vthread callbacks.
  */
 int                 vthread_register_event(
                             vthread_t *             vthread,
@@ -156,10 +205,121 @@ int                 vthread_unregister_event(
                             vthread_event_t         event,
                             void *                  event_data);
 
+/** add a timer calling callback(vthread, VTE_TIMER, timer, callback_user_data)
+ * after timeout_ms milli seconds, then every period_ms milli seconds if
+ * period_ms is not 0.
+ * Timers are kept in a hierarchical timing wheel: adding and cancelling is O(1)
+ * whatever the number of timers. The expiry is delayed by up to 1/32 of the
+ * timeout (or period), so that close timers are run on the same wakeup.
+ * @param vthread the vlib thread context
+ * @param timeout_ms the delay before the first callback
+ * @param period_ms the delay between next callbacks, 0 for a one-shot timer.
+ * @param callback the callback to be called on expiry.
+ *        thread will exit if callback returns negative value.
+ * @param callback_user_data the pointer to be passed to callback
+ * @return the timer identifier or 0 on error
+ * @notes: this function and vthread_timer_cancel() can be called from
+ *         the vthread callbacks and from other threads. A one-shot timer is
+ *         freed when its callback returns, its identifier becoming invalid.
+ */
+vthread_timer_id_t  vthread_timer_add(
+                            vthread_t *             vthread,
+                            unsigned long           timeout_ms,
+                            unsigned long           period_ms,
+                            vthread_callback_t      callback,
+                            void *                  callback_user_data);
+
+/** cancel and free a timer, the callback is not called after this.
+ * A timer can cancel itself from its callback.
+ * @param vthread the vlib thread context
+ * @param timer the timer returned by vthread_timer_add()
+ * @return 0 on SUCCESS, other value on error (errno ENOENT if the timer
+ *         already expired or was cancelled)
+ */
+int                 vthread_timer_cancel(
+                            vthread_t *             vthread,
+                            vthread_timer_id_t      timer);
+
+/** post a message to the vthread: callback(vthread, VTE_MSG, msg, callback_user_data)
+ * will be called by the vthread loop, in the order of posting.
+ * Messages are queued in memory without lock, and a burst of messages costs
+ * one wakeup of the loop (eventfd on linux, pipe otherwise).
+ * Messages posted before vthread_start() are delivered once started, messages
+ * not delivered when the thread stops are discarded.
+ * @param vthread the vlib thread context
+ * @param callback the callback to be called with the message.
+ *        thread will exit if callback returns negative value.
+ * @param msg the message, given as callback event_data
+ * @param callback_user_data the pointer to be passed to callback
+ * @return 0 on SUCCESS, -1 on error
+ * @notes: this function can be called from any thread.
+ */
+int                 vthread_post(
+                            vthread_t *             vthread,
+                            vthread_callback_t      callback,
+                            void *                  msg,
+                            void *                  callback_user_data);
+
+/** asynchronous read on fd: callback(vthread, VTE_IO_READ, vthread_io_t *, callback_user_data)
+ * is called when data is read. With the io_uring backend, the kernel does the read,
+ * otherwise it is done by the vthread when fd is readable.
+ * One read (or accept) and one write can be pending on a fd.
+ * @param vthread the vlib thread context
+ * @param fd the fd to read
+ * @param buf the buffer to fill, or NULL for a multishot read: the callback is
+ *        called with each data received, in a buffer of VLIB_THREAD_IO_BUFSZ
+ *        bytes valid until the callback returns, until end of file, error or
+ *        vthread_io_cancel(). With io_uring, multishot reads need a socket, and
+ *        use buffers registered in the kernel.
+ * @param size the size of buf
+ * @param callback the callback to be called on completion.
+ *        thread will exit if callback returns negative value.
+ * @param callback_user_data the pointer to be passed to callback
+ * @return 0 on SUCCESS, -1 on error (errno EBUSY if a read is pending on fd)
+ * @notes: the vthread_io_* functions can be called from the vthread callbacks.
+ */
+int                 vthread_io_read(
+                            vthread_t *             vthread,
+                            int                     fd,
+                            void *                  buf,
+                            size_t                  size,
+                            vthread_callback_t      callback,
+                            void *                  callback_user_data);
+
+/** asynchronous write on fd: callback(vthread, VTE_IO_WRITE, vthread_io_t *, callback_user_data)
+ * is called when at least one byte is written, buf must be valid until then.
+ * @return 0 on SUCCESS, -1 on error (errno EBUSY if a write is pending on fd) */
+int                 vthread_io_write(
+                            vthread_t *             vthread,
+                            int                     fd,
+                            const void *            buf,
+                            size_t                  size,
+                            vthread_callback_t      callback,
+                            void *                  callback_user_data);
+
+/** multishot accept on listening socket fd: callback(vthread, VTE_IO_ACCEPT,
+ * vthread_io_t *, callback_user_data) is called with each accepted connection,
+ * non-blocking and close-on-exec, until error or vthread_io_cancel().
+ * @return 0 on SUCCESS, -1 on error (errno EBUSY if a read is pending on fd) */
+int                 vthread_io_accept(
+                            vthread_t *             vthread,
+                            int                     fd,
+                            vthread_callback_t      callback,
+                            void *                  callback_user_data);
+
+/** cancel the asynchronous I/O pending on fd: their callbacks are not called
+ * after this. Must be called before closing fd. With io_uring, data already
+ * read by the kernel for a canceled read is lost.
+ * @return 0 on SUCCESS, -1 on error (errno ENOENT if nothing is pending) */
+int                 vthread_io_cancel(
+                            vthread_t *             vthread,
+                            int                     fd);
+
 /** create a pipe whose in_fd will be registered by thread. This function
  * is a shortcut to vthread_register_event, with additionally pipe
  * creation/cleaning, SIGPIPE for caller is ignored (SIGIGN) if not handled (SIGDFL).
  * Kernel guaranties atomic writes of PIPE_BUF.
+ * vthread_post() is cheaper for messages between threads of a process.
  * @param vthread the vlib thread context
  * @param callback the callback to be called on this event
  * @param callback_user_data the pointer to be passed to callback
@@ -170,12 +330,92 @@ int                 vthread_pipe_create(
                             vthread_callback_t      callback,
                             void *                  callback_user_data);
 
+/** output queue of a fd, see vthread_out_create() */
+typedef struct vthread_out_s    vthread_out_t;
+
+/** notifications of an output queue */
+typedef enum {
+    VTO_HIGH            = 1,      /* pending bytes reached the high watermark */
+    VTO_LOW,                      /* pending bytes went down to the low watermark after VTO_HIGH */
+    VTO_ERROR                     /* write error, pending data is dropped, see vthread_out_error() */
+} vthread_out_event_t;
+
+/** output queue notification callback */
+typedef void        (*vthread_out_callback_t)(
+                            vthread_out_t *         out,
+                            vthread_out_event_t     event,
+                            void *                  callback_user_data);
+
+/** release of a buffer given to vthread_out_writeref() */
+typedef void        (*vthread_out_release_t)(void * release_data);
+
+/** default high watermark of output queues */
+#define VLIB_THREAD_OUT_HIGH    (64 * 1024)
+
+/** create an output queue writing to the non-blocking fd in the vthread.
+ * Data queued during a loop iteration is written at the end of it, small
+ * writes being gathered in buffers and sent with writev(). VTE_FD_WRITE is
+ * registered on fd only while data remains that fd could not take.
+ * The fd must not get other writes, nor vthread_io_write().
+ * @param vthread the vlib thread context
+ * @param fd the fd to write
+ * @param high the pending bytes giving VTO_HIGH, 0 for VLIB_THREAD_OUT_HIGH.
+ * @param low the pending bytes giving VTO_LOW after VTO_HIGH, must be lower than high.
+ * @param callback the notification callback, can be NULL. VTO_HIGH is called
+ *        by the thread writing to the queue, VTO_LOW and VTO_ERROR by the vthread.
+ * @param callback_user_data the pointer to be passed to callback
+ * @return the queue, or NULL on error
+ * @notes: queues can be used from any thread, and from the vthread callbacks. */
+vthread_out_t *     vthread_out_create(
+                            vthread_t *             vthread,
+                            int                     fd,
+                            size_t                  high,
+                            size_t                  low,
+                            vthread_out_callback_t  callback,
+                            void *                  callback_user_data);
+
+/** free an output queue: pending data is dropped, or written before if flush
+ * is not 0, the queue being freed by the vthread after that or on error.
+ * Called from another thread while the vthread runs, the queue is freed by
+ * the vthread on its next loop iteration, so that release callbacks run there.
+ * Queues not freed before vthread_stop() are freed with the vthread. */
+void                vthread_out_free(
+                            vthread_out_t *         out,
+                            int                     flush);
+
+/** queue a copy of data
+ * @return 0 on SUCCESS, -1 on error (errno of the failed write after VTO_ERROR) */
+int                 vthread_out_write(
+                            vthread_out_t *         out,
+                            const void *            data,
+                            size_t                  size);
+
+/** queue data without copy: release(release_data) is called by the vthread
+ * when it is written or dropped, and data must be valid until then.
+ * @return 0 on SUCCESS, -1 on error (release is not called) */
+int                 vthread_out_writeref(
+                            vthread_out_t *         out,
+                            const void *            data,
+                            size_t                  size,
+                            vthread_out_release_t   release,
+                            void *                  release_data);
+
+/** @return the number of bytes not yet written */
+size_t              vthread_out_pending(
+                            vthread_out_t *         out);
+
+/** @return the errno of the write error stopping the queue, or 0 */
+int                 vthread_out_error(
+                            vthread_out_t *         out);
+
 /** write on the pipe. If size exceeds PIPE_BUF, thread mutex is locked.
  * @param vthread the vlib thread context
  * @param pipefd_out the fd to write on
  * @param data the data the be written
  * @param size the size to be written
- * @return number of written bytes or -1 on error */
+ * @return number of written bytes or -1 on error
+ * @notes: this waits up to 1 second for room in the pipe, see vthread_out_create()
+ *         for writes which do not block. */
 ssize_t             vthread_pipe_write(
                             vthread_t *             vthread,
                             int                     pipe_fdout,
@@ -213,6 +453,211 @@ int                 vthread_killmode(
                             int *               old_enable,
                             int *               old_async);
 
+/*****************************************************************************/
+/* vthread statistics: time waiting for events, running the loop and its
+ * callbacks, to find the callbacks stalling a vthread. They are off by default
+ * and cost two clock reads per callback once enabled.
+ *   vthread_stats_enable(vthread, 1, 10000); -> warns on callbacks over 10ms
+ *   ...
+ *   vthread_stats_get(vthread, &stats);
+ *   p99 = vthread_hist_percentile(&stats.callbacks[VTK_FD_READ], 99);
+ */
+
+/** number of buckets of vthread_hist_t: bucket 0 counts durations under 1 micro
+ * second, bucket i > 0 the ones in [2^(i-1), 2^i[, the last one the longer ones */
+#define VTHREAD_HIST_BUCKETS    24
+
+/** histogram of durations in micro seconds */
+typedef struct {
+    uint64_t                    count;
+    uint64_t                    total_us;
+    uint64_t                    max_us;
+    uint64_t                    buckets[VTHREAD_HIST_BUCKETS];
+} vthread_hist_t;
+
+/** kinds of callbacks in vthread statistics */
+typedef enum {
+    VTK_FD_READ         = 0,
+    VTK_FD_WRITE,
+    VTK_FD_ERR,
+    VTK_IO_READ,
+    VTK_IO_WRITE,
+    VTK_IO_ACCEPT,
+    VTK_FD_NB,                    /* number of kinds with per-fd statistics */
+    VTK_TIMER           = VTK_FD_NB,
+    VTK_MSG,
+    VTK_SIG,
+    VTK_OTHER,                    /* VTE_INIT, VTE_CLEAN, VTE_PROCESS_START */
+    VTK_NB
+} vthread_kind_t;
+
+/** statistics of a vthread, see vthread_stats_get() */
+typedef struct {
+    uint64_t                    loops;      /* loop iterations */
+    uint64_t                    slow;       /* callbacks slower than the threshold */
+    vthread_hist_t              wait;       /* time in select(), epoll or io_uring waits */
+    vthread_hist_t              run;        /* time of each iteration out of the wait */
+    vthread_hist_t              lag;        /* lateness of timers, milli second precision */
+    vthread_hist_t              callbacks[VTK_NB];
+} vthread_stats_t;
+
+/** enable or disable statistics, from any thread or a vthread callback.
+ * Disabling frees them, enabling again keeps them.
+ * @param enable 0 to disable
+ * @param slow_us log a warning in the vthread log for callbacks running
+ *        longer than slow_us micro seconds (at most one per second),
+ *        0 for no warnings.
+ * @return 0 on SUCCESS, -1 on error */
+int                 vthread_stats_enable(
+                            vthread_t *             vthread,
+                            int                     enable,
+                            unsigned long           slow_us);
+
+/** get a copy of the statistics. This waits for the running callback.
+ * @return 0 on SUCCESS, -1 on error (errno ENOENT if disabled) */
+int                 vthread_stats_get(
+                            vthread_t *             vthread,
+                            vthread_stats_t *       stats);
+
+/** get the callback durations of a kind < VTK_FD_NB on fd. As fd numbers are
+ * reused, they cover all the files which had that number.
+ * @return 0 on SUCCESS, -1 on error (errno ENOENT if nothing was recorded) */
+int                 vthread_stats_fd(
+                            vthread_t *             vthread,
+                            int                     fd,
+                            vthread_kind_t          kind,
+                            vthread_hist_t *        hist);
+
+/** clear the statistics, including the ones of fds */
+void                vthread_stats_reset(
+                            vthread_t *             vthread);
+
+/** @return the duration in micro seconds under which percent % of the
+ *          histogram durations are, rounded up to a power of 2 */
+uint64_t            vthread_hist_percentile(
+                            const vthread_hist_t *  hist,
+                            unsigned int            percent);
+
+/*****************************************************************************/
+/* vthread groups: several vthreads sharing the fds of a process, to use
+ * more than one core. Each fd is handled by one vthread of the group.
+ *   vthread_group_t * group = vthread_group_create(0, VTG_LEAST_LOADED, 0, NULL);
+ *   vthread_group_listen(group, (struct sockaddr *) &addr, sizeof(addr), 128, on_accept, NULL);
+ *   vthread_group_start(group);
+ *   ... on_accept(vthread, VTE_IO_ACCEPT, io, data) registers io->res in vthread.
+ *   vthread_group_free(group);
+ */
+
+/** choice of the vthread handling a new fd, see vthread_group_create() */
+typedef enum {
+    VTG_ROUND_ROBIN     = 0,
+    VTG_LEAST_LOADED,             /* the vthread with fewest fds and pending I/O */
+    VTG_FD_HASH                   /* fd modulo the number of vthreads */
+} vthread_group_policy_t;
+
+/** opaque vthread group */
+typedef struct vthread_group_s  vthread_group_t;
+
+/** create a group of vthreads, waiting for vthread_group_start().
+ * @param nthreads the number of vthreads, 0 for the number of cpus.
+ * @param policy the choice of the vthread of a new fd
+ * @param timeout the timeout of each vthread, see vthread_create()
+ * @param log the log instance of the vthreads, g_vlib_log if NULL.
+ * @return the group, or NULL on error */
+vthread_group_t *   vthread_group_create(
+                            unsigned int            nthreads,
+                            vthread_group_policy_t  policy,
+                            unsigned long           timeout,
+                            log_t *                 log);
+
+/** start the vthreads of the group
+ * @return 0 on SUCCESS, -1 on error */
+int                 vthread_group_start(
+                            vthread_group_t *       group);
+
+/** stop the vthreads, close the listeners of the group and free it */
+void                vthread_group_free(
+                            vthread_group_t *       group);
+
+/** @return the number of vthreads of the group */
+unsigned int        vthread_group_count(
+                            vthread_group_t *       group);
+
+/** @return the vthread at index, to customize it (vthread_set_backend(), ...),
+ *          or NULL if index is out of range */
+vthread_t *         vthread_group_get(
+                            vthread_group_t *       group,
+                            unsigned int            index);
+
+/** @return the vthread of the group running the caller, or NULL */
+vthread_t *         vthread_group_self(
+                            vthread_group_t *       group);
+
+/** choose a vthread for fd according to the group policy, without
+ * registering anything: the caller can use it for vthread_io_*() requests.
+ * @param fd the fd, or -1 to choose a vthread for a task.
+ * @return the vthread, or NULL on error */
+vthread_t *         vthread_group_pick(
+                            vthread_group_t *       group,
+                            int                     fd);
+
+/** register a fd event in a vthread of the group: the vthread already handling fd
+ * through the group, or the one chosen by the group policy.
+ * The callback receives that vthread, in which it can register other events
+ * of fd with vthread_register_event().
+ * @param event VTE_FD_{READ,WRITE,ERR,CLOSE}, with optional VTE_ONESHOT.
+ * @return the vthread in which the event is registered, or NULL on error
+ * @notes: as with vthread_register_event() on another vthread, calling this
+ *         from a callback can deadlock with a vthread doing the same: use
+ *         vthread_group_post() to hand fds over between vthreads. */
+vthread_t *         vthread_group_register_event(
+                            vthread_group_t *       group,
+                            vthread_event_t         event,
+                            void *                  event_data,
+                            vthread_callback_t      callback,
+                            void *                  callback_user_data);
+
+/** unregister a fd event from the vthread of the group handling fd.
+ * When no event of fd registered through the group is left, fd is free to be
+ * given to another vthread. A VTE_ONESHOT event already triggered cannot be
+ * unregistered, and keeps fd in its vthread.
+ * @return 0 on SUCCESS, -1 on error */
+int                 vthread_group_unregister_event(
+                            vthread_group_t *       group,
+                            vthread_event_t         event,
+                            void *                  event_data);
+
+/** listen on addr in every vthread, each one with its own socket sharing addr
+ * thanks to SO_REUSEPORT, so that the kernel spreads connections over vthreads.
+ * Connections are accepted with vthread_io_accept() and given to
+ * callback(vthread, VTE_IO_ACCEPT, vthread_io_t *, callback_user_data).
+ * Without SO_REUSEPORT, only the first vthread listens, and the callback
+ * should give connections to vthread_group_register_event().
+ * If the port of addr is 0, all sockets use the port chosen for the first one.
+ * @param addr the address to listen on, AF_INET or AF_INET6
+ * @param backlog see listen()
+ * @return 0 on SUCCESS, -1 on error */
+int                 vthread_group_listen(
+                            vthread_group_t *       group,
+                            const struct sockaddr * addr,
+                            socklen_t               addrlen,
+                            int                     backlog,
+                            vthread_callback_t      callback,
+                            void *                  callback_user_data);
+
+/** post a message to a vthread of the group, see vthread_post().
+ * Can be called from any thread, including the vthreads of the group.
+ * @param index the vthread index, or -1 to let the group policy choose.
+ * @return 0 on SUCCESS, -1 on error */
+int                 vthread_group_post(
+                            vthread_group_t *       group,
+                            int                     index,
+                            vthread_callback_t      callback,
+                            void *                  msg,
+                            void *                  callback_user_data);
+
+/*****************************************************************************/
+
 /** to be called at start of program with argc > 0 and *argv valid.
  * next calls can be done with argc == 0 and argv == NULL
  * @return 1 if valgrind was detected, 0 otherwise */
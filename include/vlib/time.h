@@ -71,7 +71,7 @@ extern "C" {
 /* vtimespeccmp: compare timespec, return 0 if =, <0 if op1<op2, >0 if op1>op2 */
 #define vtimespeccmp(tsop1, tsop2) \
             ((tsop1)->tv_sec == (tsop2)->tv_sec ? (tsop1)->tv_nsec - (tsop2)->tv_nsec \
-                                                : (tsop1)->tv_sec - (tsop2)->tvsec)
+                                                : (tsop1)->tv_sec - (tsop2)->tv_sec)
 /*
  * vclock_gettime() wrapper to clock_gettime() or
  * other available clock service on the system.
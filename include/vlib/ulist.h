@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2026 Vincent Sallaberry
+ * vlib <https://github.com/vsallaberry/vlib>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/* ------------------------------------------------------------------------
+ * Simple unrolled list: a list of chunks, each one holding several
+ * elements of fixed size stored inline, for cache friendly iteration.
+ *   ulist_t * list = ulist_create(sizeof(event_t), 0);
+ *   ulist_append(list, &event);
+ *   ULIST_FOREACH_PDATA(list, ev, event_t *) { process(ev); }
+ *   ULIST_FOREACH_PDATA_IT(list, it, ev, event_t *) {
+ *       if (ev->done) ulist_iter_remove(&it);
+ *   }
+ *   ulist_free(list, NULL);
+ */
+#ifndef VLIB_ULIST_H
+#define VLIB_ULIST_H
+
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*****************************************************************************/
+#define VLIB_ULIST_CHUNK_SZ     256     /* default chunk size in bytes */
+
+/** opaque chunk of elements */
+typedef struct ulist_chunk_s    ulist_chunk_t;
+
+/** unrolled list */
+typedef struct {
+    ulist_chunk_t *     head;
+    ulist_chunk_t *     tail;
+    size_t              count;
+    size_t              elt_size;
+    unsigned int        chunk_elts;
+} ulist_t;
+
+/** iterator, the fields must not be modified by user */
+typedef struct {
+    ulist_t *           list;
+    ulist_chunk_t *     chunk;
+    ulist_chunk_t *     prev;
+    char *              base;       /* element 0 of chunk */
+    unsigned int        idx;        /* current element in chunk */
+    unsigned int        end;        /* last element in chunk + 1 */
+    unsigned char       removed;    /* current element removed, idx is the next one */
+    unsigned char       done;
+} ulist_iter_t;
+
+typedef void    (*ulist_free_fun_t)(void *);
+
+/*****************************************************************************/
+
+/** create an unrolled list
+ * @param elt_size the size of an element
+ * @param chunk_elts number of elements in a chunk,
+ *        if 0, computed to fit in VLIB_ULIST_CHUNK_SZ bytes.
+ * @return the list or NULL on error */
+ulist_t *       ulist_create(
+                    size_t          elt_size,
+                    unsigned int    chunk_elts);
+
+/** initialize a list allocated by caller, see ulist_create()
+ * @return 0 on success, -1 on error */
+int             ulist_init(
+                    ulist_t *       list,
+                    size_t          elt_size,
+                    unsigned int    chunk_elts);
+
+/** remove all elements, calling freefun(pointer_to_element) if not NULL */
+void            ulist_clear(
+                    ulist_t *       list,
+                    ulist_free_fun_t freefun);
+
+/** ulist_clear() and release the list created with ulist_create() */
+void            ulist_free(
+                    ulist_t *       list,
+                    ulist_free_fun_t freefun);
+
+/** number of elements in the list, O(1) */
+size_t          ulist_length(
+                    const ulist_t * list);
+
+/** copy an element at end of list
+ * @param data the element to copy, if NULL, the element is not initialized.
+ * @return the pointer to the element in the list, or NULL on error */
+void *          ulist_append(
+                    ulist_t *       list,
+                    const void *    data);
+
+/** copy an element at beginning of list, see ulist_append() */
+void *          ulist_prepend(
+                    ulist_t *       list,
+                    const void *    data);
+
+/** pointer to first element, or NULL if the list is empty */
+void *          ulist_first(
+                    const ulist_t * list);
+
+/** pointer to last element, or NULL if the list is empty */
+void *          ulist_last(
+                    const ulist_t * list);
+
+/** remove the first element
+ * @param out if not NULL, the element is copied here
+ * @return 0 on success, -1 if the list is empty or on error. */
+int             ulist_pop_first(
+                    ulist_t *       list,
+                    void *          out);
+
+/*****************************************************************************/
+/** iteration */
+
+/** @return an iterator on the first element of list */
+ulist_iter_t    ulist_iter_first(
+                    ulist_t *       list);
+
+/** go to next chunk, used by ULIST_ITER_NEXT() */
+void            ulist_iter_nextchunk(
+                    ulist_iter_t *  it);
+
+/** remove the current element of iterator: the iterator then refers
+ * to the next element, and the next ULIST_ITER_NEXT() does not move it.
+ * @return 0 on success, -1 on error */
+int             ulist_iter_remove(
+                    ulist_iter_t *  it);
+
+#define ULIST_ITER_VALID(_it)   ((_it).chunk != NULL)
+#define ULIST_ITER_PDATA(_it)   ((void *) ((_it).base + (_it).idx * (_it).list->elt_size))
+#define ULIST_ITER_DATA(_it)    (*((void **) ULIST_ITER_PDATA(_it)))
+#define ULIST_ITER_NEXT(_it) \
+            ((_it).removed ? (void) ((_it).removed = 0) \
+             : (++(_it).idx < (_it).end ? (void) 0 : ulist_iter_nextchunk(&(_it))))
+
+/**
+ * for loop iterating on each element of the list, with an iterator named _it,
+ * allowing ulist_iter_remove(&_it) in the loop. Can be followed by { } block.
+ * Eg: ULIST_FOREACH_PDATA_IT(list, it, ev, event_t *) { if (...) ulist_iter_remove(&it); }
+ * The _PDATA version gives a pointer to element, the _DATA version gives the
+ * element itself, when elements are pointers (elt_size == sizeof(void *)).
+ */
+#define ULIST_FOREACH_DATA_T(_list, _it, _iter, _dtype, _getdata) \
+            for (ulist_iter_t _it = ulist_iter_first(_list); !(_it).done; (_it).done = 1) \
+                for (_dtype _iter; \
+                     ULIST_ITER_VALID(_it) && (((_iter) = (_dtype) (_getdata(_it))) || 1); \
+                     ULIST_ITER_NEXT(_it))
+
+#define ULIST_FOREACH_PDATA_IT(_list, _it, _iter, _type) \
+            ULIST_FOREACH_DATA_T(_list, _it, _iter, _type, ULIST_ITER_PDATA)
+
+#define ULIST_FOREACH_DATA_IT(_list, _it, _iter, _type) \
+            ULIST_FOREACH_DATA_T(_list, _it, _iter, _type, ULIST_ITER_DATA)
+
+/** same as SLIST_FOREACH_PDATA() / SLIST_FOREACH_DATA(),
+ * Eg: ULIST_FOREACH_DATA(list, str, char *) { printf("%s\n", str); } */
+#define ULIST_FOREACH_PDATA(_list, _iter, _type) \
+            ULIST_FOREACH_PDATA_IT(_list, _it_ulist, _iter, _type)
+
+#define ULIST_FOREACH_DATA(_list, _iter, _type) \
+            ULIST_FOREACH_DATA_IT(_list, _it_ulist, _iter, _type)
+
+/*****************************************************************************/
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ! ifndef *_H */
+
@@ -64,6 +64,33 @@ extern "C" {
 # define VLIB_UNLIKELY(_cond)       VLIB_EXPECT(_cond, 0)
 # define VLIB_LIKELY(_cond)         VLIB_EXPECT(_cond, 1)
 
+/** VLIB_ATOMIC_*: atomic operations on integers and pointers (sequentially consistent),
+ * VLIB_ATOMIC_CAS(ptr, pexpected, desired) updates *pexpected on failure.
+ * VLIB_ATOMIC_ADD/SUB return the previous value. */
+#if defined(__ATOMIC_SEQ_CST)
+# define VLIB_ATOMIC_LOAD(_ptr)             __atomic_load_n((_ptr), __ATOMIC_SEQ_CST)
+# define VLIB_ATOMIC_LOAD_RELAXED(_ptr)     __atomic_load_n((_ptr), __ATOMIC_RELAXED)
+# define VLIB_ATOMIC_STORE(_ptr, _val)      __atomic_store_n((_ptr), (_val), __ATOMIC_SEQ_CST)
+# define VLIB_ATOMIC_ADD(_ptr, _val)        __atomic_fetch_add((_ptr), (_val), __ATOMIC_SEQ_CST)
+# define VLIB_ATOMIC_SUB(_ptr, _val)        __atomic_fetch_sub((_ptr), (_val), __ATOMIC_SEQ_CST)
+# define VLIB_ATOMIC_XCHG(_ptr, _val)       __atomic_exchange_n((_ptr), (_val), __ATOMIC_SEQ_CST)
+# define VLIB_ATOMIC_CAS(_ptr, _pexp, _val) \
+            __atomic_compare_exchange_n((_ptr), (_pexp), (_val), 0, \
+                                        __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)
+#else
+# define VLIB_ATOMIC_LOAD(_ptr)             __sync_fetch_and_add((_ptr), 0)
+# define VLIB_ATOMIC_LOAD_RELAXED(_ptr)     (*(volatile __typeof__(*(_ptr)) *)(_ptr))
+# define VLIB_ATOMIC_STORE(_ptr, _val) \
+            do { __sync_synchronize(); *(_ptr) = (_val); __sync_synchronize(); } while (0)
+# define VLIB_ATOMIC_ADD(_ptr, _val)        __sync_fetch_and_add((_ptr), (_val))
+# define VLIB_ATOMIC_SUB(_ptr, _val)        __sync_fetch_and_sub((_ptr), (_val))
+# define VLIB_ATOMIC_XCHG(_ptr, _val) \
+            (__sync_synchronize(), __sync_lock_test_and_set((_ptr), (_val)))
+# define VLIB_ATOMIC_CAS(_ptr, _pexp, _val) \
+            (__sync_bool_compare_and_swap((_ptr), *(_pexp), (_val)) \
+             || ((*(_pexp) = VLIB_ATOMIC_LOAD(_ptr)), 0))
+#endif
+
 /** VLIB_OFFSETOF() / get offset of a field in a struct */
 #if 0 && defined(__offsetof)
 # define VLIB_OFFSETOF(type, field) __ofsetof(type, field)
@@ -41,6 +41,7 @@
 
 /*****************************************************************************/
 #define AVLTREE_STACK_SZ    32 /* 10^5 elts:depth=20, 10^6:24, 10^7:28 */
+#define AVLTREE_PARALLEL_SPLIT 4 /* subtrees per cpu in parallel visit, for load balancing */
 
 #if ! defined(AVLTREE_OPTIMIZE_BITS)
 # define AVLTREE_OPTIMIZE_BITS 1
@@ -698,26 +699,35 @@ typedef struct {
     avltree_visitfun_t  visit;
     void *              user_data;
     int                 how;
+    unsigned char *     jobs;
+    unsigned int        structsz;
 } avltree_visit_parallel_common_t;
 typedef struct {
     avltree_t                           tree;
-    vjob_t *                            job;
+    int                                 result;
     avltree_node_t *                    parent; /* this not the parent of tree.root */
     avltree_visit_parallel_common_t *   common;
     void *                              job_user_data; /* !!! MUST BE LAST !!! */
 } avltree_visit_parallel_t;
 
-static void *       avltree_visit_job(void * vdata) {
-    avltree_visit_parallel_t * data = (avltree_visit_parallel_t *) vdata;
-
-    return (void *)((long) avltree_visit(&(data->tree), data->common->visit,
-                                         data->job_user_data, data->common->how));
-}
-
 /*****************************************************************************/
 #define AVLTREE_JOB_BYIDX(_data, _idx, _sz) \
     ((avltree_visit_parallel_t *) (((unsigned char *) (_data)) + ((_idx) * (_sz))))
 
+/*****************************************************************************/
+static void         avltree_visit_jobs(
+                        size_t                      begin,
+                        size_t                      end,
+                        void *                      vdata) {
+    avltree_visit_parallel_common_t * common = (avltree_visit_parallel_common_t *) vdata;
+
+    for ( ; begin < end; ++begin) {
+        avltree_visit_parallel_t * data = AVLTREE_JOB_BYIDX(common->jobs, begin, common->structsz);
+        data->result = avltree_visit(&(data->tree), common->visit,
+                                     data->job_user_data, common->how);
+    }
+}
+
 /*****************************************************************************/
 static int          avltree_visit_parallel(
                         avltree_t *                 tree,
@@ -727,7 +737,7 @@ static int          avltree_visit_parallel(
 
     avltree_visit_parallel_common_t common_data;
     unsigned char *             data;
-    unsigned int                ncpus;
+    unsigned int                ncpus, nsplit;
     unsigned int                njobs, depth, maxjobs, nparents;
     unsigned int                userdatasz, structsz;
     avltree_node_t *            node;
@@ -741,7 +751,10 @@ static int          avltree_visit_parallel(
 
     if ((ncpus = vjob_cpu_nb()) < 2U)
         ncpus = 2U;
-    maxjobs = (ncpus / 2U) * 4U;
+    /* more subtrees than cpus: the pool balances them between workers */
+    for (nsplit = 1U; nsplit < ncpus * AVLTREE_PARALLEL_SPLIT; nsplit <<= 1)
+        ; /* nothing but loop */
+    maxjobs = nsplit;
     if ((data = malloc(maxjobs * (structsz))) == NULL) {
         return AVS_ERROR;
     }
@@ -757,6 +770,8 @@ static int          avltree_visit_parallel(
     common_data.user_data = user_data;
     common_data.visit = visit;
     common_data.how = how | AVH_PARALLEL; /* so as threads know they are in PARALELL mode */
+    common_data.jobs = data;
+    common_data.structsz = structsz;
     for (njobs = 0; njobs < maxjobs; ++njobs) {
         avltree_visit_parallel_t * job = AVLTREE_JOB_BYIDX(data, njobs, structsz);
         job->tree = *tree;
@@ -771,7 +786,7 @@ static int          avltree_visit_parallel(
             job->job_user_data = user_data;
         }
         job->common = &common_data;
-        job->job = NULL;
+        job->result = AVS_FINISHED;
         job->parent = NULL; /* there cannot be more parents than number of jobs */
     }
 
@@ -789,17 +804,14 @@ static int          avltree_visit_parallel(
 
         LOG_SCREAM(g_vlib_log, "avltree_parallel: node %ld depth %u", (long)AVL_DATA(node), depth);
 
-        if (1U << depth >= ncpus) { /* we reached a suitable depth to run jobs */
-            /* Launch multi-threaded visit */
+        if (1U << depth >= nsplit) { /* we reached a suitable depth to run jobs */
+            /* Prepare multi-threaded visit */
             avltree_visit_parallel_t * job = AVLTREE_JOB_BYIDX(data, njobs, structsz);
 
-            LOG_DEBUG(g_vlib_log, "avltree_parallel: node %ld, RUNNING visit job#%u",
+            LOG_DEBUG(g_vlib_log, "avltree_parallel: node %ld, visit job#%u",
                       (long)AVL_DATA(node), njobs);
 
             job->tree.root = node;
-            if ((job->job = vjob_run(avltree_visit_job, job)) == NULL) {
-                ret = AVS_ERROR;
-            }
             ++njobs;
         } else {
             /* keep parent of pushed nodes */
@@ -819,7 +831,7 @@ static int          avltree_visit_parallel(
         }
     }
 
-    LOG_DEBUG(g_vlib_log, "avltree_parallel: %u job%s launched, %u parent%s",
+    LOG_DEBUG(g_vlib_log, "avltree_parallel: %u job%s, %u parent%s",
               njobs, njobs > 1 ? "s": "", nparents, nparents > 1 ? "s" : "");
 
     /* visit parents of nodes visited by threads */
@@ -842,22 +854,23 @@ static int          avltree_visit_parallel(
             ret = AVS_ERROR;
     }
 
-    /* Wait and free jobs, merge results if necessary, by visiting roots of
-     * jobs subtrees with AVH_MERGE if jobs have allocated data, they must free it now. */
+    /* Run the subtrees visits on the job pool, this thread taking part */
+    if (vjob_parallel_for(NULL, 0, njobs, 1, avltree_visit_jobs, &common_data) != 0) {
+        avltree_visit_jobs(0, njobs, &common_data);
+    }
+
+    /* Merge results if necessary, by visiting roots of jobs subtrees with AVH_MERGE
+     * if jobs have allocated data, they must free it now. */
     if ((how & AVH_MERGE) != 0) {
         ctx->state = AVH_MERGE;
         ctx->how = how;
-        LOG_DEBUG(g_vlib_log, "avltree_parallel: wait child%s and merge",
+        LOG_DEBUG(g_vlib_log, "avltree_parallel: merge child%s",
                   (njobs > 1 ? "s" : ""));
 
     }
     while (njobs-- > 0) {
-        /* wait */
         avltree_visit_parallel_t * job = AVLTREE_JOB_BYIDX(data, njobs, structsz);
-        void * job_result = vjob_waitandfree(job->job);
-        if ((long)job_result != AVS_FINISHED
-        && ((long)job_result == AVS_ERROR
-            || job_result == VJOB_ERR_RESULT || job_result == VJOB_NO_RESULT)) {
+        if (job->result == AVS_ERROR) {
             ret = AVS_ERROR;
         }
         /* merge */
@@ -1291,34 +1304,13 @@ void                avltree_iterator_abort(avltree_iterator_t * iterator) {
 }
 
 /*****************************************************************************/
-typedef struct {
-    slist_t * head;
-    slist_t * tail;
-} avltree_slist_data_t;
-
 static AVLTREE_DECLARE_VISITFUN(avltree_toslist_visit, node_data, context, vdata) {
-    avltree_slist_data_t *  data = (avltree_slist_data_t *) vdata;
+    shlist_t *  data = (shlist_t *) vdata;
 
     if ((context->state & AVH_MERGE) != 0) {
-        avltree_slist_data_t * child_data = ((avltree_slist_data_t *) context->data);
-        if (data->head == NULL) {
-            data->head = child_data->head;
-            data->tail = child_data->tail;
-        } else if (child_data->head != NULL) {
-            data->tail->next = child_data->head;
-            data->tail = child_data->tail;
-        }
-    } else {
-        slist_t * new = slist_prepend(NULL, node_data);
-        if (new == NULL) {
-            return AVS_ERROR;
-        }
-        if (data->head == NULL) {
-            data->head = new;
-        } else {
-            data->tail->next = new;
-        }
-        data->tail = new;
+        shlist_concat(data, (shlist_t *) context->data);
+    } else if (shlist_append(data, node_data) != 0) {
+        return AVS_ERROR;
     }
     return AVS_CONTINUE;
 }
@@ -1327,7 +1319,7 @@ static AVLTREE_DECLARE_VISITFUN(avltree_toslist_visit, node_data, context, vdata
 slist_t *           avltree_to_slist(
                         avltree_t *                 tree,
                         avltree_visit_how_t         how) {
-    avltree_slist_data_t data = { .head = NULL, .tail = NULL };
+    shlist_t data = SHLIST_INITIALIZER();
 
     if (tree == NULL) {
         errno = EINVAL;
@@ -0,0 +1,546 @@
+/*
+ * Copyright (C) 2026 Vincent Sallaberry
+ * vlib <https://github.com/vsallaberry/vlib>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/* ------------------------------------------------------------------------
+ * Fibers on ucontext, run by a vthread loop.
+ * Runnable fibers are queued in the scheduler run queue, and a pipe registered
+ * in the vthread wakes up the loop, which runs them in the pipe callback. A
+ * fiber waiting for an fd registers a VTE_ONESHOT event whose callback resumes
+ * it. Fibers only run in the vthread, as its callbacks.
+ * Fiber stacks are carved out of slabs of VFIBER_SLAB_STACKS stacks, so as
+ * the number of mappings does not limit the number of fibers. A stack has a
+ * guard page at bottom, and the vfiber_t on top. Unused stacks are kept for
+ * next fibers, their pages given back to the system above VLIB_FIBER_STACK_CACHE.
+ */
+#if defined(__APPLE__) && !defined(_XOPEN_SOURCE)
+# define _XOPEN_SOURCE 600 /* ucontext */
+#endif
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <ucontext.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+#include "vlib/fiber.h"
+#include "vlib/log.h"
+#include "vlib/util.h"
+
+#include "vlib_private.h"
+
+/*****************************************************************************/
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+# define MAP_ANONYMOUS MAP_ANON
+#endif
+#if defined(__linux__) && !defined(MADV_GUARD_INSTALL)
+# define MADV_GUARD_INSTALL     102 /* linux 6.13: guard pages not splitting the mapping */
+#endif
+
+#define VFIBER_SLAB_STACKS      64  /* stacks per mapping */
+
+typedef enum {
+    VFS_READY = 0,
+    VFS_RUNNING,
+    VFS_WAITING,
+    VFS_DEAD
+} vfiber_state_t;
+
+struct vfiber_s {
+    ucontext_t          ctx;
+    vfiber_sched_t *    sched;
+    vfiber_fun_t        fun;
+    void *              data;
+    vfiber_t *          next;       /* run queue or unused stacks */
+    vfiber_t *          all_prev;   /* fibers not finished */
+    vfiber_t *          all_next;
+    unsigned int        state;
+    int                 event;      /* event which resumed the fiber */
+};
+
+typedef struct vfiber_slab_s {
+    struct vfiber_slab_s *  next;
+    char *                  map;
+} vfiber_slab_t;
+
+struct vfiber_sched_s {
+    vthread_t *         vthread;
+    ucontext_t          ctx;        /* vthread context, while a fiber runs */
+    pthread_mutex_t     mutex;      /* run queue and stacks */
+    vfiber_t *          run_head;
+    vfiber_t *          run_tail;
+    vfiber_t *          all;
+    vfiber_t *          stacks;     /* unused stacks */
+    unsigned int        nstacks;
+    vfiber_slab_t *     slabs;
+    size_t              map_size;   /* stack mapping size, including guard page */
+    size_t              nfibers;
+    int                 pipe_fd;
+    int                 notified;   /* pipe written, run queue not yet processed */
+};
+
+#define VFIBER_HDR_SZ           ((sizeof(vfiber_t) + 63) & ~((size_t) 63))
+#define VFIBER_MAP(sched, f)    ((char *) (f) + VFIBER_HDR_SZ - (sched)->map_size)
+
+static pthread_once_t   s_vfiber_once = PTHREAD_ONCE_INIT;
+static pthread_key_t    s_vfiber_key;   /* running fiber */
+static size_t           s_vfiber_pagesize = 4096;
+static int              s_vfiber_madv_guard = 1;    /* atomic: MADV_GUARD_INSTALL supported */
+
+/*****************************************************************************/
+static void     vfiber_init() {
+    long pagesize = sysconf(_SC_PAGESIZE);
+
+    if (pagesize > 0) {
+        s_vfiber_pagesize = pagesize;
+    }
+    if (pthread_key_create(&s_vfiber_key, NULL) != 0) {
+        LOG_WARN(g_vlib_log, "%s(): cannot create fiber key", __func__);
+    }
+}
+/*****************************************************************************/
+/* set the guard page at the bottom of a stack of a slab */
+static int      vfiber_stack_guard(
+                    char *              map) {
+#ifdef MADV_GUARD_INSTALL
+    /* mprotect() would split the slab mapping at each guard page */
+    if (VLIB_ATOMIC_LOAD_RELAXED(&s_vfiber_madv_guard)) {
+        if (madvise(map, s_vfiber_pagesize, MADV_GUARD_INSTALL) == 0) {
+            return 0;
+        }
+        if (errno != EINVAL) {
+            return -1;
+        }
+        VLIB_ATOMIC_STORE(&s_vfiber_madv_guard, 0);
+    }
+#endif
+    return mprotect(map, s_vfiber_pagesize, PROT_NONE);
+}
+/*****************************************************************************/
+/* map a slab and add its stacks to the unused ones, under lock */
+static int      vfiber_slab_new(
+                    vfiber_sched_t *    sched) {
+    vfiber_slab_t * slab;
+    vfiber_t *      fiber;
+    char *          map;
+
+    if ((slab = malloc(sizeof(*slab))) == NULL) {
+        return -1;
+    }
+    map = mmap(NULL, sched->map_size * VFIBER_SLAB_STACKS, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED) {
+        free(slab);
+        return -1;
+    }
+    for (unsigned int i = 0; i < VFIBER_SLAB_STACKS; ++i) {
+        /* stack grows down: guard page at bottom */
+        if (vfiber_stack_guard(map + i * sched->map_size) != 0) {
+            int errsv = errno;
+            munmap(map, sched->map_size * VFIBER_SLAB_STACKS);
+            free(slab);
+            errno = errsv;
+            return -1;
+        }
+    }
+    for (unsigned int i = VFIBER_SLAB_STACKS; i > 0; --i) {
+        fiber = (vfiber_t *) (map + i * sched->map_size - VFIBER_HDR_SZ);
+        fiber->next = sched->stacks;
+        sched->stacks = fiber;
+    }
+    sched->nstacks += VFIBER_SLAB_STACKS;
+    slab->map = map;
+    slab->next = sched->slabs;
+    sched->slabs = slab;
+    return 0;
+}
+/*****************************************************************************/
+/* not inlined in vfiber_spawn(), so that no local lives across getcontext() */
+static vfiber_t * vfiber_stack_get(
+                    vfiber_sched_t *    sched) __attribute__((noinline));
+static vfiber_t * vfiber_stack_get(
+                    vfiber_sched_t *    sched) {
+    vfiber_t *  fiber = NULL;
+
+    pthread_mutex_lock(&sched->mutex);
+    if (sched->stacks != NULL || vfiber_slab_new(sched) == 0) {
+        fiber = sched->stacks;
+        sched->stacks = fiber->next;
+        --sched->nstacks;
+    }
+    pthread_mutex_unlock(&sched->mutex);
+
+    if (fiber != NULL) {
+        fiber->sched = sched;
+    }
+    return fiber;
+}
+/*****************************************************************************/
+static void     vfiber_stack_release(
+                    vfiber_sched_t *    sched,
+                    vfiber_t *          fiber) {
+    int keep;
+
+    pthread_mutex_lock(&sched->mutex);
+    keep = sched->nstacks < VLIB_FIBER_STACK_CACHE;
+    pthread_mutex_unlock(&sched->mutex);
+
+    /* the stack is kept in the slab, but its pages are given back, except the
+     * top one holding the vfiber_t */
+    if (!keep && sched->map_size > 2 * s_vfiber_pagesize) {
+        madvise(VFIBER_MAP(sched, fiber) + s_vfiber_pagesize,
+                sched->map_size - 2 * s_vfiber_pagesize, MADV_DONTNEED);
+    }
+
+    pthread_mutex_lock(&sched->mutex);
+    fiber->next = sched->stacks;
+    sched->stacks = fiber;
+    ++sched->nstacks;
+    pthread_mutex_unlock(&sched->mutex);
+}
+/*****************************************************************************/
+/* queue fiber in run queue, waking up the vthread if needed */
+static void     vfiber_ready(
+                    vfiber_sched_t *    sched,
+                    vfiber_t *          fiber) {
+    int     notify;
+    char    c = 0;
+
+    fiber->state = VFS_READY;
+    fiber->next = NULL;
+    pthread_mutex_lock(&sched->mutex);
+    if (sched->run_tail == NULL) {
+        sched->run_head = fiber;
+    } else {
+        sched->run_tail->next = fiber;
+    }
+    sched->run_tail = fiber;
+    notify = !sched->notified;
+    sched->notified = 1;
+    pthread_mutex_unlock(&sched->mutex);
+
+    if (notify && vthread_pipe_write(sched->vthread, sched->pipe_fd, &c, sizeof(c)) != sizeof(c)) {
+        LOG_WARN(g_vlib_log, "%s(): cannot wake up vthread: %s", __func__, strerror(errno));
+        pthread_mutex_lock(&sched->mutex);
+        sched->notified = 0;
+        pthread_mutex_unlock(&sched->mutex);
+    }
+}
+/*****************************************************************************/
+static inline void vfiber_switch(
+                    vfiber_t *          fiber) {
+    swapcontext(&fiber->ctx, &fiber->sched->ctx);
+}
+/*****************************************************************************/
+static void     vfiber_resume(
+                    vfiber_sched_t *    sched,
+                    vfiber_t *          fiber,
+                    int                 event) {
+    fiber->state = VFS_RUNNING;
+    fiber->event = event;
+    pthread_setspecific(s_vfiber_key, fiber);
+    swapcontext(&sched->ctx, &fiber->ctx);
+    pthread_setspecific(s_vfiber_key, NULL);
+
+    if (fiber->state == VFS_DEAD) {
+        pthread_mutex_lock(&sched->mutex);
+        if (fiber->all_prev == NULL) {
+            sched->all = fiber->all_next;
+        } else {
+            fiber->all_prev->all_next = fiber->all_next;
+        }
+        if (fiber->all_next != NULL) {
+            fiber->all_next->all_prev = fiber->all_prev;
+        }
+        --sched->nfibers;
+        pthread_mutex_unlock(&sched->mutex);
+        vfiber_stack_release(sched, fiber);
+    }
+}
+/*****************************************************************************/
+/* makecontext() only gives int arguments */
+static void     vfiber_start(
+                    unsigned int        hi,
+                    unsigned int        lo) {
+    vfiber_t * fiber = (vfiber_t *) (uintptr_t) (((uint64_t) hi << 32) | lo);
+
+    fiber->fun(fiber->data);
+    fiber->state = VFS_DEAD;
+    vfiber_switch(fiber);
+}
+/*****************************************************************************/
+static int      vfiber_run_cb(
+                    vthread_t *         vthread,
+                    vthread_event_t     event,
+                    void *              event_data,
+                    void *              data) {
+    vfiber_sched_t *    sched = (vfiber_sched_t *) data;
+    vfiber_t *          fiber, * next;
+    char                buf[64];
+    (void)              vthread;
+
+    if (event != VTE_FD_READ) {
+        return 0;
+    }
+    while (read(VTE_FD_DATA(event_data), buf, sizeof(buf)) > 0)
+        ; /* drain pipe */
+
+    /* fibers made ready while running these ones will run on next loop */
+    pthread_mutex_lock(&sched->mutex);
+    fiber = sched->run_head;
+    sched->run_head = sched->run_tail = NULL;
+    sched->notified = 0;
+    pthread_mutex_unlock(&sched->mutex);
+
+    for ( ; fiber != NULL; fiber = next) {
+        next = fiber->next;
+        vfiber_resume(sched, fiber, VTE_NONE);
+    }
+    return 0;
+}
+/*****************************************************************************/
+static int      vfiber_fd_cb(
+                    vthread_t *         vthread,
+                    vthread_event_t     event,
+                    void *              event_data,
+                    void *              data) {
+    vfiber_t * fiber = (vfiber_t *) data;
+    (void) vthread;
+    (void) event_data;
+
+    vfiber_resume(fiber->sched, fiber, event);
+    return 0;
+}
+/*****************************************************************************/
+vfiber_sched_t *    vfiber_sched_create(
+                        vthread_t *         vthread,
+                        size_t              stack_size) {
+    vfiber_sched_t * sched;
+
+    pthread_once(&s_vfiber_once, vfiber_init);
+    if (vthread == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (stack_size == 0) {
+        stack_size = VLIB_FIBER_STACK_SZ;
+    }
+    if ((sched = calloc(1, sizeof(*sched))) == NULL) {
+        return NULL;
+    }
+    sched->vthread = vthread;
+    sched->map_size = ((stack_size + VFIBER_HDR_SZ + s_vfiber_pagesize - 1)
+                       / s_vfiber_pagesize + 1) * s_vfiber_pagesize;
+    pthread_mutex_init(&sched->mutex, NULL);
+    if ((sched->pipe_fd = vthread_pipe_create(vthread, vfiber_run_cb, sched)) < 0) {
+        pthread_mutex_destroy(&sched->mutex);
+        free(sched);
+        return NULL;
+    }
+    return sched;
+}
+/*****************************************************************************/
+void                vfiber_sched_free(
+                        vfiber_sched_t *    sched) {
+    vfiber_slab_t * slab;
+
+    if (sched == NULL) {
+        return ;
+    }
+    if (sched->nfibers != 0) {
+        LOG_VERBOSE(g_vlib_log, "%s(): discarding %lu fibers",
+                    __func__, (unsigned long) sched->nfibers);
+    }
+    while ((slab = sched->slabs) != NULL) {
+        sched->slabs = slab->next;
+        munmap(slab->map, sched->map_size * VFIBER_SLAB_STACKS);
+        free(slab);
+    }
+    pthread_mutex_destroy(&sched->mutex);
+    free(sched);
+}
+/*****************************************************************************/
+size_t              vfiber_sched_count(
+                        vfiber_sched_t *    sched) {
+    size_t count;
+
+    if (sched == NULL) {
+        errno = EINVAL;
+        return 0;
+    }
+    pthread_mutex_lock(&sched->mutex);
+    count = sched->nfibers;
+    pthread_mutex_unlock(&sched->mutex);
+    return count;
+}
+/*****************************************************************************/
+int                 vfiber_spawn(
+                        vfiber_sched_t *    sched,
+                        vfiber_fun_t        fun,
+                        void *              data) {
+    vfiber_t *  fiber;
+    uint64_t    ptr;
+
+    if (sched == NULL || fun == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    if ((fiber = vfiber_stack_get(sched)) == NULL) {
+        return -1;
+    }
+    if (getcontext(&fiber->ctx) != 0) {
+        vfiber_stack_release(sched, fiber);
+        return -1;
+    }
+    fiber->ctx.uc_stack.ss_sp = VFIBER_MAP(sched, fiber) + s_vfiber_pagesize;
+    fiber->ctx.uc_stack.ss_size = (char *) fiber - (char *) fiber->ctx.uc_stack.ss_sp;
+    fiber->ctx.uc_link = NULL;
+    ptr = (uintptr_t) fiber;
+    makecontext(&fiber->ctx, (void (*)()) vfiber_start, 2,
+                (unsigned int) (ptr >> 32), (unsigned int) (ptr & 0xffffffffU));
+    fiber->fun = fun;
+    fiber->data = data;
+
+    pthread_mutex_lock(&sched->mutex);
+    fiber->all_prev = NULL;
+    fiber->all_next = sched->all;
+    if (sched->all != NULL) {
+        sched->all->all_prev = fiber;
+    }
+    sched->all = fiber;
+    ++sched->nfibers;
+    pthread_mutex_unlock(&sched->mutex);
+
+    vfiber_ready(sched, fiber);
+    return 0;
+}
+/*****************************************************************************/
+vfiber_t *          vfiber_current() {
+    pthread_once(&s_vfiber_once, vfiber_init);
+    return (vfiber_t *) pthread_getspecific(s_vfiber_key);
+}
+/*****************************************************************************/
+int                 vfiber_yield() {
+    vfiber_t * fiber = vfiber_current();
+
+    if (fiber == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    vfiber_ready(fiber->sched, fiber);
+    vfiber_switch(fiber);
+    return 0;
+}
+/*****************************************************************************/
+int                 vfiber_wait_fd(
+                        int                 fd,
+                        unsigned int        events) {
+    vfiber_t * fiber = vfiber_current();
+
+    events &= (VTE_FD_READ | VTE_FD_WRITE | VTE_FD_ERR);
+    if (fiber == NULL || events == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (vthread_register_event(fiber->sched->vthread, events | VTE_ONESHOT,
+                               VTE_DATA_FD(fd), vfiber_fd_cb, fiber) != 0) {
+        return -1;
+    }
+    fiber->state = VFS_WAITING;
+    vfiber_switch(fiber);
+    return fiber->event;
+}
+/*****************************************************************************/
+/* @return non-zero if the failed I/O must be retried after the fiber waited for fd */
+static int      vfiber_io_wait(
+                    int                 fd,
+                    unsigned int        events) {
+    if (errno == EINTR) {
+        return 1;
+    }
+    if ((errno != EAGAIN && errno != EWOULDBLOCK) || vfiber_current() == NULL) {
+        return 0;
+    }
+    return vfiber_wait_fd(fd, events) >= 0;
+}
+/*****************************************************************************/
+ssize_t             vfiber_read(
+                        int                 fd,
+                        void *              buf,
+                        size_t              size) {
+    ssize_t n;
+
+    while ((n = read(fd, buf, size)) < 0 && vfiber_io_wait(fd, VTE_FD_READ))
+        ; /* retry */
+    return n;
+}
+/*****************************************************************************/
+ssize_t             vfiber_write(
+                        int                 fd,
+                        const void *        buf,
+                        size_t              size) {
+    size_t  done = 0;
+    ssize_t n;
+
+    while (done < size) {
+        if ((n = write(fd, (const char *) buf + done, size - done)) >= 0) {
+            done += n;
+        } else if (!vfiber_io_wait(fd, VTE_FD_WRITE)) {
+            return done > 0 ? (ssize_t) done : -1;
+        }
+    }
+    return done;
+}
+/*****************************************************************************/
+int                 vfiber_accept(
+                        int                 fd,
+                        struct sockaddr *   addr,
+                        socklen_t *         addrlen) {
+    int ret;
+
+    while ((ret = accept(fd, addr, addrlen)) < 0 && vfiber_io_wait(fd, VTE_FD_READ))
+        ; /* retry */
+    return ret;
+}
+/*****************************************************************************/
+int                 vfiber_connect(
+                        int                     fd,
+                        const struct sockaddr * addr,
+                        socklen_t               addrlen) {
+    socklen_t   len = sizeof(int);
+    int         err;
+
+    if (connect(fd, addr, addrlen) == 0) {
+        return 0;
+    }
+    /* connection continues asynchronously */
+    if ((errno != EINPROGRESS && errno != EINTR) || vfiber_current() == NULL
+    ||  vfiber_wait_fd(fd, VTE_FD_WRITE) < 0
+    ||  getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) != 0) {
+        return -1;
+    }
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+/*****************************************************************************/
+
@@ -0,0 +1,398 @@
+/*
+ * Copyright (C) 2026 Vincent Sallaberry
+ * vlib <https://github.com/vsallaberry/vlib>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/* ------------------------------------------------------------------------
+ * Simple d-ary heap (priority queue) in a contiguous array.
+ * Handles are indexes in a table giving the position of each element,
+ * free handles are chained in that table.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include "vlib/heap.h"
+#include "vlib/log.h"
+
+#include "vlib_private.h"
+
+/*****************************************************************************/
+
+typedef struct {
+    void *          data;
+    vheap_handle_t  handle;
+} vheap_node_t;
+
+struct vheap_s {
+    vheap_node_t *  nodes;
+    size_t *        pos;            /* handle -> position, or next free handle */
+    size_t          size;
+    size_t          max_size;
+    size_t          handles_used;   /* handles in [0,handles_used[ have been given */
+    vheap_handle_t  free_handle;
+    unsigned int    arity;
+    vheap_cmpfun_t  cmp;
+};
+
+#define VHEAP_PARENT(heap, i)       (((i) - 1) / (heap)->arity)
+#define VHEAP_CHILD(heap, i)        ((i) * (heap)->arity + 1)
+#define VHEAP_HANDLE_VALID(heap, h) ((h) < (heap)->handles_used \
+                                     && (heap)->pos[(h)] < (heap)->size \
+                                     && (heap)->nodes[(heap)->pos[(h)]].handle == (h))
+
+/*****************************************************************************/
+static int      vheap_reserve(
+                    vheap_t *       heap,
+                    size_t          count) {
+    size_t  new_size = heap->max_size > 0 ? heap->max_size : 1;
+    void *  new;
+
+    while (new_size < count) {
+        new_size *= 2;
+    }
+    if (new_size == heap->max_size) {
+        return 0;
+    }
+    if ((new = realloc(heap->nodes, new_size * sizeof(*heap->nodes))) == NULL) {
+        return -1;
+    }
+    heap->nodes = new;
+    if ((new = realloc(heap->pos, new_size * sizeof(*heap->pos))) == NULL) {
+        return -1;
+    }
+    heap->pos = new;
+    heap->max_size = new_size;
+    return 0;
+}
+/*****************************************************************************/
+static vheap_handle_t vheap_handle_new(
+                    vheap_t *       heap) {
+    vheap_handle_t handle;
+
+    if (heap->free_handle != VHEAP_INVALID_HANDLE) {
+        handle = heap->free_handle;
+        heap->free_handle = heap->pos[handle];
+    } else {
+        handle = heap->handles_used++;
+    }
+    return handle;
+}
+/*****************************************************************************/
+static void     vheap_handle_release(
+                    vheap_t *       heap,
+                    vheap_handle_t  handle) {
+    heap->pos[handle] = heap->free_handle;
+    heap->free_handle = handle;
+}
+/*****************************************************************************/
+static inline void vheap_set(
+                    vheap_t *       heap,
+                    size_t          i,
+                    vheap_node_t    node) {
+    heap->nodes[i] = node;
+    heap->pos[node.handle] = i;
+}
+/*****************************************************************************/
+static size_t   vheap_sift_up(
+                    vheap_t *       heap,
+                    size_t          i) {
+    vheap_node_t node = heap->nodes[i];
+
+    while (i > 0) {
+        size_t parent = VHEAP_PARENT(heap, i);
+        if (heap->cmp(node.data, heap->nodes[parent].data) >= 0) {
+            break ;
+        }
+        vheap_set(heap, i, heap->nodes[parent]);
+        i = parent;
+    }
+    vheap_set(heap, i, node);
+    return i;
+}
+/*****************************************************************************/
+static size_t   vheap_sift_down(
+                    vheap_t *       heap,
+                    size_t          i) {
+    vheap_node_t    node = heap->nodes[i];
+    size_t          child, last, best;
+
+    while ((child = VHEAP_CHILD(heap, i)) < heap->size) {
+        last = child + heap->arity;
+        if (last > heap->size) {
+            last = heap->size;
+        }
+        for (best = child++; child < last; ++child) {
+            if (heap->cmp(heap->nodes[child].data, heap->nodes[best].data) < 0) {
+                best = child;
+            }
+        }
+        if (heap->cmp(heap->nodes[best].data, node.data) >= 0) {
+            break ;
+        }
+        vheap_set(heap, i, heap->nodes[best]);
+        i = best;
+    }
+    vheap_set(heap, i, node);
+    return i;
+}
+/*****************************************************************************/
+vheap_t *       vheap_create(
+                    unsigned int    arity,
+                    size_t          init_size,
+                    vheap_cmpfun_t  cmpfun) {
+    vheap_t * heap;
+
+    if (arity < 2 || cmpfun == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (init_size == 0) {
+        init_size = VLIB_HEAP_SZ;
+    }
+    if ((heap = calloc(1, sizeof(*heap))) == NULL) {
+        return NULL;
+    }
+    heap->arity = arity;
+    heap->cmp = cmpfun;
+    if (vheap_reserve(heap, init_size) != 0) {
+        vheap_free(heap);
+        return NULL;
+    }
+    vheap_clear(heap);
+    return heap;
+}
+/*****************************************************************************/
+void            vheap_free(
+                    vheap_t *       heap) {
+    if (heap == NULL) {
+        return ;
+    }
+    if (heap->nodes != NULL) {
+        free(heap->nodes);
+    }
+    if (heap->pos != NULL) {
+        free(heap->pos);
+    }
+    free(heap);
+}
+/*****************************************************************************/
+int             vheap_clear(
+                    vheap_t *       heap) {
+    if (heap == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    heap->size = 0;
+    heap->handles_used = 0;
+    heap->free_handle = VHEAP_INVALID_HANDLE;
+    return 0;
+}
+/*****************************************************************************/
+size_t          vheap_size(
+                    const vheap_t * heap) {
+    if (heap == NULL) {
+        errno = EINVAL;
+        return 0;
+    }
+    if (heap->size == 0) {
+        errno = 0;
+    }
+    return heap->size;
+}
+/*****************************************************************************/
+size_t          vheap_memorysize(
+                    const vheap_t * heap) {
+    if (heap == NULL) {
+        errno = EINVAL;
+        return 0;
+    }
+    return sizeof(*heap) + heap->max_size * (sizeof(*heap->nodes) + sizeof(*heap->pos));
+}
+/*****************************************************************************/
+vheap_handle_t  vheap_push(
+                    vheap_t *       heap,
+                    void *          data) {
+    vheap_node_t node;
+
+    if (heap == NULL) {
+        errno = EINVAL;
+        return VHEAP_INVALID_HANDLE;
+    }
+    if (heap->size == heap->max_size && vheap_reserve(heap, heap->size + 1) != 0) {
+        return VHEAP_INVALID_HANDLE;
+    }
+    node.data = data;
+    node.handle = vheap_handle_new(heap);
+    vheap_set(heap, heap->size++, node);
+    vheap_sift_up(heap, heap->size - 1);
+
+    return node.handle;
+}
+/*****************************************************************************/
+void *          vheap_peek(
+                    const vheap_t * heap) {
+    void * ret;
+
+    if (heap == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (heap->size == 0) {
+        errno = ENOENT;
+        return NULL;
+    }
+    if ((ret = heap->nodes[0].data) == NULL) {
+        errno = 0;
+    }
+    return ret;
+}
+/*****************************************************************************/
+void *          vheap_pop(
+                    vheap_t *       heap) {
+    if (heap == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (heap->size == 0) {
+        errno = ENOENT;
+        return NULL;
+    }
+    return vheap_remove(heap, heap->nodes[0].handle);
+}
+/*****************************************************************************/
+void *          vheap_get(
+                    const vheap_t * heap,
+                    vheap_handle_t  handle) {
+    void * ret;
+
+    if (heap == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (!VHEAP_HANDLE_VALID(heap, handle)) {
+        errno = ENOENT;
+        return NULL;
+    }
+    if ((ret = heap->nodes[heap->pos[handle]].data) == NULL) {
+        errno = 0;
+    }
+    return ret;
+}
+/*****************************************************************************/
+int             vheap_decrease_key(
+                    vheap_t *       heap,
+                    vheap_handle_t  handle) {
+    if (heap == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (!VHEAP_HANDLE_VALID(heap, handle)) {
+        errno = ENOENT;
+        return -1;
+    }
+    vheap_sift_up(heap, heap->pos[handle]);
+    return 0;
+}
+/*****************************************************************************/
+int             vheap_update(
+                    vheap_t *       heap,
+                    vheap_handle_t  handle) {
+    size_t i;
+
+    if (heap == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (!VHEAP_HANDLE_VALID(heap, handle)) {
+        errno = ENOENT;
+        return -1;
+    }
+    i = heap->pos[handle];
+    if (vheap_sift_up(heap, i) == i) {
+        vheap_sift_down(heap, i);
+    }
+    return 0;
+}
+/*****************************************************************************/
+void *          vheap_remove(
+                    vheap_t *       heap,
+                    vheap_handle_t  handle) {
+    void *  ret;
+    size_t  i;
+
+    if (heap == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (!VHEAP_HANDLE_VALID(heap, handle)) {
+        errno = ENOENT;
+        return NULL;
+    }
+    i = heap->pos[handle];
+    ret = heap->nodes[i].data;
+    vheap_handle_release(heap, handle);
+
+    if (i != --heap->size) {
+        /* move the last element to the hole and restore heap order */
+        vheap_set(heap, i, heap->nodes[heap->size]);
+        if (vheap_sift_up(heap, i) == i) {
+            vheap_sift_down(heap, i);
+        }
+    }
+    if (ret == NULL) {
+        errno = 0;
+    }
+    return ret;
+}
+/*****************************************************************************/
+int             vheap_heapify(
+                    vheap_t *       heap,
+                    void * const *  data,
+                    size_t          n,
+                    vheap_handle_t *handles) {
+    vheap_node_t    node;
+    size_t          i;
+
+    if (heap == NULL || (data == NULL && n > 0)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (n == 0) {
+        return 0;
+    }
+    if (vheap_reserve(heap, heap->size + n) != 0) {
+        return -1;
+    }
+    for (i = 0; i < n; ++i) {
+        node.data = data[i];
+        node.handle = vheap_handle_new(heap);
+        if (handles != NULL) {
+            handles[i] = node.handle;
+        }
+        vheap_set(heap, heap->size++, node);
+    }
+    /* Floyd's method: sift down each parent, starting from the last one */
+    if (heap->size > 1) {
+        for (i = VHEAP_PARENT(heap, heap->size - 1) + 1; i-- > 0; ) {
+            vheap_sift_down(heap, i);
+        }
+    }
+    return 0;
+}
+/*****************************************************************************/
+
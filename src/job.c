@@ -25,15 +25,36 @@
 #include <pthread.h>
 #include <errno.h>
 #include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <sched.h>
+#ifdef __linux__
+# include <sys/resource.h>
+# include <sys/syscall.h>
+#endif
 
 #include "vlib/job.h"
 #include "vlib/thread.h"
+#include "vlib/slist.h"
+#include "vlib/heap.h"
+#include "vlib/util.h"
+#include "vlib/time.h"
 
 #include "vlib_private.h"
 
 /** internal */
 typedef struct vjob_cleanup_s vjob_cleanup_t;
 
+struct vjob_cancel_s {
+    unsigned int            cancelled;  /* atomic */
+    unsigned int            allocated;
+    uint64_t                deadline;   /* atomic: CLOCK_MONOTONIC ns, 0 if none */
+    vjob_cancel_t *         parent;     /* tree links are protected by s_vjob_cancel_mutex */
+    vjob_cancel_t *         children;
+    vjob_cancel_t *         next;
+    vjob_cancel_t *         prev;
+};
+
 struct vjob_s {
     void *                  retval;
     void *                  user_data;
@@ -43,8 +64,222 @@ struct vjob_s {
     pthread_mutex_t         mutex;
     pthread_cond_t          cond;
     unsigned int            state;
+    vjob_pool_t *           pool;       /* NULL if job has its own thread */
+    slist_t                 node;       /* pool free list, node.data is job */
+    unsigned int            refs;       /* atomic: handle + jobs this one depends on */
+    unsigned int            kind;       /* vjob_kind_t */
+    size_t                  deps;       /* atomic: jobs to wait before starting */
+    slist_t *               conts;      /* jobs depending on this one */
+    vjob_then_fun_t         then_fun;
+    void *                  dep_result; /* result given to then_fun */
+    vjob_t **               any_deps;   /* VJK_WHEN_ANY: copy of deps, to get the index of the first done */
+    vjob_cancel_t           token;      /* cancelled by vjob_kill() */
+    unsigned int            prio;       /* vjob_prio_t */
+    uint64_t                deadline;   /* CLOCK_MONOTONIC ns of EDF queue, 0 if none */
+    uint64_t                submit_ns;  /* CLOCK_MONOTONIC ns of submission, 0 if not queued */
+    int                     numa;       /* preferred NUMA node, -1 if none */
+    unsigned int            home;       /* NUMA node of the free list of job */
 };
 
+static void vjob_pool_job_release(vjob_t * job);
+static int  vjob_pool_wait(vjob_t * job, const struct timespec * abstime);
+
+static pthread_once_t       s_vjob_keys_once = PTHREAD_ONCE_INIT;
+static pthread_key_t        s_vjob_worker_key;      /* worker of pool worker threads */
+static pthread_key_t        s_vjob_current_key;     /* job run by current thread */
+static pthread_mutex_t      s_vjob_cancel_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* ************************************************************************ */
+static void vjob_keys_init() {
+    if (pthread_key_create(&s_vjob_worker_key, NULL) != 0
+    ||  pthread_key_create(&s_vjob_current_key, NULL) != 0) {
+        LOG_WARN(g_vlib_log, "%s(): cannot create job keys", __func__);
+    }
+}
+
+/* ************************************************************************ */
+/* get in abstime the CLOCK_REALTIME time in timeout_ms, for pthread_cond_timedwait() */
+static void vjob_abstime(struct timespec * abstime, unsigned long timeout_ms) {
+    vclock_gettime(CLOCK_REALTIME, abstime);
+    abstime->tv_sec += timeout_ms / 1000;
+    abstime->tv_nsec += (timeout_ms % 1000) * 1000000L;
+    if (abstime->tv_nsec >= 1000000000L) {
+        ++abstime->tv_sec;
+        abstime->tv_nsec -= 1000000000L;
+    }
+}
+
+/* ************************************************************************ */
+static uint64_t vjob_clock_ns() {
+    struct timespec ts;
+
+    vclock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* ************************************************************************ */
+/* Cancellation tokens.
+ * A token is cancelled by setting its flag, then recursively the flags of its
+ * children, so that polling only reads the flag of the token. A deadline is
+ * inherited by children when it is earlier than theirs, and polling a token
+ * having a deadline reads the clock. */
+
+/* ************************************************************************ */
+static uint64_t vjob_cancel_now() {
+    struct timespec ts;
+
+#if defined(CLOCK_MONOTONIC_COARSE)
+    if (clock_gettime(CLOCK_MONOTONIC_COARSE, &ts) != 0)
+#endif
+    vclock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* ************************************************************************ */
+static void vjob_cancel_locked(vjob_cancel_t * token) {
+    vjob_cancel_t * child;
+
+    VLIB_ATOMIC_STORE(&token->cancelled, 1);
+    for (child = token->children; child != NULL; child = child->next) {
+        if (VLIB_ATOMIC_LOAD_RELAXED(&child->cancelled) == 0) {
+            vjob_cancel_locked(child);
+        }
+    }
+}
+
+/* ************************************************************************ */
+static void vjob_cancel_deadline_locked(vjob_cancel_t * token, uint64_t deadline) {
+    vjob_cancel_t * child;
+    uint64_t        cur = VLIB_ATOMIC_LOAD_RELAXED(&token->deadline);
+
+    if (cur != 0 && cur <= deadline) {
+        return ;
+    }
+    VLIB_ATOMIC_STORE(&token->deadline, deadline);
+    for (child = token->children; child != NULL; child = child->next) {
+        vjob_cancel_deadline_locked(child, deadline);
+    }
+}
+
+/* ************************************************************************ */
+static void vjob_cancel_init(vjob_cancel_t * token, vjob_cancel_t * parent) {
+    token->cancelled = 0;
+    token->deadline = 0;
+    token->parent = token->children = token->next = token->prev = NULL;
+    if (parent == NULL) {
+        return ;
+    }
+    pthread_mutex_lock(&s_vjob_cancel_mutex);
+    VLIB_ATOMIC_STORE(&token->parent, parent);
+    if ((token->next = parent->children) != NULL) {
+        token->next->prev = token;
+    }
+    VLIB_ATOMIC_STORE(&parent->children, token);
+    token->cancelled = VLIB_ATOMIC_LOAD_RELAXED(&parent->cancelled);
+    token->deadline = VLIB_ATOMIC_LOAD_RELAXED(&parent->deadline);
+    pthread_mutex_unlock(&s_vjob_cancel_mutex);
+}
+
+/* ************************************************************************ */
+/* detach token from its parent and its children */
+static void vjob_cancel_unlink(vjob_cancel_t * token) {
+    vjob_cancel_t * child;
+
+    if (VLIB_ATOMIC_LOAD(&token->parent) == NULL
+    &&  VLIB_ATOMIC_LOAD(&token->children) == NULL) {
+        return ;
+    }
+    pthread_mutex_lock(&s_vjob_cancel_mutex);
+    if (token->parent != NULL) {
+        if (token->prev != NULL) {
+            token->prev->next = token->next;
+        } else {
+            VLIB_ATOMIC_STORE(&token->parent->children, token->next);
+        }
+        if (token->next != NULL) {
+            token->next->prev = token->prev;
+        }
+        VLIB_ATOMIC_STORE(&token->parent, (vjob_cancel_t *) NULL);
+        token->next = token->prev = NULL;
+    }
+    for (child = token->children; child != NULL; ) {
+        vjob_cancel_t * next = child->next;
+        VLIB_ATOMIC_STORE(&child->parent, (vjob_cancel_t *) NULL);
+        child->next = child->prev = NULL;
+        child = next;
+    }
+    VLIB_ATOMIC_STORE(&token->children, (vjob_cancel_t *) NULL);
+    pthread_mutex_unlock(&s_vjob_cancel_mutex);
+}
+
+/* ************************************************************************ */
+vjob_cancel_t * vjob_cancel_create(vjob_cancel_t * parent) {
+    vjob_cancel_t * token;
+
+    if ((token = malloc(sizeof(*token))) == NULL) {
+        return NULL;
+    }
+    vjob_cancel_init(token, parent);
+    token->allocated = 1;
+    return token;
+}
+
+/* ************************************************************************ */
+void vjob_cancel_free(vjob_cancel_t * token) {
+    if (token == NULL || !token->allocated)
+        return ;
+    vjob_cancel_unlink(token);
+    free(token);
+}
+
+/* ************************************************************************ */
+void vjob_cancel(vjob_cancel_t * token) {
+    if (token == NULL)
+        return ;
+    pthread_mutex_lock(&s_vjob_cancel_mutex);
+    vjob_cancel_locked(token);
+    pthread_mutex_unlock(&s_vjob_cancel_mutex);
+}
+
+/* ************************************************************************ */
+int vjob_cancel_deadline(vjob_cancel_t * token, unsigned long timeout_ms) {
+    if (token == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    pthread_mutex_lock(&s_vjob_cancel_mutex);
+    vjob_cancel_deadline_locked(token, vjob_cancel_now() + (uint64_t) timeout_ms * 1000000ULL);
+    pthread_mutex_unlock(&s_vjob_cancel_mutex);
+    return 0;
+}
+
+/* ************************************************************************ */
+int vjob_cancelled(vjob_cancel_t * token) {
+    uint64_t deadline;
+
+    if (token == NULL)
+        return 0;
+    if (VLIB_ATOMIC_LOAD_RELAXED(&token->cancelled) != 0)
+        return 1;
+    if ((deadline = VLIB_ATOMIC_LOAD_RELAXED(&token->deadline)) == 0
+    ||  vjob_cancel_now() < deadline)
+        return 0;
+    vjob_cancel(token);
+    return 1;
+}
+
+/* ************************************************************************ */
+vjob_cancel_t * vjob_cancel_current() {
+    vjob_t * job;
+
+    pthread_once(&s_vjob_keys_once, vjob_keys_init);
+    if ((job = pthread_getspecific(s_vjob_current_key)) == NULL)
+        return NULL;
+    return &job->token;
+}
+
+/* ************************************************************************ */
+
 /* ************************************************************************ */
 
 struct vjob_cleanup_s {
@@ -59,6 +294,7 @@ static void job_cleanup(void * vdata) {
         pthread_mutex_lock(&(job->mutex));
         job->state |= VJS_INTERRUPTED;
         cleanup->job = NULL;
+        pthread_cond_broadcast(&(job->cond));
         pthread_mutex_unlock(&(job->mutex));
     }
 }
@@ -73,6 +309,7 @@ static void * job_runner(void * vdata) {
     pthread_mutex_lock(&(job->mutex));
     pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
     pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, NULL);
+    pthread_setspecific(s_vjob_current_key, job);
     user_fun = job->user_fun;
     user_data = job->user_data;
     job->state |= VJS_STARTED;
@@ -110,6 +347,7 @@ static void * job_runner(void * vdata) {
         job->state |= VJS_DONE;
         job->retval = retval;
         job->cleanup = NULL;
+        pthread_cond_broadcast(&(job->cond));
         pthread_mutex_unlock(&(job->mutex));
     }
 
@@ -132,7 +370,11 @@ void * vjob_free(vjob_t * job) {
         return ret;
     vjob_kill(job);
     ret = vjob_wait(job);
-    vjob_free_ctx(job);
+    if (job->pool != NULL) {
+        vjob_pool_job_release(job);
+    } else {
+        vjob_free_ctx(job);
+    }
     return ret;
 }
 
@@ -147,14 +389,18 @@ vjob_t * vjob_run(vjob_fun_t fun, void * user_data) {
         return NULL;
     }
 
+    pthread_once(&s_vjob_keys_once, vjob_keys_init);
     pthread_mutex_init(&(job->mutex), NULL);
     pthread_cond_init(&(job->cond), NULL);
+    vjob_cancel_init(&job->token, NULL);
+    job->token.allocated = 0;
 
     job->user_fun = fun;
     job->user_data = user_data;
     job->retval = VJOB_NO_RESULT;
     job->state = VJS_CREATED;
     job->cleanup = NULL;
+    job->pool = NULL;
 
     pthread_mutex_lock(&(job->mutex));
     if (pthread_create(&(job->tid), NULL, job_runner, job) != 0) {
@@ -207,6 +453,19 @@ void * vjob_wait(vjob_t * job) {
     pthread_mutex_lock(&(job->mutex));
     state = job->state;
 
+    if (job->pool != NULL) {
+        pthread_mutex_unlock(&(job->mutex));
+        /* a worker runs other jobs while waiting */
+        vjob_pool_wait(job, NULL);
+        pthread_mutex_lock(&(job->mutex));
+        while ((job->state & (VJS_DONE | VJS_INTERRUPTED)) == 0) {
+            pthread_cond_wait(&(job->cond), &(job->mutex));
+        }
+        retval = job->retval;
+        pthread_mutex_unlock(&(job->mutex));
+        return retval;
+    }
+
     if ((state & (VJS_DETACHED)) != 0) {
         retval = job->retval;
         pthread_mutex_unlock(&(job->mutex));
@@ -249,6 +508,42 @@ void * vjob_wait(vjob_t * job) {
     return retval;
 }
 
+/* ************************************************************************ */
+void * vjob_wait_timeout(vjob_t * job, unsigned long timeout_ms) {
+    struct timespec abstime;
+    int             ret = 0;
+
+    if (job == NULL)
+        return VJOB_ERR_RESULT;
+    if (timeout_ms == 0)
+        return vjob_wait(job);
+
+    /* a detached job cannot be waited, and a pooled one is recycled when finished */
+    pthread_mutex_lock(&(job->mutex));
+    if ((job->state & (VJS_DONE | VJS_INTERRUPTED | VJS_DETACHED)) == VJS_DETACHED) {
+        pthread_mutex_unlock(&(job->mutex));
+        errno = EINVAL;
+        return VJOB_ERR_RESULT;
+    }
+    pthread_mutex_unlock(&(job->mutex));
+
+    vjob_abstime(&abstime, timeout_ms);
+    if (job->pool != NULL && vjob_pool_wait(job, &abstime) != 0) {
+        errno = ETIMEDOUT;
+        return VJOB_NO_RESULT;
+    }
+    pthread_mutex_lock(&(job->mutex));
+    while ((job->state & (VJS_DONE | VJS_INTERRUPTED)) == 0 && ret == 0) {
+        ret = pthread_cond_timedwait(&(job->cond), &(job->mutex), &abstime);
+    }
+    pthread_mutex_unlock(&(job->mutex));
+    if (ret != 0) {
+        errno = ETIMEDOUT;
+        return VJOB_NO_RESULT;
+    }
+    return vjob_wait(job);
+}
+
 /* ************************************************************************ */
 void * vjob_killnowait(vjob_t * job) {
     void *          retval  = VJOB_ERR_RESULT;
@@ -258,11 +553,13 @@ void * vjob_killnowait(vjob_t * job) {
     if (job == NULL)
         return retval;
 
+    vjob_cancel(&job->token);
+
     pthread_mutex_lock(&(job->mutex));
     state = job->state;
     job->state |= VJS_EXIT_REQUESTED;
     if ((state & (VJS_DONE | VJS_DETACHED | VJS_INTERRUPTED | VJS_EXIT_REQUESTED)) != 0
-    || (state & VJS_STARTED) == 0) {
+    || (state & VJS_STARTED) == 0 || job->pool != NULL) {
         retval = job->retval;
         pthread_mutex_unlock(&(job->mutex));
         return retval;
@@ -347,6 +644,26 @@ static inline int vjob_detach_internal(vjob_t * job, int is_self) {
         errno = EFAULT;
         return -1;
     }
+    if (job->pool != NULL) {
+        unsigned int state;
+
+        pthread_mutex_lock(&(job->mutex));
+        state = job->state;
+        if ((state & VJS_DETACHED) != 0
+        ||  (is_self && ((state & (VJS_STARTED | VJS_DONE)) != VJS_STARTED
+                         || !pthread_equal(job->tid, pthread_self())))) {
+            pthread_mutex_unlock(&(job->mutex));
+            return -1;
+        }
+        job->state |= VJS_DETACHED;
+        pthread_mutex_unlock(&(job->mutex));
+        /* a finished job is released now, otherwise by the worker */
+        if ((state & (VJS_DONE | VJS_INTERRUPTED)) != 0) {
+            vjob_pool_job_release(job);
+        }
+        LOG_SCREAM(g_vlib_log, "pooled job %lx detached.", (unsigned long) job);
+        return 0;
+    }
     pthread_mutex_lock(&(job->mutex));
     if ((!is_self || job->tid == pthread_self())
     &&  job->cleanup != NULL
@@ -405,3 +722,2301 @@ unsigned int vjob_cpu_nb() {
     return ncpus;
 }
 
+/* ************************************************************************ */
+/* CPU topology.
+ * NUMA nodes are read from /sys/devices/system/node, and numbered in their
+ * order there, skipping nodes without CPU allowed to the process. If sysfs is
+ * not available, there is one node with all allowed CPUs. */
+#define VJOB_NODE_MAX           64
+#define VJOB_SYSFS_NODE         "/sys/devices/system/node"
+#if defined(__linux__) && defined(CPU_SETSIZE)
+# define VJOB_HAVE_AFFINITY
+#endif
+
+typedef struct {
+    unsigned int            nnodes;
+    unsigned int            first[VJOB_NODE_MAX + 1];   /* cpus of node n: [first[n],first[n+1][ */
+#ifdef VJOB_HAVE_AFFINITY
+    short                   cpus[CPU_SETSIZE];
+#endif
+} vjob_topology_t;
+
+static pthread_once_t       s_vjob_topology_once = PTHREAD_ONCE_INIT;
+static vjob_topology_t      s_vjob_topology;
+
+#ifdef VJOB_HAVE_AFFINITY
+/* ************************************************************************ */
+/* add to set the cpus of a sysfs list (eg: "0-3,8,10-11")
+ * @return 0 on success, -1 on error */
+static int vjob_cpulist_read(const char * path, cpu_set_t * set) {
+    char    buf[4096];
+    char *  str, * end;
+    FILE *  file;
+    long    first, last;
+
+    if ((file = fopen(path, "r")) == NULL) {
+        return -1;
+    }
+    str = fgets(buf, sizeof(buf), file);
+    fclose(file);
+    if (str == NULL) {
+        return -1;
+    }
+    while (*str >= '0' && *str <= '9') {
+        first = last = strtol(str, &end, 10);
+        if (*end == '-') {
+            last = strtol(end + 1, &end, 10);
+        }
+        for ( ; first <= last && first < CPU_SETSIZE; ++first) {
+            CPU_SET(first, set);
+        }
+        str = (*end == ',') ? end + 1 : end;
+    }
+    return 0;
+}
+#endif
+
+/* ************************************************************************ */
+static void vjob_topology_init() {
+    vjob_topology_t *   topo = &s_vjob_topology;
+#ifdef VJOB_HAVE_AFFINITY
+    cpu_set_t           allowed, nodes, cpus;
+    char                path[sizeof(VJOB_SYSFS_NODE) + 32];
+    unsigned int        ncpus = 0;
+    int                 node, cpu;
+
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        for (cpu = 0; cpu < (int) vjob_cpu_nb() && cpu < CPU_SETSIZE; ++cpu) {
+            CPU_SET(cpu, &allowed);
+        }
+    }
+    CPU_ZERO(&nodes);
+    if (vjob_cpulist_read(VJOB_SYSFS_NODE "/online", &nodes) != 0) {
+        CPU_SET(0, &nodes);
+    }
+    for (node = 0; node < CPU_SETSIZE && topo->nnodes < VJOB_NODE_MAX; ++node) {
+        if (!CPU_ISSET(node, &nodes)) {
+            continue ;
+        }
+        CPU_ZERO(&cpus);
+        snprintf(path, sizeof(path), VJOB_SYSFS_NODE "/node%d/cpulist", node);
+        if (vjob_cpulist_read(path, &cpus) != 0) {
+            continue ;
+        }
+        topo->first[topo->nnodes] = ncpus;
+        for (cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &cpus) && CPU_ISSET(cpu, &allowed)) {
+                topo->cpus[ncpus++] = cpu;
+                CPU_CLR(cpu, &allowed);
+            }
+        }
+        if (ncpus > topo->first[topo->nnodes]) {
+            ++topo->nnodes;
+        }
+    }
+    /* no sysfs, or allowed cpus not found in nodes */
+    if (topo->nnodes < VJOB_NODE_MAX && (topo->nnodes == 0 || CPU_COUNT(&allowed) != 0)) {
+        topo->first[topo->nnodes] = ncpus;
+        for (cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &allowed)) {
+                topo->cpus[ncpus++] = cpu;
+            }
+        }
+        if (ncpus > topo->first[topo->nnodes] || topo->nnodes == 0) {
+            ++topo->nnodes;
+        }
+    }
+    topo->first[topo->nnodes] = ncpus;
+    LOG_DEBUG(g_vlib_log, "%s(): %u NUMA nodes, %u cpus", __func__, topo->nnodes, ncpus);
+#else
+    topo->nnodes = 1;
+#endif
+}
+
+/* ************************************************************************ */
+unsigned int vjob_numa_nb() {
+    pthread_once(&s_vjob_topology_once, vjob_topology_init);
+    return s_vjob_topology.nnodes;
+}
+
+/* ************************************************************************ */
+/* Pool of workers.
+ * Jobs submitted by other threads go to the injection queue, the bounded MPMC
+ * queue of D.Vyukov: each cell has a sequence number telling whether it is
+ * free for the enqueue position pos (seq == pos), or holds a job for the
+ * dequeue position pos (seq == pos + 1).
+ * Normal priority jobs submitted by a worker go to its own Chase-Lev deque (as in N.M.Lê et al.,
+ * "Correct and Efficient Work-Stealing for Weak Memory Models"): the owner
+ * pushes and takes at bottom (LIFO), other threads steal at top (FIFO).
+ * Idle workers sleep on the pool condition, counted in pool->idle which is
+ * incremented under pool->mutex before checking the queues a last time, so that
+ * a submitter seeing idle == 0 after its push knows a worker will find the job.
+ * A thread waiting for a pooled job or a parallel loop runs other jobs meanwhile.
+ * Priorities: high and low priority jobs have their own injection queues, and
+ * jobs with a deadline are kept in an EDF heap protected by pool->edf_mutex.
+ * Workers have a role telling which jobs they run: reserved workers only run
+ * deadline and high priority jobs, background ones only low priority jobs, and
+ * normal workers run everything but low priority jobs if there are background
+ * workers. Each role has its own idle counter and condition, so that a
+ * submitter wakes a worker able to run its job.
+ * NUMA: pinned workers are spread over nodes, a worker first steals workers of
+ * its node, and jobs with a node hint go to the node queue, checked by workers
+ * of that node before other queues. Each worker allocates its deque after being
+ * pinned and pooled jobs are recycled per node, so that memory is first touched
+ * on the node using it.
+ */
+#define VJOB_POOL_QUEUE_SZ      4096    /* power of 2 */
+#define VJOB_DEQUE_SZ           256     /* initial size of worker deque, power of 2 */
+#define VJOB_POOL_SPIN          16      /* dequeue tries before sleeping */
+#define VJOB_HELP_WAIT_MS       1       /* wait of a helper finding no job to run */
+#define VJOB_PARALLEL_SPLIT     8       /* default number of chunks per worker */
+#define VJOB_CACHELINE          64
+#ifndef VJOB_TELEMETRY
+# define VJOB_TELEMETRY         1       /* compile pool telemetry, enabled at runtime */
+#endif
+#if VJOB_TELEMETRY
+# define VJOB_TM_ON(pool)       (VLIB_ATOMIC_LOAD_RELAXED(&(pool)->telemetry) != 0)
+#else
+# define VJOB_TM_ON(pool)       (0)
+#endif
+
+typedef struct {
+    size_t                  seq;
+    vjob_t *                job;
+} vjob_qcell_t;
+
+typedef struct {
+    vjob_qcell_t *          cells;
+    size_t                  mask;
+    char                    pad0[VJOB_CACHELINE - sizeof(void *) - sizeof(size_t)];
+    size_t                  enqueue_pos;
+    char                    pad1[VJOB_CACHELINE - sizeof(size_t)];
+    size_t                  dequeue_pos;
+    char                    pad2[VJOB_CACHELINE - sizeof(size_t)];
+} vjob_queue_t;
+
+typedef struct vjob_darray_s {
+    struct vjob_darray_s *  prev;       /* replaced array, freed with deque */
+    size_t                  mask;
+    vjob_t *                jobs[];
+} vjob_darray_t;
+
+typedef struct {
+    ssize_t                 top;
+    char                    pad0[VJOB_CACHELINE - sizeof(ssize_t)];
+    ssize_t                 bottom;
+    vjob_darray_t *         array;
+    char                    pad1[VJOB_CACHELINE - sizeof(ssize_t) - sizeof(void *)];
+} vjob_deque_t;
+
+/* worker roles */
+typedef enum {
+    VJOB_ROLE_NORMAL = 0,
+    VJOB_ROLE_RESERVED,                 /* deadline and high priority jobs */
+    VJOB_ROLE_BACKGROUND,               /* low priority jobs */
+    VJOB_ROLE_NB
+} vjob_role_t;
+
+/* statistics of a priority class, updated by one worker or by non-worker threads */
+typedef struct {
+    size_t                  submitted;  /* atomic */
+    size_t                  started;    /* atomic */
+    uint64_t                wait_ns;    /* atomic: sum of waits between submission and start */
+    uint64_t                wait_max_ns;/* atomic */
+} vjob_prio_stats_t;
+
+/* telemetry counters, updated by one worker or by non-worker threads */
+typedef struct {
+    size_t                  completed;  /* atomic */
+    size_t                  steals;     /* atomic */
+    uint64_t                busy_ns;    /* atomic */
+    size_t                  wait_hist[VJOB_TELEMETRY_BUCKETS];  /* atomic */
+    size_t                  run_hist[VJOB_TELEMETRY_BUCKETS];   /* atomic */
+} vjob_tm_counters_t;
+
+typedef struct {
+    vjob_deque_t            deque;
+    vjob_pool_t *           pool;
+    pthread_t               tid;
+    unsigned int            index;
+    unsigned int            seed;       /* victim selection */
+    unsigned int            role;       /* vjob_role_t */
+    unsigned int            node;       /* NUMA node, 0 if pool workers are not pinned */
+    int                     cpu;        /* pinned cpu, or -1 */
+    vjob_prio_stats_t       stats[VJOB_PRIO_NB];
+    vjob_tm_counters_t      tm;
+    unsigned int            depth;      /* nested jobs run by worker, for busy time */
+    char                    pad[VJOB_CACHELINE];
+} vjob_worker_t;
+
+struct vjob_pool_s {
+    vjob_queue_t            queues[VJOB_PRIO_NB];   /* injection queues */
+    vheap_t *               edf;        /* jobs with deadline, earliest on top */
+    size_t                  nedf;       /* atomic: number of jobs in edf */
+    pthread_mutex_t         edf_mutex;
+    vjob_queue_t *          node_queues;/* normal priority jobs with a NUMA node hint */
+    slist_atomic_t *        free_jobs;  /* recycled jobs, per NUMA node */
+    unsigned int            nnodes;     /* NUMA nodes of workers, 1 if workers are not pinned */
+    unsigned int            flags;      /* VJOB_POOL_PIN_* */
+    vjob_worker_t *         workers;
+    unsigned int            nworkers;
+    unsigned int            nthreads;   /* started workers */
+    unsigned int            nroles[VJOB_ROLE_NB];
+    int                     background_nice;
+    unsigned int            idle[VJOB_ROLE_NB]; /* atomic: number of sleeping workers */
+    unsigned int            stop;       /* atomic */
+    unsigned int            seed;       /* atomic: victim selection of helpers */
+    size_t                  njobs;      /* atomic: number of allocated vjob_t */
+    vjob_prio_stats_t       stats[VJOB_PRIO_NB];    /* jobs submitted or started by non-workers */
+    vjob_tm_counters_t      tm;         /* jobs run by non-workers */
+    unsigned int            telemetry;  /* atomic: telemetry enabled */
+    uint64_t                tm_start_ns;
+    size_t                  tm_submitted;   /* counters when telemetry was enabled */
+    size_t                  tm_started;
+    vthread_t *             tm_vthread; /* periodic telemetry log */
+    pthread_mutex_t         mutex;
+    pthread_cond_t          cond[VJOB_ROLE_NB];
+    pthread_cond_t          help_cond;  /* a pending counter of vjob_pool_help() reached 0 */
+};
+
+/* pooled job kinds */
+typedef enum {
+    VJK_RUN = 0,
+    VJK_THEN,
+    VJK_WHEN_ALL,
+    VJK_WHEN_ANY,
+} vjob_kind_t;
+
+static void vjob_pool_deps_notify(vjob_t * dep, slist_t * conts, void * retval, unsigned int state);
+
+static pthread_mutex_t      s_vjob_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static vjob_pool_t *        s_vjob_pool_default = NULL;   /* atomic */
+
+/* ************************************************************************ */
+static int vjob_queue_init(vjob_queue_t * queue, size_t size) {
+    size_t i;
+
+    if ((queue->cells = malloc(size * sizeof(*queue->cells))) == NULL) {
+        return -1;
+    }
+    for (i = 0; i < size; ++i) {
+        queue->cells[i].seq = i;
+        queue->cells[i].job = NULL;
+    }
+    queue->mask = size - 1;
+    queue->enqueue_pos = queue->dequeue_pos = 0;
+    return 0;
+}
+
+/* ************************************************************************ */
+static int vjob_queue_push(vjob_queue_t * queue, vjob_t * job) {
+    vjob_qcell_t *  cell;
+    size_t          pos = VLIB_ATOMIC_LOAD_RELAXED(&queue->enqueue_pos);
+    ssize_t         diff;
+
+    while (1) {
+        cell = &queue->cells[pos & queue->mask];
+        diff = (ssize_t) (VLIB_ATOMIC_LOAD(&cell->seq) - pos);
+        if (diff == 0) {
+            if (VLIB_ATOMIC_CAS(&queue->enqueue_pos, &pos, pos + 1)) {
+                break ;
+            }
+        } else if (diff < 0) {
+            return -1; /* full */
+        } else {
+            pos = VLIB_ATOMIC_LOAD_RELAXED(&queue->enqueue_pos);
+        }
+    }
+    cell->job = job;
+    VLIB_ATOMIC_STORE(&cell->seq, pos + 1);
+    return 0;
+}
+
+/* ************************************************************************ */
+static vjob_t * vjob_queue_pop(vjob_queue_t * queue) {
+    vjob_qcell_t *  cell;
+    vjob_t *        job;
+    size_t          pos = VLIB_ATOMIC_LOAD_RELAXED(&queue->dequeue_pos);
+    ssize_t         diff;
+
+    while (1) {
+        cell = &queue->cells[pos & queue->mask];
+        diff = (ssize_t) (VLIB_ATOMIC_LOAD(&cell->seq) - (pos + 1));
+        if (diff == 0) {
+            if (VLIB_ATOMIC_CAS(&queue->dequeue_pos, &pos, pos + 1)) {
+                break ;
+            }
+        } else if (diff < 0) {
+            return NULL; /* empty */
+        } else {
+            pos = VLIB_ATOMIC_LOAD_RELAXED(&queue->dequeue_pos);
+        }
+    }
+    job = cell->job;
+    VLIB_ATOMIC_STORE(&cell->seq, pos + queue->mask + 1);
+    return job;
+}
+
+/* ************************************************************************ */
+static int vjob_queue_empty(vjob_queue_t * queue) {
+    size_t pos = VLIB_ATOMIC_LOAD(&queue->dequeue_pos);
+
+    return VLIB_ATOMIC_LOAD(&queue->cells[pos & queue->mask].seq) != pos + 1;
+}
+
+/* ************************************************************************ */
+static vjob_darray_t * vjob_darray_new(size_t size, vjob_darray_t * prev) {
+    vjob_darray_t * array;
+
+    if ((array = malloc(sizeof(*array) + size * sizeof(*array->jobs))) == NULL) {
+        return NULL;
+    }
+    array->prev = prev;
+    array->mask = size - 1;
+    return array;
+}
+
+/* ************************************************************************ */
+static int vjob_deque_init(vjob_deque_t * deque, size_t size) {
+    if ((deque->array = vjob_darray_new(size, NULL)) == NULL) {
+        return -1;
+    }
+    deque->top = deque->bottom = 0;
+    return 0;
+}
+
+/* ************************************************************************ */
+static void vjob_deque_destroy(vjob_deque_t * deque) {
+    vjob_darray_t * array, * prev;
+
+    for (array = deque->array; array != NULL; array = prev) {
+        prev = array->prev;
+        free(array);
+    }
+    deque->array = NULL;
+}
+
+/* ************************************************************************ */
+/* owner only */
+static int vjob_deque_push(vjob_deque_t * deque, vjob_t * job) {
+    ssize_t         b = VLIB_ATOMIC_LOAD_RELAXED(&deque->bottom);
+    ssize_t         t = VLIB_ATOMIC_LOAD(&deque->top);
+    vjob_darray_t * array = VLIB_ATOMIC_LOAD_RELAXED(&deque->array);
+
+    if ((size_t) (b - t) > array->mask) {
+        /* grow: thieves may still read the old array, kept until deque is destroyed */
+        vjob_darray_t * new;
+        ssize_t         i;
+
+        if ((new = vjob_darray_new(2 * (array->mask + 1), array)) == NULL) {
+            return -1;
+        }
+        for (i = t; i < b; ++i) {
+            new->jobs[i & new->mask] = VLIB_ATOMIC_LOAD_RELAXED(&array->jobs[i & array->mask]);
+        }
+        VLIB_ATOMIC_STORE(&deque->array, new);
+        array = new;
+    }
+    VLIB_ATOMIC_STORE(&array->jobs[b & array->mask], job);
+    VLIB_ATOMIC_STORE(&deque->bottom, b + 1);
+    return 0;
+}
+
+/* ************************************************************************ */
+/* owner only */
+static vjob_t * vjob_deque_take(vjob_deque_t * deque) {
+    ssize_t         b = VLIB_ATOMIC_LOAD_RELAXED(&deque->bottom) - 1;
+    vjob_darray_t * array = VLIB_ATOMIC_LOAD_RELAXED(&deque->array);
+    vjob_t *        job = NULL;
+    ssize_t         t;
+
+    VLIB_ATOMIC_STORE(&deque->bottom, b);
+    t = VLIB_ATOMIC_LOAD(&deque->top);
+    if (t <= b) {
+        job = VLIB_ATOMIC_LOAD_RELAXED(&array->jobs[b & array->mask]);
+        if (t == b) {
+            /* last job: race with thieves */
+            if (!VLIB_ATOMIC_CAS(&deque->top, &t, t + 1)) {
+                job = NULL;
+            }
+            VLIB_ATOMIC_STORE(&deque->bottom, b + 1);
+        }
+    } else {
+        VLIB_ATOMIC_STORE(&deque->bottom, b + 1);
+    }
+    return job;
+}
+
+/* ************************************************************************ */
+static vjob_t * vjob_deque_steal(vjob_deque_t * deque) {
+    ssize_t         t = VLIB_ATOMIC_LOAD(&deque->top);
+    ssize_t         b = VLIB_ATOMIC_LOAD(&deque->bottom);
+    vjob_darray_t * array;
+    vjob_t *        job;
+
+    if (t >= b) {
+        return NULL;
+    }
+    array = VLIB_ATOMIC_LOAD(&deque->array);
+    job = VLIB_ATOMIC_LOAD(&array->jobs[t & array->mask]);
+    if (!VLIB_ATOMIC_CAS(&deque->top, &t, t + 1)) {
+        return NULL;
+    }
+    return job;
+}
+
+/* ************************************************************************ */
+static int vjob_deque_empty(vjob_deque_t * deque) {
+    return VLIB_ATOMIC_LOAD(&deque->top) >= VLIB_ATOMIC_LOAD(&deque->bottom);
+}
+
+/* ************************************************************************ */
+/* @return the worker structure of current thread if it belongs to pool */
+static inline vjob_worker_t * vjob_worker_self(vjob_pool_t * pool) {
+    vjob_worker_t * worker = pthread_getspecific(s_vjob_worker_key);
+
+    return (worker != NULL && worker->pool == pool) ? worker : NULL;
+}
+
+/* ************************************************************************ */
+static vjob_t * vjob_pool_job_new(vjob_pool_t * pool) {
+    vjob_worker_t * self = vjob_worker_self(pool);
+    unsigned int    home = self != NULL ? self->node : 0;
+    slist_t *       node;
+    vjob_t *        job;
+
+    if ((node = slist_atomic_pop(&pool->free_jobs[home])) != NULL) {
+        return (vjob_t *) node->data;
+    }
+    if ((job = malloc(sizeof(*job))) == NULL) {
+        return NULL;
+    }
+    pthread_mutex_init(&(job->mutex), NULL);
+    pthread_cond_init(&(job->cond), NULL);
+    job->pool = pool;
+    job->home = home;
+    job->node.data = job;
+    job->cleanup = NULL;
+    job->any_deps = NULL;
+    VLIB_ATOMIC_ADD(&pool->njobs, 1);
+    return job;
+}
+
+/* ************************************************************************ */
+static void vjob_pool_job_release(vjob_t * job) {
+    if (VLIB_ATOMIC_SUB(&job->refs, 1) != 1) {
+        return ;
+    }
+    job->state = VJS_NONE;
+    job->user_fun = NULL;
+    job->user_data = NULL;
+    if (job->any_deps != NULL) {
+        free(job->any_deps);
+        job->any_deps = NULL;
+    }
+    slist_atomic_push(&job->pool->free_jobs[job->home], &job->node);
+}
+
+/* ************************************************************************ */
+/* set job result, wake up waiters and notify jobs depending on this one */
+static void vjob_pool_finish(vjob_t * job, void * retval, unsigned int done_state) {
+    unsigned int    state;
+    slist_t *       conts;
+
+    vjob_cancel_unlink(&job->token);
+
+    pthread_mutex_lock(&(job->mutex));
+    job->retval = retval;
+    job->state |= done_state;
+    state = job->state;
+    conts = job->conts;
+    job->conts = NULL;
+    pthread_cond_broadcast(&(job->cond));
+    pthread_mutex_unlock(&(job->mutex));
+
+    /* from here, job can be freed by its owner, unless detached */
+    if (conts != NULL) {
+        vjob_pool_deps_notify(job, conts, retval, done_state);
+    }
+    if ((state & VJS_DETACHED) != 0) {
+        vjob_pool_job_release(job);
+    }
+}
+
+/* ************************************************************************ */
+/* telemetry histogram bucket of a duration, see VJOB_TELEMETRY_BUCKETS */
+static inline unsigned int vjob_tm_bucket(uint64_t ns) {
+    uint64_t        us = ns / 1000;
+    unsigned int    bucket = 0;
+
+    while (us != 0 && bucket < VJOB_TELEMETRY_BUCKETS - 1) {
+        us >>= 1;
+        ++bucket;
+    }
+    return bucket;
+}
+
+/* ************************************************************************ */
+/* account the wait of a job taken from a queue */
+static void vjob_pool_stats_start(vjob_t * job) {
+    vjob_worker_t *     self = vjob_worker_self(job->pool);
+    vjob_prio_stats_t * stats;
+    uint64_t            wait, max;
+
+    wait = vjob_clock_ns() - job->submit_ns;
+    job->submit_ns = 0;
+    stats = self != NULL ? &self->stats[job->prio] : &job->pool->stats[job->prio];
+    VLIB_ATOMIC_ADD(&stats->started, 1);
+    VLIB_ATOMIC_ADD(&stats->wait_ns, wait);
+    max = VLIB_ATOMIC_LOAD_RELAXED(&stats->wait_max_ns);
+    while (wait > max && !VLIB_ATOMIC_CAS(&stats->wait_max_ns, &max, wait))
+        ; /* max updated by CAS */
+    if (VJOB_TM_ON(job->pool)) {
+        vjob_tm_counters_t * tm = self != NULL ? &self->tm : &job->pool->tm;
+        VLIB_ATOMIC_ADD(&tm->wait_hist[vjob_tm_bucket(wait)], 1);
+    }
+}
+
+/* ************************************************************************ */
+/* account a job run by current thread, run_ns is 0 if it was interrupted */
+static void vjob_pool_tm_run(vjob_pool_t * pool, uint64_t run_ns, int started) {
+    vjob_worker_t *         self = vjob_worker_self(pool);
+    vjob_tm_counters_t *    tm = self != NULL ? &self->tm : &pool->tm;
+
+    if (started) {
+        VLIB_ATOMIC_ADD(&tm->run_hist[vjob_tm_bucket(run_ns)], 1);
+        /* a job run by a worker waiting for another job is already in busy time */
+        if (self != NULL && self->depth == 0) {
+            VLIB_ATOMIC_ADD(&tm->busy_ns, run_ns);
+        }
+    }
+    VLIB_ATOMIC_ADD(&tm->completed, 1);
+}
+
+/* ************************************************************************ */
+static void vjob_pool_exec(vjob_t * job) {
+    vjob_pool_t *   pool = job->pool;
+    void *          retval = VJOB_NO_RESULT;
+    unsigned int    state;
+    int             tm_on = VJOB_TM_ON(pool);
+    uint64_t        run_ns = 0;
+
+    if (job->submit_ns != 0) {
+        vjob_pool_stats_start(job);
+    }
+    pthread_mutex_lock(&(job->mutex));
+    if ((job->state & VJS_EXIT_REQUESTED) == 0 && !vjob_cancelled(&job->token)) {
+        job->state |= VJS_STARTED;
+        job->tid = pthread_self();
+    }
+    state = job->state;
+    pthread_mutex_unlock(&(job->mutex));
+
+    if ((state & VJS_STARTED) != 0) {
+        /* a helper thread can run a job while another one is running */
+        void *          prev = pthread_getspecific(s_vjob_current_key);
+        vjob_worker_t * self = tm_on ? vjob_worker_self(pool) : NULL;
+
+        if (tm_on) {
+            run_ns = vjob_clock_ns();
+            if (self != NULL)
+                ++self->depth;
+        }
+        pthread_setspecific(s_vjob_current_key, job);
+        if (job->kind == VJK_THEN) {
+            retval = job->then_fun(job->dep_result, job->user_data);
+        } else {
+            retval = job->user_fun(job->user_data);
+        }
+        pthread_setspecific(s_vjob_current_key, prev);
+        if (tm_on) {
+            run_ns = vjob_clock_ns() - run_ns;
+            if (self != NULL)
+                --self->depth;
+        }
+    }
+    vjob_pool_finish(job, retval, (state & VJS_STARTED) != 0 ? VJS_DONE : VJS_INTERRUPTED);
+    /* job can be recycled from here */
+    if (tm_on) {
+        vjob_pool_tm_run(pool, run_ns, (state & VJS_STARTED) != 0);
+    }
+}
+
+/* ************************************************************************ */
+/* wake up a sleeping worker of role, or all workers if role is negative */
+static void vjob_pool_wakeup(vjob_pool_t * pool, int role) {
+    unsigned int i;
+
+    pthread_mutex_lock(&(pool->mutex));
+    if (role < 0) {
+        for (i = 0; i < VJOB_ROLE_NB; ++i) {
+            pthread_cond_broadcast(&(pool->cond[i]));
+        }
+    } else {
+        pthread_cond_signal(&(pool->cond[role]));
+    }
+    pthread_mutex_unlock(&(pool->mutex));
+}
+
+/* ************************************************************************ */
+static int vjob_edf_cmp(const void * a, const void * b) {
+    uint64_t da = ((const vjob_t *) a)->deadline, db = ((const vjob_t *) b)->deadline;
+
+    return da < db ? -1 : (da > db);
+}
+
+/* ************************************************************************ */
+static int vjob_pool_edf_push(vjob_pool_t * pool, vjob_t * job) {
+    int ret = 0;
+
+    pthread_mutex_lock(&(pool->edf_mutex));
+    if (vheap_push(pool->edf, job) == VHEAP_INVALID_HANDLE) {
+        ret = -1;
+    } else {
+        VLIB_ATOMIC_ADD(&pool->nedf, 1);
+    }
+    pthread_mutex_unlock(&(pool->edf_mutex));
+    return ret;
+}
+
+/* ************************************************************************ */
+static vjob_t * vjob_pool_edf_pop(vjob_pool_t * pool) {
+    vjob_t * job = NULL;
+
+    if (VLIB_ATOMIC_LOAD(&pool->nedf) == 0) {
+        return NULL;
+    }
+    pthread_mutex_lock(&(pool->edf_mutex));
+    if (vheap_size(pool->edf) != 0) {
+        job = vheap_pop(pool->edf);
+        VLIB_ATOMIC_SUB(&pool->nedf, 1);
+    }
+    pthread_mutex_unlock(&(pool->edf_mutex));
+    return job;
+}
+
+/* ************************************************************************ */
+/* low priority jobs are run by normal workers if there are no background ones,
+ * or if pool is stopping */
+static inline int vjob_pool_low_to_normal(vjob_pool_t * pool) {
+    return pool->nroles[VJOB_ROLE_BACKGROUND] == 0 || VLIB_ATOMIC_LOAD(&pool->stop) != 0;
+}
+
+/* ************************************************************************ */
+/* queue job according to its deadline and priority: normal priority jobs go to
+ * own deque if current thread is a worker, other ones to injection queues */
+static int vjob_pool_submit(vjob_pool_t * pool, vjob_t * job) {
+    vjob_worker_t *     self = vjob_worker_self(pool);
+    unsigned int        prio = job->prio;
+    int                 urgent = (job->deadline != 0 || prio == VJOB_PRIO_HIGH);
+    vjob_prio_stats_t * stats = self != NULL ? &self->stats[prio] : &pool->stats[prio];
+    int                 role, ret;
+
+    job->submit_ns = vjob_clock_ns();
+    if (job->deadline != 0) {
+        ret = vjob_pool_edf_push(pool, job);
+    } else if (prio == VJOB_PRIO_NORMAL && self != NULL
+               && (job->numa < 0 || (unsigned int) job->numa == self->node)
+               && vjob_deque_push(&self->deque, job) == 0) {
+        ret = 0;
+    } else if (prio == VJOB_PRIO_NORMAL && job->numa >= 0) {
+        ret = vjob_queue_push(&pool->node_queues[job->numa], job);
+    } else {
+        ret = vjob_queue_push(&pool->queues[prio], job);
+    }
+    if (ret != 0) {
+        job->submit_ns = 0;
+        return -1;
+    }
+    /* from here, job can be run and recycled */
+    VLIB_ATOMIC_ADD(&stats->submitted, 1);
+    if (urgent && VLIB_ATOMIC_LOAD(&pool->idle[VJOB_ROLE_RESERVED]) != 0) {
+        role = VJOB_ROLE_RESERVED;
+    } else if (!urgent && prio == VJOB_PRIO_LOW && !vjob_pool_low_to_normal(pool)) {
+        role = VJOB_ROLE_BACKGROUND;
+    } else {
+        role = VJOB_ROLE_NORMAL;
+    }
+    if (VLIB_ATOMIC_LOAD(&pool->idle[role]) != 0) {
+        vjob_pool_wakeup(pool, role);
+    }
+    return 0;
+}
+
+/* ************************************************************************ */
+/* steal a job from another worker, workers of the node of self first */
+static vjob_t * vjob_pool_steal(vjob_pool_t * pool, vjob_worker_t * self) {
+    unsigned int    node = self != NULL ? self->node : 0;
+    vjob_t *        job;
+    unsigned int    i, victim, pass;
+
+    if (self != NULL) {
+        self->seed = self->seed * 1103515245U + 12345U;
+        victim = self->seed >> 16;
+    } else {
+        victim = VLIB_ATOMIC_ADD(&pool->seed, 1);
+    }
+    for (pass = (pool->nnodes > 1 ? 0 : 1); pass < 2; ++pass) {
+        for (i = 0; i < pool->nworkers; ++i) {
+            vjob_worker_t * worker = &pool->workers[(victim + i) % pool->nworkers];
+            if (worker != self && (pass != 0 || worker->node == node)
+            &&  (pass == 0 || pool->nnodes == 1 || worker->node != node)
+            &&  (job = vjob_deque_steal(&worker->deque)) != NULL) {
+                if (self != NULL && VJOB_TM_ON(pool)) {
+                    VLIB_ATOMIC_ADD(&self->tm.steals, 1);
+                }
+                return job;
+            }
+        }
+    }
+    return NULL;
+}
+
+/* ************************************************************************ */
+/* pop a job from the node queues, starting with the node of self */
+static vjob_t * vjob_pool_node_pop(vjob_pool_t * pool, vjob_worker_t * self, int local) {
+    unsigned int    node = self != NULL ? self->node : 0;
+    vjob_t *        job;
+    unsigned int    i;
+
+    if (pool->nnodes == 1) {
+        return NULL;
+    }
+    if (local) {
+        return vjob_queue_pop(&pool->node_queues[node]);
+    }
+    for (i = 1; i < pool->nnodes; ++i) {
+        if ((job = vjob_queue_pop(&pool->node_queues[(node + i) % pool->nnodes])) != NULL) {
+            return job;
+        }
+    }
+    return NULL;
+}
+
+/* ************************************************************************ */
+/* find a job: own deque, then deadline and high priority jobs, then normal
+ * priority jobs of own node, of any node, stealing other workers, of other
+ * nodes, then low priority jobs, according
+ * to the role of self (non-worker threads are helping as normal workers) */
+static vjob_t * vjob_pool_find(vjob_pool_t * pool, vjob_worker_t * self) {
+    unsigned int    role = self != NULL ? self->role : VJOB_ROLE_NORMAL;
+    vjob_t *        job;
+
+    if (self != NULL && (job = vjob_deque_take(&self->deque)) != NULL) {
+        return job;
+    }
+    if (role != VJOB_ROLE_BACKGROUND) {
+        if ((job = vjob_pool_edf_pop(pool)) != NULL
+        ||  (job = vjob_queue_pop(&pool->queues[VJOB_PRIO_HIGH])) != NULL
+        ||  role == VJOB_ROLE_RESERVED) {
+            return job;
+        }
+        if ((job = vjob_pool_node_pop(pool, self, 1)) != NULL
+        ||  (job = vjob_queue_pop(&pool->queues[VJOB_PRIO_NORMAL])) != NULL
+        ||  (job = vjob_pool_steal(pool, self)) != NULL
+        ||  (job = vjob_pool_node_pop(pool, self, 0)) != NULL
+        ||  !vjob_pool_low_to_normal(pool)) {
+            return job;
+        }
+    }
+    return vjob_queue_pop(&pool->queues[VJOB_PRIO_LOW]);
+}
+
+/* ************************************************************************ */
+/* @return non-zero if vjob_pool_find() could find a job for worker self */
+static int vjob_pool_has_work(vjob_pool_t * pool, vjob_worker_t * self) {
+    unsigned int i;
+
+    if (!vjob_deque_empty(&self->deque)) {
+        return 1;
+    }
+    if (self->role != VJOB_ROLE_BACKGROUND) {
+        if (VLIB_ATOMIC_LOAD(&pool->nedf) != 0
+        ||  !vjob_queue_empty(&pool->queues[VJOB_PRIO_HIGH])) {
+            return 1;
+        }
+        if (self->role == VJOB_ROLE_RESERVED) {
+            return 0;
+        }
+        if (!vjob_queue_empty(&pool->queues[VJOB_PRIO_NORMAL])) {
+            return 1;
+        }
+        for (i = 0; i < pool->nworkers; ++i) {
+            if (!vjob_deque_empty(&pool->workers[i].deque)) {
+                return 1;
+            }
+        }
+        for (i = 0; i < pool->nnodes && pool->nnodes > 1; ++i) {
+            if (!vjob_queue_empty(&pool->node_queues[i])) {
+                return 1;
+            }
+        }
+        if (!vjob_pool_low_to_normal(pool)) {
+            return 0;
+        }
+    }
+    return !vjob_queue_empty(&pool->queues[VJOB_PRIO_LOW]);
+}
+
+/* ************************************************************************ */
+/* worker: get next job, sleeping if there is none.
+ * @return NULL if pool is stopping and there are no more jobs */
+static vjob_t * vjob_pool_next(vjob_pool_t * pool, vjob_worker_t * self) {
+    vjob_t *        job;
+    unsigned int    spin;
+
+    while (1) {
+        for (spin = 0; spin < VJOB_POOL_SPIN; ++spin) {
+            if ((job = vjob_pool_find(pool, self)) != NULL) {
+                return job;
+            }
+            sched_yield();
+        }
+        if (VLIB_ATOMIC_LOAD(&pool->stop) != 0 && !vjob_pool_has_work(pool, self)) {
+            return NULL;
+        }
+        pthread_mutex_lock(&(pool->mutex));
+        VLIB_ATOMIC_ADD(&pool->idle[self->role], 1);
+        while (!vjob_pool_has_work(pool, self) && VLIB_ATOMIC_LOAD(&pool->stop) == 0) {
+            pthread_cond_wait(&(pool->cond[self->role]), &(pool->mutex));
+        }
+        VLIB_ATOMIC_SUB(&pool->idle[self->role], 1);
+        pthread_mutex_unlock(&(pool->mutex));
+    }
+}
+
+/* ************************************************************************ */
+/* run pool jobs until waitjob is finished or until *pending is 0.
+ * @return 0, or -1 if abstime (CLOCK_REALTIME) is reached */
+static int vjob_pool_help(
+                    vjob_pool_t *           pool,
+                    vjob_worker_t *         self,
+                    vjob_t *                waitjob,
+                    size_t *                pending,
+                    const struct timespec * abstime) {
+    struct timespec ts;
+    vjob_t *        job;
+
+    while (pending != NULL ? VLIB_ATOMIC_LOAD(pending) != 0 : !vjob_done(waitjob)) {
+        if (abstime != NULL) {
+            vclock_gettime(CLOCK_REALTIME, &ts);
+            if (vtimespeccmp(&ts, abstime) >= 0) {
+                return -1;
+            }
+        }
+        if ((job = vjob_pool_find(pool, self)) != NULL) {
+            vjob_pool_exec(job);
+        } else if (waitjob == NULL) {
+            /* tasks are running somewhere: wait for the last one, checking for new jobs */
+            pthread_mutex_lock(&(pool->mutex));
+            if (VLIB_ATOMIC_LOAD(pending) != 0) {
+                vjob_abstime(&ts, VJOB_HELP_WAIT_MS);
+                if (abstime != NULL && vtimespeccmp(&ts, abstime) > 0) {
+                    ts = *abstime;
+                }
+                pthread_cond_timedwait(&(pool->help_cond), &(pool->mutex), &ts);
+            }
+            pthread_mutex_unlock(&(pool->mutex));
+        } else {
+            /* the job is running somewhere: wait for it, checking for new jobs */
+            pthread_mutex_lock(&(waitjob->mutex));
+            if ((waitjob->state & (VJS_DONE | VJS_INTERRUPTED)) == 0) {
+                vjob_abstime(&ts, VJOB_HELP_WAIT_MS);
+                if (abstime != NULL && vtimespeccmp(&ts, abstime) > 0) {
+                    ts = *abstime;
+                }
+                pthread_cond_timedwait(&(waitjob->cond), &(waitjob->mutex), &ts);
+            }
+            pthread_mutex_unlock(&(waitjob->mutex));
+        }
+    }
+    return 0;
+}
+
+/* ************************************************************************ */
+/* wake up vjob_pool_help() callers after a pending counter reached 0 */
+static void vjob_pool_help_wake(vjob_pool_t * pool) {
+    pthread_mutex_lock(&(pool->mutex));
+    pthread_cond_broadcast(&(pool->help_cond));
+    pthread_mutex_unlock(&(pool->mutex));
+}
+
+/* ************************************************************************ */
+/* a worker waiting for a job of its pool runs other jobs meanwhile.
+ * @return 0, or -1 if abstime is reached */
+static int vjob_pool_wait(vjob_t * job, const struct timespec * abstime) {
+    vjob_worker_t * self;
+
+    if ((self = vjob_worker_self(job->pool)) != NULL) {
+        return vjob_pool_help(job->pool, self, job, NULL, abstime);
+    }
+    return 0;
+}
+
+/* ************************************************************************ */
+static void * vjob_pool_worker(void * vdata) {
+    vjob_worker_t * self = (vjob_worker_t *) vdata;
+    vjob_t *        job;
+
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+    pthread_setspecific(s_vjob_worker_key, self);
+#ifdef VJOB_HAVE_AFFINITY
+    if ((self->pool->flags & (VJOB_POOL_PIN_CPU | VJOB_POOL_PIN_NODE)) != 0) {
+        vjob_topology_t *   topo = &s_vjob_topology;
+        cpu_set_t           set;
+        unsigned int        i;
+        int                 ret;
+
+        CPU_ZERO(&set);
+        if (self->cpu >= 0) {
+            CPU_SET(self->cpu, &set);
+        } else {
+            for (i = topo->first[self->node]; i < topo->first[self->node + 1]; ++i) {
+                CPU_SET(topo->cpus[i], &set);
+            }
+        }
+        if ((ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set)) != 0) {
+            LOG_WARN(g_vlib_log, "%s(): cannot pin worker #%u: %s",
+                     __func__, self->index, strerror(ret));
+        } else {
+            /* no job pushed yet: allocate the deque on the node of worker */
+            vjob_darray_t * array = self->deque.array, * new;
+            if ((new = vjob_darray_new(array->mask + 1, array)) != NULL) {
+                VLIB_ATOMIC_STORE(&self->deque.array, new);
+            }
+        }
+    }
+#endif
+#ifdef __linux__
+    if (self->role == VJOB_ROLE_BACKGROUND && self->pool->background_nice != 0) {
+        /* on linux, the nice value is per thread */
+        pid_t   tid = (pid_t) syscall(SYS_gettid);
+        int     prio;
+
+        errno = 0;
+        prio = getpriority(PRIO_PROCESS, tid);
+        if ((prio == -1 && errno != 0)
+        ||  setpriority(PRIO_PROCESS, tid, prio + self->pool->background_nice) != 0) {
+            LOG_WARN(g_vlib_log, "%s(): cannot set nice of background worker #%u: %s",
+                     __func__, self->index, strerror(errno));
+        }
+    }
+#endif
+    while ((job = vjob_pool_next(self->pool, self)) != NULL) {
+        vjob_pool_exec(job);
+    }
+    return NULL;
+}
+
+/* ************************************************************************ */
+vjob_pool_t * vjob_pool_create(unsigned int nworkers) {
+    vjob_pool_attr_t attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.nworkers = nworkers;
+    return vjob_pool_create_attr(&attr);
+}
+
+/* ************************************************************************ */
+vjob_pool_t * vjob_pool_create_attr(const vjob_pool_attr_t * attr) {
+    vjob_pool_t *   pool;
+    unsigned int    i, nworkers;
+
+    pthread_once(&s_vjob_keys_once, vjob_keys_init);
+    if ((pool = calloc(1, sizeof(*pool))) == NULL) {
+        return NULL;
+    }
+    pool->nnodes = 1;
+    if (attr != NULL) {
+        pool->flags = attr->flags;
+        pool->nroles[VJOB_ROLE_NORMAL] = attr->nworkers;
+        pool->nroles[VJOB_ROLE_RESERVED] = attr->nreserved;
+        pool->nroles[VJOB_ROLE_BACKGROUND] = attr->nbackground;
+        pool->background_nice = attr->background_nice;
+    }
+    if (pool->nroles[VJOB_ROLE_NORMAL] == 0) {
+        pool->nroles[VJOB_ROLE_NORMAL] = vjob_cpu_nb();
+    }
+#ifdef VJOB_HAVE_AFFINITY
+    if ((pool->flags & (VJOB_POOL_PIN_CPU | VJOB_POOL_PIN_NODE)) != 0) {
+        pool->nnodes = vjob_numa_nb();
+        if (s_vjob_topology.first[pool->nnodes] == 0) {
+            LOG_WARN(g_vlib_log, "%s(): no cpu to pin workers", __func__);
+            pool->flags &= ~(VJOB_POOL_PIN_CPU | VJOB_POOL_PIN_NODE);
+            pool->nnodes = 1;
+        }
+    }
+#else
+    if ((pool->flags & (VJOB_POOL_PIN_CPU | VJOB_POOL_PIN_NODE)) != 0) {
+        LOG_WARN(g_vlib_log, "%s(): worker pinning not supported", __func__);
+        pool->flags &= ~(VJOB_POOL_PIN_CPU | VJOB_POOL_PIN_NODE);
+    }
+#endif
+#ifndef __linux__
+    if (pool->background_nice != 0) {
+        LOG_WARN(g_vlib_log, "%s(): background_nice not supported", __func__);
+    }
+#endif
+    nworkers = pool->nroles[VJOB_ROLE_NORMAL] + pool->nroles[VJOB_ROLE_RESERVED]
+               + pool->nroles[VJOB_ROLE_BACKGROUND];
+    pthread_mutex_init(&(pool->mutex), NULL);
+    pthread_mutex_init(&(pool->edf_mutex), NULL);
+    for (i = 0; i < VJOB_ROLE_NB; ++i) {
+        pthread_cond_init(&(pool->cond[i]), NULL);
+    }
+    pthread_cond_init(&(pool->help_cond), NULL);
+    for (i = 0; i < VJOB_PRIO_NB; ++i) {
+        if (vjob_queue_init(&pool->queues[i], VJOB_POOL_QUEUE_SZ) != 0) {
+            vjob_pool_free(pool);
+            return NULL;
+        }
+    }
+    if ((pool->edf = vheap_create(VHEAP_ARITY_QUATERNARY, 0, vjob_edf_cmp)) == NULL
+    ||  (pool->free_jobs = calloc(pool->nnodes, sizeof(*pool->free_jobs))) == NULL
+    ||  (pool->node_queues = calloc(pool->nnodes, sizeof(*pool->node_queues))) == NULL
+    ||  (pool->workers = calloc(nworkers, sizeof(*pool->workers))) == NULL) {
+        vjob_pool_free(pool);
+        return NULL;
+    }
+    for (i = 0; i < pool->nnodes; ++i) {
+        slist_atomic_init(&pool->free_jobs[i]);
+        if (pool->nnodes > 1 && vjob_queue_init(&pool->node_queues[i], VJOB_POOL_QUEUE_SZ) != 0) {
+            vjob_pool_free(pool);
+            return NULL;
+        }
+    }
+    /* all deques must be ready before a worker tries to steal */
+    for (pool->nworkers = 0; pool->nworkers < nworkers; ++pool->nworkers) {
+        vjob_worker_t * worker = &pool->workers[pool->nworkers];
+        if (vjob_deque_init(&worker->deque, VJOB_DEQUE_SZ) != 0) {
+            vjob_pool_free(pool);
+            return NULL;
+        }
+        worker->pool = pool;
+        worker->index = pool->nworkers;
+        worker->seed = (pool->nworkers + 1) * 2654435761U;
+        worker->cpu = -1;
+#ifdef VJOB_HAVE_AFFINITY
+        if ((pool->flags & (VJOB_POOL_PIN_CPU | VJOB_POOL_PIN_NODE)) != 0) {
+            /* spread workers over nodes, then over cpus of node */
+            vjob_topology_t * topo = &s_vjob_topology;
+            unsigned int      ncpus;
+
+            worker->node = worker->index % pool->nnodes;
+            ncpus = topo->first[worker->node + 1] - topo->first[worker->node];
+            if ((pool->flags & VJOB_POOL_PIN_CPU) != 0) {
+                worker->cpu = topo->cpus[topo->first[worker->node]
+                                         + (worker->index / pool->nnodes) % ncpus];
+            }
+        }
+#endif
+        if (worker->index < pool->nroles[VJOB_ROLE_NORMAL]) {
+            worker->role = VJOB_ROLE_NORMAL;
+        } else if (worker->index < pool->nroles[VJOB_ROLE_NORMAL] + pool->nroles[VJOB_ROLE_RESERVED]) {
+            worker->role = VJOB_ROLE_RESERVED;
+        } else {
+            worker->role = VJOB_ROLE_BACKGROUND;
+        }
+    }
+    for (i = 0; i < nworkers; ++i) {
+        int ret = pthread_create(&pool->workers[i].tid, NULL, vjob_pool_worker, &pool->workers[i]);
+        if (ret != 0) {
+            LOG_WARN(g_vlib_log, "%s(): cannot create worker #%u: %s",
+                     __func__, i, strerror(ret));
+            vjob_pool_free(pool);
+            return NULL;
+        }
+        ++pool->nthreads;
+    }
+    LOG_DEBUG(g_vlib_log, "%s(): pool %lx with %u workers (%u reserved, %u background) on %u nodes",
+              __func__, (unsigned long) pool, pool->nworkers,
+              pool->nroles[VJOB_ROLE_RESERVED], pool->nroles[VJOB_ROLE_BACKGROUND], pool->nnodes);
+    if ((pool->flags & VJOB_POOL_TELEMETRY) != 0 && vjob_pool_telemetry_enable(pool, 1) != 0) {
+        LOG_WARN(g_vlib_log, "%s(): telemetry not supported", __func__);
+    }
+    return pool;
+}
+
+/* ************************************************************************ */
+int vjob_pool_free(vjob_pool_t * pool) {
+    slist_t *       node;
+    unsigned int    i;
+
+    if (pool == NULL)
+        return 0;
+
+    /* a worker would join itself */
+    if (vjob_worker_self(pool) != NULL) {
+        LOG_ERROR(g_vlib_log, "%s(): called from a worker of the pool", __func__);
+        errno = EDEADLK;
+        return -1;
+    }
+    /* the default pool is created again by next vjob_pool_default() */
+    if (VLIB_ATOMIC_LOAD(&s_vjob_pool_default) == pool) {
+        pthread_mutex_lock(&s_vjob_pool_mutex);
+        if (s_vjob_pool_default == pool) {
+            VLIB_ATOMIC_STORE(&s_vjob_pool_default, NULL);
+        }
+        pthread_mutex_unlock(&s_vjob_pool_mutex);
+    }
+    if (pool->tm_vthread != NULL) {
+        vthread_stop(pool->tm_vthread);
+    }
+    VLIB_ATOMIC_STORE(&pool->stop, 1);
+    vjob_pool_wakeup(pool, -1);
+    for (i = 0; i < pool->nthreads; ++i) {
+        pthread_join(pool->workers[i].tid, NULL);
+    }
+    for (i = 0; pool->free_jobs != NULL && i < pool->nnodes; ++i) {
+        for (node = slist_atomic_pop_all(&pool->free_jobs[i]); node != NULL; ) {
+            vjob_t * job = (vjob_t *) node->data;
+            node = node->next;
+            vjob_free_ctx(job);
+            --pool->njobs;
+        }
+    }
+    if (pool->njobs != 0) {
+        LOG_WARN(g_vlib_log, "%s(): %lu pooled jobs not freed",
+                 __func__, (unsigned long) pool->njobs);
+    }
+    if (pool->workers != NULL) {
+        for (i = 0; i < pool->nworkers; ++i) {
+            vjob_deque_destroy(&pool->workers[i].deque);
+        }
+        free(pool->workers);
+    }
+    for (i = 0; i < VJOB_PRIO_NB; ++i) {
+        if (pool->queues[i].cells != NULL) {
+            free(pool->queues[i].cells);
+        }
+    }
+    if (pool->node_queues != NULL) {
+        for (i = 0; i < pool->nnodes; ++i) {
+            if (pool->node_queues[i].cells != NULL) {
+                free(pool->node_queues[i].cells);
+            }
+        }
+        free(pool->node_queues);
+    }
+    if (pool->free_jobs != NULL) {
+        free(pool->free_jobs);
+    }
+    vheap_free(pool->edf);
+    pthread_mutex_destroy(&(pool->mutex));
+    pthread_mutex_destroy(&(pool->edf_mutex));
+    for (i = 0; i < VJOB_ROLE_NB; ++i) {
+        pthread_cond_destroy(&(pool->cond[i]));
+    }
+    pthread_cond_destroy(&(pool->help_cond));
+    free(pool);
+    return 0;
+}
+
+/* ************************************************************************ */
+vjob_pool_t * vjob_pool_default() {
+    vjob_pool_t * pool;
+
+    if ((pool = VLIB_ATOMIC_LOAD(&s_vjob_pool_default)) != NULL) {
+        return pool;
+    }
+    pthread_mutex_lock(&s_vjob_pool_mutex);
+    if ((pool = s_vjob_pool_default) == NULL
+    &&  (pool = vjob_pool_create(0)) != NULL) {
+        VLIB_ATOMIC_STORE(&s_vjob_pool_default, pool);
+    }
+    pthread_mutex_unlock(&s_vjob_pool_mutex);
+    return pool;
+}
+
+/* ************************************************************************ */
+unsigned int vjob_pool_workers(vjob_pool_t * pool) {
+    if (pool == NULL)
+        return 0;
+    return pool->nworkers;
+}
+
+/* ************************************************************************ */
+int vjob_current_node() {
+    vjob_worker_t * worker;
+
+    pthread_once(&s_vjob_keys_once, vjob_keys_init);
+    worker = pthread_getspecific(s_vjob_worker_key);
+    if (worker == NULL || (worker->pool->flags & (VJOB_POOL_PIN_CPU | VJOB_POOL_PIN_NODE)) == 0) {
+        return -1;
+    }
+    return worker->node;
+}
+
+/* ************************************************************************ */
+int vjob_pool_stats(vjob_pool_t * pool, vjob_pool_stats_t * stats) {
+    unsigned int prio, i;
+
+    if (stats == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (pool == NULL && (pool = vjob_pool_default()) == NULL) {
+        return -1;
+    }
+    for (prio = 0; prio < VJOB_PRIO_NB; ++prio) {
+        size_t      submitted, started;
+        uint64_t    wait, max;
+
+        submitted = VLIB_ATOMIC_LOAD(&pool->stats[prio].submitted);
+        started = VLIB_ATOMIC_LOAD(&pool->stats[prio].started);
+        wait = VLIB_ATOMIC_LOAD(&pool->stats[prio].wait_ns);
+        max = VLIB_ATOMIC_LOAD(&pool->stats[prio].wait_max_ns);
+        for (i = 0; i < pool->nworkers; ++i) {
+            vjob_prio_stats_t * wstats = &pool->workers[i].stats[prio];
+            uint64_t            wmax = VLIB_ATOMIC_LOAD(&wstats->wait_max_ns);
+
+            submitted += VLIB_ATOMIC_LOAD(&wstats->submitted);
+            started += VLIB_ATOMIC_LOAD(&wstats->started);
+            wait += VLIB_ATOMIC_LOAD(&wstats->wait_ns);
+            if (wmax > max) {
+                max = wmax;
+            }
+        }
+        /* counters are not read at once */
+        stats[prio].queued = submitted > started ? submitted - started : 0;
+        stats[prio].started = started;
+        stats[prio].wait_avg_us = started != 0 ? wait / started / 1000 : 0;
+        stats[prio].wait_max_us = max / 1000;
+    }
+    return 0;
+}
+
+/* ************************************************************************ */
+/* Telemetry.
+ * Counters are per worker, plus one set for non-worker threads, and are summed
+ * by vjob_pool_telemetry(). Submitted and started jobs come from pool statistics,
+ * relatively to their values when telemetry was enabled. */
+#if VJOB_TELEMETRY
+static void vjob_tm_reset(vjob_tm_counters_t * tm) {
+    unsigned int i;
+
+    VLIB_ATOMIC_STORE(&tm->completed, 0);
+    VLIB_ATOMIC_STORE(&tm->steals, 0);
+    VLIB_ATOMIC_STORE(&tm->busy_ns, 0);
+    for (i = 0; i < VJOB_TELEMETRY_BUCKETS; ++i) {
+        VLIB_ATOMIC_STORE(&tm->wait_hist[i], 0);
+        VLIB_ATOMIC_STORE(&tm->run_hist[i], 0);
+    }
+}
+
+/* ************************************************************************ */
+static void vjob_tm_add(vjob_telemetry_t * tm, vjob_tm_counters_t * counters) {
+    unsigned int i;
+
+    tm->completed += VLIB_ATOMIC_LOAD(&counters->completed);
+    tm->steals += VLIB_ATOMIC_LOAD(&counters->steals);
+    for (i = 0; i < VJOB_TELEMETRY_BUCKETS; ++i) {
+        tm->wait_hist[i] += VLIB_ATOMIC_LOAD(&counters->wait_hist[i]);
+        tm->run_hist[i] += VLIB_ATOMIC_LOAD(&counters->run_hist[i]);
+    }
+}
+
+/* ************************************************************************ */
+static void vjob_tm_counts(vjob_pool_t * pool, size_t * submitted, size_t * started) {
+    vjob_pool_stats_t   stats[VJOB_PRIO_NB];
+    unsigned int        prio;
+
+    *submitted = *started = 0;
+    vjob_pool_stats(pool, stats);
+    for (prio = 0; prio < VJOB_PRIO_NB; ++prio) {
+        *submitted += stats[prio].queued + stats[prio].started;
+        *started += stats[prio].started;
+    }
+}
+
+/* ************************************************************************ */
+static int vjob_pool_tm_process(vthread_t * vthread, vthread_event_t event,
+                                void * event_data, void * user_data) {
+    (void) event;
+    (void) event_data;
+    vjob_pool_telemetry_dump((vjob_pool_t *) user_data, vthread->log);
+    return 0;
+}
+#endif /* VJOB_TELEMETRY */
+
+/* ************************************************************************ */
+int vjob_pool_telemetry_enable(vjob_pool_t * pool, int enable) {
+#if VJOB_TELEMETRY
+    unsigned int i;
+
+    if (pool == NULL && (pool = vjob_pool_default()) == NULL) {
+        return -1;
+    }
+    if (!enable) {
+        VLIB_ATOMIC_STORE(&pool->telemetry, 0);
+        return 0;
+    }
+    if (VLIB_ATOMIC_LOAD(&pool->telemetry) != 0) {
+        return 0;
+    }
+    vjob_tm_reset(&pool->tm);
+    for (i = 0; i < pool->nworkers; ++i) {
+        vjob_tm_reset(&pool->workers[i].tm);
+    }
+    vjob_tm_counts(pool, &pool->tm_submitted, &pool->tm_started);
+    pool->tm_start_ns = vjob_clock_ns();
+    VLIB_ATOMIC_STORE(&pool->telemetry, 1);
+    return 0;
+#else
+    (void) pool;
+    (void) enable;
+    errno = ENOTSUP;
+    return -1;
+#endif
+}
+
+/* ************************************************************************ */
+int vjob_pool_telemetry(
+                    vjob_pool_t *               pool,
+                    vjob_telemetry_t *          tm,
+                    vjob_worker_telemetry_t *   workers,
+                    unsigned int                nworkers) {
+#if VJOB_TELEMETRY
+    uint64_t        elapsed;
+    unsigned int    i;
+
+    if (pool == NULL && (pool = vjob_pool_default()) == NULL) {
+        return -1;
+    }
+    if (VLIB_ATOMIC_LOAD(&pool->telemetry) == 0) {
+        errno = EAGAIN;
+        return -1;
+    }
+    elapsed = vjob_clock_ns() - pool->tm_start_ns;
+    if (tm != NULL) {
+        size_t submitted, started;
+
+        memset(tm, 0, sizeof(*tm));
+        vjob_tm_add(tm, &pool->tm);
+        for (i = 0; i < pool->nworkers; ++i) {
+            vjob_tm_add(tm, &pool->workers[i].tm);
+        }
+        /* counters are not read at once */
+        vjob_tm_counts(pool, &submitted, &started);
+        tm->submitted = submitted > pool->tm_submitted ? submitted - pool->tm_submitted : 0;
+        started = started > pool->tm_started ? started - pool->tm_started : 0;
+        tm->running = started > tm->completed ? started - tm->completed : 0;
+        tm->elapsed_us = elapsed / 1000;
+    }
+    for (i = 0; workers != NULL && i < nworkers && i < pool->nworkers; ++i) {
+        vjob_tm_counters_t *    counters = &pool->workers[i].tm;
+        uint64_t                busy = VLIB_ATOMIC_LOAD(&counters->busy_ns);
+
+        workers[i].jobs = VLIB_ATOMIC_LOAD(&counters->completed);
+        workers[i].steals = VLIB_ATOMIC_LOAD(&counters->steals);
+        workers[i].busy_us = busy / 1000;
+        workers[i].utilization = elapsed == 0 ? 0 : busy >= elapsed ? 1000 : busy * 1000 / elapsed;
+    }
+    return 0;
+#else
+    (void) pool;
+    (void) tm;
+    (void) workers;
+    (void) nworkers;
+    errno = ENOTSUP;
+    return -1;
+#endif
+}
+
+/* ************************************************************************ */
+/* print non-empty buckets of hist in buf */
+static const char * vjob_tm_hist_str(char * buf, size_t size, const size_t * hist) {
+    size_t          len = 0;
+    unsigned int    i;
+    int             n;
+
+    *buf = 0;
+    for (i = 0; i < VJOB_TELEMETRY_BUCKETS && len < size; ++i) {
+        if (hist[i] == 0) {
+            continue ;
+        }
+        if (i == VJOB_TELEMETRY_BUCKETS - 1) {
+            n = snprintf(buf + len, size - len, " >=%luus:%lu",
+                         1UL << (i - 1), (unsigned long) hist[i]);
+        } else {
+            n = snprintf(buf + len, size - len, " <%luus:%lu",
+                         1UL << i, (unsigned long) hist[i]);
+        }
+        if (n < 0)
+            break ;
+        len += n;
+    }
+    return buf;
+}
+
+/* ************************************************************************ */
+int vjob_pool_telemetry_dump(vjob_pool_t * pool, log_t * log) {
+    vjob_telemetry_t            tm;
+    vjob_worker_telemetry_t *   workers;
+    char                        buf[VJOB_TELEMETRY_BUCKETS * 24];
+    unsigned int                i;
+
+    if (pool == NULL && (pool = vjob_pool_default()) == NULL) {
+        return -1;
+    }
+    if (log == NULL) {
+        log = g_vlib_log;
+    }
+    if ((workers = malloc(pool->nworkers * sizeof(*workers))) == NULL) {
+        return -1;
+    }
+    if (vjob_pool_telemetry(pool, &tm, workers, pool->nworkers) != 0) {
+        free(workers);
+        return -1;
+    }
+    LOG_INFO(log, "pool %lx: %lu submitted, %lu running, %lu completed, %lu steals in %lu.%03lus",
+             (unsigned long) pool, (unsigned long) tm.submitted, (unsigned long) tm.running,
+             (unsigned long) tm.completed, (unsigned long) tm.steals,
+             tm.elapsed_us / 1000000, (tm.elapsed_us / 1000) % 1000);
+    LOG_INFO(log, "pool %lx: wait%s", (unsigned long) pool,
+             vjob_tm_hist_str(buf, sizeof(buf), tm.wait_hist));
+    LOG_INFO(log, "pool %lx: run%s", (unsigned long) pool,
+             vjob_tm_hist_str(buf, sizeof(buf), tm.run_hist));
+    for (i = 0; i < pool->nworkers; ++i) {
+        LOG_INFO(log, "pool %lx: worker #%u: %lu jobs, %lu steals, busy %lu.%03lus (%u.%u%%)",
+                 (unsigned long) pool, i, (unsigned long) workers[i].jobs,
+                 (unsigned long) workers[i].steals, workers[i].busy_us / 1000000,
+                 (workers[i].busy_us / 1000) % 1000,
+                 workers[i].utilization / 10, workers[i].utilization % 10);
+    }
+    free(workers);
+    return 0;
+}
+
+/* ************************************************************************ */
+int vjob_pool_telemetry_log(vjob_pool_t * pool, log_t * log, unsigned long period_ms) {
+#if VJOB_TELEMETRY
+    vthread_t * vthread;
+
+    if (pool == NULL && (pool = vjob_pool_default()) == NULL) {
+        return -1;
+    }
+    if (pool->tm_vthread != NULL) {
+        vthread_stop(pool->tm_vthread);
+        pool->tm_vthread = NULL;
+    }
+    if (period_ms == 0) {
+        return 0;
+    }
+    if (vjob_pool_telemetry_enable(pool, 1) != 0
+    ||  (vthread = vthread_create(period_ms, log)) == NULL) {
+        return -1;
+    }
+    if (vthread_register_event(vthread, VTE_PROCESS_START, NULL, vjob_pool_tm_process, pool) != 0
+    ||  vthread_start(vthread) != 0) {
+        vthread_stop(vthread);
+        return -1;
+    }
+    pool->tm_vthread = vthread;
+    return 0;
+#else
+    (void) pool;
+    (void) log;
+    (void) period_ms;
+    errno = ENOTSUP;
+    return -1;
+#endif
+}
+
+/* ************************************************************************ */
+static vjob_t * vjob_pool_job_init(vjob_pool_t * pool, vjob_fun_t fun, void * user_data,
+                                   unsigned int state) {
+    vjob_t * job;
+
+    if ((job = vjob_pool_job_new(pool)) == NULL) {
+        return NULL;
+    }
+    job->user_fun = fun;
+    job->user_data = user_data;
+    job->retval = VJOB_NO_RESULT;
+    job->state = VJS_CREATED | VJS_POOLED | state;
+    job->refs = 1;
+    job->kind = VJK_RUN;
+    job->deps = 0;
+    job->conts = NULL;
+    job->then_fun = NULL;
+    job->dep_result = NULL;
+    vjob_cancel_init(&job->token, NULL);
+    job->token.allocated = 0;
+    job->prio = VJOB_PRIO_NORMAL;
+    job->deadline = 0;
+    job->submit_ns = 0;
+    job->numa = -1;
+    return job;
+}
+
+/* ************************************************************************ */
+vjob_t * vjob_pool_run(vjob_pool_t * pool, vjob_fun_t fun, void * user_data) {
+    return vjob_pool_run_attr(pool, fun, user_data, NULL);
+}
+
+/* ************************************************************************ */
+vjob_t * vjob_pool_run_cancel(
+                    vjob_pool_t *       pool,
+                    vjob_fun_t          fun,
+                    void *              user_data,
+                    vjob_cancel_t *     token) {
+    vjob_attr_t attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.token = token;
+    return vjob_pool_run_attr(pool, fun, user_data, &attr);
+}
+
+/* ************************************************************************ */
+vjob_t * vjob_pool_run_attr(
+                    vjob_pool_t *       pool,
+                    vjob_fun_t          fun,
+                    void *              user_data,
+                    const vjob_attr_t * attr) {
+    vjob_t * job;
+
+    if (fun == NULL || (attr != NULL && attr->prio >= VJOB_PRIO_NB)) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (pool == NULL && (pool = vjob_pool_default()) == NULL) {
+        return NULL;
+    }
+    if ((job = vjob_pool_job_init(pool, fun, user_data, 0)) == NULL) {
+        return NULL;
+    }
+    if (attr != NULL) {
+        if (attr->token != NULL) {
+            vjob_cancel_init(&job->token, attr->token);
+        }
+        job->prio = attr->prio;
+        if ((attr->flags & VJOB_ATTR_NODE) != 0 && attr->node < pool->nnodes && pool->nnodes > 1) {
+            job->numa = attr->node;
+        }
+        if (attr->deadline_ms != 0) {
+            job->deadline = vjob_clock_ns() + attr->deadline_ms * 1000000ULL;
+        }
+    }
+    if (vjob_pool_submit(pool, job) != 0) {
+        LOG_SCREAM(g_vlib_log, "%s(): queue full, running job %lx",
+                   __func__, (unsigned long) job);
+        vjob_pool_exec(job);
+    }
+    return job;
+}
+
+/* ************************************************************************ */
+int vjob_pool_runandfree(vjob_pool_t * pool, vjob_fun_t fun, void * data) {
+    vjob_t * job;
+
+    if ((job = vjob_pool_run(pool, fun, data)) == NULL) {
+        return -1;
+    }
+    return vjob_detach(job);
+}
+
+/* ************************************************************************ */
+/* Futures.
+ * A continuation is a pooled job which is not queued at creation, but when the
+ * jobs it depends on (deps) are finished: each of them keeps the continuation
+ * in its list conts and notifies it when finishing. The continuation holds a
+ * reference for each dep, so that it is not recycled before all of them have
+ * notified it, even if it was started by the first one (vjob_when_any()).
+ * The result of vjob_when_any() is the index of the first finished dep, as
+ * the dep itself can be freed and recycled before the result is read. */
+
+/* ************************************************************************ */
+/* dep is finished with result retval and state dep_state, and dep can have been freed */
+static void vjob_pool_dep_done(vjob_t * cont, vjob_t * dep, void * retval, unsigned int dep_state) {
+    int ready;
+
+    if (cont->kind == VJK_WHEN_ANY) {
+        ready = (VLIB_ATOMIC_XCHG(&cont->deps, 0) != 0);
+    } else {
+        ready = (VLIB_ATOMIC_SUB(&cont->deps, 1) == 1);
+    }
+    if (ready) {
+        switch (cont->kind) {
+            case VJK_THEN:
+                cont->dep_result = retval;
+                if ((dep_state & VJS_INTERRUPTED) != 0) {
+                    vjob_pool_finish(cont, VJOB_NO_RESULT, VJS_INTERRUPTED);
+                } else if (vjob_pool_submit(cont->pool, cont) != 0) {
+                    vjob_pool_exec(cont);
+                }
+                break ;
+            case VJK_WHEN_ANY: {
+                size_t i;
+
+                for (i = 0; cont->any_deps[i] != dep; ++i)
+                    ; /* dep is in any_deps */
+                vjob_pool_finish(cont, (void *) i, VJS_DONE);
+                break ;
+            }
+            default:
+                vjob_pool_finish(cont, NULL, VJS_DONE);
+                break ;
+        }
+    }
+    vjob_pool_job_release(cont);
+}
+
+/* ************************************************************************ */
+static void vjob_pool_deps_notify(vjob_t * dep, slist_t * conts, void * retval, unsigned int state) {
+    SLIST_FOREACH_DATA(conts, cont, vjob_t *) {
+        vjob_pool_dep_done(cont, dep, retval, state);
+    }
+    slist_free(conts, NULL);
+}
+
+/* ************************************************************************ */
+/* register cont as depending on dep, cont->deps and cont->refs must count dep */
+static int vjob_pool_dep_add(vjob_t * dep, vjob_t * cont) {
+    slist_t *       conts = NULL;
+    void *          retval;
+    unsigned int    state;
+
+    pthread_mutex_lock(&(dep->mutex));
+    retval = dep->retval;
+    state = dep->state & (VJS_DONE | VJS_INTERRUPTED);
+    if (state == 0) {
+        if ((conts = slist_prepend(dep->conts, cont)) != NULL) {
+            dep->conts = conts;
+        }
+    }
+    pthread_mutex_unlock(&(dep->mutex));
+
+    if (state != 0) {
+        vjob_pool_dep_done(cont, dep, retval, state);
+    } else if (conts == NULL) {
+        return -1;
+    }
+    return 0;
+}
+
+/* ************************************************************************ */
+static vjob_t * vjob_pool_cont_create(
+                    vjob_t * const *    deps,
+                    size_t              ndeps,
+                    vjob_kind_t         kind,
+                    vjob_then_fun_t     fun,
+                    void *              user_data) {
+    vjob_pool_t *   pool;
+    vjob_t *        cont;
+    size_t          i;
+
+    for (i = 0; i < ndeps; ++i) {
+        if (deps[i] == NULL || deps[i]->pool == NULL) {
+            errno = EINVAL;
+            return NULL;
+        }
+    }
+    if ((pool = (ndeps > 0 ? deps[0]->pool : vjob_pool_default())) == NULL
+    ||  (cont = vjob_pool_job_init(pool, NULL, user_data, 0)) == NULL) {
+        return NULL;
+    }
+    cont->kind = kind;
+    cont->then_fun = fun;
+    if (ndeps > 0) {
+        cont->prio = deps[0]->prio;
+    }
+    if (ndeps == 0) {
+        vjob_pool_finish(cont, NULL, VJS_DONE);
+        return cont;
+    }
+    if (kind == VJK_WHEN_ANY) {
+        if ((cont->any_deps = malloc(ndeps * sizeof(*cont->any_deps))) == NULL) {
+            vjob_pool_job_release(cont);
+            return NULL;
+        }
+        memcpy(cont->any_deps, deps, ndeps * sizeof(*cont->any_deps));
+    }
+    cont->deps = ndeps;
+    cont->refs += ndeps;
+    for (i = 0; i < ndeps; ++i) {
+        if (vjob_pool_dep_add(deps[i], cont) != 0) {
+            /* the continuation will never start, release refs of remaining deps */
+            LOG_WARN(g_vlib_log, "%s(): cannot add continuation: %s", __func__, strerror(errno));
+            for ( ; i < ndeps; ++i) {
+                vjob_pool_job_release(cont);
+            }
+            vjob_pool_job_release(cont);
+            return NULL;
+        }
+    }
+    return cont;
+}
+
+/* ************************************************************************ */
+vjob_t * vjob_then(vjob_t * job, vjob_then_fun_t fun, void * user_data) {
+    if (fun == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+    return vjob_pool_cont_create(&job, 1, VJK_THEN, fun, user_data);
+}
+
+/* ************************************************************************ */
+vjob_t * vjob_when_all(vjob_t * const * jobs, size_t n) {
+    if (jobs == NULL && n > 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    return vjob_pool_cont_create(jobs, n, VJK_WHEN_ALL, NULL, NULL);
+}
+
+/* ************************************************************************ */
+vjob_t * vjob_when_any(vjob_t * const * jobs, size_t n) {
+    if (jobs == NULL || n == 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    return vjob_pool_cont_create(jobs, n, VJK_WHEN_ANY, NULL, NULL);
+}
+
+/* ************************************************************************ */
+/* Parallel loops.
+ * [begin,end[ is cut in chunks of grain elements. A task on chunks [c0,c1[
+ * spawns the upper half [mid,c1[ and continues with the lower half until it
+ * has one chunk, so that thieves take the biggest ranges. The task of range
+ * starting at chunk mid is tasks[mid]. Partial reduce results are stored
+ * per chunk and joined in order by the caller. */
+typedef struct vjob_range_s vjob_range_t;
+
+typedef struct {
+    vjob_pool_t *           pool;
+    size_t                  begin;
+    size_t                  end;
+    size_t                  grain;
+    vjob_range_fun_t        fun;
+    vjob_reduce_fun_t       reduce;
+    vjob_join_fun_t         join;
+    void *                  ctx;
+    void *                  result;
+    unsigned char *         accs;
+    size_t                  acc_size;
+    size_t                  pending;    /* atomic: spawned tasks not finished */
+    vjob_range_t *          tasks;
+} vjob_range_ctx_t;
+
+struct vjob_range_s {
+    vjob_range_ctx_t *      rctx;
+    size_t                  chunk_end;
+};
+
+static void vjob_range_run(vjob_range_ctx_t * rctx, size_t c0, size_t c1);
+
+/* ************************************************************************ */
+static void * vjob_range_job(void * vdata) {
+    vjob_range_t *      task = (vjob_range_t *) vdata;
+    vjob_range_ctx_t *  rctx = task->rctx;
+    vjob_pool_t *       pool = rctx->pool;
+
+    vjob_range_run(rctx, task - rctx->tasks, task->chunk_end);
+    /* rctx can be released by caller from now */
+    if (VLIB_ATOMIC_SUB(&rctx->pending, 1) == 1) {
+        vjob_pool_help_wake(pool);
+    }
+    return NULL;
+}
+
+/* ************************************************************************ */
+static void vjob_range_run(vjob_range_ctx_t * rctx, size_t c0, size_t c1) {
+    size_t b, e;
+
+    while (c1 - c0 > 1 && rctx->pool != NULL) {
+        size_t          mid = c0 + (c1 - c0) / 2;
+        vjob_range_t *  task = &rctx->tasks[mid];
+        vjob_t *        job;
+
+        task->rctx = rctx;
+        task->chunk_end = c1;
+        VLIB_ATOMIC_ADD(&rctx->pending, 1);
+        if ((job = vjob_pool_job_init(rctx->pool, vjob_range_job, task, VJS_DETACHED)) == NULL
+        ||  vjob_pool_submit(rctx->pool, job) != 0) {
+            /* run remaining chunks here */
+            if (job != NULL)
+                vjob_pool_job_release(job);
+            VLIB_ATOMIC_SUB(&rctx->pending, 1);
+            break ;
+        }
+        c1 = mid;
+    }
+    for ( ; c0 < c1; ++c0) {
+        b = rctx->begin + c0 * rctx->grain;
+        e = (rctx->end - b > rctx->grain) ? b + rctx->grain : rctx->end;
+        if (rctx->reduce != NULL) {
+            rctx->reduce(b, e, rctx->accs + c0 * rctx->acc_size, rctx->ctx);
+        } else {
+            rctx->fun(b, e, rctx->ctx);
+        }
+    }
+}
+
+/* ************************************************************************ */
+static int vjob_parallel_run(vjob_range_ctx_t * rctx) {
+    size_t nchunks, i, n = rctx->end - rctx->begin;
+
+    if (rctx->pool == NULL) {
+        rctx->pool = vjob_pool_default();
+    }
+    if (rctx->grain == 0) {
+        rctx->grain = n / (VJOB_PARALLEL_SPLIT * vjob_pool_workers(rctx->pool) + 1);
+        if (rctx->grain == 0)
+            rctx->grain = 1;
+    }
+    nchunks = (n + rctx->grain - 1) / rctx->grain;
+    if ((rctx->tasks = malloc(nchunks * sizeof(*rctx->tasks))) == NULL) {
+        return -1;
+    }
+    if (rctx->reduce != NULL) {
+        if ((rctx->accs = malloc(nchunks * rctx->acc_size)) == NULL) {
+            free(rctx->tasks);
+            return -1;
+        }
+        for (i = 0; i < nchunks; ++i) {
+            memcpy(rctx->accs + i * rctx->acc_size, rctx->result, rctx->acc_size);
+        }
+    }
+    rctx->pending = 0;
+    vjob_range_run(rctx, 0, nchunks);
+    if (rctx->pool != NULL) {
+        vjob_pool_help(rctx->pool, vjob_worker_self(rctx->pool), NULL, &rctx->pending, NULL);
+    }
+    if (rctx->reduce != NULL) {
+        for (i = 0; i < nchunks; ++i) {
+            rctx->join(rctx->result, rctx->accs + i * rctx->acc_size, rctx->ctx);
+        }
+        free(rctx->accs);
+    }
+    free(rctx->tasks);
+    return 0;
+}
+
+/* ************************************************************************ */
+int vjob_parallel_for(
+                    vjob_pool_t *       pool,
+                    size_t              begin,
+                    size_t              end,
+                    size_t              grain,
+                    vjob_range_fun_t    fun,
+                    void *              ctx) {
+    vjob_range_ctx_t rctx;
+
+    if (fun == NULL || end < begin) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (begin == end) {
+        return 0;
+    }
+    memset(&rctx, 0, sizeof(rctx));
+    rctx.pool = pool;
+    rctx.begin = begin;
+    rctx.end = end;
+    rctx.grain = grain;
+    rctx.fun = fun;
+    rctx.ctx = ctx;
+    return vjob_parallel_run(&rctx);
+}
+
+/* ************************************************************************ */
+int vjob_parallel_reduce(
+                    vjob_pool_t *       pool,
+                    size_t              begin,
+                    size_t              end,
+                    size_t              grain,
+                    vjob_reduce_fun_t   fun,
+                    vjob_join_fun_t     join,
+                    void *              result,
+                    size_t              result_size,
+                    void *              ctx) {
+    vjob_range_ctx_t rctx;
+
+    if (fun == NULL || join == NULL || result == NULL || result_size == 0 || end < begin) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (begin == end) {
+        return 0;
+    }
+    memset(&rctx, 0, sizeof(rctx));
+    rctx.pool = pool;
+    rctx.begin = begin;
+    rctx.end = end;
+    rctx.grain = grain;
+    rctx.reduce = fun;
+    rctx.join = join;
+    rctx.result = result;
+    rctx.acc_size = result_size;
+    rctx.ctx = ctx;
+    return vjob_parallel_run(&rctx);
+}
+
+/* ************************************************************************ */
+/* Task graphs.
+ * Edges are compiled on first run after a modification in arrays of successors
+ * indexed by node, and in a topological order used to check that the graph has
+ * no cycle and to compute the critical path. A run sets the counters of pending
+ * predecessors and submits root nodes. A finished node submits its ready
+ * successors but one, which it runs itself. */
+#define VJOB_GRAPH_NONE     ((unsigned int) -1)
+
+typedef struct {
+    vjob_fun_t              fun;
+    void *                  user_data;
+    void *                  result;
+    vjob_graph_t *          graph;
+    unsigned int            succ;       /* first successor in graph->succs */
+    unsigned int            nsucc;
+    unsigned int            npred;
+    unsigned int            pending;    /* atomic: predecessors not finished */
+    unsigned int            crit_pred;  /* predecessor on the longest path, or VJOB_GRAPH_NONE */
+    int                     critical;
+    uint64_t                path_ns;
+    BENCH_TM_DECL(tm);
+} vjob_graph_node_t;
+
+struct vjob_graph_s {
+    vjob_pool_t *           pool;
+    vjob_graph_node_t *     nodes;
+    unsigned int            nnodes;
+    unsigned int            max_nodes;
+    unsigned int *          edges;      /* pairs (from, to) */
+    unsigned int            nedges;
+    unsigned int            max_edges;
+    unsigned int *          succs;
+    unsigned int *          order;      /* topological order */
+    int                     compiled;
+    unsigned int            crit_last;  /* last node of critical path */
+    size_t                  remaining;  /* atomic: nodes not finished */
+    int                     done;
+    pthread_mutex_t         mutex;
+    pthread_cond_t          cond;
+    BENCH_TM_DECL(tm);
+};
+
+/* ************************************************************************ */
+vjob_graph_t * vjob_graph_create(vjob_pool_t * pool) {
+    vjob_graph_t * graph;
+
+    if (pool == NULL && (pool = vjob_pool_default()) == NULL) {
+        return NULL;
+    }
+    if ((graph = calloc(1, sizeof(*graph))) == NULL) {
+        return NULL;
+    }
+    graph->pool = pool;
+    graph->crit_last = VJOB_GRAPH_NONE;
+    pthread_mutex_init(&graph->mutex, NULL);
+    pthread_cond_init(&graph->cond, NULL);
+    return graph;
+}
+
+/* ************************************************************************ */
+void vjob_graph_free(vjob_graph_t * graph) {
+    if (graph == NULL) {
+        return ;
+    }
+    if (graph->nodes != NULL)
+        free(graph->nodes);
+    if (graph->edges != NULL)
+        free(graph->edges);
+    if (graph->succs != NULL)
+        free(graph->succs);
+    if (graph->order != NULL)
+        free(graph->order);
+    pthread_cond_destroy(&graph->cond);
+    pthread_mutex_destroy(&graph->mutex);
+    free(graph);
+}
+
+/* ************************************************************************ */
+int vjob_graph_add_node(vjob_graph_t * graph, vjob_fun_t fun, void * user_data) {
+    vjob_graph_node_t * node;
+
+    if (graph == NULL || fun == NULL || graph->nnodes >= INT_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (graph->nnodes == graph->max_nodes) {
+        unsigned int max = graph->max_nodes ? graph->max_nodes * 2 : 16;
+
+        if ((node = realloc(graph->nodes, max * sizeof(*node))) == NULL) {
+            return -1;
+        }
+        graph->nodes = node;
+        graph->max_nodes = max;
+    }
+    node = &graph->nodes[graph->nnodes];
+    memset(node, 0, sizeof(*node));
+    node->fun = fun;
+    node->user_data = user_data;
+    node->result = VJOB_NO_RESULT;
+    node->graph = graph;
+    node->crit_pred = VJOB_GRAPH_NONE;
+    graph->compiled = 0;
+    return graph->nnodes++;
+}
+
+/* ************************************************************************ */
+int vjob_graph_add_edge(vjob_graph_t * graph, int from, int to) {
+    if (graph == NULL || from < 0 || to < 0 || from == to
+    ||  (unsigned int) from >= graph->nnodes || (unsigned int) to >= graph->nnodes) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (graph->nedges == graph->max_edges) {
+        unsigned int    max = graph->max_edges ? graph->max_edges * 2 : 16;
+        unsigned int *  edges;
+
+        if ((edges = realloc(graph->edges, 2 * max * sizeof(*edges))) == NULL) {
+            return -1;
+        }
+        graph->edges = edges;
+        graph->max_edges = max;
+    }
+    graph->edges[2 * graph->nedges] = from;
+    graph->edges[2 * graph->nedges + 1] = to;
+    ++graph->nedges;
+    graph->compiled = 0;
+    return 0;
+}
+
+/* ************************************************************************ */
+static int vjob_graph_compile(vjob_graph_t * graph) {
+    vjob_graph_node_t * nodes = graph->nodes;
+    unsigned int *      p;
+    unsigned int        i, j, n, head, tail;
+
+    if ((p = realloc(graph->succs, (graph->nedges + 1) * sizeof(*p))) == NULL) {
+        return -1;
+    }
+    graph->succs = p;
+    if ((p = realloc(graph->order, (graph->nnodes + 1) * sizeof(*p))) == NULL) {
+        return -1;
+    }
+    graph->order = p;
+
+    for (i = 0; i < graph->nnodes; ++i) {
+        nodes[i].nsucc = nodes[i].npred = 0;
+    }
+    for (i = 0; i < graph->nedges; ++i) {
+        ++nodes[graph->edges[2 * i]].nsucc;
+        ++nodes[graph->edges[2 * i + 1]].npred;
+    }
+    for (i = 0, n = 0; i < graph->nnodes; ++i) {
+        nodes[i].succ = n;
+        n += nodes[i].nsucc;
+        nodes[i].nsucc = 0;
+    }
+    for (i = 0; i < graph->nedges; ++i) {
+        vjob_graph_node_t * from = &nodes[graph->edges[2 * i]];
+
+        graph->succs[from->succ + from->nsucc++] = graph->edges[2 * i + 1];
+    }
+
+    /* Kahn's algorithm, order[] being the queue of nodes without predecessors left */
+    for (i = 0, tail = 0; i < graph->nnodes; ++i) {
+        nodes[i].pending = nodes[i].npred;
+        if (nodes[i].npred == 0) {
+            graph->order[tail++] = i;
+        }
+    }
+    for (head = 0; head < tail; ++head) {
+        vjob_graph_node_t * node = &nodes[graph->order[head]];
+
+        for (j = node->succ; j < node->succ + node->nsucc; ++j) {
+            if (--nodes[graph->succs[j]].pending == 0) {
+                graph->order[tail++] = graph->succs[j];
+            }
+        }
+    }
+    if (tail != graph->nnodes) {
+        LOG_WARN(g_vlib_log, "%s(): graph has a cycle", __func__);
+        errno = EDEADLK;
+        return -1;
+    }
+    graph->compiled = 1;
+    return 0;
+}
+
+static void * vjob_graph_job(void * vdata);
+
+/* ************************************************************************ */
+static void vjob_graph_submit(vjob_graph_t * graph, vjob_graph_node_t * node) {
+    vjob_t * job;
+
+    if ((job = vjob_pool_job_init(graph->pool, vjob_graph_job, node, VJS_DETACHED)) == NULL
+    ||  vjob_pool_submit(graph->pool, job) != 0) {
+        if (job != NULL)
+            vjob_pool_job_release(job);
+        vjob_graph_job(node);
+    }
+}
+
+/* ************************************************************************ */
+static void * vjob_graph_job(void * vdata) {
+    vjob_graph_node_t * node = (vjob_graph_node_t *) vdata;
+    vjob_graph_t *      graph = node->graph;
+    vjob_graph_node_t * next, * succ;
+    unsigned int        i;
+
+    for ( ; node != NULL; node = next) {
+        BENCH_TM_START(node->tm);
+        node->result = node->fun(node->user_data);
+        BENCH_TM_STOP(node->tm);
+
+        for (i = node->succ, next = NULL; i < node->succ + node->nsucc; ++i) {
+            succ = &graph->nodes[graph->succs[i]];
+            if (VLIB_ATOMIC_SUB(&succ->pending, 1) == 1) {
+                if (next == NULL) {
+                    next = succ;
+                } else {
+                    vjob_graph_submit(graph, succ);
+                }
+            }
+        }
+        if (VLIB_ATOMIC_SUB(&graph->remaining, 1) == 1) {
+            vjob_pool_t * pool = graph->pool;
+
+            /* graph can be released by caller as soon as mutex is unlocked */
+            pthread_mutex_lock(&graph->mutex);
+            graph->done = 1;
+            pthread_cond_broadcast(&graph->cond);
+            pthread_mutex_unlock(&graph->mutex);
+            vjob_pool_help_wake(pool);
+        }
+    }
+    return NULL;
+}
+
+/* ************************************************************************ */
+static void vjob_graph_critical(vjob_graph_t * graph) {
+    vjob_graph_node_t * nodes = graph->nodes;
+    unsigned int        i, j, last = VJOB_GRAPH_NONE;
+
+    for (i = 0; i < graph->nnodes; ++i) {
+        nodes[i].path_ns = 0;
+        nodes[i].crit_pred = VJOB_GRAPH_NONE;
+        nodes[i].critical = 0;
+    }
+    /* before a node is visited, its path_ns is the longest path of its predecessors */
+    for (i = 0; i < graph->nnodes; ++i) {
+        unsigned int        n = graph->order[i];
+        vjob_graph_node_t * node = &nodes[n];
+
+        node->path_ns += BENCH_TM_GET_NS(node->tm);
+        for (j = node->succ; j < node->succ + node->nsucc; ++j) {
+            vjob_graph_node_t * succ = &nodes[graph->succs[j]];
+
+            if (succ->crit_pred == VJOB_GRAPH_NONE || node->path_ns > succ->path_ns) {
+                succ->path_ns = node->path_ns;
+                succ->crit_pred = n;
+            }
+        }
+        if (last == VJOB_GRAPH_NONE || node->path_ns > nodes[last].path_ns) {
+            last = n;
+        }
+    }
+    graph->crit_last = last;
+    for ( ; last != VJOB_GRAPH_NONE; last = nodes[last].crit_pred) {
+        nodes[last].critical = 1;
+    }
+}
+
+/* ************************************************************************ */
+int vjob_graph_run(vjob_graph_t * graph) {
+    vjob_worker_t * self;
+    unsigned int    i;
+
+    if (graph == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (!graph->compiled && vjob_graph_compile(graph) != 0) {
+        return -1;
+    }
+    if (graph->nnodes == 0) {
+        return 0;
+    }
+    for (i = 0; i < graph->nnodes; ++i) {
+        graph->nodes[i].pending = graph->nodes[i].npred;
+        graph->nodes[i].result = VJOB_NO_RESULT;
+    }
+    graph->remaining = graph->nnodes;
+    graph->done = 0;
+
+    BENCH_TM_START(graph->tm);
+    /* roots are first in topological order */
+    for (i = 0; i < graph->nnodes && graph->nodes[graph->order[i]].npred == 0; ++i) {
+        vjob_graph_submit(graph, &graph->nodes[graph->order[i]]);
+    }
+    if ((self = vjob_worker_self(graph->pool)) != NULL) {
+        vjob_pool_help(graph->pool, self, NULL, &graph->remaining, NULL);
+    }
+    pthread_mutex_lock(&graph->mutex);
+    while (!graph->done) {
+        pthread_cond_wait(&graph->cond, &graph->mutex);
+    }
+    pthread_mutex_unlock(&graph->mutex);
+    BENCH_TM_STOP(graph->tm);
+
+    vjob_graph_critical(graph);
+    return 0;
+}
+
+/* ************************************************************************ */
+void * vjob_graph_result(vjob_graph_t * graph, int node) {
+    if (graph == NULL || node < 0 || (unsigned int) node >= graph->nnodes) {
+        errno = EINVAL;
+        return VJOB_NO_RESULT;
+    }
+    return graph->nodes[node].result;
+}
+
+/* ************************************************************************ */
+int vjob_graph_timing(vjob_graph_t * graph, int node, vjob_graph_timing_t * timing) {
+    vjob_graph_node_t * n;
+    struct timespec     start;
+
+    if (graph == NULL || timing == NULL || node < 0 || (unsigned int) node >= graph->nnodes) {
+        errno = EINVAL;
+        return -1;
+    }
+    n = &graph->nodes[node];
+    if (graph->crit_last == VJOB_GRAPH_NONE || !graph->compiled) {
+        memset(timing, 0, sizeof(*timing));
+        return 0;
+    }
+    vtimespecsub(&n->tm.t0, &graph->tm.t0, &start);
+    timing->start_us = start.tv_sec * 1000000UL + start.tv_nsec / 1000;
+    timing->run_us = BENCH_TM_GET_US(n->tm);
+    timing->path_us = n->path_ns / 1000;
+    timing->critical = n->critical;
+    return 0;
+}
+
+/* ************************************************************************ */
+size_t vjob_graph_critical_path(vjob_graph_t * graph, int * nodes, size_t max) {
+    size_t          len = 0, i;
+    unsigned int    n;
+
+    if (graph == NULL || !graph->compiled) {
+        return 0;
+    }
+    for (n = graph->crit_last; n != VJOB_GRAPH_NONE; n = graph->nodes[n].crit_pred) {
+        ++len;
+    }
+    if (nodes != NULL) {
+        /* the path is walked backward from its last node */
+        for (i = len, n = graph->crit_last; n != VJOB_GRAPH_NONE; n = graph->nodes[n].crit_pred) {
+            if (--i < max) {
+                nodes[i] = n;
+            }
+        }
+    }
+    return len;
+}
@@ -29,7 +29,10 @@
 #include <stdint.h>
 #include <limits.h>
 #include <ctype.h>
+#include <errno.h>
+#include <signal.h>
 #include <pthread.h>
+#include <poll.h>
 
 #include "vlib/log.h"
 #include "vlib/util.h"
@@ -38,6 +41,9 @@
 #include "vlib/term.h"
 #include "vlib/time.h"
 #include "vlib/logpool.h"
+#include "vlib/shmrbuf.h"
+
+#include "vlib_private.h"
 
 /** internal vlib log instance */
 static log_t s_vlib_log_default = {
@@ -229,11 +235,379 @@ static int log_location(FILE * out, log_flag_t flags, log_level_t level,
     return n;
 }
 
+/** get the date and time of tim, up to minutes, doing localtime_r on minute change */
+static void log_datetime(time_t tim, char * datetime) {
+    pthread_mutex_lock(&g_vlib_log_global_ctx.mutex);
+    if (tim/60 != g_vlib_log_global_ctx.last_timet) {
+        struct tm tm;
+        g_vlib_log_global_ctx.last_timet = tim/60;
+        if (localtime_r(&tim, &tm) == NULL) {
+            memset(&tm, 0, sizeof(tm));
+        }
+        snprintf(g_vlib_log_global_ctx.datetime, LOG_DATETIME_SZ,
+                 "%04u.%02u.%02u %02u:%02u:",
+                 (tm.tm_year + 1900U) % 10000U, (tm.tm_mon + 1U) % 100U, (tm.tm_mday % 100U),
+                 tm.tm_hour % 100U, tm.tm_min % 100U);
+    }
+    strncpy(datetime, g_vlib_log_global_ctx.datetime, LOG_DATETIME_SZ);
+    pthread_mutex_unlock(&g_vlib_log_global_ctx.mutex);
+}
+
+/*****************************************************************************/
+/* Lines formatted in a buffer of the logging thread, written with one fwrite()
+ * or queued as one record of an asynchronous file. The first byte of the
+ * buffer is kept for the type of ring buffer record.
+ * The parts of the header which do not change between lines of a log (level
+ * strings with colors, [module,pid,tid]) are kept in templates of the thread,
+ * built again when the file, flags or prefix of the log change. */
+#define LOG_LINE_SZ             512
+#define LOG_TMPL_CACHE          8       /* templates per thread */
+
+typedef struct {
+    const log_t *   log;                /* NULL if free */
+    FILE *          out;
+    unsigned int    flags;
+    unsigned int    gen;                /* s_log_tmpl_gen when built */
+    unsigned int    term_gen;           /* vterm_generation() when built, for colors */
+    const char *    prefix;             /* copy of the prefix of log */
+    const char *    ctx;                /* "[module,pid:x,tid:y] " */
+    size_t          ctx_len;
+    const char *    levels[LOG_LVL_NB + 1]; /* "INF " with colors */
+    unsigned short  levels_len[LOG_LVL_NB + 1];
+    unsigned short  levels_esc[LOG_LVL_NB + 1]; /* size of color sequences */
+    char *          data;
+} log_tmpl_t;
+
+typedef struct {
+    char *          buf;
+    size_t          size;
+    size_t          len;
+    size_t          esc;                /* size of color sequences in buf */
+    int             busy;               /* being filled: nested logs use stdio */
+    time_t          minute;             /* minute of datetime */
+    char            datetime[LOG_DATETIME_SZ];
+    log_tmpl_t      tmpl[LOG_TMPL_CACHE];
+} log_line_t;
+
+static pthread_key_t    s_log_line_key;
+static pthread_once_t   s_log_line_once = PTHREAD_ONCE_INIT;
+static int              s_log_line_key_ok = 0;
+static unsigned int     s_log_tmpl_gen = 0; /* atomic: changed on fork, for pid */
+
+static void log_line_printf(log_line_t * lbuf, const char * fmt, ...)
+                            __attribute__((format(printf, 2, 3)));
+
+static void log_line_free(void * vlbuf) {
+    log_line_t * lbuf = (log_line_t *) vlbuf;
+
+    if (lbuf != NULL) {
+        for (unsigned int i = 0; i < LOG_TMPL_CACHE; ++i) {
+            if (lbuf->tmpl[i].data != NULL)
+                free(lbuf->tmpl[i].data);
+        }
+        if (lbuf->buf != NULL)
+            free(lbuf->buf);
+        free(lbuf);
+    }
+}
+
+static void log_line_atfork_child() {
+    VLIB_ATOMIC_ADD(&s_log_tmpl_gen, 1);
+}
+
+static void log_line_key_create() {
+    s_log_line_key_ok = (pthread_key_create(&s_log_line_key, log_line_free) == 0);
+    pthread_atfork(NULL, NULL, log_line_atfork_child);
+}
+
+/** get the empty line buffer of the calling thread, to give back with
+ * log_line_put(), or NULL on error or if it is in use by this thread: a log
+ * from the building of a header (vterm_init() for instance) uses stdio */
+static log_line_t * log_line_get() {
+    log_line_t * lbuf;
+
+    pthread_once(&s_log_line_once, log_line_key_create);
+    if (!s_log_line_key_ok) {
+        return NULL;
+    }
+    if ((lbuf = pthread_getspecific(s_log_line_key)) == NULL) {
+        if ((lbuf = calloc(1, sizeof(*lbuf))) == NULL
+        ||  (lbuf->buf = malloc(LOG_LINE_SZ)) == NULL
+        ||  pthread_setspecific(s_log_line_key, lbuf) != 0) {
+            log_line_free(lbuf);
+            return NULL;
+        }
+        lbuf->size = LOG_LINE_SZ;
+        lbuf->minute = -1;
+    } else if (lbuf->busy) {
+        return NULL;
+    }
+    lbuf->busy = 1;
+    lbuf->len = 1;
+    lbuf->esc = 0;
+    return lbuf;
+}
+
+/** give back the line buffer got with log_line_get() */
+static void log_line_put(log_line_t * lbuf) {
+    lbuf->busy = 0;
+}
+
+/** make room for n chars and the terminating 0 */
+static int log_line_reserve(log_line_t * lbuf, size_t n) {
+    size_t  size = lbuf->size;
+    char *  buf;
+
+    if (lbuf->len + n < size) {
+        return 0;
+    }
+    while (size <= lbuf->len + n) {
+        size *= 2;
+    }
+    if ((buf = realloc(lbuf->buf, size)) == NULL) {
+        return -1;
+    }
+    lbuf->buf = buf;
+    lbuf->size = size;
+    return 0;
+}
+
+static void log_line_write(log_line_t * lbuf, const char * str, size_t n) {
+    if (log_line_reserve(lbuf, n) == 0) {
+        memcpy(lbuf->buf + lbuf->len, str, n);
+        lbuf->len += n;
+    }
+}
+
+static void log_line_puts(log_line_t * lbuf, const char * str) {
+    log_line_write(lbuf, str, strlen(str));
+}
+
+/** append formatted text, valist being used as by vfprintf() */
+static void log_line_vprintf(log_line_t * lbuf, const char * fmt, va_list valist) {
+    va_list vatmp;
+    int     n;
+
+    va_copy(vatmp, valist);
+    n = vsnprintf(lbuf->buf + lbuf->len, lbuf->size - lbuf->len, fmt, valist);
+    if (n >= 0 && (size_t) n >= lbuf->size - lbuf->len) {
+        /* format again with the arguments copied before, or keep the truncated text */
+        if (log_line_reserve(lbuf, n) == 0) {
+            n = vsnprintf(lbuf->buf + lbuf->len, lbuf->size - lbuf->len, fmt, vatmp);
+        } else {
+            n = lbuf->size - lbuf->len - 1;
+        }
+    }
+    va_end(vatmp);
+    if (n > 0) {
+        lbuf->len += n;
+    }
+}
+
+static void log_line_printf(log_line_t * lbuf, const char * fmt, ...) {
+    va_list valist;
+
+    va_start(valist, fmt);
+    log_line_vprintf(lbuf, fmt, valist);
+    va_end(valist);
+}
+
+/** build the template of log for the file fd, in a temporary line buffer
+ * becoming the template data. */
+static int log_tmpl_build(log_tmpl_t * tmpl, log_t * log, FILE * out,
+                          unsigned int gen, unsigned int term_gen) {
+    const char *    prefix = log->prefix != NULL ? log->prefix : s_vlib_log_null.prefix;
+    log_flag_t      flags = log->flags;
+    int             fd = fileno(out);
+    int             colors = (flags & LOG_FLAG_COLOR) != 0 && vterm_has_colors(fd);
+    log_line_t      lb = { .buf = malloc(LOG_LINE_SZ), .size = LOG_LINE_SZ, .len = 0 };
+    size_t          ctx, levels[LOG_LVL_NB + 1];
+
+    if (lb.buf == NULL) {
+        return -1;
+    }
+    log_line_write(&lb, prefix, strlen(prefix) + 1);
+    ctx = lb.len;
+    if ((flags & (LOG_FLAG_MODULE | LOG_FLAG_PID | LOG_FLAG_TID)) != 0) {
+        const char * space = "";
+        log_line_puts(&lb, "[");
+        if ((flags & LOG_FLAG_MODULE) != 0) {
+            log_line_puts(&lb, prefix);
+            space = ",";
+        }
+        if ((flags & LOG_FLAG_PID) != 0) {
+            log_line_printf(&lb, "%spid:%u", space, (unsigned int) getpid());
+            space = ",";
+        }
+        if ((flags & LOG_FLAG_TID) != 0)
+            log_line_printf(&lb, "%stid:%lx", space, (unsigned long) pthread_self());
+        log_line_puts(&lb, "] ");
+    }
+    tmpl->ctx_len = lb.len - ctx;
+    log_line_write(&lb, "", 1);
+    for (unsigned int lvl = 0; lvl <= LOG_LVL_NB; ++lvl) {
+        const struct loglevel_info_s * lvlinfo = &s_log_levels_info[lvl];
+
+        levels[lvl] = lb.len;
+        if (colors) {
+            log_line_printf(&lb, "%s%s%s%s ", vterm_color(fd, lvlinfo->colorfg),
+                            vterm_color(fd, lvlinfo->style), lvlinfo->str,
+                            vterm_color(fd, lvlinfo->reset));
+        } else {
+            log_line_printf(&lb, "%s ", lvlinfo->str);
+        }
+        tmpl->levels_len[lvl] = lb.len - levels[lvl];
+        tmpl->levels_esc[lvl] = tmpl->levels_len[lvl] - strlen(lvlinfo->str) - 1;
+    }
+    if (log_line_reserve(&lb, 0) != 0) {
+        free(lb.buf);
+        return -1;
+    }
+    if (tmpl->data != NULL)
+        free(tmpl->data);
+    tmpl->data = lb.buf;
+    tmpl->prefix = lb.buf;
+    tmpl->ctx = lb.buf + ctx;
+    for (unsigned int lvl = 0; lvl <= LOG_LVL_NB; ++lvl) {
+        tmpl->levels[lvl] = lb.buf + levels[lvl];
+    }
+    tmpl->log = log;
+    tmpl->out = out;
+    tmpl->flags = flags;
+    tmpl->gen = gen;
+    tmpl->term_gen = term_gen;
+    return 0;
+}
+
+/** get the template of log for out, or NULL on error */
+static const log_tmpl_t * log_tmpl_get(log_line_t * lbuf, log_t * log, FILE * out) {
+    log_tmpl_t *    tmpl = &lbuf->tmpl[((uintptr_t) log / sizeof(*log)) % LOG_TMPL_CACHE];
+    const char *    prefix = log->prefix != NULL ? log->prefix : s_vlib_log_null.prefix;
+    unsigned int    gen = VLIB_ATOMIC_LOAD_RELAXED(&s_log_tmpl_gen);
+    unsigned int    term_gen = vterm_generation();
+
+    /* the prefix is compared, as a log at the same address can have a new one */
+    if (tmpl->log != log || tmpl->out != out || tmpl->flags != log->flags
+    ||  tmpl->gen != gen || tmpl->term_gen != term_gen || strcmp(tmpl->prefix, prefix) != 0) {
+        if (log_tmpl_build(tmpl, log, out, gen, term_gen) != 0) {
+            tmpl->log = NULL;
+            return NULL;
+        }
+    }
+    return tmpl;
+}
+
+static void log_line_location(log_line_t * lbuf, log_flag_t flags, log_level_t level,
+                              const char * file, const char * func, int line) {
+    /* see log_location() */
+    if ((flags & (LOG_FLAG_FILE | LOG_FLAG_FUNC | LOG_FLAG_LINE)) != 0
+    &&  ((flags & LOG_FLAG_LOC_ERR) == 0
+          || level == LOG_LVL_ERROR || level == LOG_LVL_WARN || level >= LOG_LVL_DEBUG)) {
+        log_line_puts(lbuf, "{");
+        if ((flags & LOG_FLAG_FILE) != 0 && file)
+            log_line_puts(lbuf, file);
+        if ((flags & LOG_FLAG_LINE) != 0)
+            log_line_printf(lbuf, ":%d", line);
+        if ((flags & LOG_FLAG_FUNC) != 0 && func)
+            log_line_printf(lbuf, ">%s()", func);
+        log_line_puts(lbuf, "} ");
+    }
+}
+
+/** append n decimal digits of value */
+static void log_line_digits(char * buf, unsigned int value, unsigned int n) {
+    while (n-- > 0) {
+        buf[n] = '0' + value % 10;
+        value /= 10;
+    }
+}
+
+/** same as log_header2(), in a line buffer */
+static void log_line_header(log_line_t * lbuf, log_level_t level, log_t * log, FILE * out,
+                           const char * file, const char * func, int line) {
+    const log_tmpl_t *  tmpl;
+    log_flag_t          flags;
+
+    if ((tmpl = log_tmpl_get(lbuf, log, out)) == NULL) {
+        return ;
+    }
+    flags = tmpl->flags;
+    if (level > LOG_LVL_NB) {
+        level = LOG_LVL_NB;
+    }
+    if ((flags & LOG_FLAG_DATETIME) != 0) {
+        struct timeval  tv;
+        time_t          tim;
+
+        if (gettimeofday(&tv, NULL) >= 0) {
+            tim = (time_t) tv.tv_sec;
+        } else {
+            tim = time(NULL);
+            tv.tv_usec = 0;
+        }
+        if (tim / 60 != lbuf->minute) {
+            lbuf->minute = tim / 60;
+            log_datetime(tim, lbuf->datetime);
+        }
+        if (log_line_reserve(lbuf, LOG_DATETIME_SZ + 7) == 0) {
+            char * p = lbuf->buf + lbuf->len;
+
+            memcpy(p, lbuf->datetime, LOG_DATETIME_SZ - 1);
+            p += LOG_DATETIME_SZ - 1;
+            log_line_digits(p, tim % 60, 2);
+            p[2] = '.';
+            log_line_digits(p + 3, tv.tv_usec / 1000, 3);
+            p[6] = ' ';
+            lbuf->len += LOG_DATETIME_SZ - 1 + 7;
+        }
+    } else if ((flags & LOG_FLAG_ABS_TIME) != 0) {
+        struct timespec ts;
+        if (vclock_gettime(CLOCK_MONOTONIC_RAW, &ts) != 0) {
+            ts.tv_sec = 0;
+            ts.tv_nsec = 0;
+        }
+        log_line_printf(lbuf, "%010u.%03u ", (unsigned int) (ts.tv_sec),
+                        (unsigned int) (ts.tv_nsec / 1000000U));
+    }
+    if ((flags & LOG_FLAG_LEVEL) != 0) {
+        log_line_write(lbuf, tmpl->levels[level], tmpl->levels_len[level]);
+        lbuf->esc += tmpl->levels_esc[level];
+    }
+    log_line_write(lbuf, tmpl->ctx, tmpl->ctx_len);
+    if ((flags & LOG_FLAG_LOC_TAIL) == 0) {
+        log_line_location(lbuf, flags, level, file, func, line);
+    }
+}
+
+static void log_line_footer(log_line_t * lbuf, log_level_t level, log_t * log,
+                            const char * file, const char * func, int line) {
+    if ((log->flags & LOG_FLAG_LOC_TAIL) != 0) {
+        log_line_puts(lbuf, " ");
+        log_line_location(lbuf, log->flags, level, file, func, line);
+    }
+    log_line_puts(lbuf, "\n");
+}
+
+/** @return the size of the lines of lbuf, without color sequences */
+static int log_line_size(log_line_t * lbuf) {
+    return lbuf->len - 1 - lbuf->esc;
+}
+
+/*****************************************************************************/
 int log_header2(log_level_t level, log_t * log, FILE * out,
                const char * file, const char * func, int line) {
     const char *    prefix;
     log_flag_t      flags;
     int             n = 0, ret, log_colors, fd;
+    log_line_t *    lbuf;
+
+    /* the header is written at once from the line buffer, or with stdio on error */
+    if ((lbuf = log_line_get()) != NULL) {
+        log_line_header(lbuf, level, log, out, file, func, line);
+        n = fwrite(lbuf->buf + 1, 1, lbuf->len - 1, out) == lbuf->len - 1 ? log_line_size(lbuf) : 0;
+        log_line_put(lbuf);
+        return n;
+    }
 
     prefix  = log->prefix != NULL   ? log->prefix   : s_vlib_log_null.prefix;
     flags = log->flags;
@@ -266,24 +640,9 @@ int log_header2(log_level_t level, log_t * log, FILE * out,
                                (unsigned int)(tv.tv_usec / 1000))) > 0)
                 n += ret;
         } else {
-            /* do localtime_r on minute change */
-            static pthread_mutex_t * const  mutex           = &g_vlib_log_global_ctx.mutex;
-            static char * const             old_datetime    = g_vlib_log_global_ctx.datetime;
-            char                            datetime[LOG_DATETIME_SZ];
-            pthread_mutex_lock(mutex);
-            if (tim/60 != *plast_timet) {
-                struct tm tm;
-                *plast_timet = tim/60;
-                if (localtime_r(&tim, &tm) == NULL) {
-                    memset(&tm, 0, sizeof(tm));
-                }
-                snprintf(old_datetime, LOG_DATETIME_SZ,
-                         "%04u.%02u.%02u %02u:%02u:",
-                         (tm.tm_year + 1900U) % 10000U, (tm.tm_mon + 1U) % 100U, (tm.tm_mday % 100U),
-                         tm.tm_hour % 100U, tm.tm_min % 100U);
-            }
-            strncpy(datetime, old_datetime, LOG_DATETIME_SZ);
-            pthread_mutex_unlock(mutex);
+            char datetime[LOG_DATETIME_SZ];
+
+            log_datetime(tim, datetime);
             if ((ret = fprintf(out, "%s%02u.%03u ", datetime,
                                (unsigned int)(tim % 60),
                                (unsigned int)(tv.tv_usec/1000))) > 0)
@@ -385,17 +744,491 @@ int log_footer(log_level_t level, log_t * log,
     return log_footer2(level, log, out, file, func, line);
 }
 
+/*****************************************************************************/
+/* Asynchronous log files: lines are queued in a process private shmrbuf,
+ * and written by a thread per file. A record is LOG_ASYNC_LINE followed by
+ * the line, or for lines bigger than a record, LOG_ASYNC_REF followed by
+ * the pointer and the size of an allocated copy of the line. */
+#define LOG_ASYNC_RECORD_SZ     512             /* maximum size of a record */
+#define LOG_ASYNC_BATCH_SZ      (64 * 1024)     /* maximum size of a write */
+#define LOG_ASYNC_BATCH_RECORDS 4096            /* records read before releasing the ring */
+#define LOG_ASYNC_WAIT_MS       100             /* writer wakeup to check its state */
+#define LOG_ASYNC_FORK_WAIT_MS  1000            /* wait for queued lines before fork() */
+#define LOG_ASYNC_LINE          'L'
+#define LOG_ASYNC_REF           'R'
+
+typedef enum {
+    LAS_FREE            = 0,
+    LAS_RUNNING,
+    LAS_STOPPING
+} log_async_state_t;
+
+typedef struct {
+    FILE *              out;        /* atomic, NULL when free */
+    unsigned int        state;      /* atomic */
+    unsigned int        users;      /* atomic: threads queuing lines */
+    unsigned int        reading;    /* atomic: ring read by the writer or a signal handler */
+    int                 fd;
+    log_async_policy_t  policy;
+    shmrbuf_t *         ring;
+    char *              batch;
+    pthread_t           tid;
+    unsigned long       queued;     /* atomic */
+    unsigned long       written;    /* atomic */
+    unsigned long       dropped;    /* atomic */
+} log_async_t;
+
+static log_async_t      s_log_async[LOG_ASYNC_MAX];
+static unsigned int     s_log_async_count = 0;  /* atomic: asynchronous files */
+static pthread_mutex_t  s_log_async_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int              s_log_async_init = 0;
+/* threads waiting for room, written lines or a stopped file, woken by log_async_notify() */
+static pthread_mutex_t  s_log_async_wait_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   s_log_async_wait_cond = PTHREAD_COND_INITIALIZER;
+static unsigned int     s_log_async_event = 0;      /* atomic: changed by log_async_notify() */
+static unsigned int     s_log_async_waiters = 0;    /* atomic */
+
+/** register as waiter, then check the awaited condition before calling log_async_wait()
+ * @return the event to give to log_async_wait() */
+static unsigned int log_async_wait_begin() {
+    VLIB_ATOMIC_ADD(&s_log_async_waiters, 1);
+    return VLIB_ATOMIC_LOAD(&s_log_async_event);
+}
+
+static void log_async_wait_end() {
+    VLIB_ATOMIC_SUB(&s_log_async_waiters, 1);
+}
+
+/** wait for a log_async_notify() done after *event was read, at most timeout_ms */
+static void log_async_wait(unsigned int * event, int timeout_ms) {
+    struct timespec ts;
+
+    vclock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += timeout_ms / 1000;
+    if ((ts.tv_nsec += (timeout_ms % 1000) * 1000000L) >= 1000000000L) {
+        ++ts.tv_sec;
+        ts.tv_nsec -= 1000000000L;
+    }
+    pthread_mutex_lock(&s_log_async_wait_mutex);
+    while (VLIB_ATOMIC_LOAD(&s_log_async_event) == *event
+    &&     pthread_cond_timedwait(&s_log_async_wait_cond, &s_log_async_wait_mutex, &ts) == 0)
+        ; /* nothing but wait */
+    *event = VLIB_ATOMIC_LOAD(&s_log_async_event);
+    pthread_mutex_unlock(&s_log_async_wait_mutex);
+}
+
+/** wake up the waiters, after the change they wait for is visible */
+static void log_async_notify() {
+    VLIB_ATOMIC_ADD(&s_log_async_event, 1);
+    if (VLIB_ATOMIC_LOAD(&s_log_async_waiters) != 0) {
+        pthread_mutex_lock(&s_log_async_wait_mutex);
+        pthread_cond_broadcast(&s_log_async_wait_cond);
+        pthread_mutex_unlock(&s_log_async_wait_mutex);
+    }
+}
+
+/** get the asynchronous file of log, to be released after queuing lines,
+ * or NULL if log is synchronous */
+static log_async_t * log_async_get(log_t * log) {
+    FILE * out;
+
+    if (VLIB_ATOMIC_LOAD_RELAXED(&s_log_async_count) == 0) {
+        return NULL;
+    }
+    out = log->out != NULL ? log->out : LOG_FILE_DEFAULT;
+    for (unsigned int i = 0; i < LOG_ASYNC_MAX; ++i) {
+        log_async_t * async = &s_log_async[i];
+
+        if (VLIB_ATOMIC_LOAD(&async->out) != out) {
+            continue ;
+        }
+        /* checked again after incrementing users, as stop waits for users */
+        VLIB_ATOMIC_ADD(&async->users, 1);
+        if (VLIB_ATOMIC_LOAD(&async->state) == LAS_RUNNING && VLIB_ATOMIC_LOAD(&async->out) == out) {
+            return async;
+        }
+        VLIB_ATOMIC_SUB(&async->users, 1);
+        /* being stopped: let queued lines be written before writing synchronously */
+        if (VLIB_ATOMIC_LOAD(&async->state) == LAS_STOPPING) {
+            unsigned int event = log_async_wait_begin();
+            while (VLIB_ATOMIC_LOAD(&async->state) == LAS_STOPPING
+            &&     VLIB_ATOMIC_LOAD(&async->out) == out) {
+                log_async_wait(&event, LOG_ASYNC_WAIT_MS);
+            }
+            log_async_wait_end();
+        }
+        break ;
+    }
+    return NULL;
+}
+
+static void log_async_release(log_async_t * async) {
+    VLIB_ATOMIC_SUB(&async->users, 1);
+}
+
+/** queue a line, according to the overflow policy
+ * @return the line size, or 0 if dropped */
+static int log_async_push(log_async_t * async, log_line_t * lbuf) {
+    char            ref[1 + sizeof(char *) + sizeof(size_t)];
+    const char *    rec = lbuf->buf;
+    size_t          size = lbuf->len, len = lbuf->len - 1;
+    char *          copy = NULL;
+    unsigned int    event;
+    int             waiting = 0;
+
+    lbuf->buf[0] = LOG_ASYNC_LINE;
+    if (size > LOG_ASYNC_RECORD_SZ) {
+        if ((copy = malloc(len)) == NULL) {
+            VLIB_ATOMIC_ADD(&async->dropped, 1);
+            return 0;
+        }
+        memcpy(copy, lbuf->buf + 1, len);
+        ref[0] = LOG_ASYNC_REF;
+        memcpy(ref + 1, &copy, sizeof(copy));
+        memcpy(ref + 1 + sizeof(copy), &len, sizeof(len));
+        rec = ref;
+        size = sizeof(ref);
+    }
+    while (shmrbuf_write(async->ring, rec, size) != 0) {
+        if (errno != EAGAIN || async->policy != LOG_ASYNC_BLOCK) {
+            if (waiting)
+                log_async_wait_end();
+            VLIB_ATOMIC_ADD(&async->dropped, 1);
+            if (copy != NULL)
+                free(copy);
+            return 0;
+        }
+        /* the ring is full: tried again once registered as waiter, then woken by the writer */
+        if (!waiting) {
+            event = log_async_wait_begin();
+            waiting = 1;
+        } else {
+            log_async_wait(&event, LOG_ASYNC_WAIT_MS);
+        }
+    }
+    if (waiting)
+        log_async_wait_end();
+    VLIB_ATOMIC_ADD(&async->queued, 1);
+    return len;
+}
+
+/** write all data, as the file can be non-blocking */
+static int log_async_write(int fd, const char * data, size_t size) {
+    struct pollfd   pfd = { .fd = fd, .events = POLLOUT, .revents = 0 };
+    ssize_t         n;
+
+    while (size > 0) {
+        if ((n = write(fd, data, size)) >= 0) {
+            data += n;
+            size -= n;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            poll(&pfd, 1, LOG_ASYNC_WAIT_MS);
+        } else if (errno != EINTR) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/** get the line of a record read from the ring */
+static const char * log_async_record(const char * rec, ssize_t n, size_t * size) {
+    const char * copy;
+
+    if (rec[0] == LOG_ASYNC_REF && n == 1 + sizeof(copy) + sizeof(*size)) {
+        memcpy(&copy, rec + 1, sizeof(copy));
+        memcpy(size, rec + 1 + sizeof(copy), sizeof(*size));
+        return copy;
+    }
+    *size = n - 1;
+    return rec + 1;
+}
+
+/** take the ring for the writer: only the fatal signal handler can hold it, and it
+ * does not give it back as the process is terminating */
+static void log_async_lock(log_async_t * async) {
+    unsigned int unlocked = 0;
+
+    if (!VLIB_ATOMIC_CAS(&async->reading, &unlocked, 1)) {
+        while (1)
+            pause();
+    }
+}
+
+static void * log_async_writer(void * data) {
+    log_async_t *   async = (log_async_t *) data;
+    char            rec[LOG_ASYNC_RECORD_SZ];
+    const char *    line;
+    unsigned long   nrec, dropped = 0, ndropped;
+    size_t          len = 0, size;
+    ssize_t         n;
+    int             stopping;
+    sigset_t        sigset;
+
+    /* signals are for other threads, except the ones of faults */
+    sigfillset(&sigset);
+    sigdelset(&sigset, SIGSEGV);
+    sigdelset(&sigset, SIGBUS);
+    sigdelset(&sigset, SIGILL);
+    sigdelset(&sigset, SIGFPE);
+    pthread_sigmask(SIG_BLOCK, &sigset, NULL);
+
+    do {
+        /* stopped once nobody queues lines and the ring is empty */
+        stopping = VLIB_ATOMIC_LOAD(&async->state) != LAS_RUNNING
+                   && VLIB_ATOMIC_LOAD(&async->users) == 0;
+
+        log_async_lock(async);
+        n = shmrbuf_read(async->ring, rec, sizeof(rec), stopping ? 0 : LOG_ASYNC_WAIT_MS);
+        for (nrec = 0; n > 0; ) {
+            line = log_async_record(rec, n, &size);
+            if (len + size > LOG_ASYNC_BATCH_SZ || line != rec + 1) {
+                log_async_write(async->fd, async->batch, len);
+                len = 0;
+            }
+            if (line != rec + 1) {
+                log_async_write(async->fd, line, size);
+                free((char *) line);
+            } else {
+                memcpy(async->batch + len, line, size);
+                len += size;
+            }
+            if (++nrec >= LOG_ASYNC_BATCH_RECORDS)
+                break ;
+            n = shmrbuf_read(async->ring, rec, sizeof(rec), 0);
+        }
+        if ((ndropped = VLIB_ATOMIC_LOAD(&async->dropped)) != dropped) {
+            if (async->policy == LOG_ASYNC_DROP_COUNT) {
+                if (len + 64 > LOG_ASYNC_BATCH_SZ) {
+                    log_async_write(async->fd, async->batch, len);
+                    len = 0;
+                }
+                len += snprintf(async->batch + len, 64, "*** log: %lu line%s dropped ***\n",
+                                ndropped - dropped, ndropped - dropped > 1 ? "s" : "");
+            }
+            dropped = ndropped;
+        }
+        if (len > 0) {
+            log_async_write(async->fd, async->batch, len);
+            len = 0;
+        }
+        VLIB_ATOMIC_STORE(&async->reading, 0);
+        if (nrec > 0) {
+            VLIB_ATOMIC_ADD(&async->written, nrec);
+            log_async_notify();
+        }
+    } while (!stopping || nrec > 0);
+
+    return NULL;
+}
+
+/** fatal signal handler: write the queued lines, then let the signal kill the process */
+static void log_async_sighandler(int sig) {
+    struct timespec ts = { 0, 1000000L };
+    char            rec[LOG_ASYNC_RECORD_SZ];
+    const char *    line;
+    size_t          size;
+    ssize_t         n;
+
+    for (unsigned int i = 0; i < LOG_ASYNC_MAX; ++i) {
+        log_async_t *   async = &s_log_async[i];
+        unsigned int    unlocked = 0;
+        int             locked;
+
+        if (VLIB_ATOMIC_LOAD(&async->state) == LAS_FREE) {
+            continue ;
+        }
+        /* wait for the writer to finish its batch, unless it is the faulting thread */
+        for (int wait_ms = 0; !(locked = VLIB_ATOMIC_CAS(&async->reading, &unlocked, 1))
+                              && !pthread_equal(pthread_self(), async->tid)
+                              && wait_ms < 2 * LOG_ASYNC_WAIT_MS; ++wait_ms) {
+            unlocked = 0;
+            nanosleep(&ts, NULL);
+        }
+        /* the ring has a single consumer: leave it to a writer still reading it */
+        if (!locked && !pthread_equal(pthread_self(), async->tid)) {
+            continue ;
+        }
+        while ((n = shmrbuf_read(async->ring, rec, sizeof(rec), 0)) > 0) {
+            line = log_async_record(rec, n, &size);
+            log_async_write(async->fd, line, size);
+        }
+    }
+    /* the handler was reset (SA_RESETHAND): the signal is delivered on return */
+    raise(sig);
+}
+
+/** write the queued lines of all asynchronous files at exit() */
+static void log_async_atexit() {
+    for (unsigned int i = 0; i < LOG_ASYNC_MAX; ++i) {
+        FILE * out = VLIB_ATOMIC_LOAD(&s_log_async[i].out);
+
+        if (out != NULL) {
+            log_async_file_flush(out, 1);
+        }
+    }
+}
+
+/** wait until the lines queued so far are written, at most timeout_ms if not negative
+ * @return 0 when written, -1 on timeout */
+static int log_async_flush_wait(log_async_t * async, int timeout_ms) {
+    unsigned long   queued = VLIB_ATOMIC_LOAD(&async->queued);
+    unsigned int    event = log_async_wait_begin();
+    struct timespec t0, t1;
+    int             remaining = timeout_ms, ret = 0;
+
+    vclock_gettime(CLOCK_MONOTONIC, &t0);
+    while ((long) (VLIB_ATOMIC_LOAD(&async->written) - queued) < 0) {
+        if (timeout_ms >= 0) {
+            vclock_gettime(CLOCK_MONOTONIC, &t1);
+            remaining = timeout_ms - (int) ((t1.tv_sec - t0.tv_sec) * 1000
+                                            + (t1.tv_nsec - t0.tv_nsec) / 1000000L);
+            if (remaining <= 0) {
+                ret = -1;
+                break ;
+            }
+        }
+        log_async_wait(&event, timeout_ms >= 0 && remaining < LOG_ASYNC_WAIT_MS
+                               ? remaining : LOG_ASYNC_WAIT_MS);
+    }
+    log_async_wait_end();
+    return ret;
+}
+
+/** before fork(): write the queued lines, and keep the files until the fork is done.
+ * The wait is bounded, as the writer can be blocked on its file: lines not written
+ * then are written by the parent only. */
+static void log_async_atfork_prepare() {
+    pthread_mutex_lock(&s_log_async_mutex);
+    for (unsigned int i = 0; i < LOG_ASYNC_MAX; ++i) {
+        if (s_log_async[i].state == LAS_RUNNING) {
+            log_async_flush_wait(&s_log_async[i], LOG_ASYNC_FORK_WAIT_MS);
+        }
+    }
+}
+
+static void log_async_atfork_parent() {
+    pthread_mutex_unlock(&s_log_async_mutex);
+}
+
+/** after fork(), in the child: there is no writer, the files become synchronous.
+ * The lines still in the ring (private mapping) are written by the parent. */
+static void log_async_atfork_child() {
+    char            rec[LOG_ASYNC_RECORD_SZ];
+    const char *    line;
+    size_t          size;
+    ssize_t         n;
+
+    for (unsigned int i = 0; i < LOG_ASYNC_MAX; ++i) {
+        log_async_t * async = &s_log_async[i];
+
+        if (async->state == LAS_FREE) {
+            continue ;
+        }
+        while ((n = shmrbuf_read(async->ring, rec, sizeof(rec), 0)) > 0) {
+            if ((line = log_async_record(rec, n, &size)) != rec + 1)
+                free((char *) line);
+        }
+        shmrbuf_close(async->ring);
+        free(async->batch);
+        async->ring = NULL;
+        async->batch = NULL;
+        async->users = 0;
+        async->reading = 0;
+        async->out = NULL;
+        async->state = LAS_FREE;
+    }
+    s_log_async_count = 0;
+    /* the waiting threads are gone, and could have held the mutex */
+    s_log_async_waiters = 0;
+    pthread_mutex_init(&s_log_async_wait_mutex, NULL);
+    pthread_cond_init(&s_log_async_wait_cond, NULL);
+    pthread_mutex_unlock(&s_log_async_mutex);
+}
+
+/** run once, under lock */
+static void log_async_initialize() {
+    static const int    signals[] = { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT };
+    struct sigaction    sa, old;
+
+    atexit(log_async_atexit);
+    pthread_atfork(log_async_atfork_prepare, log_async_atfork_parent, log_async_atfork_child);
+
+    /* handle the fatal signals not handled by the program */
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = log_async_sighandler;
+    sa.sa_flags = SA_RESETHAND;
+    sigemptyset(&sa.sa_mask);
+    for (size_t i = 0; i < sizeof(signals) / sizeof(*signals); ++i) {
+        if (sigaction(signals[i], NULL, &old) == 0
+        &&  (old.sa_flags & SA_SIGINFO) == 0 && old.sa_handler == SIG_DFL) {
+            sigaction(signals[i], &sa, NULL);
+        }
+    }
+}
+
+/** end a line: queued on an asynchronous file, or kept in lbuf to be written
+ * with the next ones by log_line_end()
+ * @return the size of the queued line without color sequences */
+static int log_line_next(log_line_t * lbuf, log_async_t * async) {
+    int n = 0;
+
+    if (async != NULL) {
+        if (log_async_push(async, lbuf) > 0)
+            n = log_line_size(lbuf);
+        lbuf->len = 1;
+        lbuf->esc = 0;
+    }
+    return n;
+}
+
+/** write the lines kept in lbuf with one fwrite(), or release the asynchronous file,
+ * then give back lbuf
+ * @return the size written without color sequences, total for asynchronous files */
+static int log_line_end(log_line_t * lbuf, log_t * log, log_async_t * async, int total) {
+    FILE * out;
+
+    if (async != NULL) {
+        log_async_release(async);
+    } else if (lbuf->len <= 1) {
+        total = 0;
+    } else {
+        out = log_getfile_locked(log);
+        if (fwrite(lbuf->buf + 1, 1, lbuf->len - 1, out) == lbuf->len - 1)
+            total = log_line_size(lbuf);
+        funlockfile(out);
+    }
+    log_line_put(lbuf);
+    return total;
+}
+
 static inline int vlog_internal(log_level_t level, log_t * log,
                                 const char * file, const char * func, int line,
                                 const char * fmt, va_list valist)
 {
-    int         total = 0;
-    FILE *      out;
-    int         n;
+    int             total = 0;
+    FILE *          out;
+    int             n;
+    log_line_t *    lbuf;
 
     if (log == NULL)
         log = &s_vlib_log_null;
 
+    if ((lbuf = log_line_get()) != NULL) {
+        log_async_t * async = log_async_get(log);
+
+        out = log->out != NULL ? log->out : LOG_FILE_DEFAULT;
+        if (fmt == NULL) {
+            log_line_puts(lbuf, "\n");
+        } else {
+            log_line_header(lbuf, level, log, out, file, func, line);
+            log_line_vprintf(lbuf, fmt, valist);
+            log_line_footer(lbuf, level, log, file, func, line);
+        }
+        total = log_line_next(lbuf, async);
+        return log_line_end(lbuf, log, async, total);
+    }
+
+    /* no line buffer: the file is written with stdio */
     out = log_getfile_locked(log);
 
     if (fmt == NULL) {
@@ -455,10 +1288,61 @@ static inline int log_buffer_internal(
     const char *    buffer = (const char *) pbuffer;
     int             n;
     va_list         vatmp;
+    log_line_t *    lbuf;
 
     if (log == NULL)
         log = &s_vlib_log_null;
 
+    if ((lbuf = log_line_get()) != NULL) {
+        log_async_t * async = log_async_get(log);
+
+        out = log->out != NULL ? log->out : LOG_FILE_DEFAULT;
+        for (size_t i_buf = 0; i_buf == 0 || i_buf < len; i_buf += chars_per_line) {
+            size_t i_char;
+
+            log_line_header(lbuf, level, log, out, file, func, line);
+            if (fmt_header) {
+                va_copy(vatmp, valist);
+                log_line_vprintf(lbuf, fmt_header, vatmp);
+                va_end(vatmp);
+            }
+            if (buffer == NULL || len == 0) {
+                if (fmt_header)
+                    log_line_puts(lbuf, "<empty>");
+                log_line_footer(lbuf, level, log, file, func, line);
+                total += log_line_next(lbuf, async);
+                break ;
+            }
+            log_line_printf(lbuf, "%04zx:", i_buf);
+            if (log_line_reserve(lbuf, 4 * chars_per_line + 3) == 0) {
+                static const char   hex[] = "0123456789abcdef";
+                char *              p = lbuf->buf + lbuf->len;
+
+                for (i_char = i_buf; i_char < i_buf + chars_per_line; i_char++) {
+                    if (i_char < len) {
+                        *p++ = ' ';
+                        *p++ = hex[(buffer[i_char] >> 4) & 0xf];
+                        *p++ = hex[buffer[i_char] & 0xf];
+                    } else {
+                        memcpy(p, "   ", 3);
+                        p += 3;
+                    }
+                }
+                memcpy(p, " | ", 3);
+                p += 3;
+                for (i_char = i_buf; i_char < i_buf + chars_per_line && i_char < len; i_char++) {
+                    char ch = buffer[i_char] & 0xff;
+                    *p++ = isprint(ch) ? ch : '?';
+                }
+                lbuf->len = p - lbuf->buf;
+            }
+            log_line_footer(lbuf, level, log, file, func, line);
+            total += log_line_next(lbuf, async);
+        }
+        return log_line_end(lbuf, log, async, total);
+    }
+
+    /* no line buffer: the file is written with stdio */
     out = log_getfile_locked(log);
 
     if (buffer == NULL || len == 0) {
@@ -495,7 +1379,7 @@ static inline int log_buffer_internal(
                 ch = '?';
             INCR_GE0(fprintf(out, "%c", ch), n, total);
         }
-        total += log_footer2(level, log, out, func, file, line);
+        total += log_footer2(level, log, out, file, func, line);
     }
     funlockfile(out);
 
@@ -545,30 +1429,51 @@ int vlog_strings(log_level_t level, log_t * log,
         FILE *          out;
         va_list         valist;
         char            buf[512];
+        log_async_t *   async = NULL;
+        log_line_t *    lbuf;
 
         if (strings_fmt == NULL) {
             return vlog_nocheck(level, log, file, func, line, NULL);
         }
 
-        out = log_getfile_locked(log);
+        /* without line buffer, the file is written with stdio */
+        if ((lbuf = log_line_get()) != NULL) {
+            async = log_async_get(log);
+            out = log->out != NULL ? log->out : LOG_FILE_DEFAULT;
+        } else {
+            out = log_getfile_locked(log);
+        }
         va_start(valist, strings_fmt);
 
         while ((len = strtok_ro_r(&token, "\n", &next, NULL, 0)) > 0 || *next != 0) {
-            ret += log_header2(level, log, out, file, func, line);
-
             strn0cpy(buf, token, len, sizeof(buf));
-            if ((n = vfprintf(out, buf, valist)) > 0)
-                ret += n;
 
-            ret += log_footer2(level, log, out, file, func, line);
+            if (lbuf != NULL) {
+                /* valist is consumed by each line, as with vfprintf() */
+                log_line_header(lbuf, level, log, out, file, func, line);
+                log_line_vprintf(lbuf, buf, valist);
+                log_line_footer(lbuf, level, log, file, func, line);
+                ret += log_line_next(lbuf, async);
+            } else {
+                ret += log_header2(level, log, out, file, func, line);
+                if ((n = vfprintf(out, buf, valist)) > 0)
+                    ret += n;
+                ret += log_footer2(level, log, out, file, func, line);
+            }
 
             if (len >= sizeof(buf)) {
-                LOG_WARN(g_vlib_log, "%s(): buffer too small, aborting", __func__);
                 break ;
             }
         }
         va_end(valist);
-        funlockfile(out);
+        if (lbuf != NULL)
+            ret = log_line_end(lbuf, log, async, ret);
+        else
+            funlockfile(out);
+        /* logged once the line buffer is written, as it is used by the warning */
+        if (len >= sizeof(buf)) {
+            LOG_WARN(g_vlib_log, "%s(): buffer too small, aborting", __func__);
+        }
         return ret;
     }
     return 0;
@@ -595,9 +1500,11 @@ log_t * log_create(log_t * from) {
 void log_close(log_t * log) {
     if (log && log->out) {
         int fd = fileno(log->out);
+        int closing = fd != STDERR_FILENO && fd != STDOUT_FILENO
+                      && (log->flags & LOG_FLAG_CLOSEFILE) != 0;
+        log_async_file_flush(log->out, closing);
         fflush(log->out);
-        if (fd != STDERR_FILENO && fd != STDOUT_FILENO
-        &&  (log->flags & LOG_FLAG_CLOSEFILE) != 0) {
+        if (closing) {
             fclose(log->out);
         }
         log->out = NULL;
@@ -643,6 +1550,144 @@ FILE * log_getfile_locked(log_t * log) {
     return file;
 }
 
+/*****************************************************************************/
+/** find the asynchronous file, under s_log_async_mutex */
+static log_async_t * log_async_find(FILE * file) {
+    for (unsigned int i = 0; i < LOG_ASYNC_MAX; ++i) {
+        if (s_log_async[i].state != LAS_FREE && s_log_async[i].out == file) {
+            return &s_log_async[i];
+        }
+    }
+    return NULL;
+}
+
+int log_async_file_flush(FILE * file, int stop) {
+    log_async_t *   async;
+
+    if (VLIB_ATOMIC_LOAD_RELAXED(&s_log_async_count) == 0) {
+        errno = ENOENT;
+        return -1;
+    }
+    pthread_mutex_lock(&s_log_async_mutex);
+    if ((async = log_async_find(file)) == NULL) {
+        pthread_mutex_unlock(&s_log_async_mutex);
+        errno = ENOENT;
+        return -1;
+    }
+    if (!stop) {
+        log_async_flush_wait(async, -1);
+        pthread_mutex_unlock(&s_log_async_mutex);
+        return 0;
+    }
+    /* the writer exits once users are gone and the ring is empty */
+    VLIB_ATOMIC_STORE(&async->state, LAS_STOPPING);
+    pthread_join(async->tid, NULL);
+    shmrbuf_close(async->ring);
+    free(async->batch);
+    async->ring = NULL;
+    async->batch = NULL;
+    VLIB_ATOMIC_STORE(&async->out, NULL);
+    VLIB_ATOMIC_SUB(&s_log_async_count, 1);
+    VLIB_ATOMIC_STORE(&async->state, LAS_FREE);
+    log_async_notify();
+    pthread_mutex_unlock(&s_log_async_mutex);
+    return 0;
+}
+
+static FILE * log_async_file(log_t * log) {
+    if (log == NULL)
+        log = &s_vlib_log_null;
+    return log->out != NULL ? log->out : LOG_FILE_DEFAULT;
+}
+
+int log_async_start(log_t * log, size_t size, log_async_policy_t policy) {
+    FILE *          out = log_async_file(log);
+    log_async_t *   async = NULL;
+    size_t          slots;
+
+    pthread_mutex_lock(&s_log_async_mutex);
+    if (log_async_find(out) != NULL) {
+        pthread_mutex_unlock(&s_log_async_mutex);
+        errno = EEXIST;
+        return -1;
+    }
+    for (unsigned int i = 0; i < LOG_ASYNC_MAX; ++i) {
+        if (s_log_async[i].state == LAS_FREE) {
+            async = &s_log_async[i];
+            break ;
+        }
+    }
+    if (async == NULL) {
+        pthread_mutex_unlock(&s_log_async_mutex);
+        errno = ENOSPC;
+        return -1;
+    }
+    if (size == 0)
+        size = LOG_ASYNC_SIZE_DEFAULT;
+    if ((slots = size / LOG_ASYNC_RECORD_SZ) < 16)
+        slots = 16;
+
+    async->fd = fileno(out);
+    async->policy = policy;
+    async->users = 0;
+    async->reading = 0;
+    async->queued = async->written = async->dropped = 0;
+    if ((async->ring = shmrbuf_open(NULL, slots, LOG_ASYNC_RECORD_SZ,
+                                    SRF_CREATE | SRF_CONSUMER)) == NULL
+    ||  (async->batch = malloc(LOG_ASYNC_BATCH_SZ)) == NULL) {
+        int errsv = errno;
+        if (async->ring != NULL)
+            shmrbuf_close(async->ring);
+        async->ring = NULL;
+        pthread_mutex_unlock(&s_log_async_mutex);
+        errno = errsv;
+        return -1;
+    }
+    /* lines already buffered by stdio are written before the queued ones */
+    fflush(out);
+    VLIB_ATOMIC_STORE(&async->state, LAS_RUNNING);
+    if ((errno = pthread_create(&async->tid, NULL, log_async_writer, async)) != 0) {
+        int errsv = errno;
+        shmrbuf_close(async->ring);
+        free(async->batch);
+        async->ring = NULL;
+        async->batch = NULL;
+        VLIB_ATOMIC_STORE(&async->state, LAS_FREE);
+        pthread_mutex_unlock(&s_log_async_mutex);
+        errno = errsv;
+        return -1;
+    }
+    VLIB_ATOMIC_STORE(&async->out, out);
+    VLIB_ATOMIC_ADD(&s_log_async_count, 1);
+    if (!s_log_async_init) {
+        s_log_async_init = 1;
+        log_async_initialize();
+    }
+    pthread_mutex_unlock(&s_log_async_mutex);
+    return 0;
+}
+
+int log_async_stop(log_t * log) {
+    return log_async_file_flush(log_async_file(log), 1);
+}
+
+int log_async_flush(log_t * log) {
+    return log_async_file_flush(log_async_file(log), 0);
+}
+
+unsigned long log_async_dropped(log_t * log) {
+    FILE *          out = log_async_file(log);
+    log_async_t *   async;
+    unsigned long   dropped = 0;
+
+    pthread_mutex_lock(&s_log_async_mutex);
+    if ((async = log_async_find(out)) != NULL) {
+        dropped = VLIB_ATOMIC_LOAD(&async->dropped);
+    }
+    pthread_mutex_unlock(&s_log_async_mutex);
+    return dropped;
+}
+
 #ifndef LOG_USE_VA_ARGS
 // VERY RARE USECASE : only active when __VA_ARGS for Macros is not available
 // and this is bad, because there is no fast level checking and no real File/line context.
@@ -667,7 +1712,7 @@ static int xvlog(log_level_t level, log_t * log,
 
         n += log_header2(level, log, out, file, func, line);
         n += vfprintf(out, fmt, arg);
-        n += log_footer2(level, log, out, func, file, line);
+        n += log_footer2(level, log, out, file, func, line);
 
         funlockfile(out);
     }
@@ -165,52 +165,34 @@ int logpool_pathcasecmp(const void * vpool1_data, const void * vpool2_data) {
 }
 
 /* ************************************************************************ */
+/* Jobs run at low priority on the default pool. A job cannot remove itself from
+ * pool->jobs, as the pool runs it in the calling thread, which holds pool->rwlock,
+ * when its queue is full: finished jobs are freed on next launch or by logpool_free(). */
 static vjob_t * logpool_job_launch_unlocked(
                     logpool_t * pool,
                     vjob_fun_t job_fun,
                     void * fun_data) {
-    vjob_t * job;
-
-    if ((job = vjob_run(job_fun, fun_data)) != NULL) {
-        pool->jobs = slist_prepend(pool->jobs, job);
-    }
-    return job;
-}
+    vjob_attr_t attr = { .prio = VJOB_PRIO_LOW };
+    vjob_t *    job;
+    slist_t *   list, * next;
 
-/* ************************************************************************ */
-static inline int logpool_job_forget_internal(
-                    logpool_t * pool,
-                    vjob_t * job,
-                    int (*jobdetach_fun)(vjob_t*)) {
-    int failed;
-
-    while ((failed = pthread_rwlock_trywrlock(&pool->rwlock)) != 0) {
-        if (pool->jobs == NULL)
-            break ; // job list is null, most probably logpool_free() on-going.
-        usleep(20000);
-    }
-    if (!failed) {
-        if (jobdetach_fun(job) == 0) {
-            LOG_SCREAM(g_vlib_log, "logpool: removing job '%lx' from list.",
-                       (unsigned long) job);
+    for (list = pool->jobs; list != NULL; list = next) {
+        next = list->next;
+        if (vjob_done(job = list->data)) {
+            LOG_SCREAM(g_vlib_log, "logpool: removing job '%lx' from list.", (unsigned long) job);
             pool->jobs = slist_remove_ptr(pool->jobs, job);
-        } else {
-            failed = -1;
+            vjob_free(job);
         }
-        pthread_rwlock_unlock(&pool->rwlock);
     }
-    return failed;
-}
-static int logpool_job_forgetme(
-                    logpool_t * pool,
-                    vjob_t * job) {
-    return logpool_job_forget_internal(pool, job, vjob_detachme);
+    if ((job = vjob_pool_run_attr(NULL, job_fun, fun_data, &attr)) != NULL) {
+        pool->jobs = slist_prepend(pool->jobs, job);
+    }
+    return job;
 }
 
 /* ************************************************************************ */
 typedef struct {
     logpool_t * pool;
-    vjob_t *    job;
     char *      path;
     char *      z_path;
     FILE *      fin;
@@ -222,9 +204,6 @@ static void  logpool_compress_log_job_clean(void * vdata) {
     int                         failed;
 
     LOG_SCREAM(g_vlib_log, "logpool: compress cleanup (%s)", data->path);
-    if (logpool_job_forgetme(data->pool, data->job) == 0) {
-        LOG_DEBUG(g_vlib_log, "logpool: removing compress job '%s' from job list.", data->path);
-    }
 
     // check if all worked well.
     if (data->fin) {
@@ -257,17 +236,14 @@ static void * logpool_compress_log_job(void * vdata) {
     void *                      dec_ctx = NULL;
     ssize_t                     in_sz, out_sz;
 
-    // first setup a pthread cleanup handler
-    vjob_killmode(0, 0, NULL, NULL);
     data->fin = data->fout = NULL;
     data->z_path = z_path;
-    pthread_cleanup_push(logpool_compress_log_job_clean, data);
 
     // Init the compression, check if supported
     in_sz = str0cpy(buf, VDECODEBUF_ZLIBENC_MAGIC, sizeof(buf)); // encode (deflate) zlib internal vlib magic / TODO
     if ((out_sz = vdecode_buffer(NULL, buf, in_sz, &dec_ctx, buf, in_sz)) < 0) {
         LOG_VERBOSE(g_vlib_log, "logpool: compression not supported");
-        return NULL;
+        goto end;
     }
 
     // open input and output files.
@@ -275,12 +251,16 @@ static void * logpool_compress_log_job(void * vdata) {
     if ((data->fin = fopen(data->path, "r")) == NULL
     ||  (data->fout = fopen(z_path, "w")) == NULL) {
         vdecode_buffer(NULL, NULL, 0, &dec_ctx, NULL, 0);
-        return NULL; // cleanup function will close files.
+        goto end; // cleanup function will close files.
     }
 
     // read input file and compress it.
     while ((in_sz = fread(buf, 1, sizeof(buf), data->fin)) > 0) {
-        vjob_testkill();
+        if (vjob_cancelled(vjob_cancel_current())) {
+            vdecode_buffer(NULL, NULL, 0, &dec_ctx, NULL, 0);
+            out_sz = -1;
+            break ;
+        }
         out_sz = vdecode_buffer(NULL, outbuf, sizeof(outbuf), &dec_ctx, buf, in_sz);
         LOG_DEBUG_LVL(LOG_LVL_SCREAM + 1, g_vlib_log, "dec %zd", out_sz);
         if (out_sz < 0)
@@ -301,8 +281,8 @@ static void * logpool_compress_log_job(void * vdata) {
         }
     }
 
-    // cleanup
-    pthread_cleanup_pop(1);
+end:
+    logpool_compress_log_job_clean(data);
     return NULL;
 }
 
@@ -348,7 +328,7 @@ static FILE * logpool_open_and_rotate_file(logpool_t * pool, const char * path)
             logpool_compress_data_t * data = malloc(sizeof(*data));
             if (data == NULL || (data->pool = pool) == NULL
             || (data->path = strdup(old_path)) == NULL
-            || (data->job = logpool_job_launch_unlocked(pool, logpool_compress_log_job, data)) == NULL) {
+            || logpool_job_launch_unlocked(pool, logpool_compress_log_job, data) == NULL) {
                 LOG_ERROR(g_vlib_log, "logpool: cannot compress log '%s': %s", old_path, strerror(errno));
                 if (data->path)
                     free(data->path);
@@ -401,8 +381,10 @@ static void logpool_file_free(void * vfile) {
     if (pool_file != NULL) {
         if (pool_file->file != NULL) {
             int fd = fileno(pool_file->file);
-            if (fd != STDERR_FILENO && fd != STDOUT_FILENO
-            && (pool_file->flags & LFF_NOCLOSE) == 0) {
+            int closing = fd != STDERR_FILENO && fd != STDOUT_FILENO
+                          && (pool_file->flags & LFF_NOCLOSE) == 0;
+            log_async_file_flush(pool_file->file, closing);
+            if (closing) {
                 struct stat stats;
                 fflush(pool_file->file);
                 fsync(fileno(pool_file->file));
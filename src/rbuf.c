@@ -26,6 +26,7 @@
 
 #include "vlib/rbuf.h"
 #include "vlib/log.h"
+#include "vlib/util.h"
 
 #include "vlib_private.h"
 
@@ -33,11 +34,22 @@
 
 #define RBUF_IS_EMPTY(rbuf)     ((rbuf)->end >= (rbuf)->max_size)
 #define RBUF_EMPTY              SIZE_MAX
+#define RBUF_NOMASK             SIZE_MAX
+
+/* mask used to wrap indexes if size is a power of 2 */
+#define RBUF_MASK(size)         (((size) & ((size) - 1)) == 0 ? (size) - 1 : RBUF_NOMASK)
+#define RBUF_WRAP(rbuf, idx)    (VLIB_LIKELY((rbuf)->mask != RBUF_NOMASK) \
+                                 ? (idx) & (rbuf)->mask : (idx) % (rbuf)->max_size)
+#define RBUF_COUNT(rbuf)        (RBUF_IS_EMPTY(rbuf) ? 0 \
+                                 : (rbuf)->end >= (rbuf)->start \
+                                   ? 1 + (rbuf)->end - (rbuf)->start \
+                                   : 1 + (rbuf)->end + (rbuf)->max_size - (rbuf)->start)
 
 struct rbuf_s {
     void **         tab;
     size_t          init_size;
     size_t          max_size;
+    size_t          mask;
     rbuf_flags_t    flags;
     size_t          start;
     size_t          end;
@@ -60,6 +72,7 @@ rbuf_t *        rbuf_create(
         return NULL;
     }
     rbuf->max_size = max_size;
+    rbuf->mask = RBUF_MASK(max_size);
     rbuf->init_size = max_size;
     rbuf->flags = flags;
     rbuf_reset(rbuf);
@@ -82,6 +95,7 @@ int             rbuf_reset(
         }
         rbuf->tab = new;
         rbuf->max_size = rbuf->init_size;
+        rbuf->mask = RBUF_MASK(rbuf->max_size);
     }
 
     return 0;
@@ -176,6 +190,7 @@ int             rbuf_push(
             }
             rbuf->end = rbuf->max_size + rbuf->end;
             rbuf->max_size *= 2;
+            rbuf->mask = RBUF_MASK(rbuf->max_size);
         } else {
             /* OVERWRITE MODE is ON -> lose the bottom element */
             rbuf->start++;
@@ -306,7 +321,7 @@ void *          rbuf_get(
         errno = ENOENT;
         return NULL;
     }
-    ret = rbuf->tab[(rbuf->start + index) % rbuf->max_size];
+    ret = rbuf->tab[RBUF_WRAP(rbuf, rbuf->start + index)];
     if (ret == NULL) {
         errno = 0;
     }
@@ -335,7 +350,7 @@ int             rbuf_set(
             }
         }
     }
-    real_index = (rbuf->start + index) % rbuf->max_size;
+    real_index = RBUF_WRAP(rbuf, rbuf->start + index);
     rbuf->tab[real_index] = data;
 
     if (RBUF_IS_EMPTY(rbuf) || index >= rbuf_size(rbuf)) {
@@ -347,3 +362,171 @@ int             rbuf_set(
 /*****************************************************************************/
 
 
+/*****************************************************************************/
+static int      rbuf_reserve(
+                    rbuf_t *        rbuf,
+                    size_t          count) {
+    size_t  new_size = rbuf->max_size;
+    void *  new;
+
+    while (new_size < count) {
+        new_size *= 2;
+    }
+    if (new_size == rbuf->max_size) {
+        return 0;
+    }
+    if ((new = realloc(rbuf->tab, sizeof(void *) * new_size)) == NULL) {
+        return -1;
+    }
+    rbuf->tab = new;
+    if (!RBUF_IS_EMPTY(rbuf) && rbuf->end < rbuf->start) {
+        /* data in range [0,end] must be moved after the old end of buffer,
+         * there is enough room as end < start < max_size <= new_size - max_size. */
+        memcpy(rbuf->tab + rbuf->max_size, rbuf->tab, (rbuf->end + 1) * sizeof(void *));
+        rbuf->end += rbuf->max_size;
+    }
+    rbuf->max_size = new_size;
+    rbuf->mask = RBUF_MASK(new_size);
+    return 0;
+}
+/*****************************************************************************/
+int             rbuf_push_n(
+                    rbuf_t *        rbuf,
+                    void * const *  data,
+                    size_t          n) {
+    size_t count, pos, n1;
+
+    if (rbuf == NULL || rbuf->start >= rbuf->max_size || (data == NULL && n > 0)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (n == 0) {
+        return 0;
+    }
+    LOG_SCREAM(g_vlib_log, "rbuf_push_n(%zu) start:%zu end:%zu maxsize:%zu",
+               n, rbuf->start, rbuf->end, rbuf->max_size);
+
+    count = RBUF_COUNT(rbuf);
+    if (count + n > rbuf->max_size) {
+        if ((rbuf->flags & RBF_OVERWRITE) == 0) {
+            /* OVERWRITE MODE is OFF -> increase buffer size */
+            if (rbuf_reserve(rbuf, count + n) != 0) {
+                return -1;
+            }
+        } else if (n >= rbuf->max_size) {
+            /* OVERWRITE MODE is ON -> only the last elements of data are kept */
+            memcpy(rbuf->tab, data + n - rbuf->max_size, rbuf->max_size * sizeof(void *));
+            rbuf->start = 0;
+            rbuf->end = rbuf->max_size - 1;
+            return 0;
+        } else {
+            /* OVERWRITE MODE is ON -> lose the bottom elements */
+            rbuf->start = RBUF_WRAP(rbuf, rbuf->start + count + n - rbuf->max_size);
+        }
+    }
+
+    pos = RBUF_IS_EMPTY(rbuf) ? rbuf->start : RBUF_WRAP(rbuf, rbuf->end + 1);
+    n1 = rbuf->max_size - pos;
+    if (n1 >= n) {
+        memcpy(rbuf->tab + pos, data, n * sizeof(void *));
+    } else {
+        memcpy(rbuf->tab + pos, data, n1 * sizeof(void *));
+        memcpy(rbuf->tab, data + n1, (n - n1) * sizeof(void *));
+    }
+    rbuf->end = RBUF_WRAP(rbuf, pos + n - 1);
+
+    return 0;
+}
+/*****************************************************************************/
+size_t          rbuf_pop_n(
+                    rbuf_t *        rbuf,
+                    void **         out,
+                    size_t          n) {
+    size_t count, i;
+
+    if (rbuf == NULL || rbuf->start >= rbuf->max_size) {
+        errno = EINVAL;
+        return 0;
+    }
+    if ((count = RBUF_COUNT(rbuf)) < n) {
+        n = count;
+    }
+    if (n == 0) {
+        errno = 0;
+        return 0;
+    }
+    for (i = 0; i < n; ++i) {
+        if (out != NULL) {
+            out[i] = rbuf->tab[rbuf->end];
+        }
+        if (rbuf->end-- == 0) {
+            rbuf->end = rbuf->max_size - 1;
+        }
+    }
+    if (n == count) {
+        rbuf->end = RBUF_EMPTY;
+    }
+    return n;
+}
+/*****************************************************************************/
+size_t          rbuf_dequeue_n(
+                    rbuf_t *        rbuf,
+                    void **         out,
+                    size_t          n) {
+    size_t count, n1;
+
+    if (rbuf == NULL || rbuf->start >= rbuf->max_size) {
+        errno = EINVAL;
+        return 0;
+    }
+    if ((count = RBUF_COUNT(rbuf)) < n) {
+        n = count;
+    }
+    if (n == 0) {
+        errno = 0;
+        return 0;
+    }
+    LOG_SCREAM(g_vlib_log, "rbuf_dequeue_n(%zu) start:%zu end:%zu maxsize:%zu",
+               n, rbuf->start, rbuf->end, rbuf->max_size);
+
+    if (out != NULL) {
+        n1 = rbuf->max_size - rbuf->start;
+        if (n1 >= n) {
+            memcpy(out, rbuf->tab + rbuf->start, n * sizeof(void *));
+        } else {
+            memcpy(out, rbuf->tab + rbuf->start, n1 * sizeof(void *));
+            memcpy(out + n1, rbuf->tab, (n - n1) * sizeof(void *));
+        }
+    }
+    if (n == count) {
+        rbuf->end = RBUF_EMPTY;
+    } else {
+        rbuf->start = RBUF_WRAP(rbuf, rbuf->start + n);
+    }
+    return n;
+}
+/*****************************************************************************/
+size_t          rbuf_peek_spans(
+                    const rbuf_t *  rbuf,
+                    rbuf_span_t     spans[2]) {
+    if (rbuf == NULL || spans == NULL || rbuf->start >= rbuf->max_size) {
+        errno = EINVAL;
+        return 0;
+    }
+    spans[1].tab = rbuf->tab;
+    spans[1].count = 0;
+    spans[0].tab = rbuf->tab + rbuf->start;
+    if (RBUF_IS_EMPTY(rbuf)) {
+        spans[0].count = 0;
+        errno = 0;
+        return 0;
+    }
+    if (rbuf->end >= rbuf->start) {
+        spans[0].count = 1 + rbuf->end - rbuf->start;
+        return spans[0].count;
+    }
+    spans[0].count = rbuf->max_size - rbuf->start;
+    spans[1].count = rbuf->end + 1;
+    return spans[0].count + spans[1].count;
+}
+/*****************************************************************************/
@@ -0,0 +1,558 @@
+/*
+ * Copyright (C) 2026 Vincent Sallaberry
+ * vlib <https://github.com/vsallaberry/vlib>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/* ------------------------------------------------------------------------
+ * Shared memory ring buffer of records, for inter-process streaming.
+ *
+ * Layout of the region: a header followed by slot_count slots of slot_size bytes.
+ * Each slot has a sequence number telling whether it is free for the write
+ * position pos (seq == pos), or readable (seq == pos + 1), as in the
+ * bounded queue of D.Vyukov: producers reserve a slot with a CAS on the write
+ * position, the consumer releases it with seq = pos + slot_count.
+ * The owner word of a slot holds the position it is free for and the pid of
+ * the producer which claimed it, so that a producer stalled while the slot was
+ * recovered and reserved again for a next position cannot claim it.
+ */
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#ifdef __linux__
+# include <sys/syscall.h>
+# include <linux/futex.h>
+#endif
+
+#include "vlib/shmrbuf.h"
+#include "vlib/util.h"
+#include "vlib/time.h"
+#include "vlib/log.h"
+
+#include "vlib_private.h"
+
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+# define MAP_ANONYMOUS MAP_ANON
+#endif
+
+/*****************************************************************************/
+
+#define SHMRBUF_MAGIC           0x5348524dU     /* 'SHRM' */
+#define SHMRBUF_VERSION         2U
+#define SHMRBUF_CACHELINE       64
+#define SHMRBUF_SKIP            UINT32_MAX      /* slot size of skipped records */
+#define SHMRBUF_INIT_WAIT_MS    2000            /* wait for initialization by creator */
+#define SHMRBUF_RECOVER_WAIT_MS 100             /* wait for producers to store their pid */
+#define SHMRBUF_PID_RECOVERED   (-1)            /* slot pid claimed by shmrbuf_recover() */
+
+/* owner word of a slot: low 32 bits of position << 32 | producer pid */
+#define SHMRBUF_OWNER(pos, pid) (((uint64_t) (uint32_t) (pos) << 32) | (uint32_t) (pid))
+#define SHMRBUF_OWNER_POS(owner, pos) \
+            ((uint32_t) ((owner) >> 32) == (uint32_t) (pos))
+#define SHMRBUF_OWNER_PID(owner) ((int32_t) (uint32_t) (owner))
+
+typedef struct {
+    uint32_t        magic;
+    uint32_t        version;
+    uint32_t        flags;
+    uint32_t        slot_size;
+    uint64_t        slot_count;
+    char            pad0[SHMRBUF_CACHELINE - 3 * sizeof(uint32_t) - sizeof(uint32_t)
+                         - sizeof(uint64_t)];
+    uint64_t        write_pos;
+    char            pad1[SHMRBUF_CACHELINE - sizeof(uint64_t)];
+    uint64_t        read_pos;
+    char            pad2[SHMRBUF_CACHELINE - sizeof(uint64_t)];
+    uint32_t        wake_seq;           /* futex word */
+    uint32_t        waiters;
+    char            pad3[SHMRBUF_CACHELINE - 2 * sizeof(uint32_t)];
+} shmrbuf_header_t;
+
+typedef struct {
+    uint64_t        seq;
+    uint64_t        owner;              /* atomic: SHMRBUF_OWNER(), for recovery */
+    uint32_t        size;
+    char            data[];
+} shmrbuf_slot_t;
+
+struct shmrbuf_s {
+    shmrbuf_header_t *  hdr;
+    char *              slots;
+    size_t              map_size;
+    uint64_t            mask;
+    size_t              slot_size;
+    pid_t               pid;
+    shmrbuf_flags_t     flags;
+};
+
+#define SHMRBUF_SLOT(shm, pos) \
+            ((shmrbuf_slot_t *) ((shm)->slots + ((pos) & (shm)->mask) * (shm)->slot_size))
+
+/*****************************************************************************/
+static void     shmrbuf_futex_wait(
+                    uint32_t *      addr,
+                    uint32_t        val,
+                    int             timeout_ms) {
+#ifdef __linux__
+    struct timespec ts, * pts = NULL;
+
+    if (timeout_ms >= 0) {
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+        pts = &ts;
+    }
+    /* not FUTEX_PRIVATE: the word is shared between processes */
+    syscall(SYS_futex, addr, FUTEX_WAIT, val, pts, NULL, 0);
+#else
+    struct timespec ts = { 0, 1000000L };
+    (void) timeout_ms;
+    while (VLIB_ATOMIC_LOAD(addr) == val) {
+        nanosleep(&ts, NULL);
+        if (timeout_ms >= 0 && timeout_ms-- == 0)
+            break ;
+    }
+#endif
+}
+/*****************************************************************************/
+static void     shmrbuf_futex_wake(
+                    uint32_t *      addr) {
+#ifdef __linux__
+    syscall(SYS_futex, addr, FUTEX_WAKE, INT32_MAX, NULL, NULL, 0);
+#else
+    (void) addr;
+#endif
+}
+/*****************************************************************************/
+static int      shmrbuf_init(
+                    shmrbuf_t *     shm,
+                    size_t          slot_count,
+                    size_t          slot_size,
+                    shmrbuf_flags_t flags) {
+    shmrbuf_header_t *  hdr = shm->hdr;
+    uint64_t            i;
+
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->version = SHMRBUF_VERSION;
+    hdr->flags = flags & SRF_SINGLE_PRODUCER;
+    hdr->slot_size = slot_size;
+    hdr->slot_count = slot_count;
+    shm->slot_size = slot_size;
+    shm->mask = slot_count - 1;
+    for (i = 0; i < slot_count; ++i) {
+        shmrbuf_slot_t * slot = SHMRBUF_SLOT(shm, i);
+        slot->size = 0;
+        slot->owner = SHMRBUF_OWNER(i, 0);
+        VLIB_ATOMIC_STORE(&slot->seq, i);
+    }
+    /* publish the initialized region */
+    VLIB_ATOMIC_STORE(&hdr->magic, SHMRBUF_MAGIC);
+    return 0;
+}
+/*****************************************************************************/
+shmrbuf_t *     shmrbuf_open(
+                    const char *    name,
+                    size_t          slot_count,
+                    size_t          record_maxsize,
+                    shmrbuf_flags_t flags) {
+    shmrbuf_t *     shm;
+    struct stat     st;
+    struct timespec ts = { 0, 1000000L };
+    size_t          slot_size = 0, map_size;
+    int             fd = -1, created = 0, i;
+
+    if (name == NULL && (flags & SRF_CREATE) == 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if ((flags & SRF_CREATE) != 0) {
+        if (slot_count == 0 || record_maxsize == 0
+        ||  record_maxsize > UINT32_MAX - 1 - sizeof(shmrbuf_slot_t)) {
+            errno = EINVAL;
+            return NULL;
+        }
+        if ((slot_count & (slot_count - 1)) != 0) {
+            size_t pow2 = 1;
+            while (pow2 < slot_count)
+                pow2 <<= 1;
+            slot_count = pow2;
+        }
+        slot_size = (sizeof(shmrbuf_slot_t) + record_maxsize + sizeof(uint64_t) - 1)
+                    & ~(sizeof(uint64_t) - 1);
+        if (name == NULL) {
+            created = 1; /* private buffer, no shm object */
+        } else if ((fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600)) >= 0) {
+            created = 1;
+        } else if (errno != EEXIST) {
+            return NULL;
+        }
+    }
+    if (!created && fd < 0 && (fd = shm_open(name, O_RDWR, 0)) < 0) {
+        return NULL;
+    }
+    if (created) {
+        map_size = sizeof(shmrbuf_header_t) + slot_count * slot_size;
+        if (fd >= 0 && ftruncate(fd, map_size) != 0) {
+            close(fd);
+            shm_unlink(name);
+            return NULL;
+        }
+    } else {
+        /* wait for the creator to set the size of the region */
+        for (i = 0; ; ++i) {
+            if (fstat(fd, &st) != 0) {
+                close(fd);
+                return NULL;
+            }
+            if ((size_t) st.st_size >= sizeof(shmrbuf_header_t))
+                break ;
+            if (i >= SHMRBUF_INIT_WAIT_MS) {
+                close(fd);
+                errno = ETIMEDOUT;
+                return NULL;
+            }
+            nanosleep(&ts, NULL);
+        }
+        map_size = st.st_size;
+    }
+
+    if ((shm = malloc(sizeof(*shm))) == NULL) {
+        if (fd >= 0)
+            close(fd);
+        if (created && name != NULL)
+            shm_unlink(name);
+        errno = ENOMEM;
+        return NULL;
+    }
+    if (fd < 0) {
+        shm->hdr = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    } else {
+        shm->hdr = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+    }
+    if (shm->hdr == MAP_FAILED) {
+        int errsv = errno;
+        free(shm);
+        /* the shm object created here would never be initialized */
+        if (created && name != NULL)
+            shm_unlink(name);
+        errno = errsv;
+        return NULL;
+    }
+    shm->map_size = map_size;
+    shm->slots = (char *) shm->hdr + sizeof(shmrbuf_header_t);
+    shm->pid = getpid();
+
+    if (created) {
+        shmrbuf_init(shm, slot_count, slot_size, flags);
+    } else {
+        for (i = 0; VLIB_ATOMIC_LOAD(&shm->hdr->magic) != SHMRBUF_MAGIC; ++i) {
+            if (i >= SHMRBUF_INIT_WAIT_MS) {
+                shmrbuf_close(shm);
+                errno = ETIMEDOUT;
+                return NULL;
+            }
+            nanosleep(&ts, NULL);
+        }
+        if (shm->hdr->version != SHMRBUF_VERSION
+        ||  shm->hdr->slot_count == 0
+        ||  (shm->hdr->slot_count & (shm->hdr->slot_count - 1)) != 0
+        ||  sizeof(shmrbuf_header_t) + shm->hdr->slot_count * shm->hdr->slot_size > map_size) {
+            shmrbuf_close(shm);
+            errno = EPROTO;
+            return NULL;
+        }
+        shm->slot_size = shm->hdr->slot_size;
+        shm->mask = shm->hdr->slot_count - 1;
+    }
+    shm->flags = (flags & ~SRF_SINGLE_PRODUCER) | (shm->hdr->flags & SRF_SINGLE_PRODUCER);
+
+    LOG_DEBUG(g_vlib_log, "shmrbuf '%s' %s: %lu slots of %zu bytes",
+              name != NULL ? name : "(private)", created ? "created" : "opened",
+              (unsigned long) shm->hdr->slot_count, shm->slot_size);
+
+    if ((flags & SRF_CONSUMER) != 0) {
+        shmrbuf_recover(shm, 0);
+    }
+    return shm;
+}
+/*****************************************************************************/
+int             shmrbuf_close(
+                    shmrbuf_t *     shm) {
+    int ret;
+
+    if (shm == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    ret = munmap(shm->hdr, shm->map_size);
+    free(shm);
+    return ret;
+}
+/*****************************************************************************/
+int             shmrbuf_unlink(
+                    const char *    name) {
+    if (name == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    return shm_unlink(name);
+}
+/*****************************************************************************/
+int             shmrbuf_write(
+                    shmrbuf_t *     shm,
+                    const void *    data,
+                    size_t          size) {
+    shmrbuf_header_t *  hdr;
+    shmrbuf_slot_t *    slot;
+    uint64_t            pos, seq, owner;
+
+    if (shm == NULL || (data == NULL && size > 0)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (size > shm->slot_size - sizeof(shmrbuf_slot_t)) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    hdr = shm->hdr;
+    pos = VLIB_ATOMIC_LOAD(&hdr->write_pos);
+    while (1) {
+        slot = SHMRBUF_SLOT(shm, pos);
+        seq = VLIB_ATOMIC_LOAD(&slot->seq);
+        if (seq == pos) {
+            /* slot is free for pos, reserve it */
+            if ((shm->flags & SRF_SINGLE_PRODUCER) != 0) {
+                VLIB_ATOMIC_STORE(&hdr->write_pos, pos + 1);
+                break ;
+            }
+            if (VLIB_ATOMIC_CAS(&hdr->write_pos, &pos, pos + 1)) {
+                break ;
+            }
+        } else if ((int64_t) (seq - pos) < 0) {
+            /* slot not released by consumer: buffer is full */
+            errno = EAGAIN;
+            return -1;
+        } else {
+            pos = VLIB_ATOMIC_LOAD(&hdr->write_pos);
+        }
+    }
+    /* the slot is claimed by shmrbuf_recover() if this producer was stalled
+     * long enough to be taken for dead, and can even have been released and
+     * reserved again for pos + slot_count: the record is dropped */
+    owner = SHMRBUF_OWNER(pos, 0);
+    if (!VLIB_ATOMIC_CAS(&slot->owner, &owner, SHMRBUF_OWNER(pos, shm->pid))) {
+        errno = ECANCELED;
+        return -1;
+    }
+    memcpy(slot->data, data, size);
+    slot->size = size;
+    seq = pos;
+    if (!VLIB_ATOMIC_CAS(&slot->seq, &seq, pos + 1)) {
+        errno = ECANCELED;
+        return -1;
+    }
+
+    /* wake up the consumer */
+    VLIB_ATOMIC_ADD(&hdr->wake_seq, 1);
+    if (VLIB_ATOMIC_LOAD(&hdr->waiters) != 0) {
+        shmrbuf_futex_wake(&hdr->wake_seq);
+    }
+    return 0;
+}
+/*****************************************************************************/
+static ssize_t  shmrbuf_tryread(
+                    shmrbuf_t *     shm,
+                    void *          buf,
+                    size_t          size) {
+    shmrbuf_slot_t *    slot;
+    uint64_t            pos;
+    uint32_t            rec_size;
+
+    while (1) {
+        pos = VLIB_ATOMIC_LOAD(&shm->hdr->read_pos);
+        slot = SHMRBUF_SLOT(shm, pos);
+        if (VLIB_ATOMIC_LOAD(&slot->seq) != pos + 1) {
+            errno = EAGAIN;
+            return -1;
+        }
+        rec_size = slot->size;
+        if (rec_size != SHMRBUF_SKIP) {
+            if (rec_size > size) {
+                errno = EMSGSIZE;
+                return -1;
+            }
+            memcpy(buf, slot->data, rec_size);
+        }
+        /* shmrbuf_recover() handles a crash between these two stores */
+        VLIB_ATOMIC_STORE(&slot->owner, SHMRBUF_OWNER(pos + shm->mask + 1, 0));
+        VLIB_ATOMIC_STORE(&shm->hdr->read_pos, pos + 1);
+        VLIB_ATOMIC_STORE(&slot->seq, pos + shm->mask + 1);
+        if (rec_size != SHMRBUF_SKIP) {
+            return rec_size;
+        }
+    }
+}
+/*****************************************************************************/
+ssize_t         shmrbuf_read(
+                    shmrbuf_t *     shm,
+                    void *          buf,
+                    size_t          size,
+                    int             timeout_ms) {
+    shmrbuf_header_t *  hdr;
+    struct timespec     t0, t1;
+    ssize_t             ret;
+    uint32_t            wake_seq;
+    int                 remaining = timeout_ms;
+
+    if (shm == NULL || (buf == NULL && size > 0)) {
+        errno = EINVAL;
+        return -1;
+    }
+    hdr = shm->hdr;
+    if (timeout_ms > 0) {
+        vclock_gettime(CLOCK_MONOTONIC, &t0);
+    }
+    while (1) {
+        wake_seq = VLIB_ATOMIC_LOAD(&hdr->wake_seq);
+        if ((ret = shmrbuf_tryread(shm, buf, size)) >= 0 || errno != EAGAIN
+        ||  remaining == 0) {
+            return ret;
+        }
+        /* register as waiter, then check again before sleeping,
+         * so that a write done in between is not missed */
+        VLIB_ATOMIC_ADD(&hdr->waiters, 1);
+        if ((ret = shmrbuf_tryread(shm, buf, size)) >= 0 || errno != EAGAIN) {
+            VLIB_ATOMIC_SUB(&hdr->waiters, 1);
+            return ret;
+        }
+        shmrbuf_futex_wait(&hdr->wake_seq, wake_seq, remaining);
+        VLIB_ATOMIC_SUB(&hdr->waiters, 1);
+
+        if (timeout_ms > 0) {
+            long elapsed;
+            vclock_gettime(CLOCK_MONOTONIC, &t1);
+            vtimespecsub(&t1, &t0, &t1);
+            elapsed = t1.tv_sec * 1000 + t1.tv_nsec / 1000000;
+            remaining = elapsed >= timeout_ms ? 0 : timeout_ms - elapsed;
+        }
+    }
+}
+/*****************************************************************************/
+size_t          shmrbuf_size(
+                    const shmrbuf_t * shm) {
+    uint64_t wpos, rpos;
+
+    if (shm == NULL) {
+        errno = EINVAL;
+        return 0;
+    }
+    rpos = VLIB_ATOMIC_LOAD(&shm->hdr->read_pos);
+    wpos = VLIB_ATOMIC_LOAD(&shm->hdr->write_pos);
+    if (wpos <= rpos) {
+        errno = 0;
+        return 0;
+    }
+    return wpos - rpos;
+}
+/*****************************************************************************/
+size_t          shmrbuf_record_maxsize(
+                    const shmrbuf_t * shm) {
+    if (shm == NULL) {
+        errno = EINVAL;
+        return 0;
+    }
+    return shm->slot_size - sizeof(shmrbuf_slot_t);
+}
+/*****************************************************************************/
+int             shmrbuf_recover(
+                    shmrbuf_t *     shm,
+                    int             force) {
+    shmrbuf_header_t *  hdr;
+    shmrbuf_slot_t *    slot;
+    uint64_t            pos, rpos, wpos;
+    int                 nrecovered = 0, waited = 0;
+
+    if (shm == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    hdr = shm->hdr;
+    rpos = VLIB_ATOMIC_LOAD(&hdr->read_pos);
+    wpos = VLIB_ATOMIC_LOAD(&hdr->write_pos);
+
+    /* consumer crashed after updating read_pos, but before releasing the slot */
+    if (rpos > 0) {
+        slot = SHMRBUF_SLOT(shm, rpos - 1);
+        if (VLIB_ATOMIC_LOAD(&slot->seq) == rpos) {
+            LOG_WARN(g_vlib_log, "shmrbuf: releasing slot %lu after consumer crash",
+                     (unsigned long) (rpos - 1));
+            VLIB_ATOMIC_STORE(&slot->seq, rpos - 1 + shm->mask + 1);
+            ++nrecovered;
+        }
+    }
+
+    /* producers which crashed between slot reservation and completion */
+    for (pos = rpos; pos < wpos; ++pos) {
+        int32_t     pid;
+        uint64_t    seq = pos, owner;
+
+        slot = SHMRBUF_SLOT(shm, pos);
+        if (VLIB_ATOMIC_LOAD(&slot->seq) != pos) {
+            continue ;
+        }
+        /* the pid is stored just after the reservation: slots below wpos were
+         * reserved before the wait, still no pid then means the producer died */
+        if (!force && !waited && VLIB_ATOMIC_LOAD(&slot->owner) == SHMRBUF_OWNER(pos, 0)) {
+            struct timespec ts = { SHMRBUF_RECOVER_WAIT_MS / 1000,
+                                   (SHMRBUF_RECOVER_WAIT_MS % 1000) * 1000000L };
+            nanosleep(&ts, NULL);
+            waited = 1;
+            if (VLIB_ATOMIC_LOAD(&slot->seq) != pos) {
+                continue ;
+            }
+        }
+        owner = VLIB_ATOMIC_LOAD(&slot->owner);
+        if (!SHMRBUF_OWNER_POS(owner, pos)) {
+            continue ;
+        }
+        pid = SHMRBUF_OWNER_PID(owner);
+        if (pid == SHMRBUF_PID_RECOVERED
+        ||  !(force || pid == 0 || (kill(pid, 0) != 0 && errno == ESRCH))) {
+            continue ;
+        }
+        /* claimed with a CAS, as a stalled producer can resume meanwhile:
+         * it drops its record if its claim or its publication fails */
+        if (!VLIB_ATOMIC_CAS(&slot->owner, &owner, SHMRBUF_OWNER(pos, SHMRBUF_PID_RECOVERED))) {
+            continue ;
+        }
+        slot->size = SHMRBUF_SKIP;
+        if (VLIB_ATOMIC_CAS(&slot->seq, &seq, pos + 1)) {
+            LOG_WARN(g_vlib_log, "shmrbuf: skipping record %lu of dead producer %ld",
+                     (unsigned long) pos, (long) pid);
+            ++nrecovered;
+        }
+    }
+    return nrecovered;
+}
+/*****************************************************************************/
+
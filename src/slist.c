@@ -22,13 +22,192 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
 
 #include "vlib/slist.h"
+#include "vlib/util.h"
+
+/*****************************************************************************/
+/* Node pool: nodes of sizeof(slist_t) are recycled in a per-thread cache,
+ * exchanged by batches with a global depot. Cached nodes are plain malloc()
+ * blocks, so that callers freeing nodes with free() remain valid.
+ * A node allocated here is followed by a tag, valid only for nodes of pool size:
+ * nodes of other sizes (slist_*_sized()) are freed with free() by slist_free_1(). */
+
+#define SLIST_POOL_BATCH        64                      /* nodes per depot batch */
+#define SLIST_POOL_CACHE_MAX    (4 * SLIST_POOL_BATCH)  /* max nodes in a thread cache */
+#define SLIST_POOL_DEPOT_MAX    64                      /* max batches in depot */
+
+#define SLIST_POOL_MAGIC        ((uintptr_t) 0x5a5e1157c0ffee11ULL)
+#define SLIST_POOL_TAG(node)    ((uintptr_t) (node) ^ SLIST_POOL_MAGIC)
+
+typedef struct {
+    slist_t             node;
+    uintptr_t           tag;    /* SLIST_POOL_TAG(&node) if node has pool size */
+} slist_pool_node_t;
+
+typedef struct {
+    slist_t *           head;
+    unsigned int        count;
+} slist_cache_t;
+
+static pthread_once_t   s_slist_pool_once   = PTHREAD_ONCE_INIT;
+static pthread_key_t    s_slist_pool_key;
+static int              s_slist_pool_ok     = 0;
+static pthread_mutex_t  s_slist_depot_mutex = PTHREAD_MUTEX_INITIALIZER;
+/* batches are chained with the data field of their first node */
+static slist_t *        s_slist_depot       = NULL;
+static unsigned int     s_slist_depot_count = 0;
+
+static void slist_pool_release(slist_t * list) {
+    slist_t * tofree;
+    while (list) {
+        tofree = list;
+        list = list->next;
+        free(tofree);
+    }
+}
+
+/* move SLIST_POOL_BATCH nodes (or all if less) of cache to the depot */
+static void slist_pool_put_batch(slist_cache_t * cache) {
+    slist_t *       batch = cache->head, * last = batch;
+    unsigned int    n;
+
+    for (n = 1; n < SLIST_POOL_BATCH && last->next != NULL; ++n) {
+        last = last->next;
+    }
+    cache->head = last->next;
+    cache->count -= n;
+    last->next = NULL;
+
+    pthread_mutex_lock(&s_slist_depot_mutex);
+    if (s_slist_depot_count < SLIST_POOL_DEPOT_MAX) {
+        batch->data = s_slist_depot;
+        s_slist_depot = batch;
+        ++s_slist_depot_count;
+        batch = NULL;
+    }
+    pthread_mutex_unlock(&s_slist_depot_mutex);
+
+    slist_pool_release(batch);
+}
+
+static void slist_pool_cache_destroy(void * vcache) {
+    slist_cache_t * cache = (slist_cache_t *) vcache;
+
+    while (cache->head != NULL) {
+        slist_pool_put_batch(cache);
+    }
+    free(cache);
+}
+
+static void slist_pool_init() {
+    s_slist_pool_ok = (pthread_key_create(&s_slist_pool_key, slist_pool_cache_destroy) == 0);
+}
+
+static inline slist_cache_t * slist_pool_cache() {
+    slist_cache_t * cache;
+
+    pthread_once(&s_slist_pool_once, slist_pool_init);
+    if (!s_slist_pool_ok) {
+        return NULL;
+    }
+    if ((cache = pthread_getspecific(s_slist_pool_key)) == NULL) {
+        if ((cache = calloc(1, sizeof(*cache))) == NULL) {
+            return NULL;
+        }
+        if (pthread_setspecific(s_slist_pool_key, cache) != 0) {
+            free(cache);
+            return NULL;
+        }
+    }
+    return cache;
+}
+
+/* allocate a node, with a readable tag if size is not larger than a pool node */
+static slist_t * slist_node_new(size_t size) {
+    slist_pool_node_t * pnode;
+
+    if (size >= sizeof(slist_pool_node_t)) {
+        return malloc(size);
+    }
+    if ((pnode = malloc(sizeof(*pnode))) == NULL) {
+        return NULL;
+    }
+    pnode->tag = size == sizeof(slist_t) ? SLIST_POOL_TAG(pnode) : 0;
+    return &(pnode->node);
+}
 
 static slist_t * slist_alloc(size_t size) {
-    return malloc(size);
+    slist_cache_t * cache;
+    slist_t *       node;
+
+    if (size != sizeof(slist_t) || (cache = slist_pool_cache()) == NULL) {
+        return slist_node_new(size);
+    }
+    if (cache->head == NULL) {
+        /* refill thread cache with a batch of the depot */
+        pthread_mutex_lock(&s_slist_depot_mutex);
+        if ((node = s_slist_depot) != NULL) {
+            s_slist_depot = node->data;
+            --s_slist_depot_count;
+        }
+        pthread_mutex_unlock(&s_slist_depot_mutex);
+        if (node == NULL) {
+            return slist_node_new(size);
+        }
+        cache->head = node;
+        for (cache->count = 0; node != NULL; node = node->next) {
+            ++cache->count;
+        }
+    }
+    node = cache->head;
+    cache->head = node->next;
+    --cache->count;
+    return node;
 }
 
+static void slist_node_free(slist_t * node) {
+    slist_cache_t * cache;
+
+    if (((slist_pool_node_t *) node)->tag != SLIST_POOL_TAG(node)
+    ||  (cache = slist_pool_cache()) == NULL) {
+        free(node);
+        return ;
+    }
+    if (cache->count >= SLIST_POOL_CACHE_MAX) {
+        slist_pool_put_batch(cache);
+    }
+    node->next = cache->head;
+    cache->head = node;
+    ++cache->count;
+}
+
+void slist_pool_flush() {
+    slist_cache_t * cache;
+    slist_t *       batch;
+
+    pthread_once(&s_slist_pool_once, slist_pool_init);
+    if (s_slist_pool_ok && (cache = pthread_getspecific(s_slist_pool_key)) != NULL) {
+        slist_pool_release(cache->head);
+        cache->head = NULL;
+        cache->count = 0;
+    }
+    pthread_mutex_lock(&s_slist_depot_mutex);
+    batch = s_slist_depot;
+    s_slist_depot = NULL;
+    s_slist_depot_count = 0;
+    pthread_mutex_unlock(&s_slist_depot_mutex);
+
+    while (batch != NULL) {
+        slist_t * next = batch->data;
+        slist_pool_release(batch);
+        batch = next;
+    }
+}
+
+/*****************************************************************************/
+
 slist_t * slist_prepend(slist_t * list, void * data) {
     slist_t * new = slist_alloc(sizeof(slist_t));
     if (new) {
@@ -285,7 +464,7 @@ void slist_free_1(slist_t * list, slist_free_fun_t freefun) {
         if (freefun) {
             freefun(list->data);
         }
-        free(list);
+        slist_node_free(list);
     }
 }
 
@@ -315,3 +494,435 @@ void slist_free_sized(slist_t * list, slist_free_fun_t freefun) {
     slist_free_internal(list, freefun, slist_free_1_sized);
 }
 
+
+/*****************************************************************************/
+shlist_t * shlist_init(shlist_t * hlist, slist_t * list) {
+    if (hlist == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+    hlist->head = hlist->tail = list;
+    hlist->count = 0;
+    if (list != NULL) {
+        for (hlist->count = 1; hlist->tail->next != NULL; hlist->tail = hlist->tail->next) {
+            ++hlist->count;
+        }
+    }
+    return hlist;
+}
+
+static inline int shlist_prepend_node(shlist_t * hlist, slist_t * new) {
+    if (new == NULL) {
+        return -1;
+    }
+    new->next = hlist->head;
+    hlist->head = new;
+    if (hlist->tail == NULL) {
+        hlist->tail = new;
+    }
+    ++hlist->count;
+    return 0;
+}
+
+static inline int shlist_append_node(shlist_t * hlist, slist_t * new) {
+    if (new == NULL) {
+        return -1;
+    }
+    new->next = NULL;
+    if (hlist->tail == NULL) {
+        hlist->head = new;
+    } else {
+        hlist->tail->next = new;
+    }
+    hlist->tail = new;
+    ++hlist->count;
+    return 0;
+}
+
+int shlist_prepend(shlist_t * hlist, void * data) {
+    slist_t * new;
+
+    if (hlist == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    if ((new = slist_alloc(sizeof(slist_t))) != NULL) {
+        new->data = data;
+    }
+    return shlist_prepend_node(hlist, new);
+}
+
+int shlist_append(shlist_t * hlist, void * data) {
+    slist_t * new;
+
+    if (hlist == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    if ((new = slist_alloc(sizeof(slist_t))) != NULL) {
+        new->data = data;
+    }
+    return shlist_append_node(hlist, new);
+}
+
+int shlist_prepend_sized(shlist_t * hlist, const void * data, size_t data_sz) {
+    if (hlist == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    return shlist_prepend_node(hlist, slist_prepend_sized(NULL, data, data_sz));
+}
+
+int shlist_append_sized(shlist_t * hlist, const void * data, size_t data_sz) {
+    if (hlist == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    return shlist_append_node(hlist, slist_prepend_sized(NULL, data, data_sz));
+}
+
+void * shlist_pop(shlist_t * hlist) {
+    slist_t *   elt;
+    void *      data;
+
+    if (hlist == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if ((elt = hlist->head) == NULL) {
+        errno = ENOENT;
+        return NULL;
+    }
+    if ((hlist->head = elt->next) == NULL) {
+        hlist->tail = NULL;
+    }
+    --hlist->count;
+    if ((data = elt->data) == NULL) {
+        errno = 0;
+    }
+    slist_free_1(elt, NULL);
+    return data;
+}
+
+shlist_t * shlist_concat(shlist_t * hlist1, shlist_t * hlist2) {
+    if (hlist1 == NULL || hlist2 == NULL) {
+        errno = EINVAL;
+        return hlist1;
+    }
+    if (hlist2->head != NULL) {
+        if (hlist1->tail == NULL) {
+            hlist1->head = hlist2->head;
+        } else {
+            hlist1->tail->next = hlist2->head;
+        }
+        hlist1->tail = hlist2->tail;
+        hlist1->count += hlist2->count;
+    }
+    hlist2->head = hlist2->tail = NULL;
+    hlist2->count = 0;
+    return hlist1;
+}
+
+size_t shlist_length(const shlist_t * hlist) {
+    if (hlist == NULL) {
+        errno = EINVAL;
+        return 0;
+    }
+    return hlist->count;
+}
+
+void shlist_free(shlist_t * hlist, slist_free_fun_t freefun) {
+    if (hlist != NULL) {
+        slist_free(hlist->head, freefun);
+        hlist->head = hlist->tail = NULL;
+        hlist->count = 0;
+    }
+}
+
+void shlist_free_sized(shlist_t * hlist, slist_free_fun_t freefun) {
+    if (hlist != NULL) {
+        slist_free_sized(hlist->head, freefun);
+        hlist->head = hlist->tail = NULL;
+        hlist->count = 0;
+    }
+}
+
+/*****************************************************************************/
+#define SLIST_CMPDATA(_elt, _sized)  ((_sized) ? (void *) &((_elt)->data) : (_elt)->data)
+
+static inline slist_t * slist_merge_internal(slist_t * list1, slist_t * list2,
+                                             slist_cmp_fun_t cmpfun, int sized) {
+    slist_t     head = { .next = NULL, .data = NULL };
+    slist_t *   tail = &head;
+
+    while (list1 && list2) {
+        /* take list1 element on equality to keep the sort stable */
+        if (cmpfun(SLIST_CMPDATA(list1, sized), SLIST_CMPDATA(list2, sized)) <= 0) {
+            tail->next = list1;
+            list1 = list1->next;
+        } else {
+            tail->next = list2;
+            list2 = list2->next;
+        }
+        tail = tail->next;
+    }
+    tail->next = list1 ? list1 : list2;
+    return head.next;
+}
+
+/* bottom-up merge sort: merge runs of size 1, 2, 4, ... without recursion
+ * nor allocation, O(n log n) comparisons. */
+static slist_t * slist_sort_internal(slist_t * list, slist_cmp_fun_t cmpfun, int sized) {
+    slist_t *       p, * q, * e, * tail;
+    unsigned long   insize, nmerges, psize, qsize, i;
+
+    if (!list || !cmpfun) {
+        return list;
+    }
+    for (insize = 1; ; insize *= 2) {
+        p = list;
+        list = tail = NULL;
+        nmerges = 0;
+
+        while (p) {
+            ++nmerges;
+            /* step insize places along from p to get q */
+            for (q = p, psize = 0, i = 0; i < insize && q; ++i) {
+                ++psize;
+                q = q->next;
+            }
+            qsize = insize;
+
+            /* merge the p and q runs */
+            while (psize > 0 || (qsize > 0 && q)) {
+                if (psize == 0) {
+                    e = q; q = q->next; --qsize;
+                } else if (qsize == 0 || !q
+                       || cmpfun(SLIST_CMPDATA(p, sized), SLIST_CMPDATA(q, sized)) <= 0) {
+                    e = p; p = p->next; --psize;
+                } else {
+                    e = q; q = q->next; --qsize;
+                }
+                if (tail) {
+                    tail->next = e;
+                } else {
+                    list = e;
+                }
+                tail = e;
+            }
+            p = q;
+        }
+        tail->next = NULL;
+
+        if (nmerges <= 1) {
+            return list;
+        }
+    }
+}
+
+static slist_t * slist_unique_internal(slist_t * list, slist_cmp_fun_t cmpfun,
+                                       slist_free_fun_t freefun, int sized) {
+    slist_t * elt, * tofree;
+
+    if (!list || !cmpfun) {
+        return list;
+    }
+    for (elt = list; elt->next; ) {
+        if (cmpfun(SLIST_CMPDATA(elt, sized), SLIST_CMPDATA(elt->next, sized)) == 0) {
+            tofree = elt->next;
+            elt->next = tofree->next;
+            if (sized) {
+                slist_free_1_sized(tofree, freefun);
+            } else {
+                slist_free_1(tofree, freefun);
+            }
+        } else {
+            elt = elt->next;
+        }
+    }
+    return list;
+}
+
+slist_t * slist_sort(slist_t * list, slist_cmp_fun_t cmpfun) {
+    return slist_sort_internal(list, cmpfun, 0);
+}
+
+slist_t * slist_sort_sized(slist_t * list, slist_cmp_fun_t cmpfun) {
+    return slist_sort_internal(list, cmpfun, 1);
+}
+
+slist_t * slist_merge_sorted(slist_t * list1, slist_t * list2, slist_cmp_fun_t cmpfun) {
+    if (!cmpfun) {
+        return slist_concat(list1, list2);
+    }
+    return slist_merge_internal(list1, list2, cmpfun, 0);
+}
+
+slist_t * slist_merge_sorted_sized(slist_t * list1, slist_t * list2, slist_cmp_fun_t cmpfun) {
+    if (!cmpfun) {
+        return slist_concat(list1, list2);
+    }
+    return slist_merge_internal(list1, list2, cmpfun, 1);
+}
+
+slist_t * slist_unique(slist_t * list, slist_cmp_fun_t cmpfun, slist_free_fun_t freefun) {
+    return slist_unique_internal(list, cmpfun, freefun, 0);
+}
+
+slist_t * slist_unique_sized(slist_t * list, slist_cmp_fun_t cmpfun, slist_free_fun_t freefun) {
+    return slist_unique_internal(list, cmpfun, freefun, 1);
+}
+
+/*****************************************************************************/
+/* Treiber stack. The {head,tag} pair is swapped with a double-word CAS when
+ * available, the tag being incremented on each update so that a pop cannot
+ * succeed if head was popped and pushed again meanwhile (ABA). */
+#if UINTPTR_MAX == UINT64_MAX && defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_16)
+# define SLIST_ATOMIC_DCAS 1
+__extension__ typedef unsigned __int128 slist_dword_t;
+#elif UINTPTR_MAX == UINT32_MAX && defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_8)
+# define SLIST_ATOMIC_DCAS 1
+typedef uint64_t slist_dword_t;
+#else
+# define SLIST_ATOMIC_DCAS 0
+#endif
+
+#if SLIST_ATOMIC_DCAS
+typedef union {
+    slist_atomic_t  s;
+    slist_dword_t   d;
+} slist_atomic_u;
+
+/* update stack to {head,tag+1} if it is still equal to *old, otherwise set *old */
+static inline int slist_atomic_cas(slist_atomic_t * stack, slist_atomic_t * old, slist_t * head) {
+    slist_atomic_u  expected, desired, prev;
+
+    expected.s = *old;
+    desired.s.head = head;
+    desired.s.tag = old->tag + 1;
+    prev.d = __sync_val_compare_and_swap((slist_dword_t *) stack, expected.d, desired.d);
+    if (prev.d == expected.d) {
+        return 1;
+    }
+    *old = prev.s;
+    return 0;
+}
+
+static inline void slist_atomic_read(slist_atomic_t * stack, slist_atomic_t * old) {
+    /* the pair might be inconsistent, it is then fixed by the first CAS */
+    old->tag = VLIB_ATOMIC_LOAD(&stack->tag);
+    old->head = VLIB_ATOMIC_LOAD(&stack->head);
+}
+#else
+/* no double-word CAS: the lowest bit of tag is a spinlock */
+static inline void slist_atomic_lock(slist_atomic_t * stack) {
+    uintptr_t tag;
+    while (1) {
+        tag = VLIB_ATOMIC_LOAD(&stack->tag) & ~((uintptr_t) 1);
+        if (VLIB_ATOMIC_CAS(&stack->tag, &tag, tag | 1)) {
+            break ;
+        }
+    }
+}
+
+static inline void slist_atomic_unlock(slist_atomic_t * stack) {
+    VLIB_ATOMIC_STORE(&stack->tag, (VLIB_ATOMIC_LOAD_RELAXED(&stack->tag) + 2) & ~((uintptr_t) 1));
+}
+#endif
+
+void slist_atomic_init(slist_atomic_t * stack) {
+    if (stack) {
+        stack->head = NULL;
+        stack->tag = 0;
+    }
+}
+
+void slist_atomic_push_list(slist_atomic_t * stack, slist_t * head, slist_t * tail) {
+#if SLIST_ATOMIC_DCAS
+    slist_atomic_t old;
+
+    if (!stack || !head || !tail) {
+        return ;
+    }
+    slist_atomic_read(stack, &old);
+    do {
+        tail->next = old.head;
+    } while (!slist_atomic_cas(stack, &old, head));
+#else
+    if (!stack || !head || !tail) {
+        return ;
+    }
+    slist_atomic_lock(stack);
+    tail->next = stack->head;
+    stack->head = head;
+    slist_atomic_unlock(stack);
+#endif
+}
+
+void slist_atomic_push(slist_atomic_t * stack, slist_t * elt) {
+    slist_atomic_push_list(stack, elt, elt);
+}
+
+slist_t * slist_atomic_pop(slist_atomic_t * stack) {
+#if SLIST_ATOMIC_DCAS
+    slist_atomic_t old;
+
+    if (!stack) {
+        return NULL;
+    }
+    slist_atomic_read(stack, &old);
+    do {
+        if (old.head == NULL) {
+            return NULL;
+        }
+    } while (!slist_atomic_cas(stack, &old, VLIB_ATOMIC_LOAD(&old.head->next)));
+    old.head->next = NULL;
+    return old.head;
+#else
+    slist_t * elt;
+
+    if (!stack) {
+        return NULL;
+    }
+    slist_atomic_lock(stack);
+    if ((elt = stack->head) != NULL) {
+        stack->head = elt->next;
+        elt->next = NULL;
+    }
+    slist_atomic_unlock(stack);
+    return elt;
+#endif
+}
+
+slist_t * slist_atomic_pop_all(slist_atomic_t * stack) {
+#if SLIST_ATOMIC_DCAS
+    slist_atomic_t old;
+
+    if (!stack) {
+        return NULL;
+    }
+    slist_atomic_read(stack, &old);
+    do {
+        if (old.head == NULL) {
+            return NULL;
+        }
+    } while (!slist_atomic_cas(stack, &old, NULL));
+    return old.head;
+#else
+    slist_t * list;
+
+    if (!stack) {
+        return NULL;
+    }
+    slist_atomic_lock(stack);
+    list = stack->head;
+    stack->head = NULL;
+    slist_atomic_unlock(stack);
+    return list;
+#endif
+}
+
+int slist_atomic_lockfree() {
+    return SLIST_ATOMIC_DCAS;
+}
+
@@ -185,6 +185,9 @@ static struct {
 #  endif
 };
 
+/* changed when the terminal is initialized or freed, for the users caching colors */
+static unsigned int s_vterm_gen = 0;
+
 /* Default colors strings corresponding to vterm_color_t
  * !!! must be in same order as enum vterm_color_t */
 enum {
@@ -341,6 +344,11 @@ int vterm_enable(int enable) {
     return VTERM_OK;
 }
 
+/* ************************************************************************* */
+unsigned int vterm_generation() {
+    return VLIB_ATOMIC_LOAD_RELAXED(&s_vterm_gen);
+}
+
 /* ************************************************************************* */
 int vterm_has_colors(int fd) {
     if (vterm_init(fd, s_vterm_info.flags) != VTERM_OK) {
@@ -983,6 +991,7 @@ int vterm_init(int fd, unsigned int flags) {
     vterm_init_default_caps(1);
 
     s_vterm_info.flags = flags;
+    VLIB_ATOMIC_ADD(&s_vterm_gen, 1);
     s_vterm_info.fd = fd; /* must be last */
 
     LOG_VERBOSE(g_vlib_log, "vterm: initialized (fd:%d flags:%u has_colors:%d)",
@@ -1005,6 +1014,7 @@ int vterm_free() {
     vterm_free_caps();
 
     LOG_VERBOSE(g_vlib_log, "%s(): done.", __func__);
+    VLIB_ATOMIC_ADD(&s_vterm_gen, 1);
     s_vterm_info.fd = VTERM_FD_FREE; /*must be last or LOG_* or other calls could redo vterm_init*/
 
     return VTERM_OK;
@@ -1230,6 +1240,7 @@ int vterm_free() {
     }
 
     LOG_VERBOSE(g_vlib_log, "%s(): done.", __func__);
+    VLIB_ATOMIC_ADD(&s_vterm_gen, 1);
     s_vterm_info.fd = VTERM_FD_FREE;/* must be last or vterm could be reinit by log */
 
     return VTERM_OK;
@@ -1348,6 +1359,7 @@ int vterm_init(int fd, unsigned int flags) {
 
     s_vterm_info.ti_col = ti_col != NULL ? strdup(ti_col) : NULL;
     s_vterm_info.flags = flags;
+    VLIB_ATOMIC_ADD(&s_vterm_gen, 1);
     s_vterm_info.fd = fd; /* last thing to be done here, but LOG_* can be done after this */
 
     #if CONFIG_CURSES_SCR
@@ -1890,6 +1902,7 @@ int vterm_free() {
         delterm(*curterm);
     }
     dlclose(s_vterm_info.lib);
+    VLIB_ATOMIC_ADD(&s_vterm_gen, 1);
     s_vterm_info.fd = VTERM_FD_FREE;
     s_vterm_info.lib = NULL;
     return VTERM_OK;
@@ -1959,6 +1972,7 @@ int vterm_init(int fd, unsigned int flags) {
     s_vterm_info.flags = flags;
     s_vterm_info.ti_col = ti_col;
     s_vterm_info.tigetnum = getnum;
+    VLIB_ATOMIC_ADD(&s_vterm_gen, 1);
     s_vterm_info.fd = fd;
     s_vterm_info.lib = lib; /* last thing to be done here */
 
@@ -31,18 +31,50 @@
 #include <errno.h>
 #include <stdint.h>
 #include <limits.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 
 #include "vlib/thread.h"
-#include "vlib/slist.h"
 #include "vlib/log.h"
 #include "vlib/util.h"
 #include "vlib/job.h"
+#include "vlib/time.h"
 
 #include "vlib_private.h"
 
 /*****************************************************************************/
 #define VLIB_THREAD_PSELECT
 
+#if defined(__linux__) && !defined(VLIB_THREAD_NO_EPOLL)
+# define VLIB_THREAD_EPOLL
+# include <sys/epoll.h>
+# define VTHREAD_EPOLL_EVENTS   256     /* max ready fds per epoll_wait() */
+#endif
+
+#if defined(__linux__) && !defined(VLIB_THREAD_NO_SIGNALFD)
+# define VLIB_THREAD_SIGNALFD
+# include <sys/signalfd.h>
+#endif
+
+#if defined(__linux__) && !defined(VLIB_THREAD_NO_EVENTFD)
+# define VLIB_THREAD_EVENTFD
+# include <sys/eventfd.h>
+#endif
+
+#if defined(__linux__) && !defined(VLIB_THREAD_NO_URING)
+# include <sys/syscall.h>
+# if defined(__NR_io_uring_setup)
+#  include <linux/io_uring.h>
+#  if defined(IORING_RECV_MULTISHOT) /* kernel headers >= 6.0 */
+#   define VLIB_THREAD_URING
+#   include <sys/mman.h>
+#   include <poll.h>
+#   define VTHREAD_URING_ENTRIES    256     /* submission queue size */
+#   define VTHREAD_URING_BUFS       64      /* registered buffers for multishot reads */
+#  endif
+# endif
+#endif
+
 #if defined(_DEBUG) && (defined(__APPLE__) || defined(BUILD_SYS_darwin))
 # include <sys/types.h>
 # include <sys/param.h>
@@ -50,21 +82,197 @@
 # define VALGRIND_DEBUG_WORKAROUND 1
 #endif
 
+/*****************************************************************************/
+#define VTE_FD_EVENTS   (VTE_FD_READ | VTE_FD_WRITE | VTE_FD_ERR)
+
+/* timing wheel: VTHREAD_TIMER_LEVELS levels of VTHREAD_TIMER_SLOTS slots, a slot of
+ * level L covering 2^(L * VTHREAD_TIMER_BITS) milli seconds (1ms .. 4.6h per turn) */
+#define VTHREAD_TIMER_BITS      6
+#define VTHREAD_TIMER_SLOTS     (1 << VTHREAD_TIMER_BITS)
+#define VTHREAD_TIMER_LEVELS    4
+#define VTHREAD_TIMER_SLACK     5       /* expiry delayed by up to timeout >> 5 */
+#define VTHREAD_TIMER_CANCELED  (1 << 0)
+
+/* a timer, linked in a wheel slot */
+typedef struct vthread_timer_s {
+    struct vthread_timer_s *    next;
+    struct vthread_timer_s **   pprev;
+    vthread_timer_id_t          id;         /* generation << 32 | (index + 1) */
+    uint64_t                    due;        /* requested expiry, ms */
+    uint64_t                    expires;    /* coalesced expiry, ms */
+    unsigned long               period;
+    int                         slot;       /* wheel slot, -1 if not in wheel */
+    unsigned int                flags;
+    vthread_callback_t          callback;
+    void *                      callback_data;
+} vthread_timer_t;
+
+/* entry of the table of timer identifiers */
+typedef struct {
+    vthread_timer_t *           timer;      /* NULL if free */
+    uint32_t                    gen;        /* incremented when the timer is freed */
+    uint32_t                    next_free;  /* index + 1 of the next free entry, or 0 */
+} vthread_timer_ref_t;
+
+struct vthread_event_data_s;
+
+/* an asynchronous I/O, see vthread_io_read() */
+typedef struct vthread_io_req_s {
+    struct vthread_io_req_s *   next;
+    struct vthread_io_req_s **  pprev;
+    vthread_event_t             event;      /* VTE_IO_* */
+    int                         fd;
+    void *                      buf;
+    size_t                      size;
+    unsigned int                flags;
+    vthread_callback_t          callback;
+    void *                      callback_data;
+} vthread_io_req_t;
+
+#define VTHREAD_IO_MULTISHOT    (1 << 0)
+#define VTHREAD_IO_CANCELED     (1 << 1)
+#define VTHREAD_IO_RUNNING      (1 << 2)
+#define VTHREAD_IO_EMULATED     (1 << 3)    /* done by the vthread when fd is ready */
+#define VTHREAD_IO_URING        (1 << 4)    /* done by io_uring */
+#define VTHREAD_IO_DIR(req)     ((req)->event == VTE_IO_WRITE ? 1 : 0)
+
+/* events registered on a fd */
+typedef struct {
+    struct vthread_event_data_s *   events;
+    unsigned int                    mask;   /* VTE_FD_EVENTS given to the backend */
+    int                             watched;/* counted in the vthread load */
+    unsigned int                    gen;    /* io_uring poll generation */
+    int                             always; /* not watched by epoll (regular file): always ready */
+    int                             always_next; /* next fd of fd_always, or -1 */
+    vthread_io_req_t *              io[2];  /* pending read or accept, and write */
+    vthread_hist_t *                stats;  /* callback durations by kind < VTK_FD_NB, or NULL */
+} vthread_fd_t;
+
+#ifdef VLIB_THREAD_URING
+/* io_uring rings, mapped from the kernel */
+typedef struct vthread_uring_s {
+    int                         fd;
+    void *                      ring;
+    size_t                      ring_sz;
+    struct io_uring_sqe *       sqes;
+    size_t                      sqes_sz;
+    unsigned int *              sq_head;
+    unsigned int *              sq_tail;
+    unsigned int                sq_mask;
+    unsigned int                sq_entries;
+    unsigned int *              cq_head;
+    unsigned int *              cq_tail;
+    unsigned int                cq_mask;
+    struct io_uring_cqe *       cqes;
+    struct io_uring_buf_ring *  br;     /* ring of registered buffers, NULL if not supported */
+    size_t                      br_sz;
+    char *                      bufs;
+    unsigned short              br_tail;
+} vthread_uring_t;
+
+/* user_data of completions: io request pointer, fd poll, or ignored */
+# define VTHREAD_URING_POLL             ((uint64_t) 1)
+# define VTHREAD_URING_IGNORE           ((uint64_t) 2)
+# define VTHREAD_URING_POLL_DATA(fd, gen) \
+            (((uint64_t)(fd) << 32) | (((uint64_t)(gen) & 0x3fffffff) << 2) | VTHREAD_URING_POLL)
+#endif
+
+/* a message posted with vthread_post() */
+typedef struct vthread_msg_s {
+    struct vthread_msg_s *      next;
+    vthread_callback_t          callback;
+    void *                      msg;
+    void *                      callback_data;
+} vthread_msg_t;
+
+/* a buffer of an output queue: gathered copies of writes, or data given by reference */
+typedef struct vthread_out_seg_s {
+    struct vthread_out_seg_s *  next;
+    const char *                data;       /* first byte not written */
+    size_t                      size;       /* bytes not written */
+    size_t                      room;       /* free bytes after data, for copies */
+    int                         copy;
+    vthread_out_release_t       release;
+    void *                      release_data;
+    char                        buf[];
+} vthread_out_seg_t;
+
+#define VTHREAD_OUT_CHUNK       4096        /* size of the buffers of copied writes */
+#define VTHREAD_OUT_IOV         64          /* max buffers per writev() */
+#define VTHREAD_OUT_DIRTY       (1 << 0)    /* to be written at end of loop iteration */
+#define VTHREAD_OUT_ARMED       (1 << 1)    /* VTE_FD_WRITE registered */
+#define VTHREAD_OUT_ABOVE       (1 << 2)    /* VTO_HIGH given, VTO_LOW not yet */
+#define VTHREAD_OUT_RUNNING     (1 << 3)
+#define VTHREAD_OUT_FREED       (1 << 4)    /* freed when vthread_out_flush() returns */
+#define VTHREAD_OUT_CLOSING     (1 << 5)    /* freed once written */
+
+/* an output queue, see vthread_out_create() */
+struct vthread_out_s {
+    vthread_t *                 vthread;
+    struct vthread_out_s *      next;       /* queues of the vthread */
+    struct vthread_out_s **     pprev;
+    struct vthread_out_s *      dirty_next; /* queues to write at end of loop iteration */
+    int                         fd;
+    unsigned int                flags;
+    int                         error;
+    size_t                      pending;
+    size_t                      high;
+    size_t                      low;
+    vthread_out_seg_t *         head;
+    vthread_out_seg_t *         tail;
+    vthread_out_callback_t      callback;
+    void *                      callback_data;
+};
+
 /*****************************************************************************/
 typedef struct vthread_priv_s {
     pthread_mutex_t             mutex;
     pthread_rwlock_t            pipe_mutex;
     pthread_cond_t              cond;
     sigset_t                    block_sigset;
-    slist_t *                   event_list;
+    struct vthread_event_data_s * events;   /* registered events */
     unsigned long               process_timeout;
     vthread_state_t             state;
-    int                         control_fd;
+    int                         control_fd; /* written to wake up the loop */
+    int                         control_efd;/* control_fd is an eventfd */
+    unsigned int                wakeup;     /* atomic: control_fd written and not read */
+    vthread_msg_t *             msgs;       /* atomic: lock-free stack of posted messages */
+    int                         sigfd;      /* signalfd, or -1 */
+    int                         sig_update; /* signal registrations changed */
+    struct vthread_event_data_s * purge;    /* events disabled by vthread itself */
+    vthread_fd_t *              fds;    /* events of each fd */
+    int                         nfds;
+    unsigned int                nprocess;   /* number of VTE_PROCESS_START events */
+    vthread_backend_t           backend;
+    int                         epfd;   /* epoll fd, or -1 */
+    int                         fd_always;  /* first fd always ready, or -1 */
+#ifdef VLIB_THREAD_EPOLL
+    struct epoll_event *        ep_events;
+#endif
+    vthread_timer_t *           timers[VTHREAD_TIMER_LEVELS * VTHREAD_TIMER_SLOTS];
+    uint64_t                    timer_bits[VTHREAD_TIMER_LEVELS]; /* non empty slots */
+    uint64_t                    timer_now;  /* last processed wheel tick, ms */
+    uint64_t                    timer_wait; /* tick the loop is waiting for */
+    vthread_timer_t *           timer_running;
+    vthread_timer_ref_t *       timer_refs; /* timers by identifier index */
+    uint32_t                    timer_refs_size;
+    uint32_t                    timer_refs_free; /* index + 1 of the first free entry, or 0 */
+    vthread_io_req_t *          io_reqs;    /* pending asynchronous I/O */
+    char *                      io_buf;     /* buffer of multishot reads without io_uring */
+    struct vthread_uring_s *    uring;      /* io_uring backend, or NULL */
+    unsigned int                load;       /* atomic: fds watched and pending I/O */
+    vthread_out_t *             outs;       /* output queues */
+    vthread_out_t *             outs_dirty; /* output queues with new data */
+    vthread_stats_t *           stats;      /* statistics, or NULL if disabled */
+    unsigned long               slow_us;    /* callback duration giving a warning, or 0 */
+    uint64_t                    slow_warned;/* time of last warning, us */
+    unsigned long               slow_skipped; /* warnings not logged since */
 } vthread_priv_t;
 
 /*****************************************************************************/
-typedef struct {
+typedef struct vthread_event_data_s {
     vthread_event_t             event;
+    vthread_event_t             registered; /* event, even if disabled (VTE_NONE) */
     union {
         int                     fd;
         void *                  ptr;
@@ -72,24 +280,94 @@ typedef struct {
     } ev;
     vthread_callback_t          callback;
     void *                      callback_data;
+    struct vthread_event_data_s * fd_next;  /* next event of same fd */
+    struct vthread_event_data_s * next;     /* event list */
+    struct vthread_event_data_s ** pprev;
+    struct vthread_event_data_s * purge_next; /* disabled events, removed on next loop */
 } vthread_event_data_t;
 
-/*****************************************************************************/
-typedef int             vthread_control_t; // data passed to control fd
-typedef unsigned int    vthread_control_len_t; //type of control length if given
-#define VTHREAD_CONTROL_LENGTH  ((vthread_control_t) (0x80000000))
-#define VTHREAD_CONTROL_MASK    ((vthread_control_t) (0x0fffffff))
-#define VTHREAD_CONTROL_NOTIFY  ((vthread_control_t) (0x01000000))
-
 /*****************************************************************************/
 static void *                   vthread_body(void * data);
 static void                     vthread_ctx_destroy(vthread_t * vthread);
 static int                      vthread_notify(vthread_t * vthread);
-static int                      vthread_control_pipe_cb(
+static int                      vthread_wakeup(vthread_priv_t * priv);
+static int                      vthread_wakeup_create(vthread_t * vthread);
+static int                      vthread_wakeup_cb(
+                                    vthread_t *             vthread,
+                                    vthread_event_t         ev,
+                                    void *                  ev_data,
+                                    void *                  cb_data);
+static void                     vthread_msg_run(vthread_t * vthread);
+static int                      vthread_unregister_event_unlocked(
+                                    vthread_t *             vthread,
+                                    vthread_event_t         event,
+                                    void *                  event_data,
+                                    int                     inloop);
+static int                      vthread_fd_grow(vthread_priv_t * priv, int fd);
+#if defined(VLIB_THREAD_EPOLL) || defined(VLIB_THREAD_URING)
+static void                     vthread_fd_ready(vthread_t * vthread, int fd, unsigned int ready);
+#endif
+static int                      vthread_io_submit(
+                                    vthread_t *             vthread,
+                                    vthread_event_t         event,
+                                    int                     fd,
+                                    void *                  buf,
+                                    size_t                  size,
+                                    vthread_callback_t      callback,
+                                    void *                  callback_user_data);
+static void                     vthread_io_complete(
+                                    vthread_t *             vthread,
+                                    vthread_io_req_t *      req,
+                                    ssize_t                 res,
+                                    void *                  buf,
+                                    int                     more);
+static void                     vthread_io_release(vthread_t * vthread, vthread_io_req_t * req);
+static void                     vthread_io_free(vthread_t * vthread, vthread_io_req_t * req);
+static int                      vthread_io_ready_cb(
+                                    vthread_t *             vthread,
+                                    vthread_event_t         ev,
+                                    void *                  ev_data,
+                                    void *                  cb_data);
+#ifdef VLIB_THREAD_URING
+static int                      vthread_uring_init(vthread_t * vthread);
+static void                     vthread_uring_free(vthread_uring_t * ur);
+static int                      vthread_uring_poll(
+                                    vthread_priv_t *        priv,
+                                    int                     fd,
+                                    unsigned int            old_mask,
+                                    unsigned int            mask);
+static int                      vthread_uring_io(vthread_priv_t * priv, vthread_io_req_t * req);
+static int                      vthread_uring_cancel(vthread_priv_t * priv, vthread_io_req_t * req);
+static int                      vthread_uring_wait(vthread_priv_t * priv, long wait_ms);
+static void                     vthread_uring_dispatch(vthread_t * vthread);
+#endif
+static void                     vthread_out_drop(vthread_out_t * out);
+static void                     vthread_out_destroy(vthread_out_t * out);
+static void                     vthread_out_flush(vthread_out_t * out);
+static void                     vthread_out_run(vthread_t * vthread);
+static int                      vthread_out_ready_cb(
+                                    vthread_t *             vthread,
+                                    vthread_event_t         ev,
+                                    void *                  ev_data,
+                                    void *                  cb_data);
+static int                      vthread_call(
+                                    vthread_t *             vthread,
+                                    vthread_callback_t      callback,
+                                    vthread_event_t         event,
+                                    void *                  event_data,
+                                    void *                  callback_data);
+static uint64_t                 vthread_clock_us();
+static void                     vthread_hist_add(vthread_hist_t * hist, uint64_t us);
+static void                     vthread_stats_free(vthread_priv_t * priv);
+static void                     vthread_sig_dispatch(vthread_t * vthread, int sig);
+#ifdef VLIB_THREAD_SIGNALFD
+static void                     vthread_signalfd_update(vthread_t * vthread);
+static int                      vthread_signalfd_cb(
                                     vthread_t *             vthread,
                                     vthread_event_t         ev,
                                     void *                  ev_data,
                                     void *                  cb_data);
+#endif
 static int                      vthread_closefd(
                                     vthread_t *             vthread,
                                     vthread_event_t         event,
@@ -102,6 +380,58 @@ static int                      vthread_register_event_unlocked(
                                     vthread_callback_t      callback,
                                     void *                  callback_user_data);
 static int                      vthread_event_cmp(const void * vev1, const void * vev2);
+static void                     vthread_event_purge(vthread_t * vthread);
+static void                     vthread_event_disable(
+                                    vthread_priv_t *        priv,
+                                    vthread_event_data_t *  data);
+static vthread_event_data_t *   vthread_event_find(
+                                    vthread_priv_t *        priv,
+                                    const vthread_event_data_t * ev);
+static void                     vthread_event_remove(
+                                    vthread_t *             vthread,
+                                    vthread_event_data_t *  data);
+static int                      vthread_fd_update(vthread_t * vthread, int fd);
+static int                      vthread_fd_link(
+                                    vthread_t *             vthread,
+                                    vthread_event_data_t *  ev);
+static void                     vthread_fd_unlink(
+                                    vthread_t *             vthread,
+                                    vthread_event_data_t *  ev);
+static void                     vthread_event_unlink(
+                                    vthread_t *             vthread,
+                                    vthread_event_data_t *  ev);
+#ifdef VLIB_THREAD_EPOLL
+static int                      vthread_epoll_init(vthread_t * vthread);
+static void                     vthread_epoll_dispatch(vthread_t * vthread, int nready);
+static void                     vthread_epoll_always(vthread_t * vthread, int fd, int always);
+static void                     vthread_epoll_always_dispatch(vthread_t * vthread);
+#endif
+static void                     vthread_fd_dispatch(
+                                    vthread_t *             vthread,
+                                    vthread_event_data_t *  data,
+                                    unsigned int            ready);
+static uint64_t                 vthread_clock_ms();
+static uint64_t                 vthread_timer_next(vthread_priv_t * priv);
+static void                     vthread_timer_run(vthread_t * vthread, uint64_t now);
+static void                     vthread_timer_arm(
+                                    vthread_priv_t *        priv,
+                                    vthread_timer_t *       timer,
+                                    unsigned long           delay);
+static void                     vthread_timer_link(
+                                    vthread_priv_t *        priv,
+                                    vthread_timer_t *       timer);
+static void                     vthread_timer_unlink(
+                                    vthread_priv_t *        priv,
+                                    vthread_timer_t *       timer);
+static int                      vthread_timer_ref(
+                                    vthread_priv_t *        priv,
+                                    vthread_timer_t *       timer);
+static vthread_timer_t *        vthread_timer_get(
+                                    vthread_priv_t *        priv,
+                                    vthread_timer_id_t      id);
+static void                     vthread_timer_free(
+                                    vthread_priv_t *        priv,
+                                    vthread_timer_t *       timer);
 static int                      vthread_ignore_sigpipe(vthread_t * vthread);
 static void                     vthread_sig_handler(int sig);
 static volatile sig_atomic_t    s_last_signal = 0;
@@ -132,13 +462,19 @@ vthread_t *     vthread_create(
     vthread->priv = priv;
     priv->state = VTS_CREATING;
     priv->process_timeout = process_timeout;
+    priv->epfd = -1;
+    priv->fd_always = -1;
+    priv->sigfd = -1;
+    priv->control_fd = -1;
+    priv->timer_now = vthread_clock_ms();
+    priv->timer_wait = UINT64_MAX;
     pthread_mutex_init(&priv->mutex, NULL);
     pthread_rwlock_init(&priv->pipe_mutex, NULL);
     pthread_cond_init(&priv->cond, NULL);
     sigemptyset(&priv->block_sigset);
 
     if (vthread_ignore_sigpipe(vthread) != 0
-    ||  (priv->control_fd = vthread_pipe_create(vthread, vthread_control_pipe_cb, NULL)) < 0) {
+    ||  vthread_wakeup_create(vthread) != 0) {
         LOG_ERROR(vthread->log, "cannot create thread control fd: %s", strerror(errno));
         vthread_ctx_destroy(vthread);
         return NULL;
@@ -181,16 +517,47 @@ int                 vthread_start(
 }
 
 /*****************************************************************************/
-void *                  vthread_stop(
-                            vthread_t *             vthread) {
-    vthread_priv_t  *   priv = vthread ? (vthread_priv_t *) vthread->priv : NULL;
-    void *              ret_val;
-    int                 ret;
+int                 vthread_set_backend(
+                            vthread_t *             vthread,
+                            vthread_backend_t       backend) {
+    vthread_priv_t * priv = vthread ? (vthread_priv_t *) vthread->priv : NULL;
+    int ret = 0;
 
     if (priv == NULL) {
-        LOG_WARN(g_vlib_log, "bad thread context");
-        return VTHREAD_RESULT_ERROR;
+        LOG_ERROR(g_vlib_log, "bad thread context");
+        errno = EINVAL;
+        return -1;
+    }
+#   ifndef VLIB_THREAD_EPOLL
+    if (backend == VTB_EPOLL) {
+        errno = ENOTSUP;
+        return -1;
+    }
+#   endif
+#   ifndef VLIB_THREAD_URING
+    if (backend == VTB_URING) {
+        errno = ENOTSUP;
+        return -1;
+    }
+#   endif
+    pthread_mutex_lock(&priv->mutex);
+    if ((priv->state & VTS_STARTED) != 0) {
+        errno = EBUSY;
+        ret = -1;
+    } else {
+        priv->backend = backend;
     }
+    pthread_mutex_unlock(&priv->mutex);
+
+    return ret;
+}
+
+/*****************************************************************************/
+/** ask the thread to exit, without waiting for it */
+static void             vthread_exit_request(
+                            vthread_t *             vthread) {
+    vthread_priv_t  *   priv = vthread->priv;
+    int                 ret;
 
     LOG_DEBUG(vthread->log, "locking priv_mutex...");
     pthread_mutex_lock(&priv->mutex);
@@ -208,24 +575,32 @@ void *                  vthread_stop(
 
     /* signal the running thread about configuration change */
     vthread_notify(vthread);
-
-    /* finally wait for end of thread and destroy its context */
     pthread_mutex_unlock(&priv->mutex);
-    ret_val = vthread_wait_and_free(vthread);
-
-    return ret_val;
 }
 
-void * vthread_wait_and_free(vthread_t * vthread) {
+/*****************************************************************************/
+void *                  vthread_stop(
+                            vthread_t *             vthread) {
     vthread_priv_t  *   priv = vthread ? (vthread_priv_t *) vthread->priv : NULL;
-    void *              ret_val;
 
     if (priv == NULL) {
         LOG_WARN(g_vlib_log, "bad thread context");
         return VTHREAD_RESULT_ERROR;
     }
+    vthread_exit_request(vthread);
+
+    /* finally wait for end of thread and destroy its context */
+    return vthread_wait_and_free(vthread);
+}
+
+/*****************************************************************************/
+/** wait for end of thread, without destroying its context */
+static void             vthread_join(
+                            vthread_t *             vthread) {
+    void *              ret_val;
 
 #   ifdef VALGRIND_DEBUG_WORKAROUND
+    vthread_priv_t  *   priv = vthread->priv;
     int valgrind = vthread_valgrind(0, NULL);
     if (valgrind) {
         vthread_state_t state = priv->state;
@@ -247,6 +622,21 @@ void * vthread_wait_and_free(vthread_t * vthread) {
 
     LOG_DEBUG(vthread->log, "destroy vthread and return join:%lx, ret:%lx...",
               (unsigned long)((size_t)ret_val), (unsigned long)((size_t)vthread->result));
+#   ifndef _DEBUG
+    (void) ret_val;
+#   endif
+}
+
+/*****************************************************************************/
+void * vthread_wait_and_free(vthread_t * vthread) {
+    vthread_priv_t  *   priv = vthread ? (vthread_priv_t *) vthread->priv : NULL;
+    void *              ret_val;
+
+    if (priv == NULL) {
+        LOG_WARN(g_vlib_log, "bad thread context");
+        return VTHREAD_RESULT_ERROR;
+    }
+    vthread_join(vthread);
     ret_val = vthread->result;
     vthread_ctx_destroy(vthread);
 
@@ -288,12 +678,25 @@ int                 vthread_register_event(
     }
     LOG_VERBOSE(vthread->log, "register event %d ev_data:%lx callback_data:%lx",
                 event, (long) event_data, (long) callback_user_data);
+    if ((event & VTE_TIMER) != 0) {
+        LOG_WARN(vthread->log, "VTE_TIMER must be registered with vthread_timer_add()");
+        errno = EINVAL;
+        return -1;
+    }
 
+    if (pthread_equal(pthread_self(), vthread->tid)) {
+        /* called from a callback, mutex is already locked and event
+         * will be taken into account on next loop */
+        return vthread_register_event_unlocked(vthread, event, event_data,
+                                               callback, callback_user_data);
+    }
     pthread_mutex_lock(&priv->mutex);
     ret = vthread_register_event_unlocked(vthread, event, event_data,
                                               callback, callback_user_data);
-    /* signal the thread about configuration change */
-    vthread_notify(vthread);
+    /* signal the thread about configuration change, not needed for
+     * fd events given to epoll */
+    if (priv->epfd < 0 || (event & ~(VTE_FD_EVENTS | VTE_FD_CLOSE | VTE_ONESHOT)) != 0)
+        vthread_notify(vthread);
     pthread_mutex_unlock(&priv->mutex);
 
     return ret;
@@ -305,7 +708,7 @@ int                 vthread_unregister_event(
                             vthread_event_t         event,
                             void *                  event_data) {
     vthread_priv_t  *       priv = vthread ? (vthread_priv_t *) vthread->priv : NULL;
-    vthread_event_data_t    ev;
+    int                     inloop, ret;
 
     if (priv == NULL) {
         LOG_WARN(g_vlib_log, "bad thread context");
@@ -314,7 +717,29 @@ int                 vthread_unregister_event(
     LOG_VERBOSE(vthread->log, "unregister event %d ev_data:%lx",
                 event, (long) event_data);
 
+    /* from a callback, mutex is already locked */
+    if ((inloop = pthread_equal(pthread_self(), vthread->tid)))
+        return vthread_unregister_event_unlocked(vthread, event, event_data, inloop);
+
     pthread_mutex_lock(&priv->mutex);
+    ret = vthread_unregister_event_unlocked(vthread, event, event_data, inloop);
+
+    /* signal the thread about configuration change */
+    if (ret == 0 && (priv->epfd < 0 || (event & ~(VTE_FD_EVENTS | VTE_FD_CLOSE | VTE_ONESHOT)) != 0))
+        vthread_notify(vthread);
+    pthread_mutex_unlock(&priv->mutex);
+
+    return ret;
+}
+
+/*****************************************************************************/
+static int          vthread_unregister_event_unlocked(
+                            vthread_t *             vthread,
+                            vthread_event_t         event,
+                            void *                  event_data,
+                            int                     inloop) {
+    vthread_priv_t  *       priv = vthread->priv;
+    vthread_event_data_t    ev, * data;
 
     ev.event = event;
 
@@ -325,128 +750,533 @@ int                 vthread_unregister_event(
         // with restore of sa_bak if use_count becomes 0.
         ev.ev.sig = (int) ((ssize_t) event_data);
         sigaddset(&priv->block_sigset, ev.ev.sig);
+        priv->sig_update = 1;
     } else {
         ev.ev.ptr = event_data;
     }
 
-    errno = 0;
-    priv->event_list = slist_remove(priv->event_list, &ev, vthread_event_cmp, free);
-    if (errno != 0) {
-        LOG_WARN(vthread->log, "cannot remove event %u(%lx) from event_list : %s",
-                 event, (unsigned long)ev.ev.ptr, strerror(errno));
-        pthread_mutex_unlock(&priv->mutex);
+    if ((data = vthread_event_find(priv, &ev)) == NULL) {
+        LOG_WARN(vthread->log, "cannot remove event %u(%lx) from event list : %s",
+                 event, (unsigned long)ev.ev.ptr, strerror(ENOENT));
+        errno = ENOENT;
         return -1;
     }
-
-    /* signal the thread about configuration change */
-    vthread_notify(vthread);
-    pthread_mutex_unlock(&priv->mutex);
-
+    if (inloop) {
+        /* the event list can be being iterated: disable the event, removed on next loop */
+        vthread_event_disable(priv, data);
+        /* the callback can close fd and get it again before the purge */
+        if ((data->registered & VTE_FD_EVENTS) != 0)
+            vthread_fd_update(vthread, data->ev.fd);
+    } else {
+        vthread_event_remove(vthread, data);
+    }
+    if ((event & VTE_SIG) != 0 && priv->sigfd < 0) {
+        /* keep the signal unblocked if it is still registered */
+        for (data = priv->events; data != NULL; data = data->next) {
+            if ((data->event & VTE_SIG) != 0 && data->ev.sig == ev.ev.sig) {
+                sigdelset(&priv->block_sigset, ev.ev.sig);
+                break ;
+            }
+        }
+    }
     return 0;
 }
 
 /*****************************************************************************/
-int                 vthread_pipe_create(
+vthread_timer_id_t  vthread_timer_add(
                             vthread_t *             vthread,
+                            unsigned long           timeout_ms,
+                            unsigned long           period_ms,
                             vthread_callback_t      callback,
                             void *                  callback_user_data) {
-    vthread_priv_t *        priv = vthread ? vthread->priv : NULL;
-    int                     pipefd[2];
-    int                     fd_flags;
+    vthread_priv_t *    priv = vthread ? (vthread_priv_t *) vthread->priv : NULL;
+    vthread_timer_t *   timer;
+    vthread_timer_id_t  id;
+    int                 inloop;
 
-    /* sanity checks */
-    if (priv == NULL) {
-        LOG_WARN(g_vlib_log, "bad thread context");
-        return -1;
+    if (priv == NULL || callback == NULL) {
+        LOG_WARN(g_vlib_log, "bad thread context or callback");
+        errno = EINVAL;
+        return 0;
     }
-    /* ignore SIGPIPE for caller if not already set or ignored */
-    if (vthread_ignore_sigpipe(vthread) != 0) {
-        return -1;
+    if ((timer = malloc(sizeof(*timer))) == NULL) {
+        LOG_ERROR(vthread->log, "error: cannot malloc timer : %s", strerror(errno));
+        return 0;
     }
+    timer->period = period_ms;
+    timer->flags = 0;
+    timer->callback = callback;
+    timer->callback_data = callback_user_data;
 
-    /* create the pipe, set it to non blocking */
-    if (pipe(pipefd) != 0) {
-        LOG_ERROR(vthread->log, "error pipe(): %s", strerror(errno));
-        return -1;
-    }
-    for (unsigned i = 0; i < 2; i++) {
-        fd_flags = fcntl(pipefd[i], F_GETFL);
-        if (fd_flags == -1 || fcntl(pipefd[i], F_SETFL, (fd_flags | O_NONBLOCK)) == -1) {
-            LOG_ERROR(vthread->log, "error fcntl(pipe) : %s", strerror(errno));
-            close(pipefd[1]);
-            close(pipefd[0]);
-            return -1;
-        }
+    /* from a callback, mutex is already locked */
+    if (!(inloop = pthread_equal(pthread_self(), vthread->tid)))
+        pthread_mutex_lock(&priv->mutex);
+
+    if (vthread_timer_ref(priv, timer) != 0) {
+        int errno_save = errno;
+        if (!inloop)
+            pthread_mutex_unlock(&priv->mutex);
+        LOG_ERROR(vthread->log, "error: cannot allocate timer identifier : %s",
+                  strerror(errno_save));
+        free(timer);
+        errno = errno_save;
+        return 0;
     }
-    /* LOCK mutex */
-    pthread_mutex_lock(&priv->mutex);
-    /* register event read for pipefd_in, and event clean to close pipefd_out
-     * note: as slist_prepend() is used, add pipefd_out last so as it will be first to close */
-    if (vthread_register_event_unlocked(vthread, VTE_FD_READ | VTE_FD_CLOSE,
-                                        VTE_DATA_FD(pipefd[0]), callback, callback_user_data) != 0
-    ||  vthread_register_event_unlocked(vthread, VTE_CLEAN, NULL,
-                                            vthread_closefd, VTE_DATA_FD(pipefd[1])) != 0) {
-        LOG_ERROR(vthread->log, "error vthread_register_event");
-        close(pipefd[1]);
-        close(pipefd[0]);
-        pipefd[1] = -1;
+    /* read under lock, as the loop can free the timer once unlocked */
+    id = timer->id;
+    timer->due = vthread_clock_ms() + timeout_ms;
+    vthread_timer_arm(priv, timer, timeout_ms);
+
+    /* wake up the thread if it waits beyond the timer expiry */
+    if (!inloop) {
+        if ((priv->state & VTS_WAITING) != 0 && timer->expires < priv->timer_wait)
+            vthread_notify(vthread);
+        pthread_mutex_unlock(&priv->mutex);
     }
-    /* notify the thread about configuration change */
-    vthread_notify(vthread);
-    pthread_mutex_unlock(&priv->mutex);
 
-    return pipefd[1];
+    return id;
 }
 
-/** ignore SIGPIPE for caller if not already set or ignored */
-static int vthread_ignore_sigpipe(vthread_t * vthread) {
-    struct sigaction    sa;
+/*****************************************************************************/
+int                 vthread_timer_cancel(
+                            vthread_t *             vthread,
+                            vthread_timer_id_t      id) {
+    vthread_priv_t *    priv = vthread ? (vthread_priv_t *) vthread->priv : NULL;
+    vthread_timer_t *   timer;
+    int                 inloop;
 
-    if (sigaction(SIGPIPE, NULL, &sa) != 0) {
-        LOG_ERROR(vthread->log, "error sigaction(get SIGPIPE): %s", strerror(errno));
+    if (priv == NULL || id == 0) {
+        LOG_WARN(g_vlib_log, "bad thread context or timer");
+        errno = EINVAL;
         return -1;
     }
-    if ((sa.sa_flags & SA_SIGINFO) == 0 && sa.sa_handler == SIG_DFL) {
-        LOG_DEBUG(vthread->log, "thread: ignore SIGPIPE for vthread_pipe_create() caller");
-        sigfillset(&sa.sa_mask);
-        sa.sa_flags = SA_RESTART;
-        sa.sa_handler = SIG_IGN;
-        if (sigaction(SIGPIPE, &sa, NULL) != 0) {
-            LOG_ERROR(vthread->log, "error sigaction(set SIGPIPE): %s", strerror(errno));
-            return -1;
-        }
+    /* from a callback, mutex is already locked */
+    if (!(inloop = pthread_equal(pthread_self(), vthread->tid)))
+        pthread_mutex_lock(&priv->mutex);
+
+    /* the timer can have expired, then the identifier is not valid anymore */
+    if ((timer = vthread_timer_get(priv, id)) == NULL
+    ||  (timer->flags & VTHREAD_TIMER_CANCELED) != 0) {
+        if (!inloop)
+            pthread_mutex_unlock(&priv->mutex);
+        errno = ENOENT;
+        return -1;
     }
+    if (timer == priv->timer_running) {
+        /* freed when its callback returns */
+        timer->flags |= VTHREAD_TIMER_CANCELED;
+    } else {
+        vthread_timer_unlink(priv, timer);
+        vthread_timer_free(priv, timer);
+    }
+
+    if (!inloop)
+        pthread_mutex_unlock(&priv->mutex);
+
     return 0;
 }
 
-/****************************************************************************/
-static int write_nonblock(int fd, const void * buf, size_t size, unsigned int timeout_ms) {
-    int ret;
+/*****************************************************************************/
+int                 vthread_post(
+                            vthread_t *             vthread,
+                            vthread_callback_t      callback,
+                            void *                  msg,
+                            void *                  callback_user_data) {
+    vthread_priv_t *    priv = vthread ? (vthread_priv_t *) vthread->priv : NULL;
+    vthread_msg_t *     node;
 
-    while ((ret = write(fd, buf, size)) < 0) {
-        if (errno == EINTR)
-            continue ;
-        if (errno == EAGAIN || errno == EWOULDBLOCK) {
-            struct timeval timeout;
-            fd_set set;
-            do {
-                timeout.tv_sec = timeout_ms / 1000;
-                timeout.tv_usec = (timeout_ms % 1000) * 1000;
-                FD_ZERO(&set);
-                FD_SET(fd, &set);
-                ret = select(fd + 1, NULL, &set, NULL, &timeout);
-            } while (ret < 0 && errno == EINTR);
-            if (ret <= 0)
-                return -1;
-            continue ;
-        }
-        break ;
+    if (priv == NULL || callback == NULL) {
+        LOG_WARN(g_vlib_log, "bad thread context or callback");
+        errno = EINVAL;
+        return -1;
     }
-    return ret;
+    if ((node = malloc(sizeof(*node))) == NULL) {
+        LOG_ERROR(vthread->log, "error: cannot malloc message : %s", strerror(errno));
+        return -1;
+    }
+    node->callback = callback;
+    node->msg = msg;
+    node->callback_data = callback_user_data;
+
+    node->next = VLIB_ATOMIC_LOAD_RELAXED(&priv->msgs);
+    while (!VLIB_ATOMIC_CAS(&priv->msgs, &node->next, node))
+        ; /* node->next updated by VLIB_ATOMIC_CAS */
+
+    /* the message is queued: on error it will be delivered on next wakeup */
+    if (vthread_wakeup(priv) != 0) {
+        LOG_ERROR(vthread->log, "error: control_fd write: %s", strerror(errno));
+    }
+    return 0;
 }
 
 /*****************************************************************************/
-ssize_t                 vthread_pipe_write(
+int                 vthread_io_read(
+                            vthread_t *             vthread,
+                            int                     fd,
+                            void *                  buf,
+                            size_t                  size,
+                            vthread_callback_t      callback,
+                            void *                  callback_user_data) {
+    return vthread_io_submit(vthread, VTE_IO_READ, fd, buf, size,
+                             callback, callback_user_data);
+}
+
+/*****************************************************************************/
+int                 vthread_io_write(
+                            vthread_t *             vthread,
+                            int                     fd,
+                            const void *            buf,
+                            size_t                  size,
+                            vthread_callback_t      callback,
+                            void *                  callback_user_data) {
+    if (buf == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    return vthread_io_submit(vthread, VTE_IO_WRITE, fd, (void *) buf, size,
+                             callback, callback_user_data);
+}
+
+/*****************************************************************************/
+int                 vthread_io_accept(
+                            vthread_t *             vthread,
+                            int                     fd,
+                            vthread_callback_t      callback,
+                            void *                  callback_user_data) {
+    return vthread_io_submit(vthread, VTE_IO_ACCEPT, fd, NULL, 0,
+                             callback, callback_user_data);
+}
+
+/*****************************************************************************/
+int                 vthread_io_cancel(
+                            vthread_t *             vthread,
+                            int                     fd) {
+    vthread_priv_t *    priv = vthread ? (vthread_priv_t *) vthread->priv : NULL;
+    vthread_io_req_t *  req;
+    int                 inloop, ret = -1;
+
+    if (priv == NULL) {
+        LOG_WARN(g_vlib_log, "bad thread context");
+        errno = EINVAL;
+        return -1;
+    }
+    /* from a callback, mutex is already locked */
+    if (!(inloop = pthread_equal(pthread_self(), vthread->tid)))
+        pthread_mutex_lock(&priv->mutex);
+
+    errno = ENOENT;
+    for (unsigned int dir = 0; fd >= 0 && fd < priv->nfds && dir < 2; ++dir) {
+        if ((req = priv->fds[fd].io[dir]) == NULL)
+            continue ;
+        priv->fds[fd].io[dir] = NULL;
+        req->flags |= VTHREAD_IO_CANCELED;
+        ret = 0;
+#       ifdef VLIB_THREAD_URING
+        if ((req->flags & VTHREAD_IO_URING) != 0) {
+            /* freed on its last completion */
+            vthread_uring_cancel(priv, req);
+            continue ;
+        }
+#       endif
+        /* freed now, or when its callback returns */
+        vthread_unregister_event_unlocked(vthread, (dir ? VTE_FD_WRITE : VTE_FD_READ) | VTE_RESERVED,
+                                          VTE_DATA_FD(fd), inloop);
+        req->flags &= ~VTHREAD_IO_EMULATED;
+        if ((req->flags & VTHREAD_IO_RUNNING) == 0)
+            vthread_io_free(vthread, req);
+    }
+
+    if (!inloop) {
+        if (ret == 0)
+            vthread_notify(vthread);
+        pthread_mutex_unlock(&priv->mutex);
+    }
+    return ret;
+}
+
+/*****************************************************************************/
+/** do an asynchronous I/O, with io_uring if used, or when fd is ready */
+static int                      vthread_io_submit(
+                                    vthread_t *             vthread,
+                                    vthread_event_t         event,
+                                    int                     fd,
+                                    void *                  buf,
+                                    size_t                  size,
+                                    vthread_callback_t      callback,
+                                    void *                  callback_user_data) {
+    vthread_priv_t *    priv = vthread ? (vthread_priv_t *) vthread->priv : NULL;
+    vthread_io_req_t *  req = NULL;
+    int                 inloop, ret = -1;
+
+    if (priv == NULL || callback == NULL || fd < 0) {
+        LOG_WARN(g_vlib_log, "bad thread context, callback or fd");
+        errno = EINVAL;
+        return -1;
+    }
+    /* from a callback, mutex is already locked */
+    if (!(inloop = pthread_equal(pthread_self(), vthread->tid)))
+        pthread_mutex_lock(&priv->mutex);
+
+    if (vthread_fd_grow(priv, fd) != 0 || (req = calloc(1, sizeof(*req))) == NULL) {
+        LOG_ERROR(vthread->log, "error: cannot malloc io request : %s", strerror(errno));
+    } else {
+        req->event = event;
+        req->fd = fd;
+        req->buf = buf;
+        req->size = size;
+        req->callback = callback;
+        req->callback_data = callback_user_data;
+        if (event == VTE_IO_ACCEPT || (event == VTE_IO_READ && buf == NULL))
+            req->flags |= VTHREAD_IO_MULTISHOT;
+
+        if (priv->fds[fd].io[VTHREAD_IO_DIR(req)] != NULL) {
+            errno = EBUSY;
+#       ifdef VLIB_THREAD_URING
+        } else if (priv->uring != NULL && (buf != NULL || event != VTE_IO_READ
+                                          || priv->uring->br != NULL)) {
+            ret = vthread_uring_io(priv, req);
+#       endif
+        } else {
+            req->flags |= VTHREAD_IO_EMULATED;
+            ret = vthread_register_event_unlocked(vthread,
+                    (event == VTE_IO_WRITE ? VTE_FD_WRITE : VTE_FD_READ) | VTE_RESERVED,
+                    VTE_DATA_FD(fd), vthread_io_ready_cb, req);
+        }
+        if (ret == 0) {
+            priv->fds[fd].io[VTHREAD_IO_DIR(req)] = req;
+            if ((req->next = priv->io_reqs) != NULL)
+                req->next->pprev = &req->next;
+            req->pprev = &priv->io_reqs;
+            priv->io_reqs = req;
+            VLIB_ATOMIC_ADD(&priv->load, 1);
+        } else {
+            free(req);
+        }
+    }
+
+    if (!inloop) {
+        if (ret == 0)
+            vthread_notify(vthread);
+        pthread_mutex_unlock(&priv->mutex);
+    }
+    return ret;
+}
+
+/*****************************************************************************/
+/** accept a non-blocking and close-on-exec connection */
+static int vthread_io_accept_fd(int fd) {
+#   ifdef SOCK_NONBLOCK
+    return accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#   else
+    int cfd = accept(fd, NULL, NULL);
+
+    if (cfd >= 0) {
+        fcntl(cfd, F_SETFL, fcntl(cfd, F_GETFL) | O_NONBLOCK);
+        fcntl(cfd, F_SETFD, FD_CLOEXEC);
+    }
+    return cfd;
+#   endif
+}
+
+/*****************************************************************************/
+/** do an asynchronous I/O without io_uring, when its fd is ready */
+static int vthread_io_ready_cb(
+    vthread_t * vthread, vthread_event_t ev, void * ev_data, void * cb_data) {
+
+    vthread_priv_t *    priv = vthread->priv;
+    vthread_io_req_t *  req = (vthread_io_req_t *) cb_data;
+    int                 fd = VTE_FD_DATA(ev_data);
+    void *              buf = req->buf;
+    ssize_t             n;
+    int                 more;
+    (void)              ev;
+
+    if (req->event == VTE_IO_ACCEPT) {
+        n = vthread_io_accept_fd(fd);
+    } else if (req->event == VTE_IO_WRITE) {
+        n = write(fd, buf, req->size);
+    } else if (buf != NULL) {
+        n = read(fd, buf, req->size);
+    } else if (priv->io_buf != NULL || (priv->io_buf = malloc(VLIB_THREAD_IO_BUFSZ)) != NULL) {
+        n = read(fd, buf = priv->io_buf, VLIB_THREAD_IO_BUFSZ);
+    } else {
+        n = -1;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return 0; /* wait until fd is ready again */
+    }
+    if (n < 0) {
+        n = -errno;
+    }
+    /* multishot reads stop at end of file, accepts on error */
+    more = (req->flags & VTHREAD_IO_MULTISHOT) != 0
+           && (req->event == VTE_IO_ACCEPT ? n >= 0 : n > 0);
+    vthread_io_complete(vthread, req, n, buf, more);
+    return 0;
+}
+
+/*****************************************************************************/
+/** call the callback of an asynchronous I/O completion, under lock */
+static void             vthread_io_complete(
+                            vthread_t *             vthread,
+                            vthread_io_req_t *      req,
+                            ssize_t                 res,
+                            void *                  buf,
+                            int                     more) {
+    vthread_priv_t *    priv = vthread->priv;
+    vthread_io_t        io;
+
+    /* the last completion releases fd before the callback, which can close it */
+    if (!more) {
+        vthread_io_release(vthread, req);
+    }
+    if ((req->flags & VTHREAD_IO_CANCELED) == 0) {
+        io.fd = req->fd;
+        io.res = res;
+        io.buf = buf;
+        io.more = more;
+        req->flags |= VTHREAD_IO_RUNNING;
+        if (vthread_call(vthread, req->callback, req->event, &io, req->callback_data) < 0)
+            priv->state |= VTS_EXIT_REQUESTED;
+        req->flags &= ~VTHREAD_IO_RUNNING;
+    }
+    /* an io_uring request cancelled still gives its last completion */
+    if (!more || (req->flags & (VTHREAD_IO_CANCELED | VTHREAD_IO_URING)) == VTHREAD_IO_CANCELED) {
+        vthread_io_free(vthread, req);
+    }
+}
+
+/*****************************************************************************/
+/** detach an asynchronous I/O from its fd, under lock */
+static void vthread_io_release(vthread_t * vthread, vthread_io_req_t * req) {
+    vthread_priv_t *    priv = vthread->priv;
+    unsigned int        dir = VTHREAD_IO_DIR(req);
+
+    if (req->fd < priv->nfds && priv->fds[req->fd].io[dir] == req) {
+        priv->fds[req->fd].io[dir] = NULL;
+    }
+    if ((req->flags & VTHREAD_IO_EMULATED) != 0) {
+        vthread_unregister_event_unlocked(vthread, (dir ? VTE_FD_WRITE : VTE_FD_READ) | VTE_RESERVED,
+                                          VTE_DATA_FD(req->fd),
+                                          pthread_equal(pthread_self(), vthread->tid));
+        req->flags &= ~VTHREAD_IO_EMULATED;
+    }
+}
+
+/*****************************************************************************/
+/** forget an asynchronous I/O, under lock */
+static void vthread_io_free(vthread_t * vthread, vthread_io_req_t * req) {
+    vthread_priv_t *    priv = vthread->priv;
+
+    vthread_io_release(vthread, req);
+    if ((*req->pprev = req->next) != NULL)
+        req->next->pprev = req->pprev;
+    VLIB_ATOMIC_SUB(&priv->load, 1);
+    free(req);
+}
+
+/*****************************************************************************/
+int                 vthread_pipe_create(
+                            vthread_t *             vthread,
+                            vthread_callback_t      callback,
+                            void *                  callback_user_data) {
+    vthread_priv_t *        priv = vthread ? vthread->priv : NULL;
+    int                     pipefd[2];
+    int                     fd_flags;
+
+    /* sanity checks */
+    if (priv == NULL) {
+        LOG_WARN(g_vlib_log, "bad thread context");
+        return -1;
+    }
+    /* ignore SIGPIPE for caller if not already set or ignored */
+    if (vthread_ignore_sigpipe(vthread) != 0) {
+        return -1;
+    }
+
+    /* create the pipe, set it to non blocking */
+    if (pipe(pipefd) != 0) {
+        LOG_ERROR(vthread->log, "error pipe(): %s", strerror(errno));
+        return -1;
+    }
+    for (unsigned i = 0; i < 2; i++) {
+        fd_flags = fcntl(pipefd[i], F_GETFL);
+        if (fd_flags == -1 || fcntl(pipefd[i], F_SETFL, (fd_flags | O_NONBLOCK)) == -1) {
+            LOG_ERROR(vthread->log, "error fcntl(pipe) : %s", strerror(errno));
+            close(pipefd[1]);
+            close(pipefd[0]);
+            return -1;
+        }
+    }
+    /* LOCK mutex */
+    pthread_mutex_lock(&priv->mutex);
+    /* register event read for pipefd_in, and event clean to close pipefd_out
+     * note: as events are prepended, add pipefd_out last so as it will be first to close */
+    if (vthread_register_event_unlocked(vthread, VTE_FD_READ | VTE_FD_CLOSE,
+                                        VTE_DATA_FD(pipefd[0]), callback, callback_user_data) != 0
+    ||  vthread_register_event_unlocked(vthread, VTE_CLEAN, NULL,
+                                            vthread_closefd, VTE_DATA_FD(pipefd[1])) != 0) {
+        LOG_ERROR(vthread->log, "error vthread_register_event");
+        close(pipefd[1]);
+        close(pipefd[0]);
+        pipefd[1] = -1;
+    }
+    /* notify the thread about configuration change */
+    vthread_notify(vthread);
+    pthread_mutex_unlock(&priv->mutex);
+
+    return pipefd[1];
+}
+
+/** ignore SIGPIPE for caller if not already set or ignored */
+static int vthread_ignore_sigpipe(vthread_t * vthread) {
+    struct sigaction    sa;
+
+    if (sigaction(SIGPIPE, NULL, &sa) != 0) {
+        LOG_ERROR(vthread->log, "error sigaction(get SIGPIPE): %s", strerror(errno));
+        return -1;
+    }
+    if ((sa.sa_flags & SA_SIGINFO) == 0 && sa.sa_handler == SIG_DFL) {
+        LOG_DEBUG(vthread->log, "thread: ignore SIGPIPE for vthread_pipe_create() caller");
+        sigfillset(&sa.sa_mask);
+        sa.sa_flags = SA_RESTART;
+        sa.sa_handler = SIG_IGN;
+        if (sigaction(SIGPIPE, &sa, NULL) != 0) {
+            LOG_ERROR(vthread->log, "error sigaction(set SIGPIPE): %s", strerror(errno));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/****************************************************************************/
+static int write_nonblock(int fd, const void * buf, size_t size, unsigned int timeout_ms) {
+    int ret;
+
+    while ((ret = write(fd, buf, size)) < 0) {
+        if (errno == EINTR)
+            continue ;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            struct timeval timeout;
+            fd_set set;
+            do {
+                timeout.tv_sec = timeout_ms / 1000;
+                timeout.tv_usec = (timeout_ms % 1000) * 1000;
+                FD_ZERO(&set);
+                FD_SET(fd, &set);
+                ret = select(fd + 1, NULL, &set, NULL, &timeout);
+            } while (ret < 0 && errno == EINTR);
+            if (ret <= 0)
+                return -1;
+            continue ;
+        }
+        break ;
+    }
+    return ret;
+}
+
+/*****************************************************************************/
+ssize_t                 vthread_pipe_write(
                             vthread_t *             vthread,
                             int                         pipe_fdout,
                             const void *                data,
@@ -455,529 +1285,2658 @@ ssize_t                 vthread_pipe_write(
     ssize_t                 ret;
     size_t                  offset;
 
-    /* sanity checks */
-    if (priv == NULL) {
-        LOG_WARN(g_vlib_log, "bad thread context");
-        return -1;
+    /* sanity checks */
+    if (priv == NULL) {
+        LOG_WARN(g_vlib_log, "bad thread context");
+        return -1;
+    }
+    /* lock pipe lock */
+    /* checks whether the size exceeds PIPE_BUF */
+    if (size <= PIPE_BUF) {
+        pthread_rwlock_rdlock(&priv->pipe_mutex);
+        ret = write_nonblock(pipe_fdout, data, size, 1000);
+        pthread_rwlock_unlock(&priv->pipe_mutex);
+        return ret;
+    }
+    pthread_rwlock_wrlock(&priv->pipe_mutex);
+    for (offset = 0; offset < size; /*no incr*/ ) {
+        ret = write_nonblock(pipe_fdout, (const char *)data + offset,
+                             offset + PIPE_BUF > size ? size - offset : PIPE_BUF, 1000);
+        if (ret < 0) {
+            pthread_rwlock_unlock(&priv->pipe_mutex);
+            return ret;
+        }
+        offset += ret;
+    }
+    pthread_rwlock_unlock(&priv->pipe_mutex);
+    return offset;
+}
+
+/*****************************************************************************/
+vthread_out_t *     vthread_out_create(
+                            vthread_t *             vthread,
+                            int                     fd,
+                            size_t                  high,
+                            size_t                  low,
+                            vthread_out_callback_t  callback,
+                            void *                  callback_user_data) {
+    vthread_priv_t *    priv = vthread ? (vthread_priv_t *) vthread->priv : NULL;
+    vthread_out_t *     out;
+    int                 inloop;
+
+    if (high == 0) {
+        high = VLIB_THREAD_OUT_HIGH;
+    }
+    if (priv == NULL || fd < 0 || low >= high) {
+        LOG_WARN(g_vlib_log, "bad thread context, fd or watermarks");
+        errno = EINVAL;
+        return NULL;
+    }
+    if ((out = calloc(1, sizeof(*out))) == NULL) {
+        LOG_ERROR(vthread->log, "error: cannot malloc output queue : %s", strerror(errno));
+        return NULL;
+    }
+    out->vthread = vthread;
+    out->fd = fd;
+    out->high = high;
+    out->low = low;
+    out->callback = callback;
+    out->callback_data = callback_user_data;
+
+    /* from a callback, mutex is already locked */
+    if (!(inloop = pthread_equal(pthread_self(), vthread->tid)))
+        pthread_mutex_lock(&priv->mutex);
+
+    if ((out->next = priv->outs) != NULL)
+        out->next->pprev = &out->next;
+    out->pprev = &priv->outs;
+    priv->outs = out;
+
+    if (!inloop)
+        pthread_mutex_unlock(&priv->mutex);
+
+    return out;
+}
+
+/*****************************************************************************/
+void                vthread_out_free(
+                            vthread_out_t *         out,
+                            int                     flush) {
+    vthread_priv_t *    priv;
+    int                 inloop;
+
+    if (out == NULL) {
+        return ;
+    }
+    priv = out->vthread->priv;
+    /* from a callback, mutex is already locked */
+    if (!(inloop = pthread_equal(pthread_self(), out->vthread->tid)))
+        pthread_mutex_lock(&priv->mutex);
+
+    if (flush && out->head != NULL && out->error == 0) {
+        /* freed by the vthread once written */
+        out->flags |= VTHREAD_OUT_CLOSING;
+    } else if ((out->flags & VTHREAD_OUT_RUNNING) != 0) {
+        /* freed when vthread_out_flush() returns */
+        out->flags |= VTHREAD_OUT_FREED;
+    } else if (!inloop && (priv->state & (VTS_STARTED | VTS_FINISHED)) == VTS_STARTED) {
+        /* freed by the vthread at end of loop iteration, as release callbacks
+         * of the dropped data are called by the vthread */
+        out->flags |= VTHREAD_OUT_FREED;
+        if ((out->flags & VTHREAD_OUT_DIRTY) == 0) {
+            out->flags |= VTHREAD_OUT_DIRTY;
+            out->dirty_next = priv->outs_dirty;
+            priv->outs_dirty = out;
+            vthread_notify(out->vthread);
+        }
+    } else {
+        vthread_out_destroy(out);
+    }
+
+    if (!inloop)
+        pthread_mutex_unlock(&priv->mutex);
+}
+
+/*****************************************************************************/
+/** queue data in out, copied or referenced */
+static int              vthread_out_queue(
+                            vthread_out_t *         out,
+                            const void *            data,
+                            size_t                  size,
+                            int                     copy,
+                            vthread_out_release_t   release,
+                            void *                  release_data) {
+    vthread_priv_t *        priv;
+    vthread_out_seg_t *     seg;
+    vthread_out_callback_t  high_callback = NULL;
+    int                     inloop, ret = 0;
+
+    if (out == NULL || (data == NULL && size > 0)) {
+        errno = EINVAL;
+        return -1;
+    }
+    priv = out->vthread->priv;
+    /* from a callback, mutex is already locked */
+    if (!(inloop = pthread_equal(pthread_self(), out->vthread->tid)))
+        pthread_mutex_lock(&priv->mutex);
+
+    seg = out->tail;
+    if (out->error != 0) {
+        errno = out->error;
+        ret = -1;
+    } else if (copy && seg != NULL && seg->room >= size) {
+        /* gather small writes in the last buffer */
+        memcpy((char *) seg->data + seg->size, data, size);
+        seg->size += size;
+        seg->room -= size;
+    } else if ((seg = malloc(sizeof(*seg) + (copy ? (size > VTHREAD_OUT_CHUNK
+                                                     ? size : VTHREAD_OUT_CHUNK) : 0))) == NULL) {
+        LOG_ERROR(out->vthread->log, "error: cannot malloc output buffer : %s", strerror(errno));
+        ret = -1;
+    } else {
+        seg->next = NULL;
+        seg->size = size;
+        seg->release = release;
+        seg->release_data = release_data;
+        if ((seg->copy = copy) != 0) {
+            memcpy(seg->buf, data, size);
+            seg->data = seg->buf;
+            seg->room = (size > VTHREAD_OUT_CHUNK ? size : VTHREAD_OUT_CHUNK) - size;
+        } else {
+            seg->data = data;
+            seg->room = 0;
+        }
+        if (out->tail == NULL)
+            out->head = seg;
+        else
+            out->tail->next = seg;
+        out->tail = seg;
+    }
+    if (ret == 0) {
+        out->pending += size;
+        /* written at end of loop iteration, or when fd is writable if armed */
+        if ((out->flags & (VTHREAD_OUT_DIRTY | VTHREAD_OUT_ARMED)) == 0) {
+            out->flags |= VTHREAD_OUT_DIRTY;
+            out->dirty_next = priv->outs_dirty;
+            priv->outs_dirty = out;
+            if (!inloop)
+                vthread_notify(out->vthread);
+        }
+        if ((out->flags & VTHREAD_OUT_ABOVE) == 0 && out->pending >= out->high) {
+            out->flags |= VTHREAD_OUT_ABOVE;
+            high_callback = out->callback;
+        }
+    }
+
+    if (!inloop)
+        pthread_mutex_unlock(&priv->mutex);
+
+    if (high_callback != NULL)
+        high_callback(out, VTO_HIGH, out->callback_data);
+
+    return ret;
+}
+
+/*****************************************************************************/
+int                 vthread_out_write(
+                            vthread_out_t *         out,
+                            const void *            data,
+                            size_t                  size) {
+    return vthread_out_queue(out, data, size, 1, NULL, NULL);
+}
+
+/*****************************************************************************/
+int                 vthread_out_writeref(
+                            vthread_out_t *         out,
+                            const void *            data,
+                            size_t                  size,
+                            vthread_out_release_t   release,
+                            void *                  release_data) {
+    return vthread_out_queue(out, data, size, 0, release, release_data);
+}
+
+/*****************************************************************************/
+size_t              vthread_out_pending(
+                            vthread_out_t *         out) {
+    vthread_priv_t *    priv;
+    size_t              pending;
+    int                 inloop;
+
+    if (out == NULL) {
+        errno = EINVAL;
+        return 0;
+    }
+    priv = out->vthread->priv;
+    if (!(inloop = pthread_equal(pthread_self(), out->vthread->tid)))
+        pthread_mutex_lock(&priv->mutex);
+    pending = out->pending;
+    if (!inloop)
+        pthread_mutex_unlock(&priv->mutex);
+    return pending;
+}
+
+/*****************************************************************************/
+int                 vthread_out_error(
+                            vthread_out_t *         out) {
+    vthread_priv_t *    priv;
+    int                 error, inloop;
+
+    if (out == NULL) {
+        return EINVAL;
+    }
+    priv = out->vthread->priv;
+    if (!(inloop = pthread_equal(pthread_self(), out->vthread->tid)))
+        pthread_mutex_lock(&priv->mutex);
+    error = out->error;
+    if (!inloop)
+        pthread_mutex_unlock(&priv->mutex);
+    return error;
+}
+
+/*****************************************************************************/
+/** drop the pending data of out, under lock */
+static void vthread_out_drop(vthread_out_t * out) {
+    vthread_out_seg_t * seg;
+
+    while ((seg = out->head) != NULL) {
+        if ((out->head = seg->next) == NULL)
+            out->tail = NULL;
+        if (seg->release != NULL)
+            seg->release(seg->release_data);
+        free(seg);
+    }
+    out->pending = 0;
+}
+
+/*****************************************************************************/
+/** forget and free out, under lock */
+static void vthread_out_destroy(vthread_out_t * out) {
+    vthread_priv_t *    priv = out->vthread->priv;
+    vthread_out_t **    pout;
+
+    if ((out->flags & VTHREAD_OUT_ARMED) != 0) {
+        vthread_unregister_event_unlocked(out->vthread, VTE_FD_WRITE | VTE_RESERVED, VTE_DATA_FD(out->fd),
+                                          pthread_equal(pthread_self(), out->vthread->tid));
+    }
+    if ((out->flags & VTHREAD_OUT_DIRTY) != 0) {
+        for (pout = &priv->outs_dirty; *pout != NULL; pout = &(*pout)->dirty_next) {
+            if (*pout == out) {
+                *pout = out->dirty_next;
+                break ;
+            }
+        }
+    }
+    if ((*out->pprev = out->next) != NULL)
+        out->next->pprev = out->pprev;
+    vthread_out_drop(out);
+    free(out);
+}
+
+/*****************************************************************************/
+/** write pending data of out with writev(), under lock in the vthread */
+static void vthread_out_flush(vthread_out_t * out) {
+    struct iovec            iov[VTHREAD_OUT_IOV];
+    vthread_out_seg_t *     seg;
+    ssize_t                 n;
+    size_t                  total;
+    int                     niov;
+
+    out->flags |= VTHREAD_OUT_RUNNING;
+    while (out->head != NULL && (out->flags & VTHREAD_OUT_FREED) == 0) {
+        for (niov = 0, total = 0, seg = out->head;
+             seg != NULL && niov < VTHREAD_OUT_IOV; seg = seg->next, ++niov) {
+            iov[niov].iov_base = (void *) seg->data;
+            iov[niov].iov_len = seg->size;
+            total += seg->size;
+        }
+        if ((n = writev(out->fd, iov, niov)) < 0) {
+            if (errno == EINTR)
+                continue ;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                out->error = errno;
+                vthread_out_drop(out);
+                if (out->callback != NULL)
+                    out->callback(out, VTO_ERROR, out->callback_data);
+            }
+            break ;
+        }
+        /* release written buffers: their callbacks can queue more data */
+        out->pending -= n;
+        for (total = n; (seg = out->head) != NULL && seg->size <= total; ) {
+            total -= seg->size;
+            if ((out->head = seg->next) == NULL)
+                out->tail = NULL;
+            if (seg->release != NULL)
+                seg->release(seg->release_data);
+            free(seg);
+        }
+        if (total > 0) {
+            seg->data += total;
+            seg->size -= total;
+        }
+        if ((out->flags & VTHREAD_OUT_ABOVE) != 0 && out->pending <= out->low) {
+            out->flags &= ~VTHREAD_OUT_ABOVE;
+            if (out->callback != NULL)
+                out->callback(out, VTO_LOW, out->callback_data);
+        }
+        if (total > 0)
+            break ; /* fd is full */
+    }
+    out->flags &= ~VTHREAD_OUT_RUNNING;
+
+    if ((out->flags & VTHREAD_OUT_FREED) != 0
+    ||  ((out->flags & VTHREAD_OUT_CLOSING) != 0 && out->head == NULL)) {
+        vthread_out_destroy(out);
+    } else if (out->head != NULL && (out->flags & VTHREAD_OUT_ARMED) == 0) {
+        if (vthread_register_event_unlocked(out->vthread, VTE_FD_WRITE | VTE_RESERVED,
+                                            VTE_DATA_FD(out->fd), vthread_out_ready_cb, out) == 0) {
+            out->flags |= VTHREAD_OUT_ARMED;
+        } else {
+            out->error = errno;
+            vthread_out_drop(out);
+            if (out->callback != NULL)
+                out->callback(out, VTO_ERROR, out->callback_data);
+        }
+    } else if (out->head == NULL && (out->flags & VTHREAD_OUT_ARMED) != 0) {
+        vthread_unregister_event_unlocked(out->vthread, VTE_FD_WRITE | VTE_RESERVED,
+                                          VTE_DATA_FD(out->fd), 1);
+        out->flags &= ~VTHREAD_OUT_ARMED;
+    }
+}
+
+/*****************************************************************************/
+/** write the output queues of the vthread having new data, under lock */
+static void vthread_out_run(vthread_t * vthread) {
+    vthread_priv_t *    priv = vthread->priv;
+    vthread_out_t *     out;
+
+    while ((out = priv->outs_dirty) != NULL) {
+        priv->outs_dirty = out->dirty_next;
+        out->flags &= ~VTHREAD_OUT_DIRTY;
+        vthread_out_flush(out);
+    }
+}
+
+/*****************************************************************************/
+/** VTE_FD_WRITE callback of an output queue with data left */
+static int vthread_out_ready_cb(
+    vthread_t * vthread, vthread_event_t ev, void * ev_data, void * cb_data) {
+    (void) vthread;
+    (void) ev;
+    (void) ev_data;
+
+    vthread_out_flush((vthread_out_t *) cb_data);
+    return 0;
+}
+
+/*****************************************************************************/
+int                 vthread_stats_enable(
+                            vthread_t *             vthread,
+                            int                     enable,
+                            unsigned long           slow_us) {
+    vthread_priv_t *    priv;
+    int                 inloop, ret = 0;
+
+    if (vthread == NULL || (priv = vthread->priv) == NULL) {
+        LOG_ERROR(g_vlib_log, "bad thread context");
+        errno = EFAULT;
+        return -1;
+    }
+    if (!(inloop = pthread_equal(pthread_self(), vthread->tid)))
+        pthread_mutex_lock(&priv->mutex);
+    if (!enable) {
+        vthread_stats_free(priv);
+    } else if (priv->stats == NULL && (priv->stats = calloc(1, sizeof(*priv->stats))) == NULL) {
+        ret = -1;
+    }
+    priv->slow_us = slow_us;
+    if (!inloop)
+        pthread_mutex_unlock(&priv->mutex);
+    return ret;
+}
+
+/*****************************************************************************/
+int                 vthread_stats_get(
+                            vthread_t *             vthread,
+                            vthread_stats_t *       stats) {
+    vthread_priv_t *    priv;
+    int                 inloop, ret = 0;
+
+    if (vthread == NULL || (priv = vthread->priv) == NULL || stats == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (!(inloop = pthread_equal(pthread_self(), vthread->tid)))
+        pthread_mutex_lock(&priv->mutex);
+    if (priv->stats != NULL) {
+        *stats = *priv->stats;
+    } else {
+        errno = ENOENT;
+        ret = -1;
+    }
+    if (!inloop)
+        pthread_mutex_unlock(&priv->mutex);
+    return ret;
+}
+
+/*****************************************************************************/
+int                 vthread_stats_fd(
+                            vthread_t *             vthread,
+                            int                     fd,
+                            vthread_kind_t          kind,
+                            vthread_hist_t *        hist) {
+    vthread_priv_t *    priv;
+    int                 inloop, ret = 0;
+
+    if (vthread == NULL || (priv = vthread->priv) == NULL || hist == NULL
+    ||  fd < 0 || kind < 0 || kind >= VTK_FD_NB) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (!(inloop = pthread_equal(pthread_self(), vthread->tid)))
+        pthread_mutex_lock(&priv->mutex);
+    if (priv->stats != NULL && fd < priv->nfds && priv->fds[fd].stats != NULL) {
+        *hist = priv->fds[fd].stats[kind];
+    } else {
+        errno = ENOENT;
+        ret = -1;
+    }
+    if (!inloop)
+        pthread_mutex_unlock(&priv->mutex);
+    return ret;
+}
+
+/*****************************************************************************/
+void                vthread_stats_reset(
+                            vthread_t *             vthread) {
+    vthread_priv_t *    priv;
+    int                 inloop;
+
+    if (vthread == NULL || (priv = vthread->priv) == NULL) {
+        return ;
+    }
+    if (!(inloop = pthread_equal(pthread_self(), vthread->tid)))
+        pthread_mutex_lock(&priv->mutex);
+    if (priv->stats != NULL) {
+        memset(priv->stats, 0, sizeof(*priv->stats));
+        for (int fd = 0; fd < priv->nfds; ++fd) {
+            if (priv->fds[fd].stats != NULL)
+                memset(priv->fds[fd].stats, 0, VTK_FD_NB * sizeof(*priv->fds[fd].stats));
+        }
+    }
+    if (!inloop)
+        pthread_mutex_unlock(&priv->mutex);
+}
+
+/*****************************************************************************/
+uint64_t            vthread_hist_percentile(
+                            const vthread_hist_t *  hist,
+                            unsigned int            percent) {
+    uint64_t    rank, count = 0;
+
+    if (hist == NULL || hist->count == 0) {
+        return 0;
+    }
+    rank = (hist->count * (percent > 100 ? 100 : percent) + 99) / 100;
+    for (unsigned int i = 0; i < VTHREAD_HIST_BUCKETS - 1; ++i) {
+        if ((count += hist->buckets[i]) >= rank && count > 0)
+            return (1ULL << i) < hist->max_us ? (1ULL << i) : hist->max_us;
+    }
+    return hist->max_us;
+}
+
+/*****************************************************************************/
+/** free the statistics, under lock */
+static void vthread_stats_free(vthread_priv_t * priv) {
+    for (int fd = 0; fd < priv->nfds; ++fd) {
+        if (priv->fds[fd].stats != NULL) {
+            free(priv->fds[fd].stats);
+            priv->fds[fd].stats = NULL;
+        }
+    }
+    if (priv->stats != NULL) {
+        free(priv->stats);
+        priv->stats = NULL;
+    }
+}
+
+/*****************************************************************************/
+static void vthread_hist_add(vthread_hist_t * hist, uint64_t us) {
+    unsigned int bucket = 0;
+
+#   if defined(__GNUC__) || defined(__clang__)
+    if (us != 0)
+        bucket = 64 - __builtin_clzll(us);
+#   else
+    for (uint64_t v = us; v != 0; v >>= 1)
+        ++bucket;
+#   endif
+    ++hist->count;
+    hist->total_us += us;
+    if (us > hist->max_us)
+        hist->max_us = us;
+    ++hist->buckets[bucket < VTHREAD_HIST_BUCKETS ? bucket : VTHREAD_HIST_BUCKETS - 1];
+}
+
+/*****************************************************************************/
+static vthread_kind_t vthread_event_kind(vthread_event_t event) {
+    switch (event) {
+        case VTE_FD_READ:   return VTK_FD_READ;
+        case VTE_FD_WRITE:  return VTK_FD_WRITE;
+        case VTE_FD_ERR:    return VTK_FD_ERR;
+        case VTE_IO_READ:   return VTK_IO_READ;
+        case VTE_IO_WRITE:  return VTK_IO_WRITE;
+        case VTE_IO_ACCEPT: return VTK_IO_ACCEPT;
+        case VTE_TIMER:     return VTK_TIMER;
+        case VTE_MSG:       return VTK_MSG;
+        case VTE_SIG:       return VTK_SIG;
+        default:            return VTK_OTHER;
+    }
+}
+
+/*****************************************************************************/
+/** call an event callback, measuring it if statistics are enabled, under lock.
+ * The callbacks of vthread internal events are not measured, as they call
+ * other callbacks (messages, I/O completions) or do the vthread work. */
+static int vthread_call(
+                    vthread_t *             vthread,
+                    vthread_callback_t      callback,
+                    vthread_event_t         event,
+                    void *                  event_data,
+                    void *                  callback_data) {
+    static const char * const   kind_names[VTK_NB] = {
+        "fd read", "fd write", "fd err", "io read", "io write", "io accept",
+        "timer", "msg", "signal", "other" };
+    vthread_priv_t *            priv = vthread->priv;
+    vthread_stats_t *           stats;
+    vthread_kind_t              kind;
+    uint64_t                    start, us;
+    int                         ret, fd = -1;
+
+    if (priv->stats == NULL
+    ||  callback == vthread_wakeup_cb || callback == vthread_io_ready_cb
+    ||  callback == vthread_out_ready_cb
+#   ifdef VLIB_THREAD_SIGNALFD
+    ||  callback == vthread_signalfd_cb
+#   endif
+    ) {
+        return callback(vthread, event, event_data, callback_data);
+    }
+    start = vthread_clock_us();
+    ret = callback(vthread, event, event_data, callback_data);
+    us = vthread_clock_us() - start;
+
+    /* the callback can disable statistics */
+    if ((stats = priv->stats) == NULL) {
+        return ret;
+    }
+    kind = vthread_event_kind(event);
+    vthread_hist_add(&stats->callbacks[kind], us);
+    if (kind <= VTK_FD_ERR) {
+        fd = VTE_FD_DATA(event_data);
+    } else if (kind < VTK_FD_NB) {
+        fd = ((vthread_io_t *) event_data)->fd;
+    }
+    if (fd >= 0 && fd < priv->nfds
+    &&  (priv->fds[fd].stats != NULL
+         || (priv->fds[fd].stats = calloc(VTK_FD_NB, sizeof(*priv->fds[fd].stats))) != NULL)) {
+        vthread_hist_add(&priv->fds[fd].stats[kind], us);
+    }
+    if (priv->slow_us != 0 && us > priv->slow_us) {
+        ++stats->slow;
+        /* at most one warning per second, telling the ones not logged */
+        if (start < priv->slow_warned + 1000000ULL && priv->slow_warned != 0) {
+            ++priv->slow_skipped;
+        } else {
+            LOG_WARN(vthread->log, "thread: slow %s callback %#lx (fd %d, data %p): "
+                     "%lu.%03lu ms (%lu more since last warning)",
+                     kind_names[kind], (unsigned long) callback, fd, callback_data,
+                     (unsigned long) (us / 1000), (unsigned long) (us % 1000),
+                     priv->slow_skipped);
+            priv->slow_warned = start;
+            priv->slow_skipped = 0;
+        }
+    }
+    return ret;
+}
+
+/* ************************************************************************ */
+void vthread_testkill() {
+    vjob_testkill();
+}
+
+/* ************************************************************************ */
+int vthread_killmode(int enable, int async, int *old_enable, int *old_async) {
+     return vjob_killmode(enable, async, old_enable, old_async);
+}
+
+/*****************************************************************************/
+/** create the fd waking up the loop: an eventfd if available, or a pipe */
+static int vthread_wakeup_create(vthread_t * vthread) {
+    vthread_priv_t *    priv = vthread->priv;
+#   ifdef VLIB_THREAD_EVENTFD
+    int                 fd, ret;
+
+    if ((fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) >= 0) {
+        pthread_mutex_lock(&priv->mutex);
+        ret = vthread_register_event_unlocked(vthread, VTE_FD_READ, VTE_DATA_FD(fd),
+                                              vthread_wakeup_cb, NULL);
+        pthread_mutex_unlock(&priv->mutex);
+        if (ret != 0) {
+            close(fd);
+            return -1;
+        }
+        priv->control_fd = fd;
+        priv->control_efd = 1;
+        return 0;
+    }
+    LOG_VERBOSE(vthread->log, "thread: eventfd(): %s, using a pipe", strerror(errno));
+#   endif
+    if ((priv->control_fd = vthread_pipe_create(vthread, vthread_wakeup_cb, NULL)) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+/*****************************************************************************/
+/** wake up the loop. The control fd is written only if it was read since
+ * the last wakeup, so that a burst of wakeups costs one write */
+static int vthread_wakeup(vthread_priv_t * priv) {
+    ssize_t ret;
+
+    if (VLIB_ATOMIC_XCHG(&priv->wakeup, 1) != 0) {
+        return 0;
+    }
+#   ifdef VLIB_THREAD_EVENTFD
+    if (priv->control_efd) {
+        uint64_t one = 1;
+        while ((ret = write(priv->control_fd, &one, sizeof(one))) < 0 && errno == EINTR)
+            ; /* loop on EINTR */
+    } else
+#   endif
+    {
+        char c = 0;
+        while ((ret = write(priv->control_fd, &c, sizeof(c))) < 0 && errno == EINTR)
+            ; /* loop on EINTR */
+    }
+    /* a full pipe will wake up the loop anyway */
+    if (ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+        VLIB_ATOMIC_STORE(&priv->wakeup, 0);
+        return -1;
+    }
+    return 0;
+}
+
+/*****************************************************************************/
+static int vthread_wakeup_cb(
+    vthread_t * vthread, vthread_event_t ev, void * ev_data, void * cb_data) {
+
+    vthread_priv_t *    priv = vthread->priv;
+    char                buf[64];
+    ssize_t             n;
+    (void)              cb_data;
+
+    if (ev == VTE_FD_READ) {
+        /* clear the flag before reading, so as a later wakeup is not lost */
+        VLIB_ATOMIC_STORE(&priv->wakeup, 0);
+        while ((n = read(VTE_FD_DATA(ev_data), buf, sizeof(buf))) > 0
+               || (n < 0 && errno == EINTR))
+            ; /* empty the pipe, or reset the eventfd counter */
+        vthread_msg_run(vthread);
+    }
+    // non negative value will just stop the select() loop,
+    // register/unregister events, check thread state, then re-loop.
+    return 0;
+}
+
+/*****************************************************************************/
+/** call the callbacks of posted messages in posting order, under lock */
+static void vthread_msg_run(vthread_t * vthread) {
+    vthread_priv_t *    priv = vthread->priv;
+    vthread_msg_t *     msgs, * fifo = NULL, * next;
+
+    /* take all messages at once, the stack being in reverse posting order */
+    for (msgs = VLIB_ATOMIC_XCHG(&priv->msgs, NULL); msgs != NULL; msgs = next) {
+        next = msgs->next;
+        msgs->next = fifo;
+        fifo = msgs;
+    }
+    for ( ; fifo != NULL; fifo = next) {
+        next = fifo->next;
+        if (vthread_call(vthread, fifo->callback, VTE_MSG, fifo->msg, fifo->callback_data) < 0)
+            priv->state |= VTS_EXIT_REQUESTED;
+        free(fifo);
+    }
+}
+
+/*****************************************************************************/
+static void vthread_body_cleanup(void * data) {
+    vthread_t *         vthread = (vthread_t *) data;
+    vthread_priv_t *    priv    = vthread ? (vthread_priv_t *) vthread->priv : NULL;
+    int                 ret;
+
+    if (priv == NULL) {
+        LOG_WARN(vthread->log, "thread: shutdown: bad context, cannot clean up");
+        return ;
+    }
+
+    LOG_VERBOSE(vthread->log, "thread: shutting down");
+
+    if ((priv->state & VTS_WAITING) != 0) {
+        if ((priv->state & VTS_STARTED) != 0) {
+            ret = pthread_mutex_lock(&(priv->mutex)); // we were interrupted by pthread_cancel while mutex not locked
+        } else {
+            // we were interrupted by pthread_cancel in pthread_cond_wait(). At least on macOS, pthread_testcancel()
+            // in pthread_cond_wait can be called before the cond mutex is unlocked, that's whe we trylock.
+            ret = pthread_mutex_trylock(&(priv->mutex));
+        }
+    } else {
+        ret = 0;
+    }
+    (void)ret;
+    LOG_DEBUG(vthread->log, "thread: state: %x, result: %lx, lockret: %d",
+              priv->state, (unsigned long)((size_t)vthread->result), ret);
+
+    priv->state = (priv->state & ~(VTS_RUNNING|VTS_WAITING)) | VTS_FINISHING;
+
+    if ((priv->state & VTS_STARTED) != 0) {
+        for (vthread_event_data_t * data = priv->events; data != NULL; data = data->next) {
+            if (data->callback != NULL && (data->event & VTE_CLEAN) != 0) {
+                vthread_call(vthread, data->callback, VTE_CLEAN, data->ev.ptr,
+                             data->callback_data);
+            }
+            if ((data->event & (VTE_FD_CLOSE)) != 0) {
+                close(data->ev.fd);
+            }
+        }
+    }
+
+    priv->state = (priv->state & ~VTS_FINISHING) | VTS_FINISHED;
+    pthread_mutex_unlock(&priv->mutex);
+
+    LOG_DEBUG(vthread->log, "vthread cleanup: exiting (result:%lx)",
+              (unsigned long)((size_t)vthread->result));
+}
+
+/*****************************************************************************/
+static void * vthread_body(void * data) {
+    static const int        blocked_sigs[] = {
+        SIGHUP, SIGINT, /*SIGPIPE,*/ SIGALRM, SIGTSTP, SIGTERM, SIGVTALRM, SIGPROF, SIGUSR1, SIGUSR2 };
+    vthread_t *             vthread = (vthread_t *) data;
+    vthread_priv_t *        priv = vthread ? (vthread_priv_t *) vthread->priv : NULL;
+    fd_set                  readfds, writefds, errfds;
+    struct sigaction        sa;
+    int                     select_ret, select_errno, ret;
+    volatile int            fd_max = -1;
+    sig_atomic_t            last_signal;
+    int                     thread_cancel_state;
+    uint64_t                now_ms, next_ms;
+    uint64_t                wait_start = 0;
+    volatile uint64_t       wait_end = 0;
+    long                    wait_ms;
+#   ifndef VLIB_THREAD_PSELECT
+    struct timeval          select_timeout, * p_select_timeout;
+    sigset_t                sigset_bak;
+#   else
+    struct timespec         select_timeout, * p_select_timeout;
+#   endif
+
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+    pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, NULL);
+
+    if (priv == NULL) {
+        LOG_ERROR(g_vlib_log, "bad thread context");
+        errno = EFAULT;
+        return VTHREAD_RESULT_ERROR;
+    }
+    LOG_VERBOSE(vthread->log, "thread: initializing");
+    pthread_mutex_lock(&priv->mutex);
+
+    if ((priv->state & VTS_EXIT_REQUESTED) != 0) {
+        LOG_VERBOSE(vthread->log, "thread: exit requested before start -> exit");
+        priv->state = VTS_FINISHED;
+        pthread_cond_signal(&priv->cond);
+        pthread_mutex_unlock(&priv->mutex);
+        return vthread->result;
+    }
+
+    // block 'user' signals which terminate the program.
+    // (note: block_sigset emptied in vthread_create())
+    for (size_t i = 0; i < PTR_COUNT(blocked_sigs); ++i) {
+        int sig = blocked_sigs[i];
+        //if SIG{INT,PROF,TERM} have default handler, do not block them.
+        if ((sig == SIGINT || sig == SIGPROF || sig == SIGTERM)
+        &&  sigaction(sig, NULL, &sa) == 0 && sa.sa_handler == SIG_DFL) {
+            continue ;
+        }
+        sigaddset(&priv->block_sigset, sig);
+    }
+    pthread_sigmask(SIG_SETMASK, &priv->block_sigset, NULL);
+
+    /* ignore SIGPIPE */
+    if (vthread_ignore_sigpipe(vthread) != 0) {
+        int errno_save = errno;
+        priv->state = VTS_FINISHED | VTS_ERROR;
+        pthread_cond_signal(&priv->cond);
+        pthread_mutex_unlock(&priv->mutex);
+        errno = errno_save;
+        return VTHREAD_RESULT_ERROR;
+    }
+
+    /* from now pthread_cancel() when enabled will call vthread_body_cleanup() */
+    pthread_cleanup_push(vthread_body_cleanup, vthread);
+
+    /* notify vthread_start() we are ready,
+     * and WAIT for vthread_start() and signal back just before loop starts.
+     * This allows call to vthread_{register_event} before start */
+    LOG_VERBOSE(vthread->log, "thread: waiting for launch");
+    priv->state = (priv->state & ~VTS_CREATING) | VTS_CREATED;
+    pthread_cond_signal(&priv->cond);
+    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+    priv->state |= VTS_WAITING;
+    select_ret = pthread_cond_wait(&priv->cond, &priv->mutex);
+    priv->state &= ~VTS_WAITING;
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+    pthread_cleanup_pop(0);
+
+    LOG_DEBUG(vthread->log, "pthread_cond_wait exit ret=%d state=%d",
+              select_ret, priv->state);
+
+    if ((priv->state & VTS_EXIT_REQUESTED) != 0) {
+        LOG_VERBOSE(vthread->log, "thread: exit requested before start -> exit");
+        priv->state |= VTS_FINISHED;
+        pthread_mutex_unlock(&priv->mutex);
+        return vthread->result;
+    }
+    pthread_cleanup_push(vthread_body_cleanup, vthread);
+    priv->state |= VTS_STARTED;
+    vthread->result = VTHREAD_RESULT_OK;
+
+    /* call the VTE_INIT callbacks just before starting select loop */
+    for (vthread_event_data_t * data = priv->events; data != NULL; data = data->next) {
+        if (data != NULL && data->callback != NULL && (data->event & VTE_INIT) != 0) {
+            ret = vthread_call(vthread, data->callback, VTE_INIT, data->ev.ptr, data->callback_data);
+            if (ret < 0)
+                priv->state |= VTS_EXIT_REQUESTED;
+        }
+    }
+#   ifdef VLIB_THREAD_URING
+    if (priv->backend == VTB_URING && vthread_uring_init(vthread) != 0) {
+        LOG_WARN(vthread->log, "thread: cannot use io_uring: %s", strerror(errno));
+    }
+#   endif
+#   ifdef VLIB_THREAD_EPOLL
+    if (priv->backend != VTB_SELECT && priv->uring == NULL && vthread_epoll_init(vthread) != 0) {
+        LOG_WARN(vthread->log, "thread: cannot use epoll, using select: %s", strerror(errno));
+    }
+#   endif
+    priv->state |= VTS_RUNNING;
+    LOG_VERBOSE(vthread->log, "thread: launched (%s)",
+                priv->uring != NULL ? "io_uring" : (priv->epfd >= 0 ? "epoll" : "select"));
+
+    while ((priv->state & (VTS_RUNNING | VTS_EXIT_REQUESTED)) == VTS_RUNNING) {
+        /* run the expired timers, and get the wait timeout from the next one */
+        now_ms = vthread_clock_ms();
+        vthread_timer_run(vthread, now_ms);
+        /* write the data queued by callbacks since last iteration */
+        vthread_out_run(vthread);
+        if ((priv->state & VTS_EXIT_REQUESTED) != 0) {
+            break ;
+        }
+        wait_ms = priv->process_timeout == 0 ? -1
+                  : (priv->process_timeout > LONG_MAX ? LONG_MAX : (long) priv->process_timeout);
+        if ((next_ms = vthread_timer_next(priv)) != UINT64_MAX) {
+            next_ms = next_ms > now_ms ? next_ms - now_ms : 0;
+            if (wait_ms < 0 || next_ms < (uint64_t) wait_ms)
+                wait_ms = (long) next_ms;
+        }
+        priv->timer_wait = wait_ms < 0 ? UINT64_MAX : now_ms + wait_ms;
+        if (priv->purge) {
+            vthread_event_purge(vthread);
+        }
+#      ifdef VLIB_THREAD_SIGNALFD
+        if (priv->sig_update) {
+            vthread_signalfd_update(vthread);
+        }
+#      endif
+        /* with select, fill the read, write, err fdsets, and manage new registered signals.
+         * epoll gets fd changes on registration */
+        FD_ZERO(&readfds);
+        FD_ZERO(&writefds);
+        FD_ZERO(&errfds);
+        if (priv->epfd < 0 && priv->uring == NULL) for (vthread_event_data_t * data = priv->events; data != NULL; data = data->next) {
+            if (data != NULL) {
+                /* fds from FD_SETSIZE registered for another backend, before its fallback to select */
+                if ((data->event & VTE_FD_EVENTS) != 0 && data->ev.fd >= FD_SETSIZE) {
+                    continue ;
+                }
+                if ((data->event & VTE_FD_READ) != 0) {
+                    FD_SET(data->ev.fd, &readfds); if (data->ev.fd > fd_max) fd_max = data->ev.fd;
+                }
+                if ((data->event & VTE_FD_WRITE) != 0) {
+                    FD_SET(data->ev.fd, &writefds); if (data->ev.fd > fd_max) fd_max = data->ev.fd;
+                }
+                if ((data->event & VTE_FD_ERR) != 0) {
+                    FD_SET(data->ev.fd, &errfds); if (data->ev.fd > fd_max) fd_max = data->ev.fd;
+                }
+                if ((data->event & VTE_SIG) != 0 && priv->sigfd < 0
+                &&  sigismember(&priv->block_sigset, data->ev.sig)) {
+                    sigdelset(&priv->block_sigset, data->ev.sig);
+                }
+            }
+        }
+        if ((priv->state & VTS_ERROR) != 0) {
+            break ;
+        }
+
+        /* set select timeout */
+        if (wait_ms >= 0) {
+            p_select_timeout = &select_timeout;
+            p_select_timeout->tv_sec = wait_ms / 1000;
+#           ifndef VLIB_THREAD_PSELECT
+            p_select_timeout->tv_usec = (wait_ms % 1000) * 1000;
+#           else
+            /* even if pselect does not modify the timespec, we allow dynamic timeout value */
+            p_select_timeout->tv_nsec = (wait_ms % 1000) * 1000000;
+#           endif
+        } else {
+            p_select_timeout = NULL;
+        }
+
+        /* -------------------------------------------- */
+        LOG_DEBUG(vthread->log, "start select timeout=%ld", wait_ms);
+
+        if ((wait_start = priv->stats != NULL ? vthread_clock_us() : 0) != 0 && wait_end != 0) {
+            vthread_hist_add(&priv->stats->run, wait_start - wait_end);
+        }
+        priv->state |= VTS_WAITING;
+
+#      ifdef VLIB_THREAD_URING
+        if (priv->uring != NULL) {
+            pthread_mutex_unlock(&priv->mutex);
+            pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &thread_cancel_state);
+            pthread_testcancel();
+
+            select_ret = vthread_uring_wait(priv, wait_ms);
+            last_signal = s_last_signal;
+            select_errno = errno;
+        } else
+#      endif
+#      ifdef VLIB_THREAD_EPOLL
+        if (priv->epfd >= 0) {
+            int timeout_ms = priv->fd_always >= 0 ? 0 : (wait_ms > INT_MAX ? INT_MAX : (int) wait_ms);
+
+            pthread_mutex_unlock(&priv->mutex);
+            pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &thread_cancel_state);
+            pthread_testcancel();
+
+            select_ret = epoll_pwait(priv->epfd, priv->ep_events, VTHREAD_EPOLL_EVENTS,
+                                     timeout_ms, &priv->block_sigset);
+            last_signal = s_last_signal;
+            select_errno = errno;
+        } else
+#      endif
+#      ifndef VLIB_THREAD_PSELECT
+        {
+            pthread_sigmask(SIG_SETMASK, &priv->block_sigset, &sigset_bak);
+            pthread_mutex_unlock(&priv->mutex);
+            pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &thread_cancel_state);
+            pthread_testcancel();
+
+            select_ret = select(fd_max + 1, &readfds, &writefds, &errfds, p_select_timeout);
+
+            last_signal = s_last_signal;
+            select_errno = errno;
+            pthread_sigmask(SIG_SETMASK, &sigset_bak, NULL);
+        }
+#      else
+        {
+            pthread_mutex_unlock(&priv->mutex);
+            pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &thread_cancel_state);
+            pthread_testcancel();
+
+            select_ret = pselect(fd_max + 1, &readfds, &writefds, &errfds,
+                                 p_select_timeout, &priv->block_sigset);
+            last_signal = s_last_signal;
+            select_errno = errno;
+        }
+#      endif
+
+        pthread_testcancel();
+        pthread_setcancelstate(thread_cancel_state, NULL);
+        pthread_mutex_lock(&priv->mutex);
+
+        LOG_DEBUG(vthread->log, "select return %d errno %d %s",
+                  select_ret, select_errno, select_errno ? strerror(select_errno) : "");
+
+        priv->state &= ~VTS_WAITING;
+        LOG_DEBUG(vthread->log, "mutex relocked, cancelstate %d", thread_cancel_state);
+        if ((wait_end = priv->stats != NULL ? vthread_clock_us() : 0) != 0) {
+            ++priv->stats->loops;
+            if (wait_start != 0)
+                vthread_hist_add(&priv->stats->wait, wait_end - wait_start);
+        }
+        /* -------------------------------------------- */
+
+        /* we have just been released by select, call callbacks with select result
+         * and update pthread_sigmask in case of configuration change */
+        if (priv->nprocess > 0) for (vthread_event_data_t * data = priv->events; data != NULL; data = data->next) {
+            if (data != NULL && data->callback != NULL
+            && (data->event & VTE_PROCESS_START) != 0) {
+                ret = vthread_call(vthread, data->callback, VTE_PROCESS_START,
+                                   (void *)((long) select_ret), data->callback_data);
+                if (ret < 0)
+                    priv->state |= VTS_EXIT_REQUESTED;
+            }
+        }
+
+#      ifdef VLIB_THREAD_EPOLL
+        /* fds epoll cannot watch are always ready, as with select() */
+        if (priv->epfd >= 0 && select_ret >= 0 && priv->fd_always >= 0) {
+            vthread_epoll_always_dispatch(vthread);
+        }
+#      endif
+        if (select_ret == 0) {
+            LOG_VERBOSE(vthread->log, "thread: select timeout");
+            continue ;
+        }
+        if (select_ret < 0 && select_errno == EINTR) {
+            LOG_VERBOSE(vthread->log, "thread: interrupted by signal: %s", strsignal(last_signal));
+            /* check callbacks registered to signal, with signalfd they are not delivered here */
+            if (priv->sigfd < 0)
+                vthread_sig_dispatch(vthread, last_signal);
+            continue ;
+        }
+        if (select_ret < 0) {
+            LOG_VERBOSE(vthread->log, "thread: select error: %s", strerror(select_errno));
+            priv->state |= VTS_ERROR;
+            break ;
+        }
+#      ifdef VLIB_THREAD_URING
+        if (priv->uring != NULL) {
+            vthread_uring_dispatch(vthread);
+            continue ;
+        }
+#      endif
+#      ifdef VLIB_THREAD_EPOLL
+        if (priv->epfd >= 0) {
+            vthread_epoll_dispatch(vthread, select_ret);
+            continue ;
+        }
+#      endif
+        for (vthread_event_data_t * data = priv->events; data != NULL; data = data->next) {
+            if (data != NULL && (data->event & VTE_FD_EVENTS) != 0) {
+                vthread_fd_dispatch(vthread, data,
+                                    (FD_ISSET(data->ev.fd, &readfds) ? VTE_FD_READ : 0)
+                                    | (FD_ISSET(data->ev.fd, &writefds) ? VTE_FD_WRITE : 0)
+                                    | (FD_ISSET(data->ev.fd, &errfds) ? VTE_FD_ERR : 0));
+            }
+        }
+        /*
+        if (priv->process_end) {
+            ret = priv->process_end(vthread, VTE_PROCESS_END,
+                                    (void *) select_ret, priv->callback_data);
+        }*/
+    } // ! while(running)
+
+    // shutting down, generate VTE_CLEAN events, set finished state, unlock mutex
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+    pthread_cleanup_pop(0);
+
+    vthread_body_cleanup(vthread);
+
+    if (vthread->result == VTHREAD_RESULT_ERROR && errno != 0) {
+        errno = 0;
+    }
+
+    return vthread->result;
+}
+
+/*****************************************************************************/
+static int                      vthread_closefd(
+                                    vthread_t *             vthread,
+                                    vthread_event_t         event,
+                                    void *                      event_data,
+                                    void *                      callback_user_data) {
+    int fd = (int)((long) callback_user_data);
+    (void) vthread;
+    (void) event;
+    (void) event_data;
+
+    return close(fd);
+}
+
+/*****************************************************************************/
+static void vthread_ctx_destroy(vthread_t * vthread) {
+    if (vthread == NULL)
+        return ;
+    vthread_priv_t  * priv = (vthread_priv_t *) vthread->priv;
+    if (priv) {
+        while (priv->events != NULL) {
+            vthread_event_data_t * data = priv->events;
+            priv->events = data->next;
+            free(data);
+        }
+        while (priv->outs != NULL) {
+            vthread_out_t * out = priv->outs;
+            priv->outs = out->next;
+            vthread_out_drop(out);
+            free(out);
+        }
+        for (int slot = 0; slot < VTHREAD_TIMER_LEVELS * VTHREAD_TIMER_SLOTS; ++slot) {
+            vthread_timer_t * timer, * next;
+            for (timer = priv->timers[slot]; timer != NULL; timer = next) {
+                next = timer->next;
+                free(timer);
+            }
+        }
+        if (priv->timer_refs != NULL)
+            free(priv->timer_refs);
+        pthread_mutex_destroy(&priv->mutex);
+        pthread_rwlock_destroy(&priv->pipe_mutex);
+        pthread_cond_destroy(&priv->cond);
+        if (priv->control_fd >= 0)
+            close(priv->control_fd);
+        while (priv->msgs != NULL) {
+            vthread_msg_t * msg = priv->msgs;
+            priv->msgs = msg->next;
+            free(msg);
+        }
+        while (priv->io_reqs != NULL) {
+            vthread_io_req_t * req = priv->io_reqs;
+            priv->io_reqs = req->next;
+            free(req);
+        }
+        if (priv->io_buf != NULL)
+            free(priv->io_buf);
+#       ifdef VLIB_THREAD_URING
+        vthread_uring_free(priv->uring);
+#       endif
+        vthread_stats_free(priv);
+        if (priv->fds != NULL)
+            free(priv->fds);
+#       ifdef VLIB_THREAD_EPOLL
+        if (priv->epfd >= 0)
+            close(priv->epfd);
+        if (priv->ep_events != NULL)
+            free(priv->ep_events);
+#       endif
+        vthread->priv = NULL;
+        free(priv);
+    }
+    free(vthread);
+}
+
+/*****************************************************************************/
+/** signal the running thread about configuration change
+ * must be called under lock */
+static int vthread_notify(vthread_t * vthread) {
+    vthread_priv_t * priv = vthread->priv;
+
+    if ((priv->state & VTS_RUNNING) != 0 && vthread_wakeup(priv) != 0) {
+        LOG_ERROR(vthread->log, "error: control_fd write: %s", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/*****************************************************************************/
+static int          vthread_register_event_unlocked(
+                            vthread_t *             vthread,
+                            vthread_event_t         event,
+                            void *                  event_data,
+                            vthread_callback_t      callback,
+                            void *                  callback_user_data) {
+    vthread_priv_t *        priv = vthread->priv;
+    vthread_event_data_t *  ev;
+
+    if ((ev = malloc(sizeof(vthread_event_data_t))) == NULL) {
+        LOG_ERROR(vthread->log, "error: cannot malloc event_data : %s", strerror(errno));
+        return -1;
+    }
+    ev->event = event;
+    ev->registered = event;
+    ev->callback = callback;
+    ev->callback_data = callback_user_data;
+    ev->fd_next = NULL;
+
+    if ((event & (VTE_FD_READ | VTE_FD_WRITE | VTE_FD_ERR | VTE_FD_CLOSE)) != 0) {
+        ev->ev.fd = (int)((ssize_t) event_data);
+    } else if ((event & VTE_SIG) != 0) {
+        ev->ev.sig = (int)((ssize_t) event_data);
+    } else {
+        ev->ev.ptr = event_data;
+    }
+
+    if ((event & VTE_SIG) != 0) {
+        // we could have a global s_SIG_STATE[NSIG] with sa_bak and use_count
+        // with backup in sa_bak and incr of use_count on register.
+        struct sigaction sa;
+
+        if (sigaction(ev->ev.sig, NULL, &sa) == 0 && (sa.sa_flags & SA_SIGINFO) == 0
+        && sa.sa_handler != vthread_sig_handler && sa.sa_handler != SIG_DFL) {
+            LOG_WARN(vthread->log, "warning the signal %d handler is already handled", ev->ev.sig);
+        }
+        sigfillset(&sa.sa_mask);
+        sa.sa_handler = vthread_sig_handler;
+        sa.sa_flags = SA_RESTART;
+        if (sigaction(ev->ev.sig, &sa, NULL) != 0) {
+            LOG_ERROR(vthread->log, "sigaction() error, event %u (%lx): %s",
+                    event, (unsigned long) event_data, strerror(errno));
+            free(ev);
+            return -1;
+        }
+        if (priv->sigfd < 0)
+            sigdelset(&priv->block_sigset, ev->ev.sig);
+        priv->sig_update = 1;
+    }
+    if ((event & (VTE_FD_EVENTS | VTE_FD_CLOSE)) != 0 && vthread_fd_link(vthread, ev) != 0) {
+        free(ev);
+        return -1;
+    }
+
+    /* prepended: not seen by an iteration of the event list in progress */
+    if ((ev->next = priv->events) != NULL)
+        ev->next->pprev = &ev->next;
+    ev->pprev = &priv->events;
+    priv->events = ev;
+    if ((event & VTE_PROCESS_START) != 0) {
+        ++priv->nprocess;
+    }
+
+    return 0;
+}
+
+/****************************************************************************/
+static int vthread_event_cmp(const void * vev1, const void * vev2) {
+    const vthread_event_data_t * ev1 = (const vthread_event_data_t *) vev1;
+    const vthread_event_data_t * ev2 = (const vthread_event_data_t *) vev2;
+
+    if (!ev1 || !ev2)
+        return ev1 - ev2;
+    if (ev1->event != ev2->event)
+        return ev1->event - ev2->event;
+
+    if ((ev1->event & (VTE_FD_READ | VTE_FD_WRITE | VTE_FD_ERR | VTE_FD_CLOSE)) != 0) {
+        return ev1->ev.fd - ev2->ev.fd;
+    } else if ((ev1->event & VTE_SIG) != 0) {
+        return ev1->ev.sig - ev2->ev.sig;
+    }
+    return (char*)ev1->ev.ptr - (char*)ev2->ev.ptr;
+}
+
+/*****************************************************************************/
+/** remove events disabled while iterating on the event list, under lock */
+static void vthread_event_purge(vthread_t * vthread) {
+    vthread_priv_t *        priv = vthread->priv;
+    vthread_event_data_t *  data;
+
+    while ((data = priv->purge) != NULL) {
+        priv->purge = data->purge_next;
+        vthread_event_remove(vthread, data);
+    }
+}
+
+/*****************************************************************************/
+/** disable an event, queued to be removed on next loop, under lock */
+static void vthread_event_disable(vthread_priv_t * priv, vthread_event_data_t * data) {
+    /* a disabled event is already queued */
+    if (data->event != VTE_NONE) {
+        data->event = VTE_NONE;
+        data->purge_next = priv->purge;
+        priv->purge = data;
+    }
+}
+
+/*****************************************************************************/
+/** find a registered event, fd events being looked up among the events of their fd,
+ * under lock */
+static vthread_event_data_t * vthread_event_find(
+                                    vthread_priv_t *        priv,
+                                    const vthread_event_data_t * ev) {
+    vthread_event_data_t * data;
+
+    if ((ev->event & (VTE_FD_READ | VTE_FD_WRITE | VTE_FD_ERR | VTE_FD_CLOSE)) != 0) {
+        if (ev->ev.fd < 0 || ev->ev.fd >= priv->nfds) {
+            return NULL;
+        }
+        for (data = priv->fds[ev->ev.fd].events; data != NULL; data = data->fd_next) {
+            if (vthread_event_cmp(data, ev) == 0)
+                return data;
+        }
+        return NULL;
+    }
+    for (data = priv->events; data != NULL; data = data->next) {
+        if (vthread_event_cmp(data, ev) == 0)
+            return data;
+    }
+    return NULL;
+}
+
+/*****************************************************************************/
+/** remove an event from the event list and free it, under lock */
+static void vthread_event_remove(vthread_t * vthread, vthread_event_data_t * data) {
+    if ((*data->pprev = data->next) != NULL)
+        data->next->pprev = data->pprev;
+    vthread_event_unlink(vthread, data);
+    free(data);
+}
+
+/*****************************************************************************/
+/** update the backend interest of fd, under lock */
+static int vthread_fd_update(vthread_t * vthread, int fd) {
+    vthread_priv_t *        priv = vthread->priv;
+    vthread_fd_t *          vfd = &priv->fds[fd];
+    vthread_event_data_t *  ev;
+    unsigned int            mask = 0;
+
+    for (ev = vfd->events; ev != NULL; ev = ev->fd_next) {
+        mask |= (ev->event & VTE_FD_EVENTS);
+    }
+    if (mask == vfd->mask) {
+        return 0;
+    }
+    /* select() cannot watch a fd from FD_SETSIZE, the other backends can */
+    if (mask != 0 && fd >= FD_SETSIZE && priv->epfd < 0 && priv->uring == NULL
+    &&  ((priv->state & VTS_RUNNING) != 0 || priv->backend == VTB_SELECT)) {
+        LOG_ERROR(vthread->log, "thread: select cannot watch fd %d, over FD_SETSIZE", fd);
+        errno = EINVAL;
+        return -1;
+    }
+#   ifdef VLIB_THREAD_EPOLL
+    if (priv->epfd >= 0) {
+        struct epoll_event  eev;
+        int                 op, always = 0;
+
+        memset(&eev, 0, sizeof(eev));
+        eev.events = ((mask & VTE_FD_READ) != 0 ? EPOLLIN : 0)
+                   | ((mask & VTE_FD_WRITE) != 0 ? EPOLLOUT : 0)
+                   | ((mask & VTE_FD_ERR) != 0 ? EPOLLPRI : 0);
+        eev.data.fd = fd;
+        op = vfd->mask == 0 ? EPOLL_CTL_ADD : (mask == 0 ? EPOLL_CTL_DEL : EPOLL_CTL_MOD);
+        if (epoll_ctl(priv->epfd, op, fd, &eev) != 0) {
+            /* fd can have been closed and reused without unregistration,
+             * and a closed fd has already left the epoll set */
+            if (op == EPOLL_CTL_ADD && errno == EEXIST) {
+                op = EPOLL_CTL_MOD;
+            } else if (op == EPOLL_CTL_MOD && errno == ENOENT) {
+                op = EPOLL_CTL_ADD;
+            } else if (op != EPOLL_CTL_DEL) {
+                op = -1;
+            }
+            if (op != EPOLL_CTL_DEL && (op < 0 || epoll_ctl(priv->epfd, op, fd, &eev) != 0)) {
+                int errno_save = errno;
+                /* regular files are refused by epoll, select() sees them always ready */
+                if (errno_save != EPERM) {
+                    LOG_ERROR(vthread->log, "epoll_ctl(fd %d, events %x): %s",
+                              fd, mask, strerror(errno_save));
+                    errno = errno_save;
+                    return -1;
+                }
+                always = 1;
+            }
+        }
+        if (always != vfd->always) {
+            vthread_epoll_always(vthread, fd, always);
+        }
+    }
+#   endif
+#   ifdef VLIB_THREAD_URING
+    if (priv->uring != NULL && vthread_uring_poll(priv, fd, vfd->mask, mask) != 0) {
+        int errno_save = errno;
+        LOG_ERROR(vthread->log, "io_uring poll(fd %d, events %x): %s", fd, mask, strerror(errno));
+        errno = errno_save;
+        return -1;
+    }
+#   endif
+    /* not deduced from the backend mask, reset when the backend is initialized */
+    if ((mask != 0) != vfd->watched) {
+        vfd->watched = (mask != 0);
+        if (vfd->watched)
+            VLIB_ATOMIC_ADD(&priv->load, 1);
+        else
+            VLIB_ATOMIC_SUB(&priv->load, 1);
+    }
+    vfd->mask = mask;
+    return 0;
+}
+
+/*****************************************************************************/
+/** make the fd table large enough for fd, under lock */
+static int vthread_fd_grow(vthread_priv_t * priv, int fd) {
+    if (fd < 0) {
+        errno = EBADF;
+        return -1;
+    }
+    if (fd >= priv->nfds) {
+        vthread_fd_t *  fds;
+        int             nfds = priv->nfds > 0 ? priv->nfds : 64;
+
+        while (nfds <= fd) {
+            nfds *= 2;
+        }
+        if ((fds = realloc(priv->fds, nfds * sizeof(*fds))) == NULL) {
+            return -1;
+        }
+        memset(fds + priv->nfds, 0, (nfds - priv->nfds) * sizeof(*fds));
+        priv->fds = fds;
+        priv->nfds = nfds;
+    }
+    return 0;
+}
+
+/*****************************************************************************/
+/** add a fd event to the events of its fd, under lock */
+static int vthread_fd_link(vthread_t * vthread, vthread_event_data_t * ev) {
+    vthread_priv_t *    priv = vthread->priv;
+    int                 fd = ev->ev.fd;
+
+    if (vthread_fd_grow(priv, fd) != 0) {
+        return -1;
+    }
+    ev->fd_next = priv->fds[fd].events;
+    priv->fds[fd].events = ev;
+    if (vthread_fd_update(vthread, fd) != 0) {
+        priv->fds[fd].events = ev->fd_next;
+        return -1;
+    }
+    return 0;
+}
+
+/*****************************************************************************/
+/** remove a fd event from the events of its fd, under lock */
+static void vthread_fd_unlink(vthread_t * vthread, vthread_event_data_t * ev) {
+    vthread_priv_t *            priv = vthread->priv;
+    vthread_event_data_t **     pev;
+
+    if (ev->ev.fd < 0 || ev->ev.fd >= priv->nfds) {
+        return ;
+    }
+    for (pev = &priv->fds[ev->ev.fd].events; *pev != NULL; pev = &(*pev)->fd_next) {
+        if (*pev == ev) {
+            *pev = ev->fd_next;
+            break ;
+        }
+    }
+    vthread_fd_update(vthread, ev->ev.fd);
+}
+
+/*****************************************************************************/
+/** forget an event removed from event list, under lock */
+static void vthread_event_unlink(vthread_t * vthread, vthread_event_data_t * ev) {
+    vthread_priv_t * priv = vthread->priv;
+
+    if ((ev->registered & (VTE_FD_EVENTS | VTE_FD_CLOSE)) != 0) {
+        vthread_fd_unlink(vthread, ev);
+    }
+    if ((ev->registered & VTE_PROCESS_START) != 0) {
+        --priv->nprocess;
+    }
+}
+
+/*****************************************************************************/
+/** call the callback of a fd event for its events among ready VTE_FD_EVENTS */
+static void vthread_fd_dispatch(
+                    vthread_t *             vthread,
+                    vthread_event_data_t *  data,
+                    unsigned int            ready) {
+    static const vthread_event_t    fd_events[] = { VTE_FD_READ, VTE_FD_WRITE, VTE_FD_ERR };
+    vthread_priv_t *                priv = vthread->priv;
+
+    if (data->callback == NULL) {
+        return ;
+    }
+    for (size_t i = 0; i < PTR_COUNT(fd_events); ++i) {
+        /* event is re-read, as it can be disabled by a callback */
+        if ((data->event & fd_events[i]) != 0 && (ready & fd_events[i]) != 0) {
+            if (vthread_call(vthread, data->callback, fd_events[i], VTE_DATA_FD(data->ev.fd),
+                             data->callback_data) < 0)
+                priv->state |= VTS_EXIT_REQUESTED;
+            if ((data->event & VTE_ONESHOT) != 0) {
+                vthread_event_disable(priv, data);
+            }
+        }
+    }
+}
+
+#ifdef VLIB_THREAD_EPOLL
+/*****************************************************************************/
+/** create the epoll fd and give it the registered fds, under lock */
+static int vthread_epoll_init(vthread_t * vthread) {
+    vthread_priv_t * priv = vthread->priv;
+
+    if ((priv->ep_events = malloc(VTHREAD_EPOLL_EVENTS * sizeof(*priv->ep_events))) == NULL
+    ||  (priv->epfd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+        return -1;
+    }
+    for (int fd = 0; fd < priv->nfds; ++fd) {
+        priv->fds[fd].mask = 0;
+        if (vthread_fd_update(vthread, fd) != 0) {
+            close(priv->epfd);
+            priv->epfd = -1;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*****************************************************************************/
+/** dispatch the ready fds given by epoll, under lock */
+static void vthread_epoll_dispatch(vthread_t * vthread, int nready) {
+    vthread_priv_t *        priv = vthread->priv;
+
+    for (int i = 0; i < nready; ++i) {
+        uint32_t        events = priv->ep_events[i].events;
+
+        /* as select(), report errors and hangups as read or write readiness */
+        vthread_fd_ready(vthread, priv->ep_events[i].data.fd,
+                         ((events & (EPOLLIN | EPOLLHUP | EPOLLERR)) != 0 ? VTE_FD_READ : 0)
+                         | ((events & (EPOLLOUT | EPOLLERR)) != 0 ? VTE_FD_WRITE : 0)
+                         | ((events & EPOLLPRI) != 0 ? VTE_FD_ERR : 0));
+    }
+}
+
+/*****************************************************************************/
+/** add or remove fd from the fds always ready, which epoll refuses, under lock */
+static void vthread_epoll_always(vthread_t * vthread, int fd, int always) {
+    vthread_priv_t *    priv = vthread->priv;
+    int *               pfd;
+
+    if (always) {
+        priv->fds[fd].always_next = priv->fd_always;
+        priv->fd_always = fd;
+        /* the loop must stop waiting for epoll */
+        vthread_notify(vthread);
+    } else {
+        for (pfd = &priv->fd_always; *pfd >= 0; pfd = &priv->fds[*pfd].always_next) {
+            if (*pfd == fd) {
+                *pfd = priv->fds[fd].always_next;
+                break ;
+            }
+        }
+    }
+    priv->fds[fd].always = always;
+}
+
+/*****************************************************************************/
+/** dispatch the fds always ready, as select() does for regular files, under lock */
+static void vthread_epoll_always_dispatch(vthread_t * vthread) {
+    vthread_priv_t *    priv = vthread->priv;
+    int                 fd, next;
+
+    for (fd = priv->fd_always; fd >= 0; fd = next) {
+        next = priv->fds[fd].always_next;
+        vthread_fd_ready(vthread, fd, priv->fds[fd].mask & (VTE_FD_READ | VTE_FD_WRITE));
+    }
+}
+#endif
+
+#ifdef VLIB_THREAD_URING
+/*****************************************************************************/
+static int vthread_uring_enter(
+                    int fd, unsigned int submit, unsigned int min_complete,
+                    unsigned int flags, void * arg, size_t argsz) {
+    return (int) syscall(__NR_io_uring_enter, fd, submit, min_complete, flags, arg, argsz);
+}
+
+/*****************************************************************************/
+/** give a buffer back to the registered buffers ring */
+static void vthread_uring_buf_put(vthread_uring_t * ur, unsigned int bid) {
+    struct io_uring_buf * buf = &ur->br->bufs[ur->br_tail & (VTHREAD_URING_BUFS - 1)];
+
+    buf->addr = (uint64_t) (uintptr_t) (ur->bufs + (size_t) bid * VLIB_THREAD_IO_BUFSZ);
+    buf->len = VLIB_THREAD_IO_BUFSZ;
+    buf->bid = bid;
+    VLIB_ATOMIC_STORE(&ur->br->tail, ++ur->br_tail);
+}
+
+/*****************************************************************************/
+/** create the io_uring rings and registered buffers, give them the registered
+ * fds and pending I/O, under lock, in the vthread */
+static int vthread_uring_init(vthread_t * vthread) {
+    vthread_priv_t *        priv = vthread->priv;
+    vthread_uring_t *       ur;
+    struct io_uring_params  params;
+    struct io_uring_buf_reg reg;
+    char *                  ring;
+    int                     errno_save;
+
+    if ((ur = calloc(1, sizeof(*ur))) == NULL) {
+        return -1;
+    }
+    ur->ring = MAP_FAILED;
+    ur->sqes = MAP_FAILED;
+    memset(&params, 0, sizeof(params));
+    if ((ur->fd = (int) syscall(__NR_io_uring_setup, VTHREAD_URING_ENTRIES, &params)) < 0) {
+        goto error;
+    }
+    /* kernel >= 5.11 */
+    if ((params.features & IORING_FEAT_SINGLE_MMAP) == 0
+    ||  (params.features & IORING_FEAT_EXT_ARG) == 0) {
+        errno = ENOTSUP;
+        goto error;
+    }
+    ur->ring_sz = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    if (params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe) > ur->ring_sz)
+        ur->ring_sz = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ur->sqes_sz = params.sq_entries * sizeof(struct io_uring_sqe);
+    if ((ur->ring = mmap(NULL, ur->ring_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         ur->fd, IORING_OFF_SQ_RING)) == MAP_FAILED
+    ||  (ur->sqes = mmap(NULL, ur->sqes_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         ur->fd, IORING_OFF_SQES)) == MAP_FAILED) {
+        goto error;
+    }
+    ring = ur->ring;
+    ur->sq_head = (unsigned int *) (ring + params.sq_off.head);
+    ur->sq_tail = (unsigned int *) (ring + params.sq_off.tail);
+    ur->sq_mask = *(unsigned int *) (ring + params.sq_off.ring_mask);
+    ur->sq_entries = params.sq_entries;
+    ur->cq_head = (unsigned int *) (ring + params.cq_off.head);
+    ur->cq_tail = (unsigned int *) (ring + params.cq_off.tail);
+    ur->cq_mask = *(unsigned int *) (ring + params.cq_off.ring_mask);
+    ur->cqes = (struct io_uring_cqe *) (ring + params.cq_off.cqes);
+    for (unsigned int i = 0; i < params.sq_entries; ++i) {
+        ((unsigned int *) (ring + params.sq_off.array))[i] = i;
+    }
+
+    /* registered buffers for multishot reads (kernel >= 5.19), optional */
+    ur->br_sz = VTHREAD_URING_BUFS * sizeof(struct io_uring_buf);
+    if ((ring = mmap(NULL, ur->br_sz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                     -1, 0)) != MAP_FAILED
+    &&  (ur->br = (struct io_uring_buf_ring *) ring) != NULL
+    &&  (ur->bufs = malloc((size_t) VTHREAD_URING_BUFS * VLIB_THREAD_IO_BUFSZ)) != NULL) {
+        memset(&reg, 0, sizeof(reg));
+        reg.ring_addr = (uint64_t) (uintptr_t) ur->br;
+        reg.ring_entries = VTHREAD_URING_BUFS;
+        reg.bgid = 0;
+        if (syscall(__NR_io_uring_register, ur->fd, IORING_REGISTER_PBUF_RING, &reg, 1) == 0) {
+            for (unsigned int bid = 0; bid < VTHREAD_URING_BUFS; ++bid)
+                vthread_uring_buf_put(ur, bid);
+        } else {
+            LOG_VERBOSE(vthread->log, "thread: io_uring without registered buffers: %s",
+                        strerror(errno));
+            free(ur->bufs);
+            ur->bufs = NULL;
+        }
+    }
+    if (ur->bufs == NULL && ur->br != NULL) {
+        munmap(ur->br, ur->br_sz);
+        ur->br = NULL;
+    }
+    priv->uring = ur;
+
+    /* pending I/O, done until now when their fd was ready */
+    for (vthread_io_req_t * req = priv->io_reqs; req != NULL; req = req->next) {
+        if ((req->flags & VTHREAD_IO_EMULATED) == 0
+        ||  (req->event == VTE_IO_READ && req->buf == NULL && ur->br == NULL))
+            continue ;
+        vthread_unregister_event_unlocked(vthread,
+            (req->event == VTE_IO_WRITE ? VTE_FD_WRITE : VTE_FD_READ) | VTE_RESERVED,
+            VTE_DATA_FD(req->fd), 1);
+        req->flags &= ~VTHREAD_IO_EMULATED;
+        if (vthread_uring_io(priv, req) != 0)
+            goto error_registered;
     }
-    /* lock pipe lock */
-    /* checks whether the size exceeds PIPE_BUF */
-    if (size <= PIPE_BUF) {
-        pthread_rwlock_rdlock(&priv->pipe_mutex);
-        ret = write_nonblock(pipe_fdout, data, size, 1000);
-        pthread_rwlock_unlock(&priv->pipe_mutex);
-        return ret;
+    /* polls of registered fds */
+    for (int fd = 0; fd < priv->nfds; ++fd) {
+        priv->fds[fd].mask = 0;
+        if (vthread_fd_update(vthread, fd) != 0)
+            goto error_registered;
     }
-    pthread_rwlock_wrlock(&priv->pipe_mutex);
-    for (offset = 0; offset < size; /*no incr*/ ) {
-        ret = write_nonblock(pipe_fdout, (const char *)data + offset,
-                             offset + PIPE_BUF > size ? size - offset : PIPE_BUF, 1000);
-        if (ret < 0) {
-            pthread_rwlock_unlock(&priv->pipe_mutex);
-            return ret;
+    return 0;
+
+error_registered:
+    LOG_ERROR(vthread->log, "thread: cannot give registered events to io_uring");
+    priv->state |= VTS_ERROR;
+    return 0;
+error:
+    errno_save = errno;
+    vthread_uring_free(ur);
+    errno = errno_save;
+    return -1;
+}
+
+/*****************************************************************************/
+static void vthread_uring_free(vthread_uring_t * ur) {
+    if (ur == NULL)
+        return ;
+    if (ur->br != NULL)
+        munmap(ur->br, ur->br_sz);
+    if (ur->bufs != NULL)
+        free(ur->bufs);
+    if (ur->sqes != MAP_FAILED)
+        munmap(ur->sqes, ur->sqes_sz);
+    if (ur->ring != MAP_FAILED)
+        munmap(ur->ring, ur->ring_sz);
+    if (ur->fd >= 0)
+        close(ur->fd);
+    free(ur);
+}
+
+/*****************************************************************************/
+/** @return a cleared submission queue entry, submitted on next wait of the loop,
+ * or NULL if the submission queue is full, under lock */
+static struct io_uring_sqe * vthread_uring_sqe(vthread_uring_t * ur) {
+    unsigned int            tail = *ur->sq_tail;
+    struct io_uring_sqe *   sqe;
+
+    if (tail - VLIB_ATOMIC_LOAD(ur->sq_head) >= ur->sq_entries) {
+        /* full: submit now */
+        vthread_uring_enter(ur->fd, tail - VLIB_ATOMIC_LOAD(ur->sq_head), 0, 0, NULL, 0);
+        if (tail - VLIB_ATOMIC_LOAD(ur->sq_head) >= ur->sq_entries) {
+            errno = EBUSY;
+            return NULL;
         }
-        offset += ret;
     }
-    pthread_rwlock_unlock(&priv->pipe_mutex);
-    return offset;
+    sqe = &ur->sqes[tail & ur->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
 }
 
-/* ************************************************************************ */
-void vthread_testkill() {
-    vjob_testkill();
+/** make the last entry given by vthread_uring_sqe() visible to the kernel */
+static void vthread_uring_push(vthread_uring_t * ur) {
+    VLIB_ATOMIC_STORE(ur->sq_tail, *ur->sq_tail + 1);
 }
 
-/* ************************************************************************ */
-int vthread_killmode(int enable, int async, int *old_enable, int *old_async) {
-     return vjob_killmode(enable, async, old_enable, old_async);
+/*****************************************************************************/
+/** replace the poll of fd, under lock */
+static int vthread_uring_poll(
+                    vthread_priv_t *        priv,
+                    int                     fd,
+                    unsigned int            old_mask,
+                    unsigned int            mask) {
+    vthread_uring_t *       ur = priv->uring;
+    vthread_fd_t *          vfd = &priv->fds[fd];
+    struct io_uring_sqe *   sqe;
+    uint32_t                events;
+
+    if (old_mask != 0) {
+        if ((sqe = vthread_uring_sqe(ur)) == NULL)
+            return -1;
+        sqe->opcode = IORING_OP_POLL_REMOVE;
+        sqe->fd = -1;
+        sqe->addr = VTHREAD_URING_POLL_DATA(fd, vfd->gen);
+        sqe->user_data = VTHREAD_URING_IGNORE;
+        vthread_uring_push(ur);
+    }
+    /* completions of the previous poll are ignored */
+    ++vfd->gen;
+    if (mask == 0)
+        return 0;
+    if ((sqe = vthread_uring_sqe(ur)) == NULL)
+        return -1;
+    events = ((mask & VTE_FD_READ) != 0 ? POLLIN : 0)
+           | ((mask & VTE_FD_WRITE) != 0 ? POLLOUT : 0)
+           | ((mask & VTE_FD_ERR) != 0 ? POLLPRI : 0);
+#   if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    events = (events << 16) | (events >> 16);
+#   endif
+    /* oneshot, queued again after each dispatch: a multishot poll would only
+     * report new readiness, and fd events are level-triggered on all backends */
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = events;
+    sqe->user_data = VTHREAD_URING_POLL_DATA(fd, vfd->gen);
+    vthread_uring_push(ur);
+    return 0;
 }
 
 /*****************************************************************************/
-static int vthread_control_pipe_cb(
-    vthread_t * vthread, vthread_event_t ev, void * ev_data, void * cb_data) {
-
-    vthread_control_t       id;
-    vthread_control_len_t   len = 0, total = 0;
-    ssize_t                 n;
-    (void)                  vthread;
-    (void)                  cb_data;
+/** queue an asynchronous I/O, under lock */
+static int vthread_uring_io(vthread_priv_t * priv, vthread_io_req_t * req) {
+    vthread_uring_t *       ur = priv->uring;
+    struct io_uring_sqe *   sqe;
 
-    if (ev == VTE_FD_READ) {
-        int fd = VTE_FD_DATA(ev_data);
-        do {
-            // read ID
-            while ((n = read(fd, &id, sizeof(id))) < 0 && errno == EINTR)
-                ; /* loop on EINTR */
-            if (n == sizeof(id)) {
-                // read LEN if BIT activated in ID
-                if ((id & VTHREAD_CONTROL_LENGTH) != 0) {
-                    char buf[128];
-                    while ((n = read(fd, &len, sizeof(len))) < 0 && errno == EINTR)
-                        ; /* loop on EINTR */
-                    if (n != sizeof(len))
-                        len = 0;
-                    // READ <LEN> bytes of data / TODO
-                    for (total = 0; total < len; total += n) {
-                        size_t to_read = total + sizeof(buf) > len ? len-total : sizeof(buf);
-                        while ((n = read(fd, buf, to_read)) < 0 && errno == EINTR)
-                            ; /* loop */
-                        if (n == -1 || ((size_t) n) < to_read)
-                            break ;
-                    }
-                }
-                switch(id & VTHREAD_CONTROL_MASK) {
-                    case VTHREAD_CONTROL_NOTIFY:
-                        break ;
-                    default:
-                        break ;
-                }
+    if ((sqe = vthread_uring_sqe(ur)) == NULL)
+        return -1;
+    sqe->fd = req->fd;
+    switch (req->event) {
+        case VTE_IO_ACCEPT:
+            sqe->opcode = IORING_OP_ACCEPT;
+            sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+            sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+            break ;
+        case VTE_IO_WRITE:
+            sqe->opcode = IORING_OP_WRITE;
+            break ;
+        default:
+            if (req->buf == NULL) {
+                /* multishot, in a registered buffer */
+                sqe->opcode = IORING_OP_RECV;
+                sqe->ioprio = IORING_RECV_MULTISHOT;
+                sqe->flags = IOSQE_BUFFER_SELECT;
+                sqe->buf_group = 0;
+            } else {
+                sqe->opcode = IORING_OP_READ;
             }
-        } while (n > 0);
+            break ;
     }
-    // non negative value will just stop the select() loop,
-    // register/unregister events, check thread state, then re-loop.
+    if (req->buf != NULL) {
+        sqe->addr = (uint64_t) (uintptr_t) req->buf;
+        sqe->len = req->size > UINT_MAX ? UINT_MAX : (unsigned int) req->size;
+        sqe->off = (uint64_t) -1; /* current position, or stream */
+    }
+    sqe->user_data = (uint64_t) (uintptr_t) req;
+    req->flags |= VTHREAD_IO_URING;
+    vthread_uring_push(ur);
     return 0;
 }
 
 /*****************************************************************************/
-static void vthread_body_cleanup(void * data) {
-    vthread_t *         vthread = (vthread_t *) data;
-    vthread_priv_t *    priv    = vthread ? (vthread_priv_t *) vthread->priv : NULL;
-    int                 ret;
-
-    if (priv == NULL) {
-        LOG_WARN(vthread->log, "thread: shutdown: bad context, cannot clean up");
-        return ;
-    }
+/** cancel an asynchronous I/O, it will give a last completion, under lock */
+static int vthread_uring_cancel(vthread_priv_t * priv, vthread_io_req_t * req) {
+    vthread_uring_t *       ur = priv->uring;
+    struct io_uring_sqe *   sqe;
 
-    LOG_VERBOSE(vthread->log, "thread: shutting down");
+    if ((sqe = vthread_uring_sqe(ur)) == NULL)
+        return -1;
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = (uint64_t) (uintptr_t) req;
+    sqe->user_data = VTHREAD_URING_IGNORE;
+    vthread_uring_push(ur);
+    return 0;
+}
 
-    if ((priv->state & VTS_WAITING) != 0) {
-        if ((priv->state & VTS_STARTED) != 0) {
-            ret = pthread_mutex_lock(&(priv->mutex)); // we were interrupted by pthread_cancel while mutex not locked
-        } else {
-            // we were interrupted by pthread_cancel in pthread_cond_wait(). At least on macOS, pthread_testcancel()
-            // in pthread_cond_wait can be called before the cond mutex is unlocked, that's whe we trylock.
-            ret = pthread_mutex_trylock(&(priv->mutex));
+/*****************************************************************************/
+/** submit the queued entries and wait for completions, not locked.
+ * @return the number of completions, 0 on timeout, -1 on error */
+static int vthread_uring_wait(vthread_priv_t * priv, long wait_ms) {
+    vthread_uring_t *               ur = priv->uring;
+    struct io_uring_getevents_arg   arg;
+    struct __kernel_timespec        ts;
+    unsigned int                    submit, flags = IORING_ENTER_EXT_ARG, min_complete = 0;
+
+    submit = VLIB_ATOMIC_LOAD(ur->sq_tail) - VLIB_ATOMIC_LOAD(ur->sq_head);
+    memset(&arg, 0, sizeof(arg));
+    arg.sigmask = (uint64_t) (uintptr_t) &priv->block_sigset;
+    arg.sigmask_sz = _NSIG / 8;
+    if (VLIB_ATOMIC_LOAD(ur->cq_tail) == *ur->cq_head) {
+        flags |= IORING_ENTER_GETEVENTS;
+        min_complete = 1;
+        if (wait_ms >= 0) {
+            ts.tv_sec = wait_ms / 1000;
+            ts.tv_nsec = (wait_ms % 1000) * 1000000L;
+            arg.ts = (uint64_t) (uintptr_t) &ts;
         }
-    } else {
-        ret = 0;
+    } else if (submit == 0) {
+        return (int) (VLIB_ATOMIC_LOAD(ur->cq_tail) - *ur->cq_head);
     }
-    (void)ret;
-    LOG_DEBUG(vthread->log, "thread: state: %x, result: %lx, lockret: %d",
-              priv->state, (unsigned long)((size_t)vthread->result), ret);
-
-    priv->state = (priv->state & ~(VTS_RUNNING|VTS_WAITING)) | VTS_FINISHING;
+    if (vthread_uring_enter(ur->fd, submit, min_complete, flags, &arg, sizeof(arg)) < 0
+    &&  errno != ETIME && errno != EBUSY && errno != EAGAIN) {
+        return -1;
+    }
+    return (int) (VLIB_ATOMIC_LOAD(ur->cq_tail) - *ur->cq_head);
+}
 
-    if ((priv->state & VTS_STARTED) != 0) {
-        SLIST_FOREACH_DATA(priv->event_list, data, vthread_event_data_t *) {
-            if (data->callback != NULL && (data->event & VTE_CLEAN) != 0) {
-                data->callback(vthread, VTE_CLEAN, data->ev.ptr,
-                        data->callback_data);
+/*****************************************************************************/
+/** dispatch the completions, under lock */
+static void vthread_uring_dispatch(vthread_t * vthread) {
+    vthread_priv_t *    priv = vthread->priv;
+    vthread_uring_t *   ur = priv->uring;
+    unsigned int        head = *ur->cq_head;
+
+    while (head != VLIB_ATOMIC_LOAD(ur->cq_tail)) {
+        struct io_uring_cqe *   cqe = &ur->cqes[head & ur->cq_mask];
+        uint64_t                data = cqe->user_data;
+        int                     res = cqe->res;
+        unsigned int            flags = cqe->flags;
+
+        VLIB_ATOMIC_STORE(ur->cq_head, ++head);
+
+        if ((data & 3) == VTHREAD_URING_POLL) {
+            int fd = (int) (data >> 32);
+
+            /* completion of a removed poll */
+            if (fd >= priv->nfds || data != VTHREAD_URING_POLL_DATA(fd, priv->fds[fd].gen))
+                continue ;
+            if (res < 0) {
+                LOG_VERBOSE(vthread->log, "thread: io_uring poll(fd %d): %s", fd, strerror(-res));
+                priv->fds[fd].mask = 0;
+                continue ;
             }
-            if ((data->event & (VTE_FD_CLOSE)) != 0) {
-                close(data->ev.fd);
+            /* as select(), report errors and hangups as read or write readiness */
+            vthread_fd_ready(vthread, fd, ((res & (POLLIN | POLLHUP | POLLERR)) != 0 ? VTE_FD_READ : 0)
+                                          | ((res & (POLLOUT | POLLERR)) != 0 ? VTE_FD_WRITE : 0)
+                                          | ((res & POLLPRI) != 0 ? VTE_FD_ERR : 0));
+            /* poll fd again, unless the callbacks changed its events, which replaced the poll */
+            if ((flags & IORING_CQE_F_MORE) == 0 && fd < priv->nfds
+            &&  data == VTHREAD_URING_POLL_DATA(fd, priv->fds[fd].gen) && priv->fds[fd].mask != 0
+            &&  vthread_uring_poll(priv, fd, 0, priv->fds[fd].mask) != 0) {
+                LOG_ERROR(vthread->log, "thread: io_uring poll(fd %d): %s", fd, strerror(errno));
+                priv->fds[fd].mask = 0;
+            }
+        } else if (data != VTHREAD_URING_IGNORE) {
+            vthread_io_req_t *  req = (vthread_io_req_t *) (uintptr_t) data;
+            void *              buf = req->buf;
+            int                 bid = -1;
+            int                 more = (flags & IORING_CQE_F_MORE) != 0;
+
+            if ((flags & IORING_CQE_F_BUFFER) != 0) {
+                bid = flags >> IORING_CQE_BUFFER_SHIFT;
+                buf = ur->bufs + (size_t) bid * VLIB_THREAD_IO_BUFSZ;
             }
+            /* the kernel can stop a multishot request which is not done, when all registered
+             * buffers were in use or when the completion queue was full: queue it again.
+             * As without io_uring, reads stop at end of file and accepts on error. */
+            if (!more && (req->flags & (VTHREAD_IO_MULTISHOT | VTHREAD_IO_CANCELED)) == VTHREAD_IO_MULTISHOT
+            &&  (res == -ENOBUFS || (req->event == VTE_IO_ACCEPT ? res >= 0 : res > 0))
+            &&  vthread_uring_io(priv, req) == 0) {
+                if (res == -ENOBUFS)
+                    continue ;
+                more = 1;
+            }
+            vthread_io_complete(vthread, req, res, buf, more);
+            if (bid >= 0)
+                vthread_uring_buf_put(ur, bid);
         }
     }
+}
+#endif
 
-    priv->state = (priv->state & ~VTS_FINISHING) | VTS_FINISHED;
-    pthread_mutex_unlock(&priv->mutex);
+#if defined(VLIB_THREAD_EPOLL) || defined(VLIB_THREAD_URING)
+/*****************************************************************************/
+/** call the callbacks of the events of a ready fd, under lock */
+static void vthread_fd_ready(vthread_t * vthread, int fd, unsigned int ready) {
+    vthread_priv_t *        priv = vthread->priv;
+    vthread_event_data_t *  data, * next;
 
-    LOG_DEBUG(vthread->log, "vthread cleanup: exiting (result:%lx)",
-              (unsigned long)((size_t)vthread->result));
+    if (fd < 0 || fd >= priv->nfds) {
+        return ;
+    }
+    /* callbacks can register events, prepended, and disable events, not freed */
+    for (data = priv->fds[fd].events; data != NULL; data = next) {
+        next = data->fd_next;
+        vthread_fd_dispatch(vthread, data, ready);
+    }
 }
+#endif
 
 /*****************************************************************************/
-static void * vthread_body(void * data) {
-    static const int        blocked_sigs[] = {
-        SIGHUP, SIGINT, /*SIGPIPE,*/ SIGALRM, SIGTSTP, SIGTERM, SIGVTALRM, SIGPROF, SIGUSR1, SIGUSR2 };
-    vthread_t *             vthread = (vthread_t *) data;
-    vthread_priv_t *        priv = vthread ? (vthread_priv_t *) vthread->priv : NULL;
-    fd_set                  readfds, writefds, errfds;
-    struct sigaction        sa;
-    int                     select_ret, select_errno, ret;
-    volatile int            fd_max = -1;
-    sig_atomic_t            last_signal;
-    int                     thread_cancel_state;
-#   ifndef VLIB_THREAD_PSELECT
-    struct timeval          select_timeout, * p_select_timeout;
-    sigset_t                sigset_bak;
-#   else
-    struct timespec         select_timeout, * p_select_timeout;
-#   endif
+static uint64_t vthread_clock_ms() {
+    struct timespec ts;
 
-    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
-    pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, NULL);
+    vclock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000L;
+}
 
-    if (priv == NULL) {
-        LOG_ERROR(g_vlib_log, "bad thread context");
-        errno = EFAULT;
-        return VTHREAD_RESULT_ERROR;
-    }
-    LOG_VERBOSE(vthread->log, "thread: initializing");
-    pthread_mutex_lock(&priv->mutex);
+/*****************************************************************************/
+static uint64_t vthread_clock_us() {
+    struct timespec ts;
 
-    if ((priv->state & VTS_EXIT_REQUESTED) != 0) {
-        LOG_VERBOSE(vthread->log, "thread: exit requested before start -> exit");
-        priv->state = VTS_FINISHED;
-        pthread_cond_signal(&priv->cond);
-        pthread_mutex_unlock(&priv->mutex);
-        return vthread->result;
-    }
+    vclock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000L;
+}
 
-    // block 'user' signals which terminate the program.
-    // (note: block_sigset emptied in vthread_create())
-    for (size_t i = 0; i < PTR_COUNT(blocked_sigs); ++i) {
-        int sig = blocked_sigs[i];
-        //if SIG{INT,PROF,TERM} have default handler, do not block them.
-        if ((sig == SIGINT || sig == SIGPROF || sig == SIGTERM)
-        &&  sigaction(sig, NULL, &sa) == 0 && sa.sa_handler == SIG_DFL) {
-            continue ;
-        }
-        sigaddset(&priv->block_sigset, sig);
-    }
-    pthread_sigmask(SIG_SETMASK, &priv->block_sigset, NULL);
+/*****************************************************************************/
+static unsigned int vthread_timer_ctz(uint64_t bits) {
+#   if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(bits);
+#   else
+    unsigned int n = 0;
 
-    /* ignore SIGPIPE */
-    if (vthread_ignore_sigpipe(vthread) != 0) {
-        int errno_save = errno;
-        priv->state = VTS_FINISHED | VTS_ERROR;
-        pthread_cond_signal(&priv->cond);
-        pthread_mutex_unlock(&priv->mutex);
-        errno = errno_save;
-        return VTHREAD_RESULT_ERROR;
+    while ((bits & 1) == 0) {
+        bits >>= 1;
+        ++n;
     }
+    return n;
+#   endif
+}
 
-    /* from now pthread_cancel() when enabled will call vthread_body_cleanup() */
-    pthread_cleanup_push(vthread_body_cleanup, vthread);
-
-    /* notify vthread_start() we are ready,
-     * and WAIT for vthread_start() and signal back just before loop starts.
-     * This allows call to vthread_{register_event} before start */
-    LOG_VERBOSE(vthread->log, "thread: waiting for launch");
-    priv->state = (priv->state & ~VTS_CREATING) | VTS_CREATED;
-    pthread_cond_signal(&priv->cond);
-    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
-    priv->state |= VTS_WAITING;
-    select_ret = pthread_cond_wait(&priv->cond, &priv->mutex);
-    priv->state &= ~VTS_WAITING;
-    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
-    pthread_cleanup_pop(0);
-
-    LOG_DEBUG(vthread->log, "pthread_cond_wait exit ret=%d state=%d",
-              select_ret, priv->state);
+/*****************************************************************************/
+/** compute the expiry of a timer from its due time, then add it to the wheel.
+ * The expiry is rounded up to the largest power of two milli seconds not above
+ * delay >> VTHREAD_TIMER_SLACK: timers of similar delays expire together. */
+static void vthread_timer_arm(
+                    vthread_priv_t *        priv,
+                    vthread_timer_t *       timer,
+                    unsigned long           delay) {
+    uint64_t    slack = delay >> VTHREAD_TIMER_SLACK, round = 1;
+
+    while ((round << 1) <= slack) {
+        round <<= 1;
+    }
+    timer->expires = (timer->due + round - 1) & ~(round - 1);
+    if (timer->expires <= priv->timer_now) {
+        timer->expires = priv->timer_now + 1;
+    }
+    vthread_timer_link(priv, timer);
+}
 
-    if ((priv->state & VTS_EXIT_REQUESTED) != 0) {
-        LOG_VERBOSE(vthread->log, "thread: exit requested before start -> exit");
-        priv->state |= VTS_FINISHED;
-        pthread_mutex_unlock(&priv->mutex);
-        return vthread->result;
+/*****************************************************************************/
+/** add a timer to the wheel, in the lowest level whose slots reach its expiry,
+ * at the last slot of the upper level if it is beyond the wheel. */
+static void vthread_timer_link(vthread_priv_t * priv, vthread_timer_t * timer) {
+    uint64_t            tick = timer->expires;
+    unsigned int        level, shift = 0;
+    int                 slot;
+
+    for (level = 0; level < VTHREAD_TIMER_LEVELS; ++level) {
+        shift = level * VTHREAD_TIMER_BITS;
+        if ((tick >> shift) - (priv->timer_now >> shift) < VTHREAD_TIMER_SLOTS)
+            break ;
     }
-    pthread_cleanup_push(vthread_body_cleanup, vthread);
-    priv->state |= VTS_STARTED;
-    vthread->result = VTHREAD_RESULT_OK;
+    if (level == VTHREAD_TIMER_LEVELS) {
+        /* moved to lower levels or again here when this slot is reached */
+        --level;
+        tick = ((priv->timer_now >> shift) + VTHREAD_TIMER_SLOTS - 1) << shift;
+    }
+    slot = level * VTHREAD_TIMER_SLOTS + ((tick >> shift) & (VTHREAD_TIMER_SLOTS - 1));
+
+    timer->slot = slot;
+    timer->pprev = &priv->timers[slot];
+    if ((timer->next = priv->timers[slot]) != NULL)
+        timer->next->pprev = &timer->next;
+    priv->timers[slot] = timer;
+    priv->timer_bits[level] |= 1ULL << (slot % VTHREAD_TIMER_SLOTS);
+}
 
-    /* call the VTE_INIT callbacks just before starting select loop */
-    SLIST_FOREACH_DATA(priv->event_list, data, vthread_event_data_t *) {
-        if (data != NULL && data->callback != NULL && (data->event & VTE_INIT) != 0) {
-            ret = data->callback(vthread, VTE_INIT, data->ev.ptr, data->callback_data);
-            if (ret < 0)
-                priv->state |= VTS_EXIT_REQUESTED;
-        }
+/*****************************************************************************/
+/** remove a timer from its wheel slot or from the list of due timers */
+static void vthread_timer_unlink(vthread_priv_t * priv, vthread_timer_t * timer) {
+    if ((*timer->pprev = timer->next) != NULL)
+        timer->next->pprev = timer->pprev;
+    if (timer->slot >= 0 && priv->timers[timer->slot] == NULL) {
+        priv->timer_bits[timer->slot / VTHREAD_TIMER_SLOTS]
+            &= ~(1ULL << (timer->slot % VTHREAD_TIMER_SLOTS));
     }
-    priv->state |= VTS_RUNNING;
-    LOG_VERBOSE(vthread->log, "thread: launched");
+    timer->slot = -1;
+}
 
-    while ((priv->state & (VTS_RUNNING | VTS_EXIT_REQUESTED)) == VTS_RUNNING) {
-        /* fill the read, write, err fdsets, and manage new registered signals  */
-        FD_ZERO(&readfds);
-        FD_ZERO(&writefds);
-        FD_ZERO(&errfds);
-        SLIST_FOREACH_DATA(priv->event_list, data, vthread_event_data_t *) {
-            if (data != NULL) {
-                if ((data->event & VTE_FD_READ) != 0) {
-                    FD_SET(data->ev.fd, &readfds); if (data->ev.fd > fd_max) fd_max = data->ev.fd;
-                }
-                if ((data->event & VTE_FD_WRITE) != 0) {
-                    FD_SET(data->ev.fd, &writefds); if (data->ev.fd > fd_max) fd_max = data->ev.fd;
-                }
-                if ((data->event & VTE_FD_ERR) != 0) {
-                    FD_SET(data->ev.fd, &errfds); if (data->ev.fd > fd_max) fd_max = data->ev.fd;
-                }
-                if ((data->event & VTE_SIG) != 0
-                &&  sigismember(&priv->block_sigset, data->ev.sig)) {
-                    sigdelset(&priv->block_sigset, data->ev.sig);
-                }
-            }
+/*****************************************************************************/
+/** give an identifier to a new timer, under lock
+ * @return 0 on success, -1 on error */
+static int vthread_timer_ref(vthread_priv_t * priv, vthread_timer_t * timer) {
+    vthread_timer_ref_t *   ref;
+    uint32_t                index;
+
+    if (priv->timer_refs_free == 0) {
+        uint32_t size = priv->timer_refs_size ? priv->timer_refs_size * 2 : 64;
+
+        if (size <= priv->timer_refs_size || size > UINT32_MAX / sizeof(*ref)
+        ||  (ref = realloc(priv->timer_refs, size * sizeof(*ref))) == NULL) {
+            errno = ENOMEM;
+            return -1;
         }
-        if ((priv->state & VTS_ERROR) != 0) {
-            break ;
+        for (index = priv->timer_refs_size; index < size; ++index) {
+            ref[index].timer = NULL;
+            ref[index].gen = 0;
+            ref[index].next_free = index + 1 < size ? index + 2 : 0;
         }
+        priv->timer_refs_free = priv->timer_refs_size + 1;
+        priv->timer_refs_size = size;
+        priv->timer_refs = ref;
+    }
+    index = priv->timer_refs_free - 1;
+    ref = &priv->timer_refs[index];
+    priv->timer_refs_free = ref->next_free;
+    ref->timer = timer;
+    timer->id = ((vthread_timer_id_t) ref->gen << 32) | (index + 1);
+    return 0;
+}
 
-        /* set select timeout */
-        if (priv->process_timeout > 0) {
-            p_select_timeout = &select_timeout;
-            p_select_timeout->tv_sec = priv->process_timeout / 1000;
-#           ifndef VLIB_THREAD_PSELECT
-            p_select_timeout->tv_usec = (priv->process_timeout % 1000) * 1000;
-#           else
-            /* even if pselect does not modify the timespec, we allow dynamic timeout value */
-            p_select_timeout->tv_nsec = (priv->process_timeout % 1000) * 1000000;
-#           endif
-        } else {
-            p_select_timeout = NULL;
-        }
+/*****************************************************************************/
+/** @return the timer of an identifier, under lock, or NULL if it was freed */
+static vthread_timer_t * vthread_timer_get(vthread_priv_t * priv, vthread_timer_id_t id) {
+    uint32_t index = (uint32_t) (id & UINT32_MAX);
 
-        /* -------------------------------------------- */
-        LOG_DEBUG(vthread->log, "start select timeout=%ld", priv->process_timeout);
+    if (index == 0 || index > priv->timer_refs_size
+    ||  priv->timer_refs[index - 1].gen != (uint32_t) (id >> 32)) {
+        return NULL;
+    }
+    return priv->timer_refs[index - 1].timer;
+}
 
-        priv->state |= VTS_WAITING;
+/*****************************************************************************/
+/** free a timer removed from the wheel, its identifier becoming invalid */
+static void vthread_timer_free(vthread_priv_t * priv, vthread_timer_t * timer) {
+    uint32_t                index = (uint32_t) (timer->id & UINT32_MAX) - 1;
+    vthread_timer_ref_t *   ref = &priv->timer_refs[index];
+
+    ref->timer = NULL;
+    ++ref->gen;
+    ref->next_free = priv->timer_refs_free;
+    priv->timer_refs_free = index + 1;
+    free(timer);
+}
+
+/*****************************************************************************/
+/** @return the next tick when a wheel slot must be processed: the expiry of
+ * timers for the first level, the cascade to lower levels for others.
+ * UINT64_MAX if there is no timer. */
+static uint64_t vthread_timer_next(vthread_priv_t * priv) {
+    uint64_t next = UINT64_MAX;
+
+    for (unsigned int level = 0; level < VTHREAD_TIMER_LEVELS; ++level) {
+        unsigned int    shift = level * VTHREAD_TIMER_BITS;
+        uint64_t        bits = priv->timer_bits[level], tick;
+        unsigned int    start = ((priv->timer_now >> shift) + 1) & (VTHREAD_TIMER_SLOTS - 1);
+
+        if (bits == 0)
+            continue ;
+        /* rotate so as bit 0 is the slot following the current one */
+        if (start != 0)
+            bits = (bits >> start) | (bits << (VTHREAD_TIMER_SLOTS - start));
+        tick = ((priv->timer_now >> shift) + 1 + vthread_timer_ctz(bits)) << shift;
+        if (tick < next)
+            next = tick;
+    }
+    return next;
+}
 
-#      ifndef VLIB_THREAD_PSELECT
-        pthread_sigmask(SIG_SETMASK, &priv->block_sigset, &sigset_bak);
-        pthread_mutex_unlock(&priv->mutex);
-        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &thread_cancel_state);
-        pthread_testcancel();
+/*****************************************************************************/
+/** call the callbacks of timers expired at 'now', under lock */
+static void vthread_timer_run(vthread_t * vthread, uint64_t now) {
+    vthread_priv_t *    priv = vthread->priv;
+    vthread_timer_t *   due, * timer;
+    uint64_t            tick;
+    int                 slot;
+
+    while ((tick = vthread_timer_next(priv)) <= now) {
+        priv->timer_now = tick;
+        /* cascade the slots of upper levels starting at this tick, higher first */
+        for (unsigned int level = VTHREAD_TIMER_LEVELS - 1; level > 0; --level) {
+            unsigned int shift = level * VTHREAD_TIMER_BITS;
+
+            if ((tick & ((1ULL << shift) - 1)) != 0)
+                continue ;
+            slot = level * VTHREAD_TIMER_SLOTS + ((tick >> shift) & (VTHREAD_TIMER_SLOTS - 1));
+            while ((timer = priv->timers[slot]) != NULL) {
+                vthread_timer_unlink(priv, timer);
+                vthread_timer_link(priv, timer);
+            }
+        }
+        /* detach the expired slot, as callbacks can add and cancel timers */
+        slot = tick & (VTHREAD_TIMER_SLOTS - 1);
+        if ((due = priv->timers[slot]) != NULL)
+            due->pprev = &due;
+        priv->timers[slot] = NULL;
+        priv->timer_bits[0] &= ~(1ULL << slot);
+
+        while ((timer = due) != NULL) {
+            vthread_timer_unlink(priv, timer);
+            priv->timer_running = timer;
+            if (priv->stats != NULL)
+                vthread_hist_add(&priv->stats->lag, now > timer->expires ? (now - timer->expires) * 1000 : 0);
+            if (vthread_call(vthread, timer->callback, VTE_TIMER, &timer->id,
+                             timer->callback_data) < 0)
+                priv->state |= VTS_EXIT_REQUESTED;
+            priv->timer_running = NULL;
 
-        select_ret = select(fd_max + 1, &readfds, &writefds, &errfds, p_select_timeout);
+            if (timer->period == 0 || (timer->flags & VTHREAD_TIMER_CANCELED) != 0) {
+                vthread_timer_free(priv, timer);
+                continue ;
+            }
+            /* periodic timer: keep its rate, but skip periods missed */
+            timer->due += timer->period;
+            if (timer->due <= now)
+                timer->due = now + timer->period;
+            vthread_timer_arm(priv, timer, timer->period);
+        }
+    }
+    if (now > priv->timer_now)
+        priv->timer_now = now;
+}
 
-        last_signal = s_last_signal;
-        select_errno = errno;
-        pthread_sigmask(SIG_SETMASK, &sigset_bak, NULL);
-#      else
-        pthread_mutex_unlock(&priv->mutex);
-        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &thread_cancel_state);
-        pthread_testcancel();
-        
-        select_ret = pselect(fd_max + 1, &readfds, &writefds, &errfds,
-                             p_select_timeout, &priv->block_sigset);
-        last_signal = s_last_signal;
-        select_errno = errno;
-#      endif
+/*****************************************************************************/
+/** call the callbacks registered to a signal, under lock */
+static void vthread_sig_dispatch(vthread_t * vthread, int sig) {
+    vthread_priv_t * priv = vthread->priv;
+    int              ret;
 
-        pthread_testcancel();
-        pthread_setcancelstate(thread_cancel_state, NULL);
-        pthread_mutex_lock(&priv->mutex);
+    for (vthread_event_data_t * data = priv->events; data != NULL; data = data->next) {
+        if (data != NULL && data->callback != NULL
+        && (data->event & VTE_SIG) != 0 && (sig == data->ev.sig)) {
+            ret = vthread_call(vthread, data->callback, VTE_SIG, VTE_DATA_SIG(data->ev.sig),
+                               data->callback_data);
+            if (ret < 0)
+                priv->state |= VTS_EXIT_REQUESTED;
+            if ((data->event & VTE_ONESHOT) != 0) {
+                vthread_event_disable(priv, data);
+            }
+        }
+    }
+}
 
-        LOG_DEBUG(vthread->log, "select return %d errno %d %s",
-                  select_ret, select_errno, select_errno ? strerror(select_errno) : "");
+#ifdef VLIB_THREAD_SIGNALFD
+/*****************************************************************************/
+static int vthread_signalfd_cb(
+    vthread_t * vthread, vthread_event_t ev, void * ev_data, void * cb_data) {
 
-        priv->state &= ~VTS_WAITING;
-        LOG_DEBUG(vthread->log, "mutex relocked, cancelstate %d", thread_cancel_state);
-        /* -------------------------------------------- */
+    struct signalfd_siginfo     si[16];
+    ssize_t                     n;
+    (void)                      cb_data;
 
-        /* we have just been released by select, call callbacks with select result
-         * and update pthread_sigmask in case of configuration change */
-        SLIST_FOREACH_DATA(priv->event_list, data, vthread_event_data_t *) {
-            if (data != NULL && data->callback != NULL
-            && (data->event & VTE_PROCESS_START) != 0) {
-                ret = data->callback(vthread, VTE_PROCESS_START,
-                                             (void *)((long) select_ret),
-                                             data->callback_data);
-                if (ret < 0)
-                    priv->state |= VTS_EXIT_REQUESTED;
+    if (ev == VTE_FD_READ) {
+        /* all pending signals are read, not only the last one as with pselect */
+        while ((n = read(VTE_FD_DATA(ev_data), si, sizeof(si))) > 0
+               || (n < 0 && errno == EINTR)) {
+            for (size_t i = 0; n > 0 && i < (size_t) n / sizeof(*si); ++i) {
+                LOG_VERBOSE(vthread->log, "thread: signal: %s", strsignal(si[i].ssi_signo));
+                vthread_sig_dispatch(vthread, si[i].ssi_signo);
             }
         }
+    }
+    return 0;
+}
 
-        if (select_ret == 0) {
-            LOG_VERBOSE(vthread->log, "thread: select timeout");
-            continue ;
-        }
-        if (select_ret < 0 && select_errno == EINTR) {
-            LOG_VERBOSE(vthread->log, "thread: interrupted by signal: %s", strsignal(last_signal));
-            /* check callbacks registered to signal */
-            SLIST_FOREACH_DATA(priv->event_list, data, vthread_event_data_t *) {
-                if (data != NULL && data->callback != NULL
-                && (data->event & VTE_SIG) != 0 && (last_signal == data->ev.sig)) {
-                    ret = data->callback(vthread, VTE_SIG, VTE_DATA_SIG(data->ev.sig),
-                                                  data->callback_data);
-                    if (ret < 0)
-                        priv->state |= VTS_EXIT_REQUESTED;
-                }
-            }
-            continue ;
+/*****************************************************************************/
+/** give the registered signals to the signalfd, created with the first one.
+ * They are then kept blocked in the vthread. Under lock, in the vthread. */
+static void vthread_signalfd_update(vthread_t * vthread) {
+    vthread_priv_t *    priv = vthread->priv;
+    sigset_t            mask;
+    int                 fd, nsigs = 0;
+
+    priv->sig_update = 0;
+    sigemptyset(&mask);
+    for (vthread_event_data_t * data = priv->events; data != NULL; data = data->next) {
+        if ((data->event & VTE_SIG) != 0) {
+            sigaddset(&mask, data->ev.sig);
+            ++nsigs;
         }
-        if (select_ret < 0) {
-            LOG_VERBOSE(vthread->log, "thread: select error: %s", strerror(select_errno));
-            priv->state |= VTS_ERROR;
-            break ;
+    }
+    if (priv->sigfd < 0 && nsigs == 0) {
+        return ;
+    }
+    if ((fd = signalfd(priv->sigfd, &mask, SFD_NONBLOCK | SFD_CLOEXEC)) < 0) {
+        LOG_WARN(vthread->log, "thread: cannot use signalfd: %s", strerror(errno));
+        return ;
+    }
+    if (priv->sigfd < 0) {
+        if (vthread_register_event_unlocked(vthread, VTE_FD_READ | VTE_FD_CLOSE, VTE_DATA_FD(fd),
+                                            vthread_signalfd_cb, NULL) != 0) {
+            close(fd);
+            return ;
         }
-        SLIST_FOREACH_DATA(priv->event_list, data, vthread_event_data_t *) {
-            if (data != NULL && data->callback != NULL) {
-                if ((data->event & VTE_FD_READ) != 0 && FD_ISSET(data->ev.fd, &readfds)) {
-                    ret = data->callback(vthread, VTE_FD_READ, VTE_DATA_FD(data->ev.fd),
-                                            data->callback_data);
-                    if (ret < 0)
-                        priv->state |= VTS_EXIT_REQUESTED;
-                }
-                if ((data->event & VTE_FD_WRITE) != 0 && FD_ISSET(data->ev.fd, &writefds)) {
-                    ret = data->callback(vthread, VTE_FD_WRITE, VTE_DATA_FD(data->ev.fd),
-                                            data->callback_data);
-                    if (ret < 0)
-                        priv->state |= VTS_EXIT_REQUESTED;
-                }
-                if ((data->event & VTE_FD_ERR) != 0 && FD_ISSET(data->ev.fd, &errfds)) {
-                    ret = data->callback(vthread, VTE_FD_ERR, VTE_DATA_FD(data->ev.fd),
-                                            data->callback_data);
-                    if (ret < 0)
-                        priv->state |= VTS_EXIT_REQUESTED;
-                }
-            }
+        priv->sigfd = fd;
+    }
+    for (vthread_event_data_t * data = priv->events; data != NULL; data = data->next) {
+        if ((data->event & VTE_SIG) != 0) {
+            sigaddset(&priv->block_sigset, data->ev.sig);
         }
-        /*
-        if (priv->process_end) {
-            ret = priv->process_end(vthread, VTE_PROCESS_END,
-                                    (void *) select_ret, priv->callback_data);
-        }*/
-    } // ! while(running)
+    }
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+}
+#endif
 
-    // shutting down, generate VTE_CLEAN events, set finished state, unlock mutex
-    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
-    pthread_cleanup_pop(0);
+/*****************************************************************************/
+static void vthread_sig_handler(int sig) {
+     s_last_signal = sig;
+}
 
-    vthread_body_cleanup(vthread);
+/*****************************************************************************/
+typedef struct {
+    unsigned int                index;      /* 1 + index of the vthread of fd, 0 if none */
+    unsigned int                nevents;    /* events of fd registered through the group */
+} vthread_group_fd_t;
+
+struct vthread_group_s {
+    pthread_mutex_t             mutex;      /* owners and listeners */
+    vthread_t **                vthreads;
+    unsigned int                nthreads;
+    vthread_group_policy_t      policy;
+    unsigned int                next;       /* atomic: next round robin index */
+    vthread_group_fd_t *        owners;     /* the vthread of each fd */
+    int                         nowners;
+    int *                       listen_fds;
+    unsigned int                nlisten;
+};
 
-    if (vthread->result == VTHREAD_RESULT_ERROR && errno != 0) {
-        errno = 0;
+/*****************************************************************************/
+vthread_group_t *   vthread_group_create(
+                            unsigned int            nthreads,
+                            vthread_group_policy_t  policy,
+                            unsigned long           timeout,
+                            log_t *                 log) {
+    vthread_group_t * group;
+
+    if (nthreads == 0) {
+        nthreads = vjob_cpu_nb();
+    }
+    if ((group = calloc(1, sizeof(*group))) == NULL
+    ||  (group->vthreads = calloc(nthreads, sizeof(*group->vthreads))) == NULL) {
+        LOG_ERROR(log ? log : g_vlib_log, "cannot malloc vthread group: %s", strerror(errno));
+        free(group);
+        return NULL;
+    }
+    pthread_mutex_init(&group->mutex, NULL);
+    group->policy = policy;
+    for (group->nthreads = 0; group->nthreads < nthreads; ++group->nthreads) {
+        if ((group->vthreads[group->nthreads] = vthread_create(timeout, log)) == NULL) {
+            vthread_group_free(group);
+            return NULL;
+        }
     }
+    return group;
+}
 
-    return vthread->result;
+/*****************************************************************************/
+int                 vthread_group_start(
+                            vthread_group_t *       group) {
+    if (group == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    for (unsigned int i = 0; i < group->nthreads; ++i) {
+        if (vthread_start(group->vthreads[i]) != 0) {
+            return -1;
+        }
+    }
+    return 0;
 }
 
 /*****************************************************************************/
-static int                      vthread_closefd(
-                                    vthread_t *             vthread,
-                                    vthread_event_t         event,
-                                    void *                      event_data,
-                                    void *                      callback_user_data) {
-    int fd = (int)((long) callback_user_data);
-    (void) vthread;
-    (void) event;
-    (void) event_data;
+void                vthread_group_free(
+                            vthread_group_t *       group) {
+    if (group == NULL) {
+        return ;
+    }
+    /* all vthreads are stopped before freeing one, as they can post to each other */
+    for (unsigned int i = 0; i < group->nthreads; ++i) {
+        vthread_exit_request(group->vthreads[i]);
+    }
+    for (unsigned int i = 0; i < group->nthreads; ++i) {
+        vthread_join(group->vthreads[i]);
+    }
+    for (unsigned int i = 0; i < group->nthreads; ++i) {
+        vthread_ctx_destroy(group->vthreads[i]);
+    }
+    for (unsigned int i = 0; i < group->nlisten; ++i) {
+        close(group->listen_fds[i]);
+    }
+    pthread_mutex_destroy(&group->mutex);
+    free(group->listen_fds);
+    free(group->owners);
+    free(group->vthreads);
+    free(group);
+}
 
-    return close(fd);
+/*****************************************************************************/
+unsigned int        vthread_group_count(
+                            vthread_group_t *       group) {
+    return group ? group->nthreads : 0;
 }
 
 /*****************************************************************************/
-static void vthread_ctx_destroy(vthread_t * vthread) {
-    if (vthread == NULL)
-        return ;
-    vthread_priv_t  * priv = (vthread_priv_t *) vthread->priv;
-    if (priv) {
-        slist_free(priv->event_list, free);
-        pthread_mutex_destroy(&priv->mutex);
-        pthread_rwlock_destroy(&priv->pipe_mutex);
-        pthread_cond_destroy(&priv->cond);
-        close(priv->control_fd);
-        vthread->priv = NULL;
-        free(priv);
+vthread_t *         vthread_group_get(
+                            vthread_group_t *       group,
+                            unsigned int            index) {
+    if (group == NULL || index >= group->nthreads) {
+        errno = EINVAL;
+        return NULL;
     }
-    free(vthread);
+    return group->vthreads[index];
 }
 
 /*****************************************************************************/
-/** signal the running thread about configuration change
- * must be called under lock */
-static int vthread_notify(vthread_t * vthread) {
-    vthread_priv_t * priv = vthread->priv;
+vthread_t *         vthread_group_self(
+                            vthread_group_t *       group) {
+    pthread_t self = pthread_self();
 
-    if ((priv->state & VTS_RUNNING) != 0) {
-        vthread_control_t id = VTHREAD_CONTROL_NOTIFY;
-        if (vthread_pipe_write(vthread, priv->control_fd, &id, sizeof(id)) != sizeof(id)) {
-            LOG_ERROR(vthread->log, "error: control_fd write: %s", strerror(errno));
-            return -1;
+    for (unsigned int i = 0; group != NULL && i < group->nthreads; ++i) {
+        if (pthread_equal(self, group->vthreads[i]->tid)) {
+            return group->vthreads[i];
         }
     }
-    return 0;
+    return NULL;
 }
 
 /*****************************************************************************/
-static int          vthread_register_event_unlocked(
-                            vthread_t *             vthread,
+/** index of the vthread chosen for fd by the group policy */
+static unsigned int vthread_group_index(vthread_group_t * group, int fd) {
+    unsigned int first, best, best_load = UINT_MAX;
+
+    if (group->policy == VTG_FD_HASH && fd >= 0) {
+        return (unsigned int) fd % group->nthreads;
+    }
+    first = VLIB_ATOMIC_ADD(&group->next, 1) % group->nthreads;
+    if (group->policy != VTG_LEAST_LOADED) {
+        return first;
+    }
+    /* starting at the round robin index spreads vthreads of equal load */
+    best = first;
+    for (unsigned int n = 0, i = first; n < group->nthreads; ++n, i = (i + 1) % group->nthreads) {
+        vthread_priv_t *    priv = group->vthreads[i]->priv;
+        unsigned int        load = VLIB_ATOMIC_LOAD_RELAXED(&priv->load);
+
+        if (load < best_load) {
+            best_load = load;
+            best = i;
+        }
+    }
+    return best;
+}
+
+/*****************************************************************************/
+vthread_t *         vthread_group_pick(
+                            vthread_group_t *       group,
+                            int                     fd) {
+    if (group == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+    return group->vthreads[vthread_group_index(group, fd)];
+}
+
+/*****************************************************************************/
+/** forget one event of fd registered in the vthread index - 1, and the vthread
+ * of fd when it was the last one */
+static void vthread_group_fd_release(vthread_group_t * group, int fd, unsigned int index) {
+    pthread_mutex_lock(&group->mutex);
+    if (fd < group->nowners && group->owners[fd].index == index
+    &&  group->owners[fd].nevents > 0 && --group->owners[fd].nevents == 0) {
+        group->owners[fd].index = 0;
+    }
+    pthread_mutex_unlock(&group->mutex);
+}
+
+/*****************************************************************************/
+vthread_t *         vthread_group_register_event(
+                            vthread_group_t *       group,
                             vthread_event_t         event,
                             void *                  event_data,
                             vthread_callback_t      callback,
                             void *                  callback_user_data) {
-    vthread_priv_t *        priv = vthread->priv;
-    vthread_event_data_t *  ev;
-    slist_t *               new;
-    struct sigaction        sa_bak;
+    int             fd = VTE_FD_DATA(event_data);
+    unsigned int    index;
 
-    if ((ev = malloc(sizeof(vthread_event_data_t))) == NULL) {
-        LOG_ERROR(vthread->log, "error: cannot malloc event_data : %s", strerror(errno));
-        return -1;
+    if (group == NULL || fd < 0 || (event & (VTE_FD_EVENTS | VTE_FD_CLOSE)) == 0
+    ||  (event & ~(VTE_FD_EVENTS | VTE_FD_CLOSE | VTE_ONESHOT)) != 0) {
+        LOG_WARN(g_vlib_log, "bad vthread group, fd or event");
+        errno = EINVAL;
+        return NULL;
     }
-    ev->event = event;
-    ev->callback = callback;
-    ev->callback_data = callback_user_data;
+    pthread_mutex_lock(&group->mutex);
+    if (fd >= group->nowners) {
+        vthread_group_fd_t *    owners;
+        int                     nowners = group->nowners > 0 ? group->nowners : 64;
 
-    if ((event & (VTE_FD_READ | VTE_FD_WRITE | VTE_FD_ERR | VTE_FD_CLOSE)) != 0) {
-        ev->ev.fd = (int)((ssize_t) event_data);
-    } else if ((event & VTE_SIG) != 0) {
-        ev->ev.sig = (int)((ssize_t) event_data);
-    } else {
-        ev->ev.ptr = event_data;
+        while (nowners <= fd) {
+            nowners *= 2;
+        }
+        if ((owners = realloc(group->owners, nowners * sizeof(*owners))) == NULL) {
+            pthread_mutex_unlock(&group->mutex);
+            return NULL;
+        }
+        memset(owners + group->nowners, 0, (nowners - group->nowners) * sizeof(*owners));
+        group->owners = owners;
+        group->nowners = nowners;
     }
+    /* counted before registration, so that fd keeps its vthread meanwhile */
+    if (group->owners[fd].index == 0) {
+        group->owners[fd].index = 1 + vthread_group_index(group, fd);
+    }
+    ++group->owners[fd].nevents;
+    index = group->owners[fd].index - 1;
+    pthread_mutex_unlock(&group->mutex);
 
-    if ((event & VTE_SIG) != 0) {
-        // we could have a global s_SIG_STATE[NSIG] with sa_bak and use_count
-        // with backup in sa_bak and incr of use_count on register.
-        struct sigaction sa;
+    /* not under group lock: callbacks of the vthread can use the group */
+    if (vthread_register_event(group->vthreads[index], event, event_data,
+                               callback, callback_user_data) != 0) {
+        int errno_save = errno;
 
-        if (sigaction(ev->ev.sig, NULL, &sa) == 0 && (sa.sa_flags & SA_SIGINFO) == 0
-        && sa.sa_handler != vthread_sig_handler && sa.sa_handler != SIG_DFL) {
-            LOG_WARN(vthread->log, "warning the signal %d handler is already handled", ev->ev.sig);
-        }
-        sigfillset(&sa.sa_mask);
-        sa.sa_handler = vthread_sig_handler;
-        sa.sa_flags = SA_RESTART;
-        if (sigaction(ev->ev.sig, &sa, &sa_bak) != 0) {
-            LOG_ERROR(vthread->log, "sigaction() error, event %u (%lx): %s",
-                    event, (unsigned long) event_data, strerror(errno));
-            free(ev);
-            return -1;
-        }
-        sigdelset(&priv->block_sigset, ev->ev.sig);
+        /* without events, the fd is given to a vthread again on next registration */
+        vthread_group_fd_release(group, fd, index + 1);
+        errno = errno_save;
+        return NULL;
     }
+    return group->vthreads[index];
+}
 
-    new = slist_prepend(priv->event_list, ev);
-    if (new == priv->event_list) {
-        LOG_ERROR(vthread->log, "error: cannot add event %u (%lx) in event_list : %s",
-                  event, (unsigned long) event_data, strerror(errno));
-        if ((event & VTE_SIG) != 0 && sigaction(ev->ev.sig, &sa_bak, NULL) != 0) {
-            LOG_WARN(vthread->log, "restore sigaction() error, event %u (%lx): %s",
-                     event, (unsigned long) event_data, strerror(errno));
-        }
-        free(ev);
+/*****************************************************************************/
+int                 vthread_group_unregister_event(
+                            vthread_group_t *       group,
+                            vthread_event_t         event,
+                            void *                  event_data) {
+    int             fd = VTE_FD_DATA(event_data);
+    unsigned int    index = 0;
+
+    if (group == NULL || fd < 0) {
+        errno = EINVAL;
         return -1;
     }
-    priv->event_list = new;
+    pthread_mutex_lock(&group->mutex);
+    if (fd < group->nowners) {
+        index = group->owners[fd].index;
+    }
+    pthread_mutex_unlock(&group->mutex);
 
+    if (index == 0) {
+        errno = ENOENT;
+        return -1;
+    }
+    if (vthread_unregister_event(group->vthreads[index - 1], event, event_data) != 0) {
+        return -1;
+    }
+    vthread_group_fd_release(group, fd, index);
     return 0;
 }
 
-/****************************************************************************/
-static int vthread_event_cmp(const void * vev1, const void * vev2) {
-    const vthread_event_data_t * ev1 = (const vthread_event_data_t *) vev1;
-    const vthread_event_data_t * ev2 = (const vthread_event_data_t *) vev2;
+/*****************************************************************************/
+/** create a socket listening on addr, with SO_REUSEPORT if reuseport */
+static int vthread_group_socket(
+                    const struct sockaddr * addr,
+                    socklen_t               addrlen,
+                    int                     backlog,
+                    int                     reuseport) {
+    int fd, one = 1;
+
+    if ((fd = socket(addr->sa_family, SOCK_STREAM, 0)) < 0) {
+        return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+#   ifdef SO_REUSEPORT
+    if (reuseport && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) != 0) {
+        close(fd);
+        return -1;
+    }
+#   else
+    (void) reuseport;
+#   endif
+    if (bind(fd, addr, addrlen) != 0 || listen(fd, backlog) != 0) {
+        int err = errno;
 
-    if (!ev1 || !ev2)
-        return ev1 - ev2;
-    if (ev1->event != ev2->event)
-        return ev1->event - ev2->event;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    return fd;
+}
 
-    if ((ev1->event & (VTE_FD_READ | VTE_FD_WRITE | VTE_FD_ERR | VTE_FD_CLOSE)) != 0) {
-        return ev1->ev.fd - ev2->ev.fd;
-    } else if ((ev1->event & VTE_SIG) != 0) {
-        return ev1->ev.sig - ev2->ev.sig;
+/*****************************************************************************/
+int                 vthread_group_listen(
+                            vthread_group_t *       group,
+                            const struct sockaddr * addr,
+                            socklen_t               addrlen,
+                            int                     backlog,
+                            vthread_callback_t      callback,
+                            void *                  callback_user_data) {
+    struct sockaddr_storage bound;
+    socklen_t               boundlen = sizeof(bound);
+    unsigned int            nsockets = 1, i;
+    int *                   fds;
+    int                     fd, errno_save;
+
+    if (group == NULL || addr == NULL || callback == NULL || addrlen > sizeof(bound)) {
+        errno = EINVAL;
+        return -1;
     }
-    return (char*)ev1->ev.ptr - (char*)ev2->ev.ptr;
+    /* the first socket tells whether SO_REUSEPORT works, and chooses port 0 */
+    if ((fd = vthread_group_socket(addr, addrlen, backlog, group->nthreads > 1)) >= 0) {
+        nsockets = group->nthreads;
+    } else if ((fd = vthread_group_socket(addr, addrlen, backlog, 0)) < 0) {
+        LOG_ERROR(group->vthreads[0]->log, "cannot listen: %s", strerror(errno));
+        return -1;
+    }
+    if (getsockname(fd, (struct sockaddr *) &bound, &boundlen) != 0) {
+        memcpy(&bound, addr, boundlen = addrlen);
+    }
+    if ((fds = malloc(nsockets * sizeof(*fds))) == NULL) {
+        close(fd);
+        return -1;
+    }
+    /* not under group lock: vthread_io_*() take the vthread lock, under which
+     * callbacks can use the group */
+    for (i = 0; i < nsockets; ++i) {
+        if (i > 0 && (fd = vthread_group_socket((struct sockaddr *) &bound, boundlen,
+                                                backlog, 1)) < 0) {
+            LOG_ERROR(group->vthreads[i]->log, "cannot listen: %s", strerror(errno));
+            break ;
+        }
+        if (vthread_io_accept(group->vthreads[i], fd, callback, callback_user_data) != 0) {
+            errno_save = errno;
+            close(fd);
+            errno = errno_save;
+            break ;
+        }
+        fds[i] = fd;
+    }
+    if (i == nsockets) {
+        int * listen_fds;
+
+        pthread_mutex_lock(&group->mutex);
+        if ((listen_fds = realloc(group->listen_fds,
+                                  (group->nlisten + nsockets) * sizeof(*listen_fds))) != NULL) {
+            group->listen_fds = listen_fds;
+            memcpy(listen_fds + group->nlisten, fds, nsockets * sizeof(*fds));
+            group->nlisten += nsockets;
+        }
+        pthread_mutex_unlock(&group->mutex);
+        if (listen_fds != NULL) {
+            free(fds);
+            return 0;
+        }
+    }
+    /* all or nothing: the listeners created here are removed */
+    errno_save = errno;
+    while (i > 0) {
+        --i;
+        vthread_io_cancel(group->vthreads[i], fds[i]);
+        close(fds[i]);
+    }
+    free(fds);
+    errno = errno_save;
+    return -1;
 }
 
 /*****************************************************************************/
-static void vthread_sig_handler(int sig) {
-     s_last_signal = sig;
+int                 vthread_group_post(
+                            vthread_group_t *       group,
+                            int                     index,
+                            vthread_callback_t      callback,
+                            void *                  msg,
+                            void *                  callback_user_data) {
+    if (group == NULL || index >= (int) group->nthreads) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (index < 0) {
+        index = vthread_group_index(group, -1);
+    }
+    return vthread_post(group->vthreads[index], callback, msg, callback_user_data);
 }
 
 /*****************************************************************************/
@@ -0,0 +1,320 @@
+/*
+ * Copyright (C) 2026 Vincent Sallaberry
+ * vlib <https://github.com/vsallaberry/vlib>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+/* ------------------------------------------------------------------------
+ * Simple unrolled list.
+ * Elements of a chunk are contiguous in range [start, start + count[,
+ * appending fills chunks forward, prepending fills them backward.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "vlib/ulist.h"
+
+/*****************************************************************************/
+
+struct ulist_chunk_s {
+    ulist_chunk_t *     next;
+    unsigned int        start;
+    unsigned int        count;
+};
+
+/* keep elements aligned as returned by malloc() */
+#define ULIST_ALIGN             (2 * sizeof(void *))
+#define ULIST_CHUNK_HDR_SZ      ((sizeof(ulist_chunk_t) + ULIST_ALIGN - 1) & ~(ULIST_ALIGN - 1))
+#define ULIST_CHUNK_BASE(c)     ((char *) (c) + ULIST_CHUNK_HDR_SZ)
+#define ULIST_CHUNK_ELT(l, c, i) (ULIST_CHUNK_BASE(c) + (size_t) (i) * (l)->elt_size)
+
+/*****************************************************************************/
+static ulist_chunk_t * ulist_chunk_new(
+                    ulist_t *       list,
+                    unsigned int    start) {
+    ulist_chunk_t * chunk;
+
+    if ((chunk = malloc(ULIST_CHUNK_HDR_SZ + list->chunk_elts * list->elt_size)) == NULL) {
+        return NULL;
+    }
+    chunk->next = NULL;
+    chunk->start = start;
+    chunk->count = 0;
+    return chunk;
+}
+/*****************************************************************************/
+int             ulist_init(
+                    ulist_t *       list,
+                    size_t          elt_size,
+                    unsigned int    chunk_elts) {
+    if (list == NULL || elt_size == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (chunk_elts == 0) {
+        chunk_elts = (VLIB_ULIST_CHUNK_SZ - ULIST_CHUNK_HDR_SZ) / elt_size;
+        if (chunk_elts < 4) {
+            chunk_elts = 4;
+        }
+    }
+    list->head = list->tail = NULL;
+    list->count = 0;
+    list->elt_size = elt_size;
+    list->chunk_elts = chunk_elts;
+    return 0;
+}
+/*****************************************************************************/
+ulist_t *       ulist_create(
+                    size_t          elt_size,
+                    unsigned int    chunk_elts) {
+    ulist_t * list;
+
+    if ((list = malloc(sizeof(*list))) == NULL) {
+        return NULL;
+    }
+    if (ulist_init(list, elt_size, chunk_elts) != 0) {
+        free(list);
+        return NULL;
+    }
+    return list;
+}
+/*****************************************************************************/
+void            ulist_clear(
+                    ulist_t *       list,
+                    ulist_free_fun_t freefun) {
+    ulist_chunk_t * chunk, * tofree;
+    unsigned int    i;
+
+    if (list == NULL) {
+        return ;
+    }
+    for (chunk = list->head; chunk != NULL; ) {
+        if (freefun != NULL) {
+            for (i = chunk->start; i < chunk->start + chunk->count; ++i) {
+                freefun(ULIST_CHUNK_ELT(list, chunk, i));
+            }
+        }
+        tofree = chunk;
+        chunk = chunk->next;
+        free(tofree);
+    }
+    list->head = list->tail = NULL;
+    list->count = 0;
+}
+/*****************************************************************************/
+void            ulist_free(
+                    ulist_t *       list,
+                    ulist_free_fun_t freefun) {
+    if (list == NULL) {
+        return ;
+    }
+    ulist_clear(list, freefun);
+    free(list);
+}
+/*****************************************************************************/
+size_t          ulist_length(
+                    const ulist_t * list) {
+    if (list == NULL) {
+        errno = EINVAL;
+        return 0;
+    }
+    return list->count;
+}
+/*****************************************************************************/
+void *          ulist_append(
+                    ulist_t *       list,
+                    const void *    data) {
+    ulist_chunk_t * chunk;
+    void *          elt;
+
+    if (list == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if ((chunk = list->tail) == NULL
+    ||  chunk->start + chunk->count >= list->chunk_elts) {
+        if ((chunk = ulist_chunk_new(list, 0)) == NULL) {
+            return NULL;
+        }
+        if (list->tail == NULL) {
+            list->head = chunk;
+        } else {
+            list->tail->next = chunk;
+        }
+        list->tail = chunk;
+    }
+    elt = ULIST_CHUNK_ELT(list, chunk, chunk->start + chunk->count);
+    if (data != NULL) {
+        memcpy(elt, data, list->elt_size);
+    }
+    ++chunk->count;
+    ++list->count;
+    return elt;
+}
+/*****************************************************************************/
+void *          ulist_prepend(
+                    ulist_t *       list,
+                    const void *    data) {
+    ulist_chunk_t * chunk;
+    void *          elt;
+
+    if (list == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if ((chunk = list->head) == NULL || chunk->start == 0) {
+        if ((chunk = ulist_chunk_new(list, list->chunk_elts)) == NULL) {
+            return NULL;
+        }
+        chunk->next = list->head;
+        list->head = chunk;
+        if (list->tail == NULL) {
+            list->tail = chunk;
+        }
+    }
+    elt = ULIST_CHUNK_ELT(list, chunk, --chunk->start);
+    if (data != NULL) {
+        memcpy(elt, data, list->elt_size);
+    }
+    ++chunk->count;
+    ++list->count;
+    return elt;
+}
+/*****************************************************************************/
+void *          ulist_first(
+                    const ulist_t * list) {
+    if (list == NULL || list->head == NULL) {
+        return NULL;
+    }
+    return ULIST_CHUNK_ELT(list, list->head, list->head->start);
+}
+/*****************************************************************************/
+void *          ulist_last(
+                    const ulist_t * list) {
+    if (list == NULL || list->tail == NULL) {
+        return NULL;
+    }
+    return ULIST_CHUNK_ELT(list, list->tail, list->tail->start + list->tail->count - 1);
+}
+/*****************************************************************************/
+static void     ulist_chunk_unlink(
+                    ulist_t *       list,
+                    ulist_chunk_t * chunk,
+                    ulist_chunk_t * prev) {
+    if (prev == NULL) {
+        list->head = chunk->next;
+    } else {
+        prev->next = chunk->next;
+    }
+    if (list->tail == chunk) {
+        list->tail = prev;
+    }
+    free(chunk);
+}
+/*****************************************************************************/
+int             ulist_pop_first(
+                    ulist_t *       list,
+                    void *          out) {
+    ulist_chunk_t * chunk;
+
+    if (list == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    if ((chunk = list->head) == NULL) {
+        errno = ENOENT;
+        return -1;
+    }
+    if (out != NULL) {
+        memcpy(out, ULIST_CHUNK_ELT(list, chunk, chunk->start), list->elt_size);
+    }
+    ++chunk->start;
+    --list->count;
+    if (--chunk->count == 0) {
+        ulist_chunk_unlink(list, chunk, NULL);
+    }
+    return 0;
+}
+/*****************************************************************************/
+static inline void ulist_iter_setchunk(
+                    ulist_iter_t *  it,
+                    ulist_chunk_t * chunk) {
+    it->chunk = chunk;
+    if (chunk != NULL) {
+        it->base = ULIST_CHUNK_BASE(chunk);
+        it->idx = chunk->start;
+        it->end = chunk->start + chunk->count;
+    }
+}
+/*****************************************************************************/
+ulist_iter_t    ulist_iter_first(
+                    ulist_t *       list) {
+    ulist_iter_t it;
+
+    it.list = list;
+    it.chunk = it.prev = NULL;
+    it.base = NULL;
+    it.idx = it.end = 0;
+    it.removed = it.done = 0;
+    if (list != NULL) {
+        ulist_iter_setchunk(&it, list->head);
+    }
+    return it;
+}
+/*****************************************************************************/
+void            ulist_iter_nextchunk(
+                    ulist_iter_t *  it) {
+    if (it == NULL || it->chunk == NULL) {
+        return ;
+    }
+    it->prev = it->chunk;
+    ulist_iter_setchunk(it, it->chunk->next);
+}
+/*****************************************************************************/
+int             ulist_iter_remove(
+                    ulist_iter_t *  it) {
+    ulist_t *       list;
+    ulist_chunk_t * chunk;
+
+    if (it == NULL || it->list == NULL || (chunk = it->chunk) == NULL || it->removed) {
+        errno = EINVAL;
+        return -1;
+    }
+    list = it->list;
+    --list->count;
+    if (--chunk->count == 0) {
+        ulist_chunk_t * next = chunk->next;
+        ulist_chunk_unlink(list, chunk, it->prev);
+        ulist_iter_setchunk(it, next);
+    } else if (it->idx == chunk->start) {
+        /* first element: no move needed */
+        it->idx = ++chunk->start;
+        if (it->idx >= it->end) {
+            ulist_iter_nextchunk(it);
+        }
+    } else {
+        memmove(ULIST_CHUNK_ELT(list, chunk, it->idx),
+                ULIST_CHUNK_ELT(list, chunk, it->idx + 1),
+                (size_t) (it->end - it->idx - 1) * list->elt_size);
+        if (it->idx >= --it->end) {
+            ulist_iter_nextchunk(it);
+        }
+    }
+    it->removed = 1;
+    return 0;
+}
+/*****************************************************************************/
+
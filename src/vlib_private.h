@@ -32,6 +32,14 @@ extern "C" {
 extern log_t *          g_vlib_log;
 extern logpool_t *      g_vlib_logpool;
 
+/** log.c: write the lines queued on an asynchronous log file, and make
+ * it synchronous if stop is not 0.
+ * @return 0 on success, -1 if file is not asynchronous */
+int                     log_async_file_flush(FILE * file, int stop);
+
+/** get the generation of the terminal, changed by vterm_init() and vterm_free() */
+unsigned int            vterm_generation();
+
 #ifdef __cplusplus
 }
 #endif